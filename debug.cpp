@@ -11,6 +11,11 @@
 #include <engine/engine.cpp>
 
 #include <bonsai_debug/debug_data_system.cpp>
+#include <bonsai_debug/debug_trace_writer.cpp>
+#include <bonsai_debug/debug_perfetto.cpp>
+#include <bonsai_debug/debug_capture.cpp>
+#include <bonsai_debug/debug_baseline.cpp>
+#include <bonsai_debug/debug_trace_export.cpp>
 #include <bonsai_debug/debug_render_system.cpp>
 
 #if BONSAI_WIN32
@@ -84,8 +89,75 @@ DebugFrameEnd(v2 *MouseP, v2 *MouseDP, v2 ScreenDim, input *Input, r32 dt, picke
         TotalDrawCalls
       ));
     EndColumn(UiGroup);
+  PushNewRow(UiGroup);
+    StartColumn(UiGroup, &Style, Padding);
+      u32 ProfiledScopes = 0;
+      u32 ProfiledAllocations = 0;
+      u64 ProfilerCycles = GetProfilerOverheadCycles(DebugState, &ProfiledScopes, &ProfiledAllocations);
+
+      frame_stats *ReadFrame = DebugState->Frames + DebugState->ReadScopeIndex;
+      r64 MsPerCycle = ReadFrame->NsPerCycle / 1000000.0;
+
+      Text(UiGroup, FormatCountedString(TranArena, CS("Profiler %.2fms :: Scopes(%u) x %lucy Allocations(%u) x %lucy rdtsc %lucy"),
+        r64(ProfilerCycles)*MsPerCycle,
+        ProfiledScopes,
+        DebugState->Overhead.ScopeCycles,
+        ProfiledAllocations,
+        DebugState->Overhead.AllocationCycles,
+        DebugState->Overhead.RdtscCycles
+      ));
+    EndColumn(UiGroup);
+  PushNewRow(UiGroup);
+    StartColumn(UiGroup, &Style, Padding);
+      debug_frame_counters *Counters = &ReadFrame->Counters;
+      Text(UiGroup, FormatCountedString(TranArena, CS("Counters :: Scopes(%u) Events(%u) MutexOps(%u) Allocations(%u) CSwitches(%u) Dropped(%u)"),
+        Counters->Scopes,
+        Counters->ScopeEvents,
+        Counters->MutexOps,
+        Counters->Allocations,
+        Counters->ContextSwitches,
+        Counters->Dropped
+      ));
+    EndColumn(UiGroup);
+
+  debug_trace_writer *TraceWriter = DebugState->TraceWriter;
+  if (TraceWriter && TraceWriter->Running)
+  {
+    PushNewRow(UiGroup);
+      StartColumn(UiGroup, &Style, Padding);
+        Text(UiGroup, FormatCountedString(TranArena, CS("Trace :: %.2fMB Frames(%u) Queued(%u) Dropped(%u) Lost events(%lu) Unsealed(%u) Mutex frames lost(%u) CSwitches dropped(%u) Write errors(%u)"),
+          r64(TraceWriter->BytesWritten) / r64(Megabytes(1)),
+          TraceWriter->FramesWritten,
+          TraceWriter->FrameWriteAt - TraceWriter->FrameReadAt,
+          TraceWriter->FramesDropped,
+          TraceWriter->EventsLost,
+          TraceWriter->ThreadFramesUnsealed,
+          TraceWriter->MutexFramesLost,
+          TraceWriter->ContextSwitchesDropped,
+          TraceWriter->WriteErrors
+        ));
+      EndColumn(UiGroup);
+  }
+
+  debug_flight_recorder *Recorder = &DebugState->FlightRecorder;
+  if (Recorder->Pending || Recorder->CapturesWritten || Recorder->TriggersIgnored)
+  {
+    PushNewRow(UiGroup);
+      StartColumn(UiGroup, &Style, Padding);
+        Text(UiGroup, FormatCountedString(TranArena, CS("Capture :: %s Written(%u) Ignored(%u) Frames dropped(%u) Lost events(%lu) Last(%s)"),
+          Recorder->Pending ? Recorder->Reason : "idle",
+          Recorder->CapturesWritten,
+          Recorder->TriggersIgnored,
+          Recorder->FramesDropped,
+          Recorder->Writer ? (u64)Recorder->Writer->EventsLost : (u64)0,
+          Recorder->LastCapturePath
+        ));
+      EndColumn(UiGroup);
+  }
   PushTableEnd(UiGroup);
-  
+
+  PushFramePercentiles(UiGroup, DebugState, "StatusBarFramePercentileInteraction");
+
   END_BLOCK("Draw Status Bar");
 
   if (DebugState->DisplayDebugMenu)
@@ -155,6 +227,41 @@ DebugFrameEnd(v2 *MouseP, v2 *MouseDP, v2 ScreenDim, input *Input, r32 dt, picke
       }
     }
 
+    {
+      ui_style *Style = (DebugState->UIType & DebugUIType_BudgetViolations) ? &DefaultSelectedStyle : &DefaultStyle;
+      if (Button(UiGroup, CS("Budgets"), (umm)"Budgets", Style, Padding))
+      {
+        ToggleBitfieldValue(DebugState->UIType, DebugUIType_BudgetViolations);
+      }
+    }
+
+    {
+      ui_style *Style = (DebugState->UIType & DebugUIType_Percentiles) ? &DefaultSelectedStyle : &DefaultStyle;
+      if (Button(UiGroup, CS("Percentiles"), (umm)"Percentiles", Style, Padding))
+      {
+        ToggleBitfieldValue(DebugState->UIType, DebugUIType_Percentiles);
+      }
+    }
+
+    {
+      ui_style *Style = (DebugState->UIType & DebugUIType_Capture) ? &DefaultSelectedStyle : &DefaultStyle;
+      if (Button(UiGroup, CS("Capture"), (umm)"Capture", Style, Padding))
+      {
+        ToggleBitfieldValue(DebugState->UIType, DebugUIType_Capture);
+      }
+    }
+
+    {
+      // NOTE(Jesse): Cycles through the modes; the TSC ones only if we trust it
+      debug_timestamps *Timestamps = &DebugState->Timestamps;
+      if (Button(UiGroup, FormatCountedString(TranArena, CSz("Timestamps (%S)"), Global_TimestampModeNames[Timestamps->RequestedMode]), (umm)"Timestamps", &DefaultStyle, Padding))
+      {
+        u32 NextMode = (Timestamps->RequestedMode + 1) % TimestampMode_Count;
+        if (!Timestamps->TscReliable) { NextMode = TimestampMode_Clock; }
+        Timestamps->RequestedMode = NextMode;
+      }
+    }
+
     PushTableEnd(UiGroup);
 
 
@@ -195,6 +302,21 @@ DebugFrameEnd(v2 *MouseP, v2 *MouseDP, v2 ScreenDim, input *Input, r32 dt, picke
       DebugDrawDrawCalls(UiGroup);
     }
 
+    if (DebugState->UIType & DebugUIType_BudgetViolations)
+    {
+      DebugDrawBudgetViolations(UiGroup, DebugState);
+    }
+
+    if (DebugState->UIType & DebugUIType_Percentiles)
+    {
+      DebugDrawPercentiles(UiGroup, DebugState);
+    }
+
+    if (DebugState->UIType & DebugUIType_Capture)
+    {
+      DebugDrawCapture(UiGroup, DebugState);
+    }
+
     END_BLOCK("Draw Debug Menu");
   }
 
@@ -254,7 +376,7 @@ DebugFrameBegin(b32 ToggleMenu, b32 ToggleProfiling)
 
   if (ToggleProfiling)
   {
-    State->DebugDoScopeProfiling = !State->DebugDoScopeProfiling;
+    SetScopeProfilingEnabled(State, !State->DebugDoScopeProfiling);
   }
 
   /* DebugLine("State->UiGroup.NumMinimizedWindowsDrawn (%u)", State->UiGroup.NumMinimizedWindowsDrawn ); */
@@ -324,6 +446,14 @@ BonsaiDebug_OnLoad(debug_state *DebugState, thread_local_state *ThreadStates)
 
   SetThreadLocal_ThreadIndex(0);
 
+  // NOTE(Jesse): On the first load the rings don't exist yet; InitDebugState
+  // publishes the main thread's.  On a reload our thread_locals start out
+  // zeroed so put the main thread's cursor back.
+  if (DebugState->ThreadStates)
+  {
+    ThreadLocal_ScopeEvents = DebugState->ThreadStates[0].ScopeEvents;
+  }
+
   DebugState->ClearFramebuffers               = ClearFramebuffers;
   DebugState->FrameEnd                        = DebugFrameEnd;
   DebugState->FrameBegin                      = DebugFrameBegin;
@@ -334,7 +464,6 @@ BonsaiDebug_OnLoad(debug_state *DebugState, thread_local_state *ThreadStates)
   DebugState->MutexWait                       = MutexWait;
   DebugState->MutexAquired                    = MutexAquired;
   DebugState->MutexReleased                   = MutexReleased;
-  DebugState->GetProfileScope                 = GetProfileScope;
   DebugState->Debug_Allocate                  = DEBUG_Allocate;
   DebugState->RegisterThread                  = RegisterThread;
   DebugState->TrackDrawCall                   = TrackDrawCall;
@@ -345,6 +474,22 @@ BonsaiDebug_OnLoad(debug_state *DebugState, thread_local_state *ThreadStates)
   DebugState->DumpScopeTreeDataToConsole      = DumpScopeTreeDataToConsole;
   DebugState->GetReadScopeTree                = GetReadScopeTree;
   DebugState->GetWriteScopeTree               = GetWriteScopeTree;
+  DebugState->GetWriteScopeEvents             = GetWriteScopeEvents;
+  DebugState->RegisterScopeCallsite           = RegisterScopeCallsite;
+  DebugState->RecordBudgetViolation           = RecordBudgetViolation;
+  DebugState->RecordFlowEvent                 = RecordFlowEvent;
+  DebugState->StartTraceCapture               = StartTraceCapture;
+  DebugState->StartPerfettoCapture            = StartPerfettoCapture;
+  DebugState->StopTraceCapture                = StopTraceCapture;
+  DebugState->RequestCapture                  = RequestCapture;
+  DebugState->SetCaptureTriggers              = SetCaptureTriggers;
+  DebugState->InstallCrashHandlers            = InstallCrashHandlers;
+  DebugState->SaveBaseline                    = SaveBaseline;
+  DebugState->CompareToBaseline               = CompareToBaseline;
+  DebugState->SetBaselineThresholds           = SetBaselineThresholds;
+  DebugState->ExportChromeTrace               = ExportChromeTrace;
+  DebugState->ExportFlameGraph                = ExportFlameGraph;
+  DebugState->OpenCaptureFile                 = OpenCaptureFile;
 
   DebugState->WriteMemoryRecord               = WriteMemoryRecord;
   DebugState->ClearMemoryRecordsFor           = ClearMemoryRecordsFor;
@@ -352,6 +497,22 @@ BonsaiDebug_OnLoad(debug_state *DebugState, thread_local_state *ThreadStates)
   DebugState->OpenAndInitializeDebugWindow    = OpenAndInitializeDebugWindow;
   DebugState->ProcessInputAndRedrawWindow     = ProcessInputAndRedrawWindow;
   DebugState->InitializeRenderSystem          = InitDebugRenderSystem;
+
+  // NOTE(Jesse): The handlers point into the lib; the old one took its own
+  // out in BonsaiDebug_OnUnload.
+  if (DebugState->FlightRecorder.HandlersInstalled)
+  {
+    InstallCaptureSignalHandlers(DebugState);
+  }
+}
+
+link_export void
+BonsaiDebug_OnUnload(debug_state *DebugState)
+{
+  if (DebugState->FlightRecorder.HandlersInstalled)
+  {
+    UninstallCaptureSignalHandlers(DebugState);
+  }
 }
 
 link_export b32
@@ -364,13 +525,17 @@ InitDebugState(debug_state *DebugState, u64 AllocationSize)
 
   LastMs = GetHighPrecisionClock();
 
-  DebugState->Frames[1].StartingCycle = GetCycleCount();
-
   DebugState->Initialized = True;
 
   Global_DebugStatePointer = DebugState;
 
   InitDebugDataSystem(DebugState);
+  CalibrateTimestamps(DebugState);
+
+  DebugState->BaselineThresholds = Global_DefaultBaselineThresholds;
+
+  DebugState->Frames[1].StartingCycle = GetDebugTimestamp(DebugState);
+  DebugState->Frames[1].NsPerCycle = GetNsPerCycle(&DebugState->Timestamps, DebugState->Timestamps.Mode);
 
   DEBUG_REGISTER_NAMED_ARENA(TranArena, 0, "debug_lib TranArena");
 
@@ -378,7 +543,8 @@ InitDebugState(debug_state *DebugState, u64 AllocationSize)
   Platform_EnableContextSwitchTracing();
 #endif
 
-  DebugState->DebugDoScopeProfiling = True;
+  SetScopeProfilingEnabled(DebugState, True);
+  CalibrateProfilerOverhead(DebugState);
 
   b32 Result = True;
   return Result;
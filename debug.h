@@ -48,7 +48,7 @@ typedef b32 (*meta_comparator)(memory_record*, memory_record*);
 
 struct called_function
 {
-  const char* Name;
+  u16 CallsiteId;
   u32 CallCount;
 };
 
@@ -84,7 +84,9 @@ poof(are_equal(memory_arena_stats))
 #include <generated/are_equal_memory_arena_stats.h>
 
 struct debug_profile_scope;
+struct debug_profile_scope_block;
 struct debug_scope_tree;
+struct debug_scope_event_ring;
 
 enum debug_context_switch_type
 {
@@ -128,6 +130,8 @@ struct debug_context_switch_event_buffer_stream
   debug_context_switch_event_buffer_stream_block *CurrentBlock;
 
   debug_context_switch_event_buffer_stream_block *FirstFreeBlock;
+
+  u64 Ingested; // Running total, written by whoever pushes (see win32_etw.cpp)
 };
 
 
@@ -157,6 +161,138 @@ GetLatest(debug_context_switch_event_buffer_stream *Stream)
 }
 
 
+struct debug_budget_violation
+{
+  u32 FrameId;
+  u16 CallsiteId;
+  u16 ThreadIndex;
+  u64 DurationNs;
+  u64 OverrunNs;
+};
+
+// NOTE(Jesse): Single producer (the owning thread), single consumer (the main
+// thread, in MainThreadAdvanceDebugSystem).  When it's full new violations
+// get counted and dropped.
+#define DEBUG_BUDGET_VIOLATIONS_PER_THREAD (256)
+struct debug_budget_violation_ring
+{
+  volatile u32 WriteAt;
+  volatile u32 ReadAt;
+  volatile u32 Dropped;
+
+  debug_budget_violation Violations[DEBUG_BUDGET_VIOLATIONS_PER_THREAD];
+};
+
+// NOTE(Jesse): Session totals, per callsite
+struct debug_callsite_budget_stats
+{
+  u32 Violations;
+  u32 LastFrameId;
+  u32 LastThreadIndex;
+  u64 WorstOverrunNs;
+  u64 TotalOverrunNs;
+};
+
+#define DEBUG_RECENT_BUDGET_VIOLATIONS (64)
+
+struct debug_flow_event
+{
+  u64 Id;
+  u64 Cycle;
+  u32 FrameId;
+  u16 ThreadIndex;
+  u16 Type; // debug_flow_event_type
+};
+
+// NOTE(Jesse): Same deal as debug_budget_violation_ring; the owning thread
+// writes, the main thread drains it every frame.
+#define DEBUG_FLOW_EVENTS_PER_THREAD (4096)
+struct debug_flow_event_ring
+{
+  volatile u32 WriteAt;
+  volatile u32 ReadAt;
+  volatile u32 Dropped;
+
+  debug_flow_event Events[DEBUG_FLOW_EVENTS_PER_THREAD];
+};
+
+// NOTE(Jesse): One side of a flow that's waiting for the other one to show
+// up.  Usually a Begin waiting on its End, but the rings get drained one
+// thread at a time so an End can get here first.
+struct debug_pending_flow
+{
+  debug_flow_event Event;
+  u32 CollectedFrameId;
+  b32 Used;
+};
+
+// NOTE(Jesse): Open addressed, linear probing.  Entries older than
+// FramesTracked frames are assumed to never complete and get evicted.
+#define DEBUG_PENDING_FLOWS_BITS (12)
+#define DEBUG_PENDING_FLOWS (1u << DEBUG_PENDING_FLOWS_BITS)
+#define DEBUG_PENDING_FLOWS_MAX_LOAD (DEBUG_PENDING_FLOWS - DEBUG_PENDING_FLOWS/4)
+
+struct debug_flow_link
+{
+  u64 Id;
+  u64 BeginCycle;
+  u64 EndCycle;
+  u16 BeginThreadIndex;
+  u16 EndThreadIndex;
+  u32 CompletedFrameId; // Main thread frame the End got matched in
+};
+
+#define DEBUG_RECENT_FLOW_LINKS (1024)
+
+// NOTE(Jesse): Queued -> started latencies of the flows that completed in a
+// frame.  Bucket N counts latencies in [2^N, 2^(N+1)) nanoseconds.
+#define DEBUG_FLOW_LATENCY_BUCKETS (32)
+struct debug_flow_latency_histogram
+{
+  u32 Counts[DEBUG_FLOW_LATENCY_BUCKETS];
+  u32 Total;
+  u64 MaxNs;
+};
+
+// NOTE(Jesse): What BuildScopeTree does once a thread has used up its
+// ProfileScopeBudget worth of debug_profile_scopes.
+enum debug_scope_overflow_policy
+{
+  ScopeOverflow_Drop,        // Stop building; the rest of the frame is missing
+  ScopeOverflow_Collapse,    // Free the children of already closed scopes in the frame being built
+  ScopeOverflow_StealOldest, // Free the oldest other frame this thread has built
+
+  ScopeOverflow_Count,
+};
+
+#define DEBUG_PROFILE_SCOPE_BUDGET_DEFAULT (Megabytes(32)) // Per thread
+
+// NOTE(Jesse): Running totals, only ever written by the thread they belong
+// to, on a line of their own.  The main thread reads them once a frame and
+// turns them into a debug_frame_counters (see CollectThreadCounters).  Reads
+// of an aligned u64 don't tear on x64, which is all we need here.
+struct debug_thread_counters
+{
+  u64 Scopes;      // Timed scopes entered, including the ones sampled out
+  u64 ScopeEvents; // Written to the ScopeEvents ring
+  u64 MutexOps;
+  u64 Allocations; // Recorded through WriteMemoryRecord
+  u64 Dropped;     // Mutex ops, budget violations and flow events that didn't fit
+
+  u64 Pad[3];
+};
+CAssert(sizeof(debug_thread_counters) == CACHE_LINE_SIZE);
+
+struct debug_frame_counters
+{
+  u32 Scopes;
+  u32 ScopeEvents;
+  u32 MutexOps;
+  u32 Allocations;
+  u32 ContextSwitches; // Ingested from ETW, for every thread
+  u32 Dropped;
+};
+
 struct debug_thread_state
 {
   memory_arena *Memory;
@@ -164,7 +300,7 @@ struct debug_thread_state
   memory_record *MetaTable;
 
   debug_scope_tree *ScopeTrees;
-  debug_profile_scope *FirstFreeScope;
+  debug_profile_scope_block *FirstFreeBlock;
 
   mutex_op_array *MutexOps;
 
@@ -185,16 +321,78 @@ struct debug_thread_state
 #else
   /* u8 Pad[12]; */
 #endif
+
+  // NOTE(Jesse): Everything above is read from other threads, so the members
+  // below here go on their own cache line.  The event ring itself is written
+  // on every scope push/pop and is allocated on its own line as well.
+  debug_scope_event_ring *ScopeEvents;
+
+  // NOTE(Jesse): ScopeEvents->CallCounts as of the last time we advanced,
+  // for turning the running counts into per-frame ones.
+  u32 *ReportedCallCounts;
+
+  debug_budget_violation_ring *BudgetViolations;
+  debug_flow_event_ring *FlowEvents;
+
+  // NOTE(Jesse): debug_profile_scope_blocks owned by one of the ScopeTrees.
+  // Main thread only.
+  u32 LiveBlockCount;
+  u32 PeakBlockCount;
+
+#if EMCC
+  u8 Pad1[40];
+#else
+  u8 Pad1[24];
+#endif
+
+  debug_thread_counters Counters;
+};
+CAssert(sizeof(debug_thread_state) == 3*CACHE_LINE_SIZE);
+
+// NOTE(Jesse): Bounds on debug_state::ScopeEventsPerThread; the max is 4GB
+// of events per thread.
+#define DEBUG_SCOPE_EVENTS_PER_THREAD_MIN (1u << 16)
+#define DEBUG_SCOPE_EVENTS_PER_THREAD_MAX (1u << 28)
+
+#define DEBUG_SAMPLING_UPDATE_INTERVAL   (32)   // frames
+#define DEBUG_SAMPLING_MAX_CALLS_PER_FRAME (4096) // per callsite, summed over threads
+#define DEBUG_SAMPLING_MIN_COST_RATIO    (4)    // cheaper than this many times the overhead gets sampled ..
+#define DEBUG_SAMPLING_MIN_CALLS_FOR_COST (256) // .. if it's called at least this many times per frame
+#define DEBUG_SAMPLING_MAX_RATE          (1u << 15)
+
+struct debug_callsite_sampling
+{
+  u32 LastCallCount; // Sum of every threads CallCounts at the last update
+  u32 CallsPerFrame;
+
+  // NOTE(Jesse): Accumulated by BuildScopeTree from recorded calls only
+  u64 BuiltCycles;
+  u32 BuiltCalls;
+
+  u32 Override; // 0 is automatic, otherwise record one of every Override calls
+
+  // NOTE(Jesse): Seen with another scope nested in it.  These never get
+  // sampled, override or not; the children of the calls we skipped would
+  // still be recorded and end up under its parent.
+  b32 HasChildren;
+};
+
+// NOTE(Jesse): Measured once by CalibrateProfilerOverhead at startup
+struct debug_profiler_overhead
+{
+  u64 ScopeCycles;      // What an empty TIMED_BLOCK costs the scope around it
+  u64 RdtscCycles;      // Back-to-back __rdtsc, which every scope measures itself as
+  u64 AllocationCycles; // Recording one DEBUG_Allocate into the meta table
 };
-CAssert(sizeof(debug_thread_state) == CACHE_LINE_SIZE);
 
 struct unique_debug_profile_scope
 {
-  const char* Name;
+  u16 CallsiteId;
   u32 CallCount;
   u64 TotalCycles;
   u64 MinCycles = u64_MAX;
   u64 MaxCycles;
+  u64 TotalPayload;
 
   debug_profile_scope* Scope;
   unique_debug_profile_scope* NextUnique;
@@ -213,11 +411,561 @@ struct selected_arenas
   selected_memory_arena Arenas[MAX_SELECTED_ARENAS];
 };
 
+// NOTE(Jesse): Workers seal their tree for a frame when they get around to
+// advancing, which is some time after the main thread did.  Anything that
+// wants every threads data for a frame waits this many frames for it.
+#define DEBUG_SEALED_FRAME_LAG (4)
+
 struct frame_stats
 {
   u64 TotalCycles;
   u64 StartingCycle;
   r32 FrameMs;
+
+  // NOTE(Jesse): "Cycles" are whatever the timestamp mode the frame was
+  // recorded in counts; TSC ticks or nanoseconds.
+  r64 NsPerCycle;
+
+  debug_flow_latency_histogram FlowLatency;
+
+  debug_frame_counters Counters;
+};
+
+// NOTE(Jesse): Hands out an index per call path, keyed on the index of the
+// path it was called from and its callsite; open addressing, linear probing.
+// Path 0 is the empty one everything hangs off of, and what you get back once
+// the table is full.  The merged tree, the frame diff and the flame graph
+// export all key on this, and keep what they add up per path in arrays of
+// their own, by the same index.
+struct debug_call_path
+{
+  u32 Parent;
+  u16 CallsiteId;
+};
+
+struct debug_call_path_table
+{
+  u32 Count; // Including path 0
+  u32 MaxCount;
+  u32 SlotMask;
+
+  debug_call_path *Paths;
+  u32 *Slots; // Path index, 0 for empty; twice MaxCount so probes stay short
+};
+
+// NOTE(Jesse): Every call path we've seen, merged across threads, keyed by
+// the callsites on the way down from the top of a threads frame.  Node 0 is
+// the root.  UpdateHistoryTiers feeds it each frame once that's sealed; every
+// node a frame touched gets a delta, which is what lets the oldest frame be
+// taken back out of the window.  Times are corrected for profiler overhead
+// and scaled up by the sample rate, same as the per-frame callgraph.
+#define DEBUG_MERGED_TREE_MAX_NODES (1 << 14)
+#define DEBUG_MERGED_TREE_DELTAS (1 << 18)
+#define DEBUG_MERGED_TREE_MAX_WINDOW (1024)
+#define DEBUG_MERGED_TREE_WINDOW_DEFAULT (120)
+
+struct debug_merged_totals
+{
+  u64 Calls;
+  u64 Ns;
+  u64 Payload;
+};
+
+struct debug_merged_node
+{
+  u16 CallsiteId;
+  u16 Depth;
+  b32 Expanded;
+
+  u32 Parent;
+  u32 FirstChild;
+  u32 LastChild;
+  u32 NextSibling;
+
+  u32 TouchedFrameId; // FrameId+1 of the frame Frame is accumulating, 0 for none
+  debug_merged_totals Frame;
+  debug_merged_totals Window;
+  debug_merged_totals Session;
+};
+
+struct debug_merged_delta
+{
+  u32 Node;
+  u32 Calls;
+  u64 Ns;
+  u64 Payload;
+};
+
+struct debug_merged_frame
+{
+  u64 FirstDelta;
+  u32 DeltaCount;
+  r32 FrameMs;
+};
+
+struct debug_merged_tree
+{
+  u32 NodeCount;
+  u32 NodesDropped; // Paths that didn't fit; not counted anywhere
+  debug_merged_node *Nodes;
+  debug_call_path_table Paths; // Node index by path
+
+  u32 TouchedCount;
+  u32 *Touched; // Nodes with something in Frame
+
+  u64 DeltaAt;
+  debug_merged_delta *Deltas; // DEBUG_MERGED_TREE_DELTAS ring
+
+  // NOTE(Jesse): The frames in the window, oldest first.  There can be fewer
+  // than WindowFrames if a lot of nodes are busy and the deltas run out.
+  u32 WindowFrames;
+  u32 FirstWindowFrame;
+  u32 WindowFrameCount;
+  debug_merged_frame *Frames; // DEBUG_MERGED_TREE_MAX_WINDOW ring
+  r64 WindowFrameMs;
+
+  u32 SessionFrames;
+  r64 SessionFrameMs;
+};
+
+// NOTE(Jesse): What debug_baseline.cpp holds a run to against a baseline; a
+// change has to clear every one of these to count.  Run to run noise on a
+// busy machine is a few percent, and a soak run has enough calls that the z
+// test alone would flag all of it, hence the size thresholds.
+struct debug_baseline_thresholds
+{
+  r64 MaxChange;     // Fraction the p50 or p90 can move by
+  r64 MinZ;          // Mann-Whitney z score, so the shift is consistent and not a few outliers
+  u64 MinSamples;    // Calls (or frames) each run needs before we say anything
+  u64 MinChangeNs;   // Smaller moves than this are noise whatever the fraction
+};
+
+// NOTE(Jesse): Two frames' scope trees merged by call path, across threads,
+// into one table.  A path is its parent's entry and a callsite, so lining the
+// frames up is a hash lookup per scope; there's no tree matching to speak of.
+// Entry 0 is the root.  Side 0 is the baseline, side 1 the frame we compare.
+#define DEBUG_FRAME_DIFF_MAX_ENTRIES (1 << 17)
+#define DEBUG_FRAME_DIFF_MAX_DEPTH   (256)
+#define DEBUG_FRAME_DIFF_ROWS        (256)
+
+// NOTE(Jesse): Indexed by Paths
+struct debug_frame_diff_entry
+{
+  u64 Cycles[2];
+  u32 Calls[2];
+};
+
+struct debug_frame_diff
+{
+  u32 BaselineSlot;
+  u32 TargetSlot;
+  u32 FrameRecorded[2]; // What the cached result was built from
+
+  u32 EntriesDropped; // Didn't fit, or were too deep; counted in their parent
+  debug_frame_diff_entry *Entries;
+  debug_call_path_table Paths;
+
+  u32 RowCount;
+  u32 *Rows;          // Biggest change first
+
+  u64 TotalCycles[2];
+  u64 BuildCycles;
+};
+
+// NOTE(Jesse): Log-linear buckets, like an HDR histogram.  Durations under
+// DEBUG_DURATION_HISTOGRAM_SUB_BUCKETS ns get a bucket each; above that every
+// power of two is split into that many even buckets, so a bucket is never
+// more than ~6% wide.  Anything over 2^DEBUG_DURATION_HISTOGRAM_MAX_BITS ns
+// (18 minutes or so) lands in the last one.
+#define DEBUG_DURATION_HISTOGRAM_SUB_BUCKET_BITS (4)
+#define DEBUG_DURATION_HISTOGRAM_SUB_BUCKETS (1 << DEBUG_DURATION_HISTOGRAM_SUB_BUCKET_BITS)
+#define DEBUG_DURATION_HISTOGRAM_MAX_BITS (40)
+#define DEBUG_DURATION_HISTOGRAM_BUCKETS ((DEBUG_DURATION_HISTOGRAM_MAX_BITS - DEBUG_DURATION_HISTOGRAM_SUB_BUCKET_BITS + 1) * DEBUG_DURATION_HISTOGRAM_SUB_BUCKETS)
+
+struct debug_duration_histogram
+{
+  u64 Total;
+  u64 MaxNs;
+  u64 Counts[DEBUG_DURATION_HISTOGRAM_BUCKETS];
+};
+
+// NOTE(Jesse): The largest value that lands in the bucket
+inline u64
+GetDurationBucketMaxNs(u32 BucketIndex)
+{
+  u64 Result = BucketIndex;
+  if (BucketIndex >= DEBUG_DURATION_HISTOGRAM_SUB_BUCKETS)
+  {
+    u32 Shift = BucketIndex/DEBUG_DURATION_HISTOGRAM_SUB_BUCKETS - 1;
+    u64 SubBucket = BucketIndex % DEBUG_DURATION_HISTOGRAM_SUB_BUCKETS;
+    Result = ((DEBUG_DURATION_HISTOGRAM_SUB_BUCKETS + SubBucket + 1) << Shift) - 1;
+  }
+  return Result;
+}
+
+// NOTE(Jesse): The window is the current half and the one before it, so it
+// covers between one and two DEBUG_DURATION_WINDOW_FRAMES worth of frames.
+#define DEBUG_DURATION_WINDOW_FRAMES (600)
+
+struct debug_duration_stats
+{
+  debug_duration_histogram Session;
+  debug_duration_histogram Window[2]; // Indexed by debug_state::DurationWindowAt
+};
+
+#define DEBUG_DURATION_PERCENTILE_COUNT (5)
+
+struct debug_duration_summary
+{
+  u64 Total;
+  u64 Ns[DEBUG_DURATION_PERCENTILE_COUNT]; // At Global_DurationPercentiles; the last one is the max
+};
+
+// NOTE(Jesse): History older than the full-detail frames.  Each tier keeps a
+// ring of buckets covering BucketMs of frame time, each with the frame times
+// and the scope time of every callsite that was called in it.  Tier 0 is fed
+// a frame at a time, DEBUG_SEALED_FRAME_LAG frames after it ends, and every
+// tier after that is fed the buckets the one before it closes.
+//
+// Callsite time is inclusive and scaled up by the sample rate the scope was
+// recorded at, so it's an estimate for sampled callsites.
+#define DEBUG_HISTORY_TIER_COUNT (2)
+
+#define DEBUG_HISTORY_SECOND_BUCKETS (600)  // Ten minutes
+#define DEBUG_HISTORY_SECOND_AGGREGATES (1 << 17)
+#define DEBUG_HISTORY_MINUTE_BUCKETS (1440) // A day
+#define DEBUG_HISTORY_MINUTE_AGGREGATES (1 << 18)
+
+struct debug_callsite_aggregate
+{
+  u16 CallsiteId;
+  u16 Pad;
+  u32 Calls;
+  u64 Ns;
+};
+CAssert(sizeof(debug_callsite_aggregate) == 16);
+
+struct debug_history_bucket
+{
+  u32 FrameCount;
+  r32 MaxFrameMs;
+  r64 TotalFrameMs;
+
+  // NOTE(Jesse): Into the tiers Aggregates ring, which gets lapped before the
+  // buckets do if a lot of callsites are busy.
+  u64 FirstAggregate;
+  u32 AggregateCount;
+};
+
+struct debug_history_tier
+{
+  r64 BucketMs;
+
+  u32 BucketCount; // Capacity of Buckets
+  u64 BucketAt;    // How many have been closed; the newest is BucketAt-1
+  debug_history_bucket *Buckets;
+
+  u64 AggregateMask;
+  u64 AggregateAt;
+  debug_callsite_aggregate *Aggregates;
+
+  // NOTE(Jesse): The bucket being filled.  Indexed by callsite id.
+  debug_history_bucket Open;
+  u64 *OpenNs;
+  u32 *OpenCalls;
+};
+
+// NOTE(Jesse): Continuous capture to disk; see debug_trace_writer.cpp for
+// the file format.  The main thread hands off a debug_trace_frame once a
+// frame is DEBUG_SEALED_FRAME_LAG frames old, and the writer thread reads the
+// scope events and mutex ops straight out of the per-thread buffers.  It has
+// until the rings lap it to get there, and counts whatever it missed.
+#define DEBUG_TRACE_FRAME_QUEUE   (256)
+#define DEBUG_TRACE_CSWITCH_QUEUE (1 << 16)
+#define DEBUG_TRACE_BUFFER_SIZE   (Megabytes(1))
+#define DEBUG_TRACE_CHUNK_EVENTS  (4096) // Worst case ~22 bytes each encoded
+
+// NOTE(Jesse): 2 made every frame decodable on its own; see the Index record
+#define DEBUG_TRACE_VERSION (2)
+
+enum debug_trace_record_type
+{
+  TraceRecord_Callsite = 1,
+  TraceRecord_Frame,
+  TraceRecord_ScopeEvents,
+  TraceRecord_MutexOps,
+  TraceRecord_ContextSwitches,
+  TraceRecord_Index,
+};
+
+// NOTE(Jesse): Captures that get closed normally end with an index of every
+// frame in them, followed by a debug_capture_trailer, so a reader can map
+// the file and go straight to any frame.  The entries are written raw and
+// 8 byte aligned so they can be used right out of the map.
+struct debug_capture_frame_index
+{
+  u32 FrameId;
+  r32 FrameMs;
+  u64 Offset; // Of the frames Frame record
+  u64 Size;   // Up to the next Frame record, or the Index
+  u64 StartingCycle;
+  u64 TotalCycles;
+  r64 NsPerCycle;
+};
+CAssert(sizeof(debug_capture_frame_index) == 48);
+
+#define DEBUG_CAPTURE_TRAILER_MAGIC (0x58494442) // "BDIX"
+struct debug_capture_trailer
+{
+  u64 IndexOffset;      // Of the Index record
+  u64 FrameIndexOffset; // Of the first debug_capture_frame_index
+  u32 FrameCount;
+  u32 Magic;
+};
+CAssert(sizeof(debug_capture_trailer) == 24);
+
+// NOTE(Jesse): A capture file mapped for reading; see debug_capture.cpp.
+// Nothing gets decoded until somebody asks for a frame, and the strings point
+// straight into the map.  Callsites are indexed by the id they were recorded
+// with, which has nothing to do with the ids in the process reading them.
+struct debug_capture_callsite
+{
+  counted_string Name;
+  counted_string File;
+  u32 Line;
+  u16 Category;
+};
+
+struct debug_capture
+{
+  u8 *Data;
+  u64 Size;
+  umm FileHandle; // win32 only
+  umm MapHandle;  // win32 only
+
+  u32 Version;
+  b32 Indexed; // Had an index; otherwise we scanned for the frames
+
+  debug_capture_frame_index *Frames; // Into the map, if it was Indexed
+  u32 FrameCount;
+
+  debug_capture_callsite *Callsites; // u16_MAX+1 of them
+  memory_arena *Memory;
+};
+
+struct debug_capture_scope
+{
+  u64 StartingCycle;
+  u64 EndingCycle; // 0 if it was still open when the frame ended
+  u64 Payload;
+  u16 CallsiteId;
+  u16 SampleMask;
+  b32 Continued;   // Opened in an earlier frame; StartingCycle is the frames
+  b32 Expanded;    // Capture window only
+
+  debug_capture_scope *Parent;
+  debug_capture_scope *Child;
+  debug_capture_scope *Sibling;
+};
+
+struct debug_capture_mutex_op
+{
+  u64 Cycle;
+  u64 Mutex;
+  u32 Op; // mutex_op
+};
+
+struct debug_capture_context_switch
+{
+  u64 Cycle;
+  u32 ThreadIndex;
+  u32 Type; // debug_context_switch_type
+  u32 ProcessorNumber;
+};
+
+#define DEBUG_CAPTURE_MAX_THREADS (256)
+#define DEBUG_CAPTURE_MAX_DEPTH (256)
+
+struct debug_capture_thread
+{
+  debug_capture_scope *Root; // Siblings from there
+  u32 ScopeCount;
+
+  debug_capture_mutex_op *MutexOps;
+  u32 MutexOpCount;
+};
+
+struct debug_capture_frame
+{
+  debug_capture_frame_index *Index;
+
+  u32 ThreadCount;
+  debug_capture_thread Threads[DEBUG_CAPTURE_MAX_THREADS];
+
+  debug_capture_context_switch *ContextSwitches;
+  u32 ContextSwitchCount;
+};
+
+// NOTE(Jesse): Only the writer thread grows this, a block at a time, and it
+// gets reused from one capture to the next.
+#define DEBUG_CAPTURE_INDEX_BLOCK_FRAMES (4096)
+struct debug_capture_index_block
+{
+  debug_capture_index_block *Next;
+  u32 Count;
+  debug_capture_frame_index Frames[DEBUG_CAPTURE_INDEX_BLOCK_FRAMES];
+};
+
+struct debug_trace_frame
+{
+  u32 FrameId;
+  r32 FrameMs;
+  u64 StartingCycle;
+  u64 TotalCycles;
+  r64 NsPerCycle;
+};
+
+enum debug_trace_format
+{
+  TraceFormat_Bonsai,   // BDTR, see debug_trace_writer.cpp
+  TraceFormat_Perfetto, // Perfetto TracePackets, see debug_perfetto.cpp
+};
+
+// NOTE(Jesse): Perfetto sequences are per-thread, two for each (scopes and
+// locks) plus one for everything else.  Which sequences a callsite name has
+// been interned on is a bitfield, which is where the thread limit is from.
+#define DEBUG_PERFETTO_MAX_THREADS   (64)
+#define DEBUG_PERFETTO_MAX_SEQUENCES (1 + 2*DEBUG_PERFETTO_MAX_THREADS)
+#define DEBUG_PERFETTO_MAX_CPUS      (256)
+
+struct debug_perfetto_sequence
+{
+  b32 Cleared;  // Incremental state has been written
+  b32 WaitOpen; // Lock sequences; a "wait" slice hasn't been ended yet
+  u64 LastNs;   // Value of the sequences incremental clock
+};
+
+// NOTE(Jesse): The per-thread context switch buffers get sorted and reused
+// by the ETW thread, so it pushes a copy of each one here as well.
+struct debug_trace_context_switch
+{
+  u16 ThreadIndex;
+  u16 Type; // debug_context_switch_type
+  u32 ProcessorNumber;
+  u64 CycleCount;
+};
+
+struct debug_trace_writer
+{
+  // NOTE(Jesse): Main thread -> writer
+  volatile u32 FrameWriteAt;
+  volatile u32 FrameReadAt;
+  debug_trace_frame Frames[DEBUG_TRACE_FRAME_QUEUE];
+
+  // NOTE(Jesse): ETW thread -> writer
+  volatile u32 ContextSwitchWriteAt;
+  volatile u32 ContextSwitchReadAt;
+  debug_trace_context_switch *ContextSwitches;
+
+  volatile b32 Running;
+  volatile b32 StopRequested;
+  void *File;   // FILE*
+  umm   Thread; // HANDLE or pthread_t
+
+  // NOTE(Jesse): Only touched by the writer thread
+  u8 *Buffer;
+  umm BufferAt;
+  u8 *CallsiteWritten; // Indexed by callsite id
+  u64 LastContextSwitchCycle;
+  u64 LastMutex;
+
+  // NOTE(Jesse): Backpressure, for the UI
+  volatile u64 BytesWritten;
+  volatile u32 FramesWritten;
+  volatile u32 FramesDropped;          // Queue was full when the main thread handed one off
+  volatile u32 ContextSwitchesDropped; // Same, from the ETW thread
+  volatile u64 EventsLost;             // The ring lapped the writer
+  volatile u32 ThreadFramesUnsealed;   // Worker still hadn't advanced past the frame
+  volatile u32 MutexFramesLost;        // Slot got reused while we were reading it
+  volatile u32 WriteErrors;
+
+  volatile b32 Finished; // The writer thread drained everything after StopRequested
+  s32 Fd;                // Written to instead of File from a fatal signal handler
+  b32 IncludeOpenTrees;  // .. which also wants the frames nobody has sealed yet
+
+  debug_trace_format Format;
+
+  // NOTE(Jesse): BDTR only, writer thread only.  The crash writer can't
+  // allocate so it doesn't index; readers scan those.
+  b32 WriteIndex;
+  memory_arena *IndexMemory;
+  debug_capture_index_block *FirstIndexBlock;
+  debug_capture_index_block *CurrentIndexBlock;
+  debug_capture_frame_index *LastIndexed;
+
+  // NOTE(Jesse): Perfetto only, writer thread only
+  debug_perfetto_sequence *Sequences;
+  u64 *CallsiteInterned; // Indexed by callsite id, a bit per thread
+  u8 *CpuDescribed;
+  u32 ThreadsDescribed;
+  b32 FrameCounterDescribed;
+  r64 FrameStartNs;
+  u64 FrameStartingCycle;
+  r64 NsPerCycle;
+};
+
+// NOTE(Jesse): Something bad happened, so write out the frames around it.
+// The frames before the trigger are still sitting in the rings, and go to a
+// writer of our own as soon as it fires; the FramesAfter after it follow as
+// they're sealed.  Nothing stops while that happens, so FramesBefore has to
+// fit in FramesTracked, and in the scope event rings, with room to spare,
+// and the whole capture in the writer's queue.  See ClampCaptureFrames
+#define DEBUG_CAPTURE_FRAMES_BEFORE_DEFAULT (60)
+#define DEBUG_CAPTURE_FRAMES_AFTER_DEFAULT  (30)
+#define DEBUG_CAPTURE_REASON_LENGTH         (64)
+#define DEBUG_CAPTURE_PATH_LENGTH           (256)
+
+struct debug_flight_recorder
+{
+  u32 FramesBefore;
+  u32 FramesAfter;
+  r32 FrameMsTrigger;     // 0 is off
+  u64 ScopeTriggerCycles; // For callsites named ScopeTriggerName
+  char ScopeTriggerName[DEBUG_CAPTURE_REASON_LENGTH];
+
+  // NOTE(Jesse): DEBUG_CAPTURE can come from any thread.  Requested goes
+  // 0 -> 1 while the reason gets filled in, then 2 once it's ready.
+  volatile u32 Requested;
+  const char *RequestedReason;
+
+  volatile b32 Signalled; // SIGUSR1
+
+  // NOTE(Jesse): Main thread only
+  b32 Pending;
+  u32 TriggerFrameId;
+  u32 FirstFrameId;
+  u32 LastFrameId;
+  u32 NextFrameId; // Next one to hand to Writer
+  char Reason[DEBUG_CAPTURE_REASON_LENGTH];
+
+  u32 CapturesWritten;
+  u32 FramesDropped; // Writer's queue was full; left out of the capture
+  volatile u32 TriggersIgnored; // Came in while we were busy with the last one
+  char LastCapturePath[DEBUG_CAPTURE_PATH_LENGTH];
+
+  debug_trace_writer *Writer;
+  debug_trace_writer *CrashWriter; // Allocated up front; the signal handler can't
+  b32 HandlersInstalled;           // DEBUG_INSTALL_CRASH_HANDLERS; reinstalled by BonsaiDebug_OnLoad
+};
+
+struct debug_timestamps
+{
+  u64 TscFrequency; // Ticks per second, measured against the monotonic clock
+  b32 TscInvariant; // CPUID says the TSC runs at a constant rate in every P/C state
+  b32 TscReliable;  // .. and two back-to-back calibrations agreed
+
+  u32 Mode;          // debug_timestamp_mode frames are being recorded in
+  u32 RequestedMode; // Takes effect on the next frame
 };
 
 struct registered_memory_arena
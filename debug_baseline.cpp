@@ -0,0 +1,540 @@
+#include <stdio.h>
+#include <math.h>
+
+/*****************************             *********************************/
+/*****************************  Baselines  *********************************/
+/*****************************             *********************************/
+
+
+// NOTE(Jesse): A baseline is a sessions frame time histogram and the session
+// duration histogram of every callsite, so a later run can be held up against
+// it.  This part doesn't touch the debug_state; debug_perf_gate.cpp builds it
+// on its own to compare two files from a script.
+//
+// File format, all little-endian and unpadded
+//
+//   "BDBL", u32 version, u32 sub bucket bits, u32 max bits, u32 callsite count
+//   Frame time histogram
+//   Per callsite: u16 name length, name, u16 file length, file, histogram
+//
+//   Histograms are u64 Total, u64 MaxNs, u32 non-empty bucket count, then
+//   (u16 bucket, u64 count) for each of those.
+//
+// Callsites are matched up by name and file across runs; their ids aren't
+// stable, and TIMED_NAMED_BLOCK names don't have to be unique.  Only the last
+// part of the file's path counts, in case the runs were built somewhere
+// different.  Version 1 files had no file, so those match on the name alone.
+
+#define DEBUG_BASELINE_VERSION (2)
+
+struct debug_baseline_callsite
+{
+  counted_string Name;
+  counted_string File;
+  debug_duration_histogram *Durations;
+};
+
+struct debug_baseline
+{
+  debug_duration_histogram FrameTimes;
+
+  u32 CallsiteCount;
+  debug_baseline_callsite *Callsites;
+};
+
+global_variable debug_baseline_thresholds Global_DefaultBaselineThresholds = { 0.05, 3.0, 100, 1000 };
+
+enum debug_baseline_verdict
+{
+  BaselineVerdict_Same,
+  BaselineVerdict_Regressed,
+  BaselineVerdict_Improved,
+  BaselineVerdict_TooFewSamples,
+  BaselineVerdict_Missing, // In the baseline, never called this run
+  BaselineVerdict_New,     // Not in the baseline
+};
+
+global_variable const char *Global_BaselineVerdictNames[] = { "same", "REGRESSED", "improved", "too few samples", "missing", "new" };
+
+struct debug_baseline_report
+{
+  u32 Verdicts[BaselineVerdict_New+1];
+  debug_baseline_verdict FrameTime;
+};
+
+// NOTE(Jesse): For scripts.  0 passed, 1 something regressed, 2 we couldn't
+// compare at all.
+enum debug_baseline_exit_status
+{
+  BaselineExit_Passed    = 0,
+  BaselineExit_Regressed = 1,
+  BaselineExit_Error     = 2,
+};
+
+
+
+/*****************************                      ************************/
+/*****************************  Baseline Read/Write  ************************/
+/*****************************                      ************************/
+
+
+
+link_internal b32
+WriteBaselineHistogram(FILE *File, debug_duration_histogram *Histogram)
+{
+  u32 NonEmpty = 0;
+  for (u32 BucketIndex = 0; BucketIndex < DEBUG_DURATION_HISTOGRAM_BUCKETS; ++BucketIndex)
+  {
+    if (Histogram->Counts[BucketIndex]) { ++NonEmpty; }
+  }
+
+  b32 Result = fwrite(&Histogram->Total, sizeof(u64), 1, File) == 1 &&
+               fwrite(&Histogram->MaxNs, sizeof(u64), 1, File) == 1 &&
+               fwrite(&NonEmpty,         sizeof(u32), 1, File) == 1;
+
+  for (u32 BucketIndex = 0; Result && BucketIndex < DEBUG_DURATION_HISTOGRAM_BUCKETS; ++BucketIndex)
+  {
+    if (Histogram->Counts[BucketIndex])
+    {
+      u16 Bucket = (u16)BucketIndex;
+      Result = fwrite(&Bucket, sizeof(u16), 1, File) == 1 &&
+               fwrite(Histogram->Counts + BucketIndex, sizeof(u64), 1, File) == 1;
+    }
+  }
+
+  return Result;
+}
+
+link_internal b32
+ReadBaselineHistogram(FILE *File, debug_duration_histogram *Histogram)
+{
+  u32 NonEmpty = 0;
+  b32 Result = fread(&Histogram->Total, sizeof(u64), 1, File) == 1 &&
+               fread(&Histogram->MaxNs, sizeof(u64), 1, File) == 1 &&
+               fread(&NonEmpty,         sizeof(u32), 1, File) == 1 &&
+               NonEmpty <= DEBUG_DURATION_HISTOGRAM_BUCKETS;
+
+  for (u32 Index = 0; Result && Index < NonEmpty; ++Index)
+  {
+    u16 Bucket = 0;
+    u64 Count = 0;
+    Result = fread(&Bucket, sizeof(u16), 1, File) == 1 &&
+             fread(&Count,  sizeof(u64), 1, File) == 1 &&
+             Bucket < DEBUG_DURATION_HISTOGRAM_BUCKETS;
+
+    if (Result) { Histogram->Counts[Bucket] = Count; }
+  }
+
+  return Result;
+}
+
+link_internal b32
+WriteBaseline(const char *Path, debug_baseline *Baseline)
+{
+  FILE *File = fopen(Path, "wb");
+  if (!File) { Error("Couldn't open baseline file (%s)", Path); return False; }
+
+  u32 Header[4] = { DEBUG_BASELINE_VERSION, DEBUG_DURATION_HISTOGRAM_SUB_BUCKET_BITS, DEBUG_DURATION_HISTOGRAM_MAX_BITS, Baseline->CallsiteCount };
+  b32 Result = fwrite("BDBL", 1, 4, File) == 4 &&
+               fwrite(Header, sizeof(Header), 1, File) == 1 &&
+               WriteBaselineHistogram(File, &Baseline->FrameTimes);
+
+  for ( u32 CallsiteIndex = 0;
+            Result && CallsiteIndex < Baseline->CallsiteCount;
+          ++CallsiteIndex )
+  {
+    debug_baseline_callsite *Callsite = Baseline->Callsites + CallsiteIndex;
+    u16 NameLength = (u16)Min(Callsite->Name.Count, (umm)u16_MAX);
+    u16 FileLength = (u16)Min(Callsite->File.Count, (umm)u16_MAX);
+    Result = fwrite(&NameLength, sizeof(u16), 1, File) == 1 &&
+             fwrite(Callsite->Name.Start, 1, NameLength, File) == NameLength &&
+             fwrite(&FileLength, sizeof(u16), 1, File) == 1 &&
+             fwrite(Callsite->File.Start, 1, FileLength, File) == FileLength &&
+             WriteBaselineHistogram(File, Callsite->Durations);
+  }
+
+  Result = (fclose(File) == 0) && Result;
+  if (!Result) { Error("Couldn't write baseline file (%s)", Path); }
+
+  return Result;
+}
+
+link_internal b32
+ReadBaseline(const char *Path, debug_baseline *Baseline, memory_arena *Memory)
+{
+  Clear(Baseline);
+
+  FILE *File = fopen(Path, "rb");
+  if (!File) { Error("Couldn't open baseline file (%s)", Path); return False; }
+
+  char Magic[4] = {};
+  u32 Header[4] = {};
+  b32 Result = fread(Magic, 1, 4, File) == 4 &&
+               fread(Header, sizeof(Header), 1, File) == 1;
+
+  if (Result)
+  {
+    if (Magic[0] != 'B' || Magic[1] != 'D' || Magic[2] != 'B' || Magic[3] != 'L' || Header[0] == 0 || Header[0] > DEBUG_BASELINE_VERSION)
+    {
+      Error("(%s) isn't a version %u baseline file", Path, DEBUG_BASELINE_VERSION);
+      Result = False;
+    }
+    else if (Header[1] != DEBUG_DURATION_HISTOGRAM_SUB_BUCKET_BITS || Header[2] != DEBUG_DURATION_HISTOGRAM_MAX_BITS)
+    {
+      Error("Baseline file (%s) was written with different histogram buckets", Path);
+      Result = False;
+    }
+  }
+
+  if (Result)
+  {
+    Result = ReadBaselineHistogram(File, &Baseline->FrameTimes);
+
+    Baseline->CallsiteCount = Header[3];
+    Baseline->Callsites = Allocate(debug_baseline_callsite, Memory, Baseline->CallsiteCount);
+  }
+
+  for ( u32 CallsiteIndex = 0;
+            Result && CallsiteIndex < Baseline->CallsiteCount;
+          ++CallsiteIndex )
+  {
+    debug_baseline_callsite *Callsite = Baseline->Callsites + CallsiteIndex;
+
+    u16 NameLength = 0;
+    Result = fread(&NameLength, sizeof(u16), 1, File) == 1;
+    if (Result)
+    {
+      char *Name = Allocate(char, Memory, NameLength);
+      Callsite->Name = CS(Name, NameLength);
+      Result = fread(Name, 1, NameLength, File) == NameLength;
+    }
+
+    u16 FileLength = 0;
+    if (Result && Header[0] >= 2)
+    {
+      Result = fread(&FileLength, sizeof(u16), 1, File) == 1;
+      if (Result)
+      {
+        char *FileName = Allocate(char, Memory, FileLength);
+        Callsite->File = CS(FileName, FileLength);
+        Result = fread(FileName, 1, FileLength, File) == FileLength;
+      }
+    }
+
+    if (Result)
+    {
+      Callsite->Durations = Allocate(debug_duration_histogram, Memory, 1);
+      Result = ReadBaselineHistogram(File, Callsite->Durations);
+    }
+  }
+
+  fclose(File);
+  if (!Result) { Error("Couldn't read baseline file (%s)", Path); }
+
+  return Result;
+}
+
+
+
+/*****************************                      ************************/
+/*****************************  Baseline Comparison  ************************/
+/*****************************                      ************************/
+
+
+
+// NOTE(Jesse): Interpolated within the bucket the percentile lands in.
+// Buckets are 3-6% wide, which is about as much as we'd want to call a
+// regression, so snapping to the top of one would make a single bucket of
+// jitter look like a change.
+link_internal u64
+GetHistogramPercentileNs(debug_duration_histogram *Histogram, r64 Percentile)
+{
+  u64 Result = 0;
+  u64 Seen = 0;
+  r64 Target = r64(Histogram->Total) * Percentile / 100.0;
+  for (u32 BucketIndex = 0; BucketIndex < DEBUG_DURATION_HISTOGRAM_BUCKETS; ++BucketIndex)
+  {
+    u64 Count = Histogram->Counts[BucketIndex];
+    if (Count && r64(Seen + Count) >= Target)
+    {
+      u64 MinNs = BucketIndex ? GetDurationBucketMaxNs(BucketIndex-1)+1 : 0;
+      u64 MaxNs = GetDurationBucketMaxNs(BucketIndex);
+
+      r64 Fraction = Min(1.0, Max(0.0, (Target - r64(Seen)) / r64(Count)));
+      Result = MinNs + u64(Fraction * r64(MaxNs - MinNs));
+      Result = Min(Result, Histogram->MaxNs);
+      break;
+    }
+    Seen += Count;
+  }
+  return Result;
+}
+
+// NOTE(Jesse): Mann-Whitney U, straight off the histograms; both are on the
+// same buckets so everything in a bucket counts as a tie.  Positive means
+// Current tends to take longer.  No tie correction, so it's a little
+// conservative.
+link_internal r64
+GetMannWhitneyZ(debug_duration_histogram *Baseline, debug_duration_histogram *Current)
+{
+  r64 BaselineCount = r64(Baseline->Total);
+  r64 CurrentCount = r64(Current->Total);
+
+  r64 U = 0.0;
+  r64 BaselineBelow = 0.0;
+  for (u32 BucketIndex = 0; BucketIndex < DEBUG_DURATION_HISTOGRAM_BUCKETS; ++BucketIndex)
+  {
+    r64 InBaseline = r64(Baseline->Counts[BucketIndex]);
+    U += r64(Current->Counts[BucketIndex]) * (BaselineBelow + 0.5*InBaseline);
+    BaselineBelow += InBaseline;
+  }
+
+  r64 Mean = BaselineCount*CurrentCount / 2.0;
+  r64 Deviation = sqrt(BaselineCount*CurrentCount*(BaselineCount+CurrentCount+1.0) / 12.0);
+  r64 Result = SafeDivide0(U - Mean, Deviation);
+  return Result;
+}
+
+// NOTE(Jesse): Whichever of the p50 and p90 moved more, relative to the baseline
+link_internal r64
+GetBaselineChange(debug_duration_histogram *Baseline, debug_duration_histogram *Current, s64 *ChangeNs)
+{
+  r64 Result = 0.0;
+  *ChangeNs = 0;
+
+  r64 Percentiles[2] = { 50.0, 90.0 };
+  for (u32 PercentileIndex = 0; PercentileIndex < 2; ++PercentileIndex)
+  {
+    s64 BaselineNs = (s64)GetHistogramPercentileNs(Baseline, Percentiles[PercentileIndex]);
+    s64 CurrentNs  = (s64)GetHistogramPercentileNs(Current, Percentiles[PercentileIndex]);
+    r64 Change = SafeDivide0(r64(CurrentNs - BaselineNs), r64(Max(BaselineNs, (s64)1)));
+
+    if ((Change < 0.0 ? -Change : Change) > (Result < 0.0 ? -Result : Result))
+    {
+      Result = Change;
+      *ChangeNs = CurrentNs - BaselineNs;
+    }
+  }
+
+  return Result;
+}
+
+link_internal debug_baseline_verdict
+CompareHistograms(debug_duration_histogram *Baseline, debug_duration_histogram *Current, debug_baseline_thresholds *Thresholds, r64 *Change, r64 *Z)
+{
+  *Change = 0.0;
+  *Z = 0.0;
+
+  if (Baseline->Total < Thresholds->MinSamples || Current->Total < Thresholds->MinSamples) { return BaselineVerdict_TooFewSamples; }
+
+  s64 ChangeNs = 0;
+  *Change = GetBaselineChange(Baseline, Current, &ChangeNs);
+  *Z = GetMannWhitneyZ(Baseline, Current);
+
+  u64 AbsChangeNs = u64(ChangeNs < 0 ? -ChangeNs : ChangeNs);
+  if (AbsChangeNs < Thresholds->MinChangeNs) { return BaselineVerdict_Same; }
+
+  debug_baseline_verdict Result = BaselineVerdict_Same;
+  if (*Change >  Thresholds->MaxChange && *Z >  Thresholds->MinZ) { Result = BaselineVerdict_Regressed; }
+  if (*Change < -Thresholds->MaxChange && *Z < -Thresholds->MinZ) { Result = BaselineVerdict_Improved; }
+
+  return Result;
+}
+
+link_internal void
+PrintBaselineLine(counted_string Name, debug_duration_histogram *Baseline, debug_duration_histogram *Current, debug_baseline_verdict Verdict, r64 Change, r64 Z)
+{
+  DebugLine("%s %s%.1fpct z %s%.1f  p50 %.1fus -> %.1fus  p90 %.1fus -> %.1fus  calls %lu -> %lu  %S",
+      Global_BaselineVerdictNames[Verdict],
+      Change < 0.0 ? "-" : "+", (Change < 0.0 ? -Change : Change)*100.0,
+      Z < 0.0 ? "-" : "+", Z < 0.0 ? -Z : Z,
+      r64(GetHistogramPercentileNs(Baseline, 50.0))/1000.0, r64(GetHistogramPercentileNs(Current, 50.0))/1000.0,
+      r64(GetHistogramPercentileNs(Baseline, 90.0))/1000.0, r64(GetHistogramPercentileNs(Current, 90.0))/1000.0,
+      Baseline->Total, Current->Total, Name);
+}
+
+link_internal counted_string
+GetBaselineFileName(counted_string Path)
+{
+  counted_string Result = Path;
+  for (umm CharIndex = 0; CharIndex < Path.Count; ++CharIndex)
+  {
+    if (Path.Start[CharIndex] == '/' || Path.Start[CharIndex] == '\\')
+    {
+      Result = CS(Path.Start + CharIndex + 1, Path.Count - CharIndex - 1);
+    }
+  }
+  return Result;
+}
+
+link_internal b32
+BaselineCallsitesMatch(debug_baseline_callsite *A, debug_baseline_callsite *B)
+{
+  b32 Result = StringsMatch(A->Name, B->Name);
+  if (Result && A->File.Count && B->File.Count)
+  {
+    Result = StringsMatch(GetBaselineFileName(A->File), GetBaselineFileName(B->File));
+  }
+  return Result;
+}
+
+// NOTE(Jesse): Prints a line for every callsite that isn't the same, or
+// every one at all if Verbose.
+link_internal debug_baseline_report
+CompareBaselines(debug_baseline *Baseline, debug_baseline *Current, debug_baseline_thresholds *Thresholds, b32 Verbose)
+{
+  debug_baseline_report Report = {};
+  debug_duration_histogram Empty = {};
+
+  r64 Change, Z;
+  Report.FrameTime = CompareHistograms(&Baseline->FrameTimes, &Current->FrameTimes, Thresholds, &Change, &Z);
+  PrintBaselineLine(CSz("(frame time)"), &Baseline->FrameTimes, &Current->FrameTimes, Report.FrameTime, Change, Z);
+
+  for ( u32 CurrentIndex = 0;
+            CurrentIndex < Current->CallsiteCount;
+          ++CurrentIndex )
+  {
+    debug_baseline_callsite *CurrentCallsite = Current->Callsites + CurrentIndex;
+
+    debug_baseline_callsite *BaselineCallsite = 0;
+    for ( u32 BaselineIndex = 0;
+              BaselineIndex < Baseline->CallsiteCount;
+            ++BaselineIndex )
+    {
+      if (BaselineCallsitesMatch(Baseline->Callsites + BaselineIndex, CurrentCallsite))
+      {
+        BaselineCallsite = Baseline->Callsites + BaselineIndex;
+        break;
+      }
+    }
+
+    debug_baseline_verdict Verdict = BaselineVerdict_New;
+    Change = Z = 0.0;
+    if (BaselineCallsite)
+    {
+      Verdict = CompareHistograms(BaselineCallsite->Durations, CurrentCallsite->Durations, Thresholds, &Change, &Z);
+    }
+
+    Report.Verdicts[Verdict]++;
+    if (Verbose || (Verdict != BaselineVerdict_Same && Verdict != BaselineVerdict_TooFewSamples))
+    {
+      PrintBaselineLine(CurrentCallsite->Name, BaselineCallsite ? BaselineCallsite->Durations : &Empty, CurrentCallsite->Durations, Verdict, Change, Z);
+    }
+  }
+
+  for ( u32 BaselineIndex = 0;
+            BaselineIndex < Baseline->CallsiteCount;
+          ++BaselineIndex )
+  {
+    debug_baseline_callsite *BaselineCallsite = Baseline->Callsites + BaselineIndex;
+
+    b32 Found = False;
+    for ( u32 CurrentIndex = 0;
+              CurrentIndex < Current->CallsiteCount && !Found;
+            ++CurrentIndex )
+    {
+      Found = BaselineCallsitesMatch(Current->Callsites + CurrentIndex, BaselineCallsite);
+    }
+
+    if (!Found)
+    {
+      Report.Verdicts[BaselineVerdict_Missing]++;
+      PrintBaselineLine(BaselineCallsite->Name, BaselineCallsite->Durations, &Empty, BaselineVerdict_Missing, 0.0, 0.0);
+    }
+  }
+
+  DebugLine("%u regressed, %u improved, %u same, %u too few samples, %u missing, %u new, frame time %s",
+      Report.Verdicts[BaselineVerdict_Regressed], Report.Verdicts[BaselineVerdict_Improved], Report.Verdicts[BaselineVerdict_Same],
+      Report.Verdicts[BaselineVerdict_TooFewSamples], Report.Verdicts[BaselineVerdict_Missing], Report.Verdicts[BaselineVerdict_New],
+      Global_BaselineVerdictNames[Report.FrameTime]);
+
+  return Report;
+}
+
+link_internal debug_baseline_exit_status
+GetBaselineExitStatus(debug_baseline_report *Report)
+{
+  b32 Regressed = Report->FrameTime == BaselineVerdict_Regressed || Report->Verdicts[BaselineVerdict_Regressed];
+  debug_baseline_exit_status Result = Regressed ? BaselineExit_Regressed : BaselineExit_Passed;
+  return Result;
+}
+
+
+
+#if DEBUG_SYSTEM_INTERNAL_BUILD
+
+/*****************************                    **************************/
+/*****************************  Session Baselines  **************************/
+/*****************************                    **************************/
+
+
+
+// NOTE(Jesse): Main thread only.  Points straight at the live session
+// histograms, so it's only good until the next frame advance.
+link_internal void
+GetSessionBaseline(debug_state *State, debug_baseline *Baseline, memory_arena *Memory)
+{
+  Clear(Baseline);
+  Baseline->FrameTimes = State->FrameDurations.Session;
+  Baseline->Callsites = Allocate(debug_baseline_callsite, Memory, State->ScopeCallsiteCount);
+
+  for ( u32 CallsiteIndex = 1;
+            CallsiteIndex < State->ScopeCallsiteCount;
+          ++CallsiteIndex )
+  {
+    debug_duration_stats *Stats = State->CallsiteDurations[CallsiteIndex];
+    if (Stats && Stats->Session.Total)
+    {
+      debug_baseline_callsite *Callsite = Baseline->Callsites + Baseline->CallsiteCount++;
+      Callsite->Name = CS(GetCallsite((u16)CallsiteIndex)->Name);
+      Callsite->File = CS(GetCallsite((u16)CallsiteIndex)->File);
+      Callsite->Durations = &Stats->Session;
+    }
+  }
+}
+
+link_internal b32
+SaveBaseline(const char *Path)
+{
+  debug_baseline Baseline;
+  GetSessionBaseline(GetDebugState(), &Baseline, TranArena);
+
+  b32 Result = WriteBaseline(Path, &Baseline);
+  return Result;
+}
+
+// NOTE(Jesse): Returns a debug_baseline_exit_status, so a soak run can hand
+// it straight to exit()
+link_internal s32
+CompareToBaseline(const char *Path)
+{
+  debug_state *State = GetDebugState();
+
+  memory_arena *BaselineArena = AllocateArena();
+  debug_baseline Baseline;
+  debug_baseline_exit_status Result = BaselineExit_Error;
+
+  if (ReadBaseline(Path, &Baseline, BaselineArena))
+  {
+    debug_baseline Current;
+    GetSessionBaseline(State, &Current, TranArena);
+
+    debug_baseline_report Report = CompareBaselines(&Baseline, &Current, &State->BaselineThresholds, False);
+    Result = GetBaselineExitStatus(&Report);
+  }
+
+  VaporizeArena(BaselineArena);
+  return (s32)Result;
+}
+
+link_internal void
+SetBaselineThresholds(r64 MaxChange, r64 MinZ, u64 MinSamples, u64 MinChangeNs)
+{
+  debug_baseline_thresholds *Thresholds = &GetDebugState()->BaselineThresholds;
+  Thresholds->MaxChange   = MaxChange;
+  Thresholds->MinZ        = MinZ;
+  Thresholds->MinSamples  = MinSamples;
+  Thresholds->MinChangeNs = MinChangeNs;
+}
+
+#endif
@@ -0,0 +1,597 @@
+#if !BONSAI_WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/******************************                  *****************************/
+/******************************  Capture Reader  *****************************/
+/******************************                  *****************************/
+
+
+// NOTE(Jesse): Reads what debug_trace_writer.cpp writes.  Doesn't touch the
+// debug_state, so offline tools can include this with just debug.h.
+//
+// Opening a capture maps it and reads the index off the end, if it has one.
+// Crash dumps don't, so those get scanned once to find the frames.  After
+// that a frame is a seek and a decode of just that frame.
+
+struct debug_capture_reader
+{
+  u8 *At;
+  u8 *End;
+  b32 Overflowed;
+};
+
+link_internal u8
+ReadCaptureU8(debug_capture_reader *Reader)
+{
+  u8 Result = 0;
+  if (Reader->At < Reader->End) { Result = *Reader->At++; }
+  else                          { Reader->Overflowed = True; }
+  return Result;
+}
+
+link_internal u64
+ReadCaptureVarint(debug_capture_reader *Reader)
+{
+  u64 Result = 0;
+  for (u32 Shift = 0; Shift < 64; Shift += 7)
+  {
+    u8 Byte = ReadCaptureU8(Reader);
+    Result |= u64(Byte & 0x7f) << Shift;
+    if ((Byte & 0x80) == 0) break;
+  }
+  return Result;
+}
+
+link_internal s64
+ReadCaptureSigned(debug_capture_reader *Reader)
+{
+  u64 ZigZag = ReadCaptureVarint(Reader);
+  s64 Result = s64(ZigZag >> 1) ^ -s64(ZigZag & 1);
+  return Result;
+}
+
+// NOTE(Jesse): Points into the map; 0 if there isn't Count left
+link_internal u8 *
+ReadCaptureBytes(debug_capture_reader *Reader, u64 Count)
+{
+  u8 *Result = 0;
+  if (u64(Reader->End - Reader->At) >= Count) { Result = Reader->At; Reader->At += Count; }
+  else                                        { Reader->Overflowed = True; Reader->At = Reader->End; }
+  return Result;
+}
+
+link_internal counted_string
+ReadCaptureString(debug_capture_reader *Reader)
+{
+  u64 Count = ReadCaptureVarint(Reader);
+  u8 *Start = ReadCaptureBytes(Reader, Count);
+
+  counted_string Result = CS((const char*)Start, Start ? (umm)Count : 0);
+  return Result;
+}
+
+link_internal void
+ReadCaptureCallsite(debug_capture_reader *Reader, debug_capture *Capture)
+{
+  u64 CallsiteId = ReadCaptureVarint(Reader);
+
+  debug_capture_callsite Callsite = {};
+  Callsite.Line     = (u32)ReadCaptureVarint(Reader);
+  Callsite.Category = (u16)ReadCaptureVarint(Reader);
+  Callsite.Name     = ReadCaptureString(Reader);
+  Callsite.File     = ReadCaptureString(Reader);
+
+  if (CallsiteId <= u16_MAX) { Capture->Callsites[CallsiteId] = Callsite; }
+}
+
+link_internal debug_capture_callsite *
+GetCaptureCallsite(debug_capture *Capture, u16 CallsiteId)
+{
+  debug_capture_callsite *Result = Capture->Callsites + CallsiteId;
+  return Result;
+}
+
+/******************************                  *****************************/
+/******************************  Frame Decoding  *****************************/
+/******************************                  *****************************/
+
+
+struct debug_capture_tree_builder
+{
+  debug_capture_scope *Open;
+  debug_capture_scope *LastClosed;
+  debug_capture_scope *Tails[DEBUG_CAPTURE_MAX_DEPTH]; // Last scope at each depth under whatever's open
+  u32 Depth;
+  u32 Overflow; // Begins we didn't have room for, so their Ends get skipped too
+
+  u64 LastCycle;
+};
+
+link_internal void
+PushCaptureScope(debug_capture_thread *Thread, debug_capture_tree_builder *Builder, debug_capture_scope *Scope)
+{
+  if (Builder->Tails[Builder->Depth])  { Builder->Tails[Builder->Depth]->Sibling = Scope; }
+  else if (Builder->Open)              { Builder->Open->Child = Scope; }
+  else                                 { Thread->Root = Scope; }
+
+  Builder->Tails[Builder->Depth] = Scope;
+  ++Thread->ScopeCount;
+}
+
+// NOTE(Jesse): An End with nothing open belongs to a scope that was opened in
+// an earlier frame.  Everything we've seen at the top so far happened inside
+// of it, so it becomes their parent.
+link_internal void
+CloseContinuedCaptureScope(debug_capture_thread *Thread, debug_capture_tree_builder *Builder, debug_capture_frame_index *Index, u64 Cycle, memory_arena *Memory)
+{
+  debug_capture_scope *Scope = Allocate(debug_capture_scope, Memory, 1);
+  Scope->StartingCycle = Index->StartingCycle;
+  Scope->EndingCycle   = Cycle;
+  Scope->Continued     = True;
+  Scope->Child         = Thread->Root;
+
+  for (debug_capture_scope *Child = Thread->Root; Child; Child = Child->Sibling)
+  {
+    Child->Parent = Scope;
+  }
+
+  Thread->Root = Scope;
+  ++Thread->ScopeCount;
+
+  Builder->Tails[0] = Scope;
+  Builder->LastClosed = Scope;
+}
+
+link_internal void
+DecodeCaptureScopeEvents(debug_capture_reader *Reader, debug_capture_frame *Frame, debug_capture_tree_builder **Builders, memory_arena *Memory)
+{
+  u32 ThreadIndex = (u32)ReadCaptureVarint(Reader);
+  u64 EventCount = ReadCaptureVarint(Reader);
+  if (ThreadIndex >= DEBUG_CAPTURE_MAX_THREADS) { Reader->Overflowed = True; return; }
+
+  debug_capture_thread *Thread = Frame->Threads + ThreadIndex;
+  Frame->ThreadCount = Max(Frame->ThreadCount, ThreadIndex+1);
+
+  debug_capture_tree_builder *Builder = Builders[ThreadIndex];
+  if (!Builder)
+  {
+    Builder = Builders[ThreadIndex] = Allocate(debug_capture_tree_builder, Memory, 1);
+    Builder->LastCycle = Frame->Index->StartingCycle;
+  }
+
+  for ( u64 EventIndex = 0;
+            EventIndex < EventCount && !Reader->Overflowed;
+          ++EventIndex )
+  {
+    u64 Packed = ReadCaptureVarint(Reader);
+    u32 Type = u32(Packed & 3);
+
+    switch (Type)
+    {
+      case ScopeEvent_Begin:
+      case ScopeEvent_End:
+      {
+        u64 ZigZag = Packed >> 2;
+        s64 Delta = s64(ZigZag >> 1) ^ -s64(ZigZag & 1);
+        u64 Cycle = Builder->LastCycle = Builder->LastCycle + u64(Delta);
+
+        if (Type == ScopeEvent_Begin)
+        {
+          u16 CallsiteId = (u16)ReadCaptureVarint(Reader);
+          u16 SampleMask = (u16)ReadCaptureVarint(Reader);
+
+          if (Builder->Depth == DEBUG_CAPTURE_MAX_DEPTH)
+          {
+            ++Builder->Overflow;
+            break;
+          }
+
+          debug_capture_scope *Scope = Allocate(debug_capture_scope, Memory, 1);
+          Scope->StartingCycle = Cycle;
+          Scope->CallsiteId    = CallsiteId;
+          Scope->SampleMask    = SampleMask;
+          Scope->Parent        = Builder->Open;
+
+          PushCaptureScope(Thread, Builder, Scope);
+
+          Builder->Open = Scope;
+          ++Builder->Depth;
+          if (Builder->Depth < DEBUG_CAPTURE_MAX_DEPTH) { Builder->Tails[Builder->Depth] = 0; }
+        }
+        else if (Builder->Overflow)
+        {
+          --Builder->Overflow;
+        }
+        else if (Builder->Open)
+        {
+          Builder->Open->EndingCycle = Cycle;
+          Builder->LastClosed = Builder->Open;
+          Builder->Open = Builder->Open->Parent;
+          --Builder->Depth;
+        }
+        else
+        {
+          CloseContinuedCaptureScope(Thread, Builder, Frame->Index, Cycle, Memory);
+        }
+      } break;
+
+      case ScopeEvent_Payload:
+      {
+        if (Builder->LastClosed) { Builder->LastClosed->Payload = Packed >> 2; }
+      } break;
+
+      // NOTE(Jesse): A slot the crash handler found half written
+      case ScopeEvent_None: {} break;
+
+      default:
+      {
+        Reader->Overflowed = True;
+      } break;
+    }
+  }
+}
+
+link_internal void
+DecodeCaptureMutexOps(debug_capture_reader *Reader, debug_capture_frame *Frame, u64 *LastMutex, memory_arena *Memory)
+{
+  u32 ThreadIndex = (u32)ReadCaptureVarint(Reader);
+  u32 Count = (u32)ReadCaptureVarint(Reader);
+  if (ThreadIndex >= DEBUG_CAPTURE_MAX_THREADS || Count > MUTEX_OPS_PER_FRAME) { Reader->Overflowed = True; return; }
+
+  debug_capture_thread *Thread = Frame->Threads + ThreadIndex;
+  Frame->ThreadCount = Max(Frame->ThreadCount, ThreadIndex+1);
+
+  Thread->MutexOps = Allocate(debug_capture_mutex_op, Memory, Count);
+  Thread->MutexOpCount = Count;
+
+  u64 LastCycle = Frame->Index->StartingCycle;
+  for (u32 OpIndex = 0; OpIndex < Count; ++OpIndex)
+  {
+    debug_capture_mutex_op *Op = Thread->MutexOps + OpIndex;
+    Op->Op    = ReadCaptureU8(Reader);
+    Op->Cycle = LastCycle = LastCycle + u64(ReadCaptureSigned(Reader));
+    Op->Mutex = *LastMutex = *LastMutex + u64(ReadCaptureSigned(Reader));
+  }
+}
+
+// NOTE(Jesse): There's usually one of these a frame, so growing the array
+// when there's another is fine.
+link_internal void
+DecodeCaptureContextSwitches(debug_capture_reader *Reader, debug_capture_frame *Frame, u64 *LastCycle, memory_arena *Memory)
+{
+  u32 Count = (u32)ReadCaptureVarint(Reader);
+  if (Count > DEBUG_TRACE_CHUNK_EVENTS) { Reader->Overflowed = True; return; }
+
+  debug_capture_context_switch *Switches = Allocate(debug_capture_context_switch, Memory, Frame->ContextSwitchCount + Count);
+  if (Frame->ContextSwitchCount)
+  {
+    MemCopy((u8*)Frame->ContextSwitches, (u8*)Switches, Frame->ContextSwitchCount*sizeof(debug_capture_context_switch));
+  }
+
+  for (u32 SwitchIndex = 0; SwitchIndex < Count; ++SwitchIndex)
+  {
+    debug_capture_context_switch *Switch = Switches + Frame->ContextSwitchCount + SwitchIndex;
+    Switch->ThreadIndex     = (u32)ReadCaptureVarint(Reader);
+    Switch->Type            = (u32)ReadCaptureVarint(Reader);
+    Switch->ProcessorNumber = (u32)ReadCaptureVarint(Reader);
+    Switch->Cycle = *LastCycle = *LastCycle + u64(ReadCaptureSigned(Reader));
+  }
+
+  Frame->ContextSwitches = Switches;
+  Frame->ContextSwitchCount += Count;
+}
+
+// NOTE(Jesse): Skips a record, other than picking up callsites.  Leaves the
+// reader at the next one.
+link_internal void
+SkipCaptureRecord(debug_capture_reader *Reader, debug_capture *Capture, u8 Type)
+{
+  switch (Type)
+  {
+    case TraceRecord_Callsite:
+    {
+      ReadCaptureCallsite(Reader, Capture);
+    } break;
+
+    case TraceRecord_ScopeEvents:
+    {
+      ReadCaptureVarint(Reader);
+      u64 EventCount = ReadCaptureVarint(Reader);
+      for (u64 EventIndex = 0; EventIndex < EventCount && !Reader->Overflowed; ++EventIndex)
+      {
+        u64 Packed = ReadCaptureVarint(Reader);
+        if ((Packed & 3) == ScopeEvent_Begin) { ReadCaptureVarint(Reader); ReadCaptureVarint(Reader); }
+      }
+    } break;
+
+    case TraceRecord_MutexOps:
+    {
+      ReadCaptureVarint(Reader);
+      u64 Count = ReadCaptureVarint(Reader);
+      for (u64 OpIndex = 0; OpIndex < Count && !Reader->Overflowed; ++OpIndex)
+      {
+        ReadCaptureU8(Reader);
+        ReadCaptureVarint(Reader);
+        ReadCaptureVarint(Reader);
+      }
+    } break;
+
+    case TraceRecord_ContextSwitches:
+    {
+      u64 Count = ReadCaptureVarint(Reader);
+      for (u64 SwitchIndex = 0; SwitchIndex < 4*Count && !Reader->Overflowed; ++SwitchIndex)
+      {
+        ReadCaptureVarint(Reader);
+      }
+    } break;
+
+    default:
+    {
+      Reader->Overflowed = True;
+    } break;
+  }
+}
+
+// NOTE(Jesse): Everything comes out of Memory, which the caller can throw
+// away as soon as it's done with the frame.
+link_internal b32
+DecodeCaptureFrame(debug_capture *Capture, u32 FrameIndex, debug_capture_frame *Frame, memory_arena *Memory)
+{
+  Clear(Frame);
+  if (FrameIndex >= Capture->FrameCount) return False;
+
+  Frame->Index = Capture->Frames + FrameIndex;
+
+  // NOTE(Jesse): Straight out of the file, so careful not to wrap
+  if (Frame->Index->Offset > Capture->Size || Frame->Index->Size > Capture->Size - Frame->Index->Offset) return False;
+
+  debug_capture_reader Reader = { Capture->Data + Frame->Index->Offset, Capture->Data + Frame->Index->Offset + Frame->Index->Size, False };
+  debug_capture_tree_builder **Builders = Allocate(debug_capture_tree_builder*, Memory, DEBUG_CAPTURE_MAX_THREADS);
+
+  u64 LastMutex = 0;
+  u64 LastContextSwitchCycle = Frame->Index->StartingCycle;
+
+  while (Reader.At < Reader.End && !Reader.Overflowed)
+  {
+    u8 Type = ReadCaptureU8(&Reader);
+    switch (Type)
+    {
+      case TraceRecord_Frame:
+      {
+        // NOTE(Jesse): Already have all of this from the index
+        ReadCaptureVarint(&Reader);
+        ReadCaptureVarint(&Reader);
+        ReadCaptureVarint(&Reader);
+        ReadCaptureBytes(&Reader, sizeof(r64) + sizeof(r32));
+      } break;
+
+      case TraceRecord_ScopeEvents:     { DecodeCaptureScopeEvents(&Reader, Frame, Builders, Memory); } break;
+      case TraceRecord_MutexOps:        { DecodeCaptureMutexOps(&Reader, Frame, &LastMutex, Memory); } break;
+      case TraceRecord_ContextSwitches: { DecodeCaptureContextSwitches(&Reader, Frame, &LastContextSwitchCycle, Memory); } break;
+
+      default: { SkipCaptureRecord(&Reader, Capture, Type); } break;
+    }
+  }
+
+  if (Reader.Overflowed) { Warn("Capture frame %u is corrupt; showing what decoded", Frame->Index->FrameId); }
+
+  b32 Result = !Reader.Overflowed;
+  return Result;
+}
+
+/******************************                   ****************************/
+/******************************  Opening Captures ****************************/
+/******************************                   ****************************/
+
+
+// NOTE(Jesse): Fills in Capture->Frames from the Frame records, for files
+// that never got an index.  Two passes so the index can be one array.
+link_internal void
+ScanCaptureFrames(debug_capture *Capture, u64 End)
+{
+  for (u32 Pass = 0; Pass < 2; ++Pass)
+  {
+    debug_capture_reader Reader = { Capture->Data + 8, Capture->Data + End, False };
+    debug_capture_frame_index *Last = 0;
+    u32 FrameCount = 0;
+
+    while (Reader.At < Reader.End && !Reader.Overflowed)
+    {
+      u64 Offset = u64(Reader.At - Capture->Data);
+      u8 Type = ReadCaptureU8(&Reader);
+
+      if (Type == TraceRecord_Frame)
+      {
+        debug_capture_frame_index Entry = {};
+        Entry.Offset        = Offset;
+        Entry.FrameId       = (u32)ReadCaptureVarint(&Reader);
+        Entry.StartingCycle = ReadCaptureVarint(&Reader);
+        Entry.TotalCycles   = ReadCaptureVarint(&Reader);
+
+        u8 *Raw = ReadCaptureBytes(&Reader, sizeof(r64) + sizeof(r32));
+        if (Raw)
+        {
+          MemCopy(Raw, (u8*)&Entry.NsPerCycle, sizeof(r64));
+          MemCopy(Raw + sizeof(r64), (u8*)&Entry.FrameMs, sizeof(r32));
+        }
+
+        if (Pass == 1)
+        {
+          if (Last) { Last->Size = Offset - Last->Offset; }
+          Last = Capture->Frames + FrameCount;
+          *Last = Entry;
+        }
+        ++FrameCount;
+      }
+      else if (Type == TraceRecord_Index)
+      {
+        break;
+      }
+      else
+      {
+        SkipCaptureRecord(&Reader, Capture, Type);
+      }
+    }
+
+    // NOTE(Jesse): A crash dump can end anywhere; the last frame gets
+    // whatever made it.
+    if (Pass == 0)
+    {
+      Capture->FrameCount = FrameCount;
+      Capture->Frames = Allocate(debug_capture_frame_index, Capture->Memory, Max(FrameCount, 1u));
+    }
+    else if (Last)
+    {
+      Last->Size = u64(Reader.At - Capture->Data) - Last->Offset;
+    }
+  }
+}
+
+link_internal b32
+ReadCaptureIndex(debug_capture *Capture)
+{
+  if (Capture->Size < 8 + sizeof(debug_capture_trailer)) return False;
+
+  u64 TrailerOffset = Capture->Size - sizeof(debug_capture_trailer);
+  debug_capture_trailer *Trailer = (debug_capture_trailer*)(Capture->Data + TrailerOffset);
+  u64 FramesSize = u64(Trailer->FrameCount) * sizeof(debug_capture_frame_index);
+
+  b32 Result = Trailer->Magic == DEBUG_CAPTURE_TRAILER_MAGIC &&
+               Trailer->IndexOffset >= 8 &&
+               Trailer->IndexOffset < Trailer->FrameIndexOffset &&
+               Trailer->FrameIndexOffset <= TrailerOffset &&
+               Trailer->FrameIndexOffset % 8 == 0 &&
+               FramesSize == TrailerOffset - Trailer->FrameIndexOffset;
+
+  if (Result)
+  {
+    debug_capture_reader Reader = { Capture->Data + Trailer->IndexOffset, Capture->Data + Trailer->FrameIndexOffset, False };
+    if (ReadCaptureU8(&Reader) == TraceRecord_Index)
+    {
+      u64 CallsiteCount = ReadCaptureVarint(&Reader);
+      for (u64 CallsiteIndex = 0; CallsiteIndex < CallsiteCount && !Reader.Overflowed; ++CallsiteIndex)
+      {
+        ReadCaptureCallsite(&Reader, Capture);
+      }
+    }
+    else
+    {
+      Reader.Overflowed = True;
+    }
+
+    Capture->Frames = (debug_capture_frame_index*)(Capture->Data + Trailer->FrameIndexOffset);
+    Capture->FrameCount = Trailer->FrameCount;
+    Capture->Indexed = True;
+
+    Result = !Reader.Overflowed;
+  }
+
+  return Result;
+}
+
+link_internal void
+UnmapCapture(debug_capture *Capture)
+{
+#if BONSAI_WIN32
+  if (Capture->Data) { UnmapViewOfFile(Capture->Data); }
+  if (Capture->MapHandle) { CloseHandle((HANDLE)Capture->MapHandle); }
+  if (Capture->FileHandle) { CloseHandle((HANDLE)Capture->FileHandle); }
+#else
+  if (Capture->Data) { munmap(Capture->Data, Capture->Size); }
+#endif
+
+  Capture->Data = 0;
+  Capture->Size = 0;
+  Capture->MapHandle = 0;
+  Capture->FileHandle = 0;
+}
+
+link_internal b32
+MapCapture(debug_capture *Capture, const char *Path)
+{
+#if BONSAI_WIN32
+  HANDLE File = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+  if (File == INVALID_HANDLE_VALUE) return False;
+  Capture->FileHandle = (umm)File;
+
+  LARGE_INTEGER Size;
+  if (GetFileSizeEx(File, &Size) && Size.QuadPart)
+  {
+    HANDLE Map = CreateFileMappingA(File, 0, PAGE_READONLY, 0, 0, 0);
+    if (Map)
+    {
+      Capture->MapHandle = (umm)Map;
+      Capture->Data = (u8*)MapViewOfFile(Map, FILE_MAP_READ, 0, 0, 0);
+      Capture->Size = (u64)Size.QuadPart;
+    }
+  }
+#else
+  s32 Fd = open(Path, O_RDONLY);
+  if (Fd < 0) return False;
+
+  struct stat Stat;
+  if (fstat(Fd, &Stat) == 0 && Stat.st_size > 0)
+  {
+    void *Data = mmap(0, (size_t)Stat.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+    if (Data != MAP_FAILED)
+    {
+      Capture->Data = (u8*)Data;
+      Capture->Size = (u64)Stat.st_size;
+    }
+  }
+
+  // NOTE(Jesse): The map keeps the file around
+  close(Fd);
+#endif
+
+  b32 Result = Capture->Data != 0;
+  if (!Result) { UnmapCapture(Capture); }
+  return Result;
+}
+
+link_internal void
+CloseCapture(debug_capture *Capture)
+{
+  UnmapCapture(Capture);
+  if (Capture->Memory) { VaporizeArena(Capture->Memory); }
+  Clear(Capture);
+}
+
+link_internal b32
+OpenCapture(debug_capture *Capture, const char *Path)
+{
+  Clear(Capture);
+
+  if (!MapCapture(Capture, Path)) { Error("Couldn't map capture (%s)", Path); return False; }
+
+  b32 Result = Capture->Size >= 8 && Capture->Data[0] == 'B' && Capture->Data[1] == 'D' && Capture->Data[2] == 'T' && Capture->Data[3] == 'R';
+  if (Result)
+  {
+    MemCopy(Capture->Data + 4, (u8*)&Capture->Version, sizeof(u32));
+    Result = Capture->Version == DEBUG_TRACE_VERSION;
+    if (!Result) { Error("Capture (%s) is version %u, we read version %u", Path, Capture->Version, DEBUG_TRACE_VERSION); }
+  }
+  else
+  {
+    Error("(%s) isn't a capture", Path);
+  }
+
+  if (Result)
+  {
+    Capture->Memory = AllocateArena();
+    Capture->Callsites = Allocate(debug_capture_callsite, Capture->Memory, u16_MAX+1);
+
+    if (!ReadCaptureIndex(Capture))
+    {
+      Capture->Indexed = False;
+      ScanCaptureFrames(Capture, Capture->Size);
+    }
+  }
+
+  if (!Result) { CloseCapture(Capture); }
+  return Result;
+}
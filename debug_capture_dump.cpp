@@ -0,0 +1,95 @@
+// NOTE(Jesse): Prints what's in a BDTR capture without loading all of it.
+// With no frame it lists every frame out of the index; with one it decodes
+// just that frame and prints its trees.
+//
+//   debug_capture_dump <capture> [frame index]
+
+#define DEBUG_SYSTEM_API 1
+
+#include <stdlib.h>
+
+#include <bonsai_stdlib/bonsai_stdlib.h>
+#include <bonsai_stdlib/bonsai_stdlib.cpp>
+
+#include <bonsai_debug/debug.h>
+#include <bonsai_debug/debug_capture.cpp>
+
+link_internal void
+DumpCaptureScopes(debug_capture *Capture, debug_capture_scope *FirstScope, r64 NsPerCycle, u32 Depth)
+{
+  for ( debug_capture_scope *Scope = FirstScope;
+                             Scope;
+                             Scope = Scope->Sibling )
+  {
+    counted_string Name = Scope->Continued ? CSz("(continued)") : GetCaptureCallsite(Capture, Scope->CallsiteId)->Name;
+
+    if (Scope->EndingCycle)
+    {
+      r64 Us = r64(Scope->EndingCycle - Scope->StartingCycle) * NsPerCycle / 1000.0;
+      if (Scope->Payload) { DebugLine("%*c%S %.2fus %lu items", Depth*2, ' ', Name, Us, Scope->Payload); }
+      else                { DebugLine("%*c%S %.2fus", Depth*2, ' ', Name, Us); }
+    }
+    else
+    {
+      DebugLine("%*c%S (open)", Depth*2, ' ', Name);
+    }
+
+    DumpCaptureScopes(Capture, Scope->Child, NsPerCycle, Depth+1);
+  }
+}
+
+s32
+main(s32 ArgCount, const char **Args)
+{
+  if (ArgCount < 2)
+  {
+    DebugLine("usage: debug_capture_dump <capture> [frame index]");
+    return 1;
+  }
+
+  debug_capture Capture;
+  if (!OpenCapture(&Capture, Args[1])) { return 1; }
+
+  if (ArgCount < 3)
+  {
+    DebugLine("%u frames%s", Capture.FrameCount, Capture.Indexed ? "" : " (not indexed, scanned)");
+    for ( u32 FrameIndex = 0;
+              FrameIndex < Capture.FrameCount;
+            ++FrameIndex )
+    {
+      debug_capture_frame_index *Frame = Capture.Frames + FrameIndex;
+      DebugLine("%u frame %u %.2fms %lu bytes at %lu", FrameIndex, Frame->FrameId, r64(Frame->FrameMs), Frame->Size, Frame->Offset);
+    }
+  }
+  else
+  {
+    u32 FrameIndex = (u32)strtoul(Args[2], 0, 10);
+
+    memory_arena *Memory = AllocateArena();
+    debug_capture_frame *Frame = Allocate(debug_capture_frame, Memory, 1);
+
+    if (FrameIndex >= Capture.FrameCount)
+    {
+      Error("Frame index %u is past the end of the capture (%u frames)", FrameIndex, Capture.FrameCount);
+      CloseCapture(&Capture);
+      return 1;
+    }
+
+    DecodeCaptureFrame(&Capture, FrameIndex, Frame, Memory);
+    DebugLine("frame %u %.2fms, %u context switches", Frame->Index->FrameId, r64(Frame->Index->FrameMs), Frame->ContextSwitchCount);
+
+    for ( u32 ThreadIndex = 0;
+              ThreadIndex < Frame->ThreadCount;
+            ++ThreadIndex )
+    {
+      debug_capture_thread *Thread = Frame->Threads + ThreadIndex;
+      if (!Thread->Root && !Thread->MutexOpCount) continue;
+
+      DebugLine("Thread %u, %u scopes, %u lock ops", ThreadIndex, Thread->ScopeCount, Thread->MutexOpCount);
+      DumpCaptureScopes(&Capture, Thread->Root, Frame->Index->NsPerCycle, 1);
+    }
+  }
+
+  CloseCapture(&Capture);
+  return 0;
+}
@@ -1,9 +1,40 @@
+#if BONSAI_WIN32
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
 /* debug_global thread_local u32 ThreadLocal_ThreadIndex = 0; */
 debug_global b32 DebugGlobal_RedrawEveryPush = 0;
 
+link_internal void BuildScopeTree(debug_thread_state *ThreadState, debug_scope_tree *Tree);
+link_internal void UpdateCallsiteBudget(debug_state *State, u16 CallsiteId);
+link_internal void UpdateCallsiteBudgets(debug_state *State);
+link_internal b32 ScopeEventsOverwritten(debug_scope_event_ring *Ring, u64 FirstEvent);
+link_internal void HandOffTraceFrame(debug_state *State, u32 FrameId);
+link_internal void UpdateCallsiteCaptureTrigger(debug_state *State, u16 CallsiteId);
+link_internal void CheckScopeCaptureTrigger(debug_state *State, u16 CallsiteId, u64 Cycles, u32 FrameId);
+link_internal void UpdateFlightRecorder(debug_state *State, frame_stats *ThisFrame, u32 LastFrameId);
+link_internal void InitFlightRecorder(debug_state *State);
+link_internal debug_open_scope_stack GetOpenScopesAtStart(debug_thread_state *ThreadState, debug_scope_tree *Tree);
+link_internal debug_open_scope_stack *GetOpenScopesAtEnd(debug_thread_state *ThreadState, debug_scope_tree *Tree);
+link_internal void PushOpenScope(debug_open_scope_stack *Stack, u64 BeginEvent);
+link_internal void PopOpenScope(debug_open_scope_stack *Stack);
+
+inline u32
+GetFrameSlot(u64 FrameId)
+{
+  u32 Result = (u32)(FrameId % GetDebugState()->FramesTracked);
+  return Result;
+}
+
 debug_scope_tree* GetReadScopeTree(u32 ThreadIndex)
 {
-  debug_scope_tree *RootScope = &GetDebugState()->ThreadStates[ThreadIndex].ScopeTrees[GetDebugState()->ReadScopeIndex];
+  debug_thread_state *ThreadState = &GetDebugState()->ThreadStates[ThreadIndex];
+  debug_scope_tree *RootScope = &ThreadState->ScopeTrees[GetDebugState()->ReadScopeIndex];
+
+  BuildScopeTree(ThreadState, RootScope);
+
   return RootScope;
 }
 
@@ -14,12 +45,85 @@ debug_scope_tree* GetWriteScopeTree()
   debug_thread_state* ThreadState = GetDebugState()->GetThreadLocalState();
   if (ThreadState)
   {
-    Result = ThreadState->ScopeTrees + (ThreadState->WriteIndex % DEBUG_FRAMES_TRACKED);
+    Result = ThreadState->ScopeTrees + GetFrameSlot(ThreadState->WriteIndex);
+  }
+
+  return Result;
+}
+
+// NOTE(Jesse): This is what other modules call to fill in their copy of
+// ThreadLocal_ScopeEvents, so it must not hand out a ring for a thread that
+// hasn't been registered; it'd get cached forever.  Our own copy is wiped
+// when we get reloaded, in which case we find the thread by id.
+debug_scope_event_ring* GetWriteScopeEvents()
+{
+  debug_scope_event_ring* Result = ThreadLocal_ScopeEvents;
+
+  debug_state *State = GetDebugState();
+  if (!Result && State->ThreadStates)
+  {
+    u32 ThreadId = GetCurrentThreadId();
+    u32 TotalThreadCount = GetTotalThreadCount();
+    for ( u32 ThreadIndex = 0;
+              ThreadIndex < TotalThreadCount;
+            ++ThreadIndex )
+    {
+      debug_thread_state *ThreadState = State->ThreadStates + ThreadIndex;
+      if (ThreadState->ThreadId == ThreadId)
+      {
+        Result = ThreadState->ScopeEvents;
+        ThreadLocal_ScopeEvents = Result;
+        break;
+      }
+    }
   }
 
   return Result;
 }
 
+link_internal u32
+GetEnabledScopeCategories(debug_state *State)
+{
+  u32 Result = State->DebugDoScopeProfiling ? State->ScopeCategoryMask : 0;
+  return Result;
+}
+
+link_internal void
+UpdateEnabledScopeCategories(debug_state *State)
+{
+  if (State->ThreadStates)
+  {
+    u32 EnabledCategories = GetEnabledScopeCategories(State);
+
+    u32 TotalThreadCount = GetTotalThreadCount();
+    for ( u32 ThreadIndex = 0;
+              ThreadIndex < TotalThreadCount;
+            ++ThreadIndex )
+    {
+      debug_scope_event_ring *Ring = State->ThreadStates[ThreadIndex].ScopeEvents;
+      if (Ring) { Ring->EnabledCategories = EnabledCategories; }
+    }
+  }
+
+  return;
+}
+
+link_internal void
+SetScopeProfilingEnabled(debug_state *State, b32 Enabled)
+{
+  State->DebugDoScopeProfiling = Enabled;
+  UpdateEnabledScopeCategories(State);
+  return;
+}
+
+link_internal void
+ToggleScopeCategory(debug_state *State, u32 Category)
+{
+  State->ScopeCategoryMask ^= (1u << Category);
+  UpdateEnabledScopeCategories(State);
+  return;
+}
+
 
 
 /*****************************                   *****************************/
@@ -61,6 +165,8 @@ RegisterThread(thread_startup_params *Params)
   debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadLocal_ThreadIndex);
   ThreadState->ThreadId = GetCurrentThreadId(); // Params->ThreadId;
   /* Assert(ThreadState->ThreadId); */
+
+  ThreadLocal_ScopeEvents = ThreadState->ScopeEvents;
   return;
 }
 #endif
@@ -74,6 +180,138 @@ GetThreadLocalState()
 
 
 
+/****************************                   ******************************/
+/****************************  Scope Callsites  ******************************/
+/****************************                   ******************************/
+
+
+
+link_internal b32
+CallsitesMatch(debug_scope_callsite *First, debug_scope_callsite *Second)
+{
+  b32 Result = ( First->Line == Second->Line          &&
+                 StringsMatch(First->Name, Second->Name) &&
+                 StringsMatch(First->File, Second->File) );
+  return Result;
+}
+
+// NOTE(Jesse): This is the slow path; it runs once per callsite, per loaded
+// module.  Callsites that get registered again after a hot reload find their
+// old entry and keep their Id.  We copy the strings because the module that
+// owns the originals can be unloaded out from under us.
+void
+RegisterScopeCallsite(debug_scope_callsite *Callsite)
+{
+  debug_state *DebugState = GetDebugState();
+
+  while (!AtomicCompareExchange(&DebugState->ScopeCallsiteLock, 1, 0)) {}
+
+  if (!Callsite->Id)
+  {
+    u16 Id = 0;
+    for ( u32 CallsiteIndex = 1;
+              CallsiteIndex < DebugState->ScopeCallsiteCount;
+            ++CallsiteIndex )
+    {
+      if (CallsitesMatch(DebugState->ScopeCallsites + CallsiteIndex, Callsite))
+      {
+        Id = (u16)CallsiteIndex;
+        break;
+      }
+    }
+
+    if (!Id)
+    {
+      if (DebugState->ScopeCallsiteCount < MAX_DEBUG_SCOPE_CALLSITES-1)
+      {
+        Id = (u16)DebugState->ScopeCallsiteCount++;
+
+        debug_scope_callsite *Registered = DebugState->ScopeCallsites + Id;
+        Registered->Name = GetNullTerminated(CS(Callsite->Name), DebugState->ScopeCallsiteMemory);
+        Registered->File = GetNullTerminated(CS(Callsite->File), DebugState->ScopeCallsiteMemory);
+        Registered->Line = Callsite->Line;
+        Registered->Id   = Id;
+
+        UpdateCallsiteCaptureTrigger(DebugState, Id);
+      }
+      else
+      {
+        Warn("MAX_DEBUG_SCOPE_CALLSITES (%u) exceeded, recording (%s) as unknown.", MAX_DEBUG_SCOPE_CALLSITES, Callsite->Name);
+        Id = MAX_DEBUG_SCOPE_CALLSITES-1;
+      }
+    }
+
+    // NOTE(Jesse): The budget and category are allowed to change across a reload
+    debug_scope_callsite *Registered = DebugState->ScopeCallsites + Id;
+    if (Id != MAX_DEBUG_SCOPE_CALLSITES-1)
+    {
+      Registered->Category = Callsite->Category;
+
+      if (Registered->BudgetUs != Callsite->BudgetUs)
+      {
+        Registered->BudgetUs = Callsite->BudgetUs;
+        UpdateCallsiteBudget(DebugState, Id);
+      }
+    }
+
+    Callsite->Id = Id;
+  }
+
+  DebugState->ScopeCallsiteLock = 0;
+
+  return;
+}
+
+link_internal debug_scope_callsite *
+GetCallsite(u16 CallsiteId)
+{
+  debug_scope_callsite *Result = GetDebugState()->ScopeCallsites + CallsiteId;
+  return Result;
+}
+
+link_internal debug_scope_callsite *
+GetCallsite(debug_profile_scope *Scope)
+{
+  debug_scope_callsite *Result = GetCallsite(Scope->CallsiteId);
+  return Result;
+}
+
+link_internal counted_string
+GetCallsiteLocation(debug_scope_callsite *Callsite)
+{
+  counted_string Result = FormatCountedString(TranArena, CSz("%s:%u"), Callsite->File, Callsite->Line);
+  return Result;
+}
+
+link_internal void
+InitScopeCallsites(debug_state *DebugState)
+{
+  DebugState->ScopeCallsiteMemory = AllocateArena();
+  DEBUG_REGISTER_ARENA(DebugState->ScopeCallsiteMemory, 0);
+
+  debug_scope_callsite *Unknown = DebugState->ScopeCallsites;
+  Unknown->Name = "(unknown)";
+  Unknown->File = "";
+
+  debug_scope_callsite *Overflow = DebugState->ScopeCallsites + MAX_DEBUG_SCOPE_CALLSITES-1;
+  Overflow->Name = "(MAX_DEBUG_SCOPE_CALLSITES exceeded)";
+  Overflow->File = "";
+  Overflow->Id   = MAX_DEBUG_SCOPE_CALLSITES-1;
+
+  DebugState->ScopeCallsiteCount = 1;
+
+  for ( u32 CallsiteIndex = 0;
+            CallsiteIndex < MAX_DEBUG_SCOPE_CALLSITES;
+          ++CallsiteIndex )
+  {
+    DebugState->ScopeCallsiteBudgetCycles[CallsiteIndex] = u64_MAX;
+  }
+
+  return;
+}
+
+
+
 /****************************                       **************************/
 /****************************  Arena Introspection  **************************/
 /****************************                       **************************/
@@ -268,6 +506,7 @@ WriteMemoryRecord(memory_record *InputMeta)
   {
     memory_record *MetaTable = Thread->MetaTable;
     WriteToMetaTable(InputMeta, MetaTable, PushesMatchExactly);
+    Thread->Counters.Allocations++;
   }
   return;
 }
@@ -408,12 +647,44 @@ GetCycleCount(debug_profile_scope *Scope)
   u64 Result = 0;
   if (Scope->EndingCycle)
   {
-    Assert(Scope->EndingCycle > Scope->StartingCycle);
+    Assert(Scope->EndingCycle >= Scope->StartingCycle);
     Result = Scope->EndingCycle - Scope->StartingCycle;
   }
   return Result;
 }
 
+// NOTE(Jesse): For scopes with a payload (TIMED_BLOCK_N).  Both are 0 when
+// there's nothing to divide by.
+link_internal r64
+GetCyclesPerItem(u64 Cycles, u64 Items)
+{
+  r64 Result = SafeDivide0(r64(Cycles), r64(Items));
+  return Result;
+}
+
+link_internal r64
+GetItemsPerSecond(u64 Cycles, u64 Items, r64 NsPerCycle)
+{
+  r64 Seconds = r64(Cycles) * NsPerCycle / 1000000000.0;
+  r64 Result = SafeDivide0(r64(Items), Seconds);
+  return Result;
+}
+
+// NOTE(Jesse): GetCycleCount minus what the profiler itself added: one
+// rdtsc for the scope measuring itself, and a whole empty TIMED_BLOCK for
+// every scope recorded underneath it.
+link_internal u64
+GetCorrectedCycleCount(debug_profile_scope *Scope)
+{
+  debug_profiler_overhead *Overhead = &GetDebugState()->Overhead;
+
+  u64 Result = GetCycleCount(Scope);
+  u64 ProfilerCycles = Overhead->RdtscCycles + (Scope->DescendantCount * Overhead->ScopeCycles);
+
+  Result = Result > ProfilerCycles ? Result - ProfilerCycles : 0;
+  return Result;
+}
+
 void
 InitScopeTree(debug_scope_tree *Tree)
 {
@@ -425,33 +696,74 @@ InitScopeTree(debug_scope_tree *Tree)
   return;
 }
 
-void
-FreeScopes(debug_thread_state *ThreadState, debug_profile_scope *ScopeToFree)
-{
-  // Behaves poorly when timed because it adds a profile scope for every
-  // profile scope present, which has the net effect of adding infinite scopes
-  // over the course of the program.
-  //
-  // Can be timed by wrapping the call site with a TIMED_BLOCK
-  //
-  /* TIMED_FUNCTION(); */
+link_internal void
+ResetScopeTreeCursor(debug_scope_tree *Tree)
+{
+  Tree->Root              = 0;
+  Tree->WriteScope        = &Tree->Root;
+  Tree->ParentOfNextScope = 0;
+  Tree->BuiltFrame        = 0;
+  Tree->ScopesDropped     = 0;
+  Tree->ScopesCollapsed   = 0;
+  Tree->BlocksStolen      = 0;
+}
 
+// NOTE(Jesse): Puts a subtree on the trees free list.  Iterative, so deep
+// trees can't blow the stack; every childs sibling chain gets spliced in ahead
+// of whatever we had left to visit.  Returns how many scopes it freed.
+//
+// Behaves poorly when timed because it adds a profile scope for every profile
+// scope present.  Can be timed by wrapping the call site with a TIMED_BLOCK
+link_internal u32
+FreeScopes(debug_scope_tree *Tree, debug_profile_scope *ScopeToFree)
+{
+  u32 Result = 0;
 
   debug_profile_scope* Current = ScopeToFree;
   while (Current)
   {
     debug_profile_scope* Next = Current->Sibling;
 
-    FreeScopes(ThreadState, Current->Child);
+    if (Current->Child)
+    {
+      debug_profile_scope *LastChild = Current->Child;
+      while (LastChild->Sibling) { LastChild = LastChild->Sibling; }
+
+      LastChild->Sibling = Next;
+      Next = Current->Child;
+    }
 
     Clear(Current);
 
-    Current->Sibling = ThreadState->FirstFreeScope;
-    ThreadState->FirstFreeScope = Current;
+    Current->Sibling = Tree->FirstFreeScope;
+    Tree->FirstFreeScope = Current;
+    ++Result;
 
     Current = Next;
   }
 
+  return Result;
+}
+
+// NOTE(Jesse): O(1); the trees blocks go back to the thread in one go and
+// nothing in them gets looked at until they're handed out again.
+link_internal void
+FreeScopeTree(debug_thread_state *ThreadState, debug_scope_tree *Tree)
+{
+  if (Tree->FirstBlock)
+  {
+    Tree->LastBlock->Next = ThreadState->FirstFreeBlock;
+    ThreadState->FirstFreeBlock = Tree->FirstBlock;
+
+    Assert(ThreadState->LiveBlockCount >= Tree->BlockCount);
+    ThreadState->LiveBlockCount -= Tree->BlockCount;
+  }
+
+  Tree->FirstBlock     = 0;
+  Tree->LastBlock      = 0;
+  Tree->BlockCount     = 0;
+  Tree->FirstFreeScope = 0;
+
   return;
 }
 
@@ -459,130 +771,2014 @@ FreeScopes(debug_thread_state *ThreadState, debug_profile_scope *ScopeToFree)
 inline u32
 GetNextDebugFrameIndex(u32 Current)
 {
-  u32 Result = (Current + 1) % DEBUG_FRAMES_TRACKED;
+  u32 Result = GetFrameSlot(Current + 1);
   return Result;
 }
 
-inline void
-AdvanceThreadState(debug_thread_state *ThreadState, u32 NextFrameId)
+link_internal void
+OpenWriteScopeTree(debug_thread_state *ThreadState, u32 FrameId)
 {
-  /* TIMED_FUNCTION(); */
-  // Can this actually be timed if we're freeing scopes?  I think it can,
-  // because we're freeing the _next_ frames scopes, however it's behaving
-  // badly when turned on
-
-  u32 NextWriteIndex = NextFrameId % DEBUG_FRAMES_TRACKED;
-  debug_scope_tree *NextWriteTree = ThreadState->ScopeTrees + NextWriteIndex;
+  debug_scope_tree *Tree = ThreadState->ScopeTrees + GetFrameSlot(FrameId);
 
-  FreeScopes(ThreadState, NextWriteTree->Root);
-  InitScopeTree(NextWriteTree);
-
-  ThreadState->MutexOps[NextWriteIndex].NextRecord = 0;
-
-  NextWriteTree->FrameRecorded = NextFrameId;
+  Tree->Closed           = False;
+  Tree->FirstEvent       = ThreadState->ScopeEvents->At;
+  Tree->OnePastLastEvent = Tree->FirstEvent;
+  Tree->FrameRecorded    = FrameId;
+  Tree->SampledCallCount = 0;
 
   return;
 }
 
-inline void
-WorkerThreadAdvanceDebugSystem()
-{
-  /* Assert(ThreadLocal_ThreadIndex != 0); */
-
-  debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadLocal_ThreadIndex);
-  debug_thread_state *MainThreadState = GetThreadLocalStateFor(0);
+/******************************              *********************************/
+/******************************  Timestamps  *********************************/
+/******************************              *********************************/
 
-  if (ThreadState != MainThreadState)
-  {
-    u32 NextFrameId = MainThreadState->WriteIndex;
 
-    // Note(Jesse): WriteIndex must not straddle a cache line!
-    Assert(sizeof(MainThreadState->WriteIndex) == 4);
-    Assert((umm)(&MainThreadState->WriteIndex)%64 <= 60 );
 
-    if (NextFrameId != ThreadState->WriteIndex)
-    {
-      ThreadState->WriteIndex = NextFrameId;
-      AdvanceThreadState(ThreadState, NextFrameId);
-    }
+link_internal b32
+CpuHasInvariantTsc()
+{
+  b32 Result = False;
 
+#if BONSAI_WIN32
+  int Registers[4];
+  __cpuid(Registers, (int)0x80000000);
+  if ((u32)Registers[0] >= 0x80000007)
+  {
+    __cpuid(Registers, (int)0x80000007);
+    Result = (Registers[3] & (1 << 8)) != 0;
+  }
+#else
+  u32 Eax, Ebx, Ecx, Edx;
+  if (__get_cpuid(0x80000007, &Eax, &Ebx, &Ecx, &Edx))
+  {
+    Result = (Edx & (1 << 8)) != 0;
   }
+#endif
+
+  return Result;
 }
 
-global_variable r64 LastMs;
+#define TSC_CALIBRATION_NS (10000000ull)
 
-void
-MainThreadAdvanceDebugSystem(r32 Dt)
+link_internal u64
+MeasureTscFrequency()
 {
-  TIMED_FUNCTION();
-  Assert(ThreadLocal_ThreadIndex == 0);
+  u64 StartingNs = GetMonotonicNanoseconds();
+  u64 StartingTsc = __rdtsc();
 
-  Assert(ThreadLocal_ThreadIndex == 0);
-  debug_thread_state *MainThreadState = GetThreadLocalStateFor(ThreadLocal_ThreadIndex);
-  debug_state *SharedState = GetDebugState();
+  u64 EndingNs = StartingNs;
+  while (EndingNs - StartingNs < TSC_CALIBRATION_NS) { EndingNs = GetMonotonicNanoseconds(); }
+  u64 EndingTsc = __rdtsc();
 
-  if (SharedState->DebugDoScopeProfiling)
+  u64 Result = (u64)((r64)(EndingTsc - StartingTsc) * 1000000000.0 / (r64)(EndingNs - StartingNs));
+  return Result;
+}
+
+link_internal r64
+GetNsPerCycle(debug_timestamps *Timestamps, u32 Mode)
+{
+  r64 Result = 1.0;
+  if (Mode != TimestampMode_Clock)
   {
-    u64 CurrentCycles = GetCycleCount();
+    Result = SafeDivide0(1000000000.0, (r64)Timestamps->TscFrequency);
+  }
+  return Result;
+}
 
-    u32 ThisFrameWriteIndex = MainThreadState->WriteIndex % DEBUG_FRAMES_TRACKED;
+link_internal u64
+GetDebugTimestamp(debug_state *State)
+{
+  u64 Result = ReadBeginTimestamp(State->Timestamps.Mode);
+  return Result;
+}
 
-    AtomicIncrement(&MainThreadState->WriteIndex);
-    AdvanceThreadState(MainThreadState, MainThreadState->WriteIndex);
+// NOTE(Jesse): Some VMs report an invariant TSC and then migrate us between
+// hosts, or just don't virtualize it very well, so we also make sure two
+// calibrations in a row agree.  If either check fails we record in
+// nanoseconds from the monotonic clock instead.
+link_internal void
+CalibrateTimestamps(debug_state *State)
+{
+  debug_timestamps *Timestamps = &State->Timestamps;
 
-    /* SharedState->ReadScopeIndex = GetNextDebugFrameIndex(SharedState->ReadScopeIndex); */
-    SharedState->ReadScopeIndex = ThisFrameWriteIndex;
+  Timestamps->TscInvariant = CpuHasInvariantTsc();
 
+  u64 FirstFrequency = MeasureTscFrequency();
+  u64 SecondFrequency = MeasureTscFrequency();
+  u64 Drift = FirstFrequency > SecondFrequency ? FirstFrequency - SecondFrequency : SecondFrequency - FirstFrequency;
 
-    /* Record frame cycle counts */
+  Timestamps->TscFrequency = SecondFrequency;
+  Timestamps->TscReliable = Timestamps->TscInvariant && SecondFrequency && (Drift * 100 < SecondFrequency);
 
-    frame_stats *ThisFrame = SharedState->Frames + ThisFrameWriteIndex;
-    ThisFrame->FrameMs = Dt * 1000.0f;
-    ThisFrame->TotalCycles = CurrentCycles - ThisFrame->StartingCycle;
+  if (Timestamps->TscReliable)
+  {
+    Timestamps->Mode = TimestampMode_Rdtsc;
+  }
+  else
+  {
+    Warn("TSC is not reliable (invariant %u, %lu vs %lu Hz), timing scopes with the monotonic clock", Timestamps->TscInvariant, FirstFrequency, SecondFrequency);
+    Timestamps->Mode = TimestampMode_Clock;
+  }
 
+  Timestamps->RequestedMode = Timestamps->Mode;
 
-    u32 NextFrameWriteIndex = GetNextDebugFrameIndex(ThisFrameWriteIndex);
-    frame_stats *NextFrame = SharedState->Frames + NextFrameWriteIndex;
-    Clear(NextFrame);
-    NextFrame->StartingCycle = CurrentCycles;
+  u32 TotalThreadCount = GetTotalThreadCount();
+  for ( u32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    State->ThreadStates[ThreadIndex].ScopeEvents->TimestampMode = Timestamps->Mode;
   }
-}
 
-min_max_avg_dt
-ComputeMinMaxAvgDt()
-{
-  TIMED_FUNCTION();
+  UpdateCallsiteBudgets(State);
 
-  debug_state *SharedState = GetDebugState();
+  return;
+}
 
-  min_max_avg_dt Dt = {};
-  Dt.Min = f32_MAX;
 
-  u32 FrameCount = 0;
-  for (u32 FrameIndex = 0;
-      FrameIndex < DEBUG_FRAMES_TRACKED;
-      ++FrameIndex )
-  {
-    frame_stats *Frame = SharedState->Frames + FrameIndex;
 
-    if (Frame->FrameMs > 0.1f) { ++FrameCount; }
-    if (Frame->FrameMs > 0.1f) { Dt.Min = Min(Dt.Min, Frame->FrameMs); }
-    Dt.Max = Max(Dt.Max, Frame->FrameMs);
-    Dt.Avg += Frame->FrameMs;
-  }
+/*****************************                 *****************************/
+/*****************************  Scope Budgets  *****************************/
+/*****************************                 *****************************/
 
-  Dt.Avg = SafeDivide0(Dt.Avg, r32(FrameCount));
 
-  return Dt;
-}
 
-#if 0
-inline void
-DoDebugFrameRecord(debug_recording_state *State, hotkeys *Hotkeys)
+link_internal void
+UpdateCallsiteBudget(debug_state *State, u16 CallsiteId)
 {
+  u64 BudgetCycles = u64_MAX;
+
+  // NOTE(Jesse): Before CalibrateTimestamps runs we don't know how long a
+  // cycle is; it'll come back around when it's done.
+  u32 BudgetUs = State->ScopeCallsites[CallsiteId].BudgetUs;
+  r64 NsPerCycle = GetNsPerCycle(&State->Timestamps, State->Timestamps.Mode);
+  if (BudgetUs && NsPerCycle > 0.0)
   {
-    static b32 Toggled = False;
-    if (Hotkeys->Debug_ToggleLoopedGamePlayback  && !Toggled)
+    BudgetCycles = (u64)((r64)BudgetUs * 1000.0 / NsPerCycle);
+  }
+
+  State->ScopeCallsiteBudgetCycles[CallsiteId] = BudgetCycles;
+  return;
+}
+
+link_internal void
+UpdateCallsiteBudgets(debug_state *State)
+{
+  for ( u32 CallsiteIndex = 1;
+            CallsiteIndex < State->ScopeCallsiteCount;
+          ++CallsiteIndex )
+  {
+    UpdateCallsiteBudget(State, (u16)CallsiteIndex);
+  }
+  return;
+}
+
+// NOTE(Jesse): Called from debug_budgeted_timed_function on the thread that
+// went over.  Scopes that straddled a timestamp mode change measured
+// themselves in the wrong units, so we throw those away.
+void
+RecordBudgetViolation(u16 CallsiteId, u64 Cycles)
+{
+  debug_state *State = GetDebugState();
+  debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadLocal_ThreadIndex);
+
+  u32 Mode = ThreadState->ScopeEvents->TimestampMode;
+  if (Mode != State->Timestamps.Mode) return;
+
+  debug_budget_violation_ring *Ring = ThreadState->BudgetViolations;
+
+  u32 WriteAt = Ring->WriteAt;
+  if (WriteAt - Ring->ReadAt < DEBUG_BUDGET_VIOLATIONS_PER_THREAD)
+  {
+    r64 NsPerCycle = GetNsPerCycle(&State->Timestamps, Mode);
+    u64 BudgetCycles = State->ScopeCallsiteBudgetCycles[CallsiteId];
+
+    debug_budget_violation *Violation = Ring->Violations + (WriteAt % DEBUG_BUDGET_VIOLATIONS_PER_THREAD);
+    Violation->FrameId     = ThreadState->WriteIndex;
+    Violation->CallsiteId  = CallsiteId;
+    Violation->ThreadIndex = (u16)ThreadLocal_ThreadIndex;
+    Violation->DurationNs  = (u64)((r64)Cycles * NsPerCycle);
+    Violation->OverrunNs   = (u64)((r64)(Cycles - BudgetCycles) * NsPerCycle);
+
+    // NOTE(Jesse): Publishes the violation; the main thread won't look at it
+    // until WriteAt moves past it.
+    AtomicIncrement(&Ring->WriteAt);
+  }
+  else
+  {
+    AtomicIncrement(&Ring->Dropped);
+    ThreadState->Counters.Dropped++;
+  }
+
+  return;
+}
+
+// NOTE(Jesse): Main thread only
+link_internal void
+CollectBudgetViolations(debug_state *State)
+{
+  u32 BudgetViolationsDropped = 0;
+
+  u32 TotalThreadCount = GetTotalThreadCount();
+  for ( u32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    debug_budget_violation_ring *Ring = State->ThreadStates[ThreadIndex].BudgetViolations;
+
+    u32 WriteAt = Ring->WriteAt;
+    for ( u32 ReadAt = Ring->ReadAt;
+              ReadAt != WriteAt;
+            ++ReadAt )
+    {
+      debug_budget_violation *Violation = Ring->Violations + (ReadAt % DEBUG_BUDGET_VIOLATIONS_PER_THREAD);
+
+      debug_callsite_budget_stats *Stats = State->ScopeCallsiteBudgetStats + Violation->CallsiteId;
+      Stats->Violations++;
+      Stats->LastFrameId     = Violation->FrameId;
+      Stats->LastThreadIndex = Violation->ThreadIndex;
+      Stats->WorstOverrunNs  = Max(Stats->WorstOverrunNs, Violation->OverrunNs);
+      Stats->TotalOverrunNs += Violation->OverrunNs;
+
+      State->RecentBudgetViolations[State->RecentBudgetViolationAt++ % DEBUG_RECENT_BUDGET_VIOLATIONS] = *Violation;
+      State->BudgetViolationCount++;
+    }
+
+    Ring->ReadAt = WriteAt;
+
+    BudgetViolationsDropped += Ring->Dropped;
+  }
+
+  State->BudgetViolationsDropped = BudgetViolationsDropped;
+
+  return;
+}
+
+
+/*****************************               *******************************/
+/*****************************  Flow Events  *******************************/
+/*****************************               *******************************/
+
+
+// NOTE(Jesse): Called from FLOW_BEGIN / FLOW_END on whichever thread queued
+// or picked up the job.  Stamped in the same units as that threads scopes so
+// the links line up with the bars in the Threads window.
+void
+RecordFlowEvent(u64 Id, u32 Type)
+{
+  debug_state *State = GetDebugState();
+  debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadLocal_ThreadIndex);
+
+  debug_scope_event_ring *ScopeEvents = ThreadState->ScopeEvents;
+  if (!ScopeEvents->EnabledCategories) return;
+
+  u32 Mode = ScopeEvents->TimestampMode;
+  if (Mode != State->Timestamps.Mode) return;
+
+  debug_flow_event_ring *Ring = ThreadState->FlowEvents;
+
+  u32 WriteAt = Ring->WriteAt;
+  if (WriteAt - Ring->ReadAt < DEBUG_FLOW_EVENTS_PER_THREAD)
+  {
+    debug_flow_event *Event = Ring->Events + (WriteAt % DEBUG_FLOW_EVENTS_PER_THREAD);
+    Event->Id          = Id;
+    Event->FrameId     = ThreadState->WriteIndex;
+    Event->ThreadIndex = (u16)ThreadLocal_ThreadIndex;
+    Event->Type        = (u16)Type;
+    Event->Cycle       = ReadBeginTimestamp(Mode);
+
+    AtomicIncrement(&Ring->WriteAt);
+  }
+  else
+  {
+    AtomicIncrement(&Ring->Dropped);
+    ThreadState->Counters.Dropped++;
+  }
+
+  return;
+}
+
+link_internal u32
+GetPendingFlowHomeSlot(u64 Id)
+{
+  u32 Result = (u32)((Id * 0x9E3779B97F4A7C15ull) >> (64 - DEBUG_PENDING_FLOWS_BITS));
+  return Result;
+}
+
+link_internal void
+RemovePendingFlow(debug_state *State, u32 Slot)
+{
+  u32 Mask = DEBUG_PENDING_FLOWS-1;
+
+  // NOTE(Jesse): Backward shift deletion; anything after the hole that would
+  // have had to probe through it gets moved into it, so lookups never need
+  // tombstones.
+  u32 Hole = Slot;
+  for ( u32 Next = (Hole+1) & Mask;
+            State->PendingFlows[Next].Used;
+            Next = (Next+1) & Mask )
+  {
+    u32 Home = GetPendingFlowHomeSlot(State->PendingFlows[Next].Event.Id);
+    if ( ((Next - Home) & Mask) >= ((Next - Hole) & Mask) )
+    {
+      State->PendingFlows[Hole] = State->PendingFlows[Next];
+      Hole = Next;
+    }
+  }
+
+  Clear(State->PendingFlows + Hole);
+  State->PendingFlowCount--;
+
+  return;
+}
+
+link_internal void
+ClearPendingFlows(debug_state *State)
+{
+  for ( u32 Slot = 0;
+            Slot < DEBUG_PENDING_FLOWS;
+          ++Slot )
+  {
+    Clear(State->PendingFlows + Slot);
+  }
+  State->PendingFlowCount = 0;
+
+  return;
+}
+
+link_internal u32
+GetFlowLatencyBucket(u64 LatencyNs)
+{
+  u32 Result = 0;
+  while ( (LatencyNs >> (Result+1)) && Result < DEBUG_FLOW_LATENCY_BUCKETS-1 )
+  {
+    ++Result;
+  }
+  return Result;
+}
+
+link_internal void
+CompleteFlow(debug_state *State, frame_stats *Frame, r64 NsPerCycle, debug_flow_event *Begin, debug_flow_event *End, u32 FrameId)
+{
+  debug_flow_link *Link = State->RecentFlowLinks + (State->RecentFlowLinkAt++ % DEBUG_RECENT_FLOW_LINKS);
+  Link->Id               = Begin->Id;
+  Link->BeginCycle       = Begin->Cycle;
+  Link->EndCycle         = End->Cycle;
+  Link->BeginThreadIndex = Begin->ThreadIndex;
+  Link->EndThreadIndex   = End->ThreadIndex;
+  Link->CompletedFrameId = FrameId;
+
+  // NOTE(Jesse): Different cores' TSCs can disagree by a handful of cycles,
+  // so a job that gets picked up immediately can look like it started first.
+  u64 LatencyCycles = End->Cycle > Begin->Cycle ? End->Cycle - Begin->Cycle : 0;
+  u64 LatencyNs = (u64)((r64)LatencyCycles * NsPerCycle);
+
+  debug_flow_latency_histogram *Histogram = &Frame->FlowLatency;
+  Histogram->Counts[GetFlowLatencyBucket(LatencyNs)]++;
+  Histogram->Total++;
+  Histogram->MaxNs = Max(Histogram->MaxNs, LatencyNs);
+
+  return;
+}
+
+link_internal void
+CollectFlowEvent(debug_state *State, frame_stats *Frame, r64 NsPerCycle, debug_flow_event *Event, u32 FrameId)
+{
+  u32 Mask = DEBUG_PENDING_FLOWS-1;
+
+  u32 Slot = GetPendingFlowHomeSlot(Event->Id);
+  for ( ;
+        State->PendingFlows[Slot].Used;
+        Slot = (Slot+1) & Mask )
+  {
+    debug_pending_flow *Pending = State->PendingFlows + Slot;
+    if (Pending->Event.Id == Event->Id && Pending->Event.Type != Event->Type)
+    {
+      debug_flow_event *Begin = Event->Type == FlowEvent_Begin ? Event : &Pending->Event;
+      debug_flow_event *End   = Event->Type == FlowEvent_End   ? Event : &Pending->Event;
+      CompleteFlow(State, Frame, NsPerCycle, Begin, End, FrameId);
+      RemovePendingFlow(State, Slot);
+      return;
+    }
+  }
+
+  if (State->PendingFlowCount < DEBUG_PENDING_FLOWS_MAX_LOAD)
+  {
+    debug_pending_flow *Pending = State->PendingFlows + Slot;
+    Pending->Event = *Event;
+    Pending->CollectedFrameId = FrameId;
+    Pending->Used = True;
+    State->PendingFlowCount++;
+  }
+  else
+  {
+    State->FlowsRejected++;
+  }
+
+  return;
+}
+
+link_internal void
+EvictStaleFlows(debug_state *State, u32 FrameId)
+{
+  for ( u32 Slot = 0;
+            Slot < DEBUG_PENDING_FLOWS;
+            )
+  {
+    debug_pending_flow *Pending = State->PendingFlows + Slot;
+    if (Pending->Used && FrameId - Pending->CollectedFrameId > State->FramesTracked)
+    {
+      // NOTE(Jesse): Don't advance; whatever got shifted into this slot
+      // hasn't been looked at yet.
+      RemovePendingFlow(State, Slot);
+      State->FlowsEvicted++;
+    }
+    else
+    {
+      ++Slot;
+    }
+  }
+
+  return;
+}
+
+// NOTE(Jesse): Main thread only.  Latencies of the flows that complete go in
+// the histogram for Frame.
+link_internal void
+CollectFlowEvents(debug_state *State, frame_stats *Frame, u32 FrameId)
+{
+  r64 NsPerCycle = GetNsPerCycle(&State->Timestamps, State->Timestamps.Mode);
+  u32 FlowsDropped = 0;
+
+  u32 TotalThreadCount = GetTotalThreadCount();
+  for ( u32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    debug_flow_event_ring *Ring = State->ThreadStates[ThreadIndex].FlowEvents;
+
+    u32 WriteAt = Ring->WriteAt;
+    for ( u32 ReadAt = Ring->ReadAt;
+              ReadAt != WriteAt;
+            ++ReadAt )
+    {
+      debug_flow_event *Event = Ring->Events + (ReadAt % DEBUG_FLOW_EVENTS_PER_THREAD);
+      CollectFlowEvent(State, Frame, NsPerCycle, Event, FrameId);
+    }
+
+    Ring->ReadAt = WriteAt;
+
+    FlowsDropped += Ring->Dropped;
+  }
+
+  State->FlowsDropped = FlowsDropped;
+
+  EvictStaleFlows(State, FrameId);
+
+  return;
+}
+
+
+
+
+/***************************                    ******************************/
+/***************************  Profiler Overhead  ******************************/
+/***************************                    ******************************/
+
+
+
+#define PROFILER_CALIBRATION_PASSES      (16)
+#define PROFILER_CALIBRATION_ITERATIONS (1024)
+
+// NOTE(Jesse): We take the fastest pass of each so an interrupt or a context
+// switch in the middle of one doesn't throw the numbers off.
+//
+// This records into the main threads event ring and puts the ring back when
+// it's done, so it can run again whenever the timestamp mode changes.  The
+// numbers are in whatever units the current mode records in.
+link_internal void
+CalibrateProfilerOverhead(debug_state *State)
+{
+  Assert(ThreadLocal_ThreadIndex == 0);
+
+  debug_profiler_overhead *Overhead = &State->Overhead;
+  *Overhead = {};
+
+  debug_thread_state *MainThreadState = GetThreadLocalStateFor(0);
+  debug_scope_event_ring *Ring = MainThreadState->ScopeEvents;
+  u64 RingAt = Ring->At;
+  u32 Mode = Ring->TimestampMode;
+
+  Overhead->ScopeCycles = u64_MAX;
+  Overhead->RdtscCycles = u64_MAX;
+  Overhead->AllocationCycles = u64_MAX;
+
+  DEBUG_SCOPE_CALLSITE(CalibrationCallsite, "CalibrateProfilerOverhead", Category_Debug);
+
+  // NOTE(Jesse): Has to record regardless of what the user turned off
+  u32 EnabledCategories = Ring->EnabledCategories;
+  Ring->EnabledCategories = u32_MAX;
+
+  for ( u32 PassIndex = 0;
+            PassIndex < PROFILER_CALIBRATION_PASSES;
+          ++PassIndex )
+  {
+    u64 StartingCycle = ReadBeginTimestamp(Mode);
+    for ( u32 Iteration = 0;
+              Iteration < PROFILER_CALIBRATION_ITERATIONS;
+            ++Iteration )
+    {
+      debug_timed_function CalibrationTimer(&CalibrationCallsite);
+    }
+    u64 EndingCycle = ReadEndTimestamp(Mode);
+
+    Overhead->ScopeCycles = Min(Overhead->ScopeCycles, (EndingCycle - StartingCycle) / PROFILER_CALIBRATION_ITERATIONS);
+    Ring->At = RingAt;
+  }
+
+  Ring->EnabledCategories = EnabledCategories;
+
+  for ( u32 PassIndex = 0;
+            PassIndex < PROFILER_CALIBRATION_PASSES;
+          ++PassIndex )
+  {
+    u64 StartingCycle = ReadBeginTimestamp(Mode);
+    u64 EndingCycle = ReadEndTimestamp(Mode);
+    Overhead->RdtscCycles = Min(Overhead->RdtscCycles, EndingCycle - StartingCycle);
+  }
+
+  {
+    // NOTE(Jesse): Same work as WriteMemoryRecord, into a table nobody looks at
+    memory_record *ScratchTable = Allocate(memory_record, TranArena, META_TABLE_SIZE);
+    memory_record Record =
+    {
+      .Name = "CalibrateProfilerOverhead",
+      .ArenaAddress = BONSAI_NO_ARENA,
+      .ArenaMemoryBlock = (umm)"CalibrateProfilerOverhead",
+      .StructSize = 1,
+      .StructCount = 1,
+      .ThreadId = 0,
+      .PushCount = 1
+    };
+
+    for ( u32 PassIndex = 0;
+              PassIndex < PROFILER_CALIBRATION_PASSES;
+            ++PassIndex )
+    {
+      u64 StartingCycle = ReadBeginTimestamp(Mode);
+      for ( u32 Iteration = 0;
+                Iteration < PROFILER_CALIBRATION_ITERATIONS;
+              ++Iteration )
+      {
+        debug_thread_state *Thread = GetThreadLocalStateFor(ThreadLocal_ThreadIndex);
+        if (Thread) { WriteToMetaTable(&Record, ScratchTable, PushesMatchExactly); }
+      }
+      u64 EndingCycle = ReadEndTimestamp(Mode);
+
+      Overhead->AllocationCycles = Min(Overhead->AllocationCycles, (EndingCycle - StartingCycle) / PROFILER_CALIBRATION_ITERATIONS);
+    }
+  }
+
+  // NOTE(Jesse): Don't let the calibration scopes show up anywhere
+  Ring->CallCounts[CalibrationCallsite.Id] = 0;
+  MainThreadState->ReportedCallCounts[CalibrationCallsite.Id] = 0;
+
+  return;
+}
+
+// NOTE(Jesse): Scopes actually recorded in the frame being viewed, and what
+// they and the allocation tracking cost, in cycles.
+link_internal u64
+GetProfilerOverheadCycles(debug_state *State, u32 *ScopeCount, u32 *AllocationCount)
+{
+  u64 Scopes = 0;
+  u64 FrameRecorded = State->ThreadStates[0].ScopeTrees[State->ReadScopeIndex].FrameRecorded;
+
+  u32 TotalThreadCount = GetTotalThreadCount();
+  for ( u32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    debug_thread_state *ThreadState = State->ThreadStates + ThreadIndex;
+    debug_scope_tree *Tree = ThreadState->ScopeTrees + State->ReadScopeIndex;
+
+    // NOTE(Jesse): Counting Begins, since TIMED_BLOCK_N scopes have a Payload
+    // event as well as the Begin and End.  They're counted once per tree,
+    // along with what's open at the end of it, and usually already are by the
+    // time we get here.  Workers that haven't recorded the frame we're looking
+    // at yet have an older one in the slot, which doesn't count.
+    if (Tree->Closed && Tree->FrameRecorded == FrameRecorded)
+    {
+      GetOpenScopesAtEnd(ThreadState, Tree);
+      if (Tree->OpenAtEndFrame == FrameRecorded+1) { Scopes += Tree->BeginCount; }
+    }
+  }
+
+  u64 Pushes = State->Frames[State->ReadScopeIndex].Counters.Allocations;
+
+  *ScopeCount = (u32)Scopes;
+  *AllocationCount = (u32)Pushes;
+
+  u64 Result = (Scopes * State->Overhead.ScopeCycles) + (Pushes * State->Overhead.AllocationCycles);
+  return Result;
+}
+
+/****************************                  *******************************/
+/****************************  Scope Sampling  *******************************/
+/****************************                  *******************************/
+
+
+
+// NOTE(Jesse): Runs on the owning thread when it advances.  The list of
+// sampled callsites can change underneath us; the worst that does is report
+// a count for a callsite that isn't being sampled anymore, which nobody
+// looks at.
+//
+// ReportedCallCounts gets brought up to date for every callsite, not just the
+// sampled ones, so a callsite that just started being sampled doesn't report
+// everything since the beginning of time.
+link_internal void
+RecordSampledCallCounts(debug_thread_state *ThreadState, debug_scope_tree *Tree)
+{
+  debug_state *State = GetDebugState();
+  u32 *CallCounts = ThreadState->ScopeEvents->CallCounts;
+  u32 *ReportedCallCounts = ThreadState->ReportedCallCounts;
+
+  u32 SampledCallsiteCount = Min(State->SampledCallsiteCount, (u32)MAX_SAMPLED_CALLSITES);
+  for ( u32 SampledIndex = 0;
+            SampledIndex < SampledCallsiteCount;
+          ++SampledIndex )
+  {
+    u16 CallsiteId = State->SampledCallsites[SampledIndex];
+
+    debug_sampled_call_count *Sampled = Tree->SampledCalls + SampledIndex;
+    Sampled->CallsiteId = CallsiteId;
+    Sampled->CallCount = CallCounts[CallsiteId] - ReportedCallCounts[CallsiteId];
+  }
+
+  Tree->SampledCallCount = SampledCallsiteCount;
+
+  u64 Scopes = 0;
+  for ( u32 CallsiteIndex = 0;
+            CallsiteIndex < MAX_DEBUG_SCOPE_CALLSITES;
+          ++CallsiteIndex )
+  {
+    Scopes += CallCounts[CallsiteIndex] - ReportedCallCounts[CallsiteIndex];
+    ReportedCallCounts[CallsiteIndex] = CallCounts[CallsiteIndex];
+  }
+
+  ThreadState->Counters.Scopes += Scopes;
+
+  return;
+}
+
+link_internal u32
+GetSampledCallCount(debug_scope_tree *Tree, u16 CallsiteId)
+{
+  u32 Result = 0;
+  for ( u32 SampledIndex = 0;
+            SampledIndex < Tree->SampledCallCount;
+          ++SampledIndex )
+  {
+    if (Tree->SampledCalls[SampledIndex].CallsiteId == CallsiteId)
+    {
+      Result = Tree->SampledCalls[SampledIndex].CallCount;
+      break;
+    }
+  }
+  return Result;
+}
+
+link_internal u32
+NextSampleRate(u32 Rate)
+{
+  u32 Result = 1;
+  while (Result < Rate && Result < DEBUG_SAMPLING_MAX_RATE) { Result <<= 1; }
+  return Result;
+}
+
+link_internal u32
+ChooseSampleRate(debug_callsite_sampling *Sampling, u32 CurrentRate, u64 OverheadCycles)
+{
+  u32 Result = 1;
+
+  if (Sampling->CallsPerFrame > DEBUG_SAMPLING_MAX_CALLS_PER_FRAME)
+  {
+    Result = NextSampleRate((Sampling->CallsPerFrame + DEBUG_SAMPLING_MAX_CALLS_PER_FRAME-1) / DEBUG_SAMPLING_MAX_CALLS_PER_FRAME);
+  }
+
+  if (Sampling->BuiltCalls && Sampling->CallsPerFrame >= DEBUG_SAMPLING_MIN_CALLS_FOR_COST)
+  {
+    u64 AvgCycles = Max(u64(1), Sampling->BuiltCycles / Sampling->BuiltCalls);
+    u64 MinCycles = Max(u64(1), OverheadCycles)*DEBUG_SAMPLING_MIN_COST_RATIO;
+    if (AvgCycles < MinCycles)
+    {
+      Result = Max(Result, NextSampleRate((u32)(MinCycles / AvgCycles)));
+    }
+  }
+
+  // NOTE(Jesse): Don't flip back and forth around the thresholds
+  if (Result < CurrentRate && Result*4 > CurrentRate)
+  {
+    Result = CurrentRate;
+  }
+
+  return Result;
+}
+
+// NOTE(Jesse): Main thread only.  Every DEBUG_SAMPLING_UPDATE_INTERVAL frames
+// we look at how often each callsite was called, across all threads, and how
+// expensive it was when we last built a tree containing it, and pick how many
+// calls each one records.
+link_internal void
+UpdateScopeSampling(debug_state *State)
+{
+  if (++State->FramesSinceSamplingUpdate < DEBUG_SAMPLING_UPDATE_INTERVAL) return;
+  State->FramesSinceSamplingUpdate = 0;
+
+  u32 TotalThreadCount = GetTotalThreadCount();
+  u32 SampledCallsiteCount = 0;
+
+  for ( u32 CallsiteIndex = 1;
+            CallsiteIndex < State->ScopeCallsiteCount;
+          ++CallsiteIndex )
+  {
+    debug_callsite_sampling *Sampling = State->ScopeCallsiteSampling + CallsiteIndex;
+
+    u32 CallCount = 0;
+    for ( u32 ThreadIndex = 0;
+              ThreadIndex < TotalThreadCount;
+            ++ThreadIndex )
+    {
+      CallCount += State->ThreadStates[ThreadIndex].ScopeEvents->CallCounts[CallsiteIndex];
+    }
+
+    Sampling->CallsPerFrame = (CallCount - Sampling->LastCallCount) / DEBUG_SAMPLING_UPDATE_INTERVAL;
+    Sampling->LastCallCount = CallCount;
+
+    u32 CurrentRate = State->ScopeCallsiteSampleMasks[CallsiteIndex] + 1u;
+    u32 Rate = Sampling->Override ? Sampling->Override : ChooseSampleRate(Sampling, CurrentRate, State->Overhead.ScopeCycles);
+
+    if (Sampling->HasChildren) { Rate = 1; }
+
+    Sampling->BuiltCycles = 0;
+    Sampling->BuiltCalls = 0;
+
+    if (Rate > 1 && SampledCallsiteCount == MAX_SAMPLED_CALLSITES)
+    {
+      Rate = 1;
+    }
+
+    if (Rate > 1)
+    {
+      State->SampledCallsites[SampledCallsiteCount++] = (u16)CallsiteIndex;
+    }
+
+    State->ScopeCallsiteSampleMasks[CallsiteIndex] = (u16)(Rate-1);
+  }
+
+  State->SampledCallsiteCount = SampledCallsiteCount;
+
+  return;
+}
+
+/*****************************                      ************************/
+/*****************************  Duration Histograms  ************************/
+/*****************************                      ************************/
+
+
+
+global_variable r64 Global_DurationPercentiles[DEBUG_DURATION_PERCENTILE_COUNT] = { 50.0, 90.0, 99.0, 99.9, 100.0 };
+global_variable const char *Global_DurationPercentileNames[DEBUG_DURATION_PERCENTILE_COUNT] = { "p50", "p90", "p99", "p99.9", "max" };
+
+link_internal u32
+GetMostSignificantBit(u64 Value)
+{
+  Assert(Value);
+#if BONSAI_WIN32
+  unsigned long Result;
+  _BitScanReverse64(&Result, Value);
+  return (u32)Result;
+#else
+  return 63u - (u32)__builtin_clzll(Value);
+#endif
+}
+
+link_internal u32
+GetDurationBucket(u64 Ns)
+{
+  u32 Result = (u32)Ns;
+  if (Ns >= DEBUG_DURATION_HISTOGRAM_SUB_BUCKETS)
+  {
+    Ns = Min(Ns, (u64(1) << DEBUG_DURATION_HISTOGRAM_MAX_BITS) - 1);
+    u32 Shift = GetMostSignificantBit(Ns) - DEBUG_DURATION_HISTOGRAM_SUB_BUCKET_BITS;
+    Result = (Shift+1)*DEBUG_DURATION_HISTOGRAM_SUB_BUCKETS + u32((Ns >> Shift) & (DEBUG_DURATION_HISTOGRAM_SUB_BUCKETS-1));
+  }
+
+  Assert(Result < DEBUG_DURATION_HISTOGRAM_BUCKETS);
+  return Result;
+}
+
+link_internal void
+RecordDuration(debug_duration_histogram *Histogram, u32 BucketIndex, u64 Ns, u32 Count)
+{
+  Histogram->Counts[BucketIndex] += Count;
+  Histogram->Total += Count;
+  Histogram->MaxNs = Max(Histogram->MaxNs, Ns);
+}
+
+link_internal void
+RecordDuration(debug_state *State, debug_duration_stats *Stats, u64 Ns, u32 Count)
+{
+  u32 BucketIndex = GetDurationBucket(Ns);
+  RecordDuration(&Stats->Session, BucketIndex, Ns, Count);
+  RecordDuration(Stats->Window + State->DurationWindowAt, BucketIndex, Ns, Count);
+}
+
+// NOTE(Jesse): Window is the sliding window, otherwise the whole session.
+// The percentiles come back as the top of the bucket they landed in, capped
+// at the max, so they err high by at most a bucket.
+link_internal debug_duration_summary
+SummarizeDurations(debug_duration_stats *Stats, b32 Window)
+{
+  debug_duration_histogram *Histograms[2] = { &Stats->Session, 0 };
+  if (Window)
+  {
+    Histograms[0] = Stats->Window + 0;
+    Histograms[1] = Stats->Window + 1;
+  }
+
+  debug_duration_summary Result = {};
+  u64 MaxNs = 0;
+  for (u32 HistogramIndex = 0; HistogramIndex < 2; ++HistogramIndex)
+  {
+    if (Histograms[HistogramIndex])
+    {
+      Result.Total += Histograms[HistogramIndex]->Total;
+      MaxNs = Max(MaxNs, Histograms[HistogramIndex]->MaxNs);
+    }
+  }
+
+  if (Result.Total)
+  {
+    u64 Seen = 0;
+    u32 PercentileIndex = 0;
+    for ( u32 BucketIndex = 0;
+              BucketIndex < DEBUG_DURATION_HISTOGRAM_BUCKETS && PercentileIndex < DEBUG_DURATION_PERCENTILE_COUNT-1;
+            ++BucketIndex )
+    {
+      for (u32 HistogramIndex = 0; HistogramIndex < 2; ++HistogramIndex)
+      {
+        if (Histograms[HistogramIndex]) { Seen += Histograms[HistogramIndex]->Counts[BucketIndex]; }
+      }
+
+      while ( PercentileIndex < DEBUG_DURATION_PERCENTILE_COUNT-1 &&
+              r64(Seen) >= r64(Result.Total) * Global_DurationPercentiles[PercentileIndex] / 100.0 )
+      {
+        Result.Ns[PercentileIndex++] = Min(GetDurationBucketMaxNs(BucketIndex), MaxNs);
+      }
+    }
+
+    Result.Ns[DEBUG_DURATION_PERCENTILE_COUNT-1] = MaxNs;
+  }
+
+  return Result;
+}
+
+// NOTE(Jesse): Main thread only
+link_internal debug_duration_stats *
+GetCallsiteDurations(debug_state *State, u16 CallsiteId)
+{
+  debug_duration_stats *Result = State->CallsiteDurations[CallsiteId];
+  if (!Result)
+  {
+    Result = Allocate(debug_duration_stats, State->DurationArena, 1);
+    State->CallsiteDurations[CallsiteId] = Result;
+  }
+  return Result;
+}
+
+// NOTE(Jesse): Main thread only, once per frame.  Callsites are rotated along
+// with the frame times even though they're DEBUG_SEALED_FRAME_LAG frames
+// behind; the window is hundreds of frames so it doesn't matter.
+link_internal void
+RecordFrameDuration(debug_state *State, frame_stats *Frame, u32 FrameId)
+{
+  if (++State->DurationWindowFrames > DEBUG_DURATION_WINDOW_FRAMES)
+  {
+    State->DurationWindowAt = (State->DurationWindowAt + 1) % 2;
+    State->DurationWindowFrames = 1;
+
+    Clear(State->FrameDurations.Window + State->DurationWindowAt);
+    for ( u32 CallsiteIndex = 1;
+              CallsiteIndex < State->ScopeCallsiteCount;
+            ++CallsiteIndex )
+    {
+      debug_duration_stats *Stats = State->CallsiteDurations[CallsiteIndex];
+      if (Stats) { Clear(Stats->Window + State->DurationWindowAt); }
+    }
+  }
+
+  u64 Ns = (u64)(r64(Frame->FrameMs) * 1000000.0);
+  RecordDuration(State, &State->FrameDurations, Ns, 1);
+  State->FrameDurationExemplars[GetDurationBucket(Ns)] = FrameId;
+}
+
+// NOTE(Jesse): Selects the most recent frame that landed in the percentiles
+// bucket if we still have it, or the frame closest to it that we do, same as
+// picking one off the ticker.
+link_internal void
+SelectFrameAtPercentile(debug_state *State, u32 PercentileIndex, b32 Window)
+{
+  debug_duration_summary Summary = SummarizeDurations(&State->FrameDurations, Window);
+  if (!Summary.Total) return;
+
+  u64 TargetNs = Summary.Ns[PercentileIndex];
+  u32 WriteIndex = GetThreadLocalStateFor(0)->WriteIndex;
+
+  u32 Exemplar = State->FrameDurationExemplars[GetDurationBucket(TargetNs)];
+  if (Exemplar && WriteIndex - Exemplar < State->FramesTracked-1)
+  {
+    State->ReadScopeIndex = GetFrameSlot(Exemplar);
+  }
+  else
+  {
+    r64 BestDelta = f64_MAX;
+    for ( u32 FrameSlot = 0;
+              FrameSlot < State->FramesTracked;
+            ++FrameSlot )
+    {
+      frame_stats *Frame = State->Frames + FrameSlot;
+      if (FrameSlot == GetFrameSlot(WriteIndex) || Frame->FrameMs <= 0.f) continue;
+
+      r64 Ns = r64(Frame->FrameMs) * 1000000.0;
+      r64 Delta = Ns > r64(TargetNs) ? Ns - r64(TargetNs) : r64(TargetNs) - Ns;
+      if (Delta < BestDelta)
+      {
+        BestDelta = Delta;
+        State->ReadScopeIndex = FrameSlot;
+      }
+    }
+  }
+
+  return;
+}
+
+
+
+/******************************              *******************************/
+/******************************  Call Paths  *******************************/
+/******************************              *******************************/
+
+
+
+// NOTE(Jesse): MaxCount has to be a power of two.  The table is empty until
+// it's been reset.
+link_internal void
+InitCallPathTable(debug_call_path_table *Table, u32 MaxCount, memory_arena *Arena)
+{
+  Assert((MaxCount & (MaxCount-1)) == 0);
+
+  Table->Count    = 0;
+  Table->MaxCount = MaxCount;
+  Table->SlotMask = (MaxCount*2)-1;
+  Table->Paths    = Allocate(debug_call_path, Arena, MaxCount);
+  Table->Slots    = Allocate(u32,             Arena, MaxCount*2);
+}
+
+link_internal void
+ResetCallPathTable(debug_call_path_table *Table)
+{
+  for (u32 Slot = 0; Slot <= Table->SlotMask; ++Slot) { Table->Slots[Slot] = 0; }
+  Clear(Table->Paths);
+  Table->Count = 1;
+}
+
+// NOTE(Jesse): 0 if the table is full.  A new path comes back as Count-1.
+link_internal u32
+GetCallPath(debug_call_path_table *Table, u32 Parent, u16 CallsiteId)
+{
+  Assert(Table->Count);
+
+  u64 Key = (u64(Parent) << 16) | CallsiteId;
+  u32 Slot = u32((Key * 0x9E3779B97F4A7C15ull) >> 40) & Table->SlotMask;
+
+  while (Table->Slots[Slot])
+  {
+    debug_call_path *Path = Table->Paths + Table->Slots[Slot];
+    if (Path->Parent == Parent && Path->CallsiteId == CallsiteId) { return Table->Slots[Slot]; }
+    Slot = (Slot + 1) & Table->SlotMask;
+  }
+
+  if (Table->Count == Table->MaxCount) return 0;
+
+  u32 Result = Table->Count++;
+  Table->Paths[Result].Parent     = Parent;
+  Table->Paths[Result].CallsiteId = CallsiteId;
+
+  Table->Slots[Slot] = Result;
+  return Result;
+}
+
+
+
+/****************************                    *****************************/
+/****************************  Merged Call Tree  *****************************/
+/****************************                    *****************************/
+
+
+
+link_internal void
+InitMergedTree(debug_merged_tree *Tree, memory_arena *Arena)
+{
+  Tree->Nodes   = Allocate(debug_merged_node,  Arena, DEBUG_MERGED_TREE_MAX_NODES);
+  Tree->Touched = Allocate(u32,                Arena, DEBUG_MERGED_TREE_MAX_NODES);
+  Tree->Deltas  = Allocate(debug_merged_delta, Arena, DEBUG_MERGED_TREE_DELTAS);
+  Tree->Frames  = Allocate(debug_merged_frame, Arena, DEBUG_MERGED_TREE_MAX_WINDOW);
+
+  InitCallPathTable(&Tree->Paths, DEBUG_MERGED_TREE_MAX_NODES, Arena);
+  ResetCallPathTable(&Tree->Paths);
+
+  Tree->NodeCount = 1;
+  Tree->Nodes[0].Expanded = True;
+  Tree->WindowFrames = DEBUG_MERGED_TREE_WINDOW_DEFAULT;
+}
+
+// NOTE(Jesse): 0 if the path doesn't fit; everything under it gets dropped too
+link_internal u32
+GetMergedChild(debug_merged_tree *Tree, u32 ParentIndex, u16 CallsiteId, b32 ParentDropped)
+{
+  if (ParentDropped) return 0;
+
+  // NOTE(Jesse): Nodes are handed out in step with Paths, so a path index is
+  // its node index.
+  u32 Result = GetCallPath(&Tree->Paths, ParentIndex, CallsiteId);
+  if (!Result)
+  {
+    Tree->NodesDropped++;
+    return 0;
+  }
+
+  if (Result < Tree->NodeCount) return Result;
+
+  // NOTE(Jesse): Children stay in the order they were first seen, so rows
+  // don't jump around in the callgraph.
+  Assert(Result == Tree->NodeCount);
+  Tree->NodeCount++;
+
+  debug_merged_node *Parent = Tree->Nodes + ParentIndex;
+  debug_merged_node *Child = Tree->Nodes + Result;
+  Child->CallsiteId = CallsiteId;
+  Child->Depth      = u16(Parent->Depth + 1);
+  Child->Parent     = ParentIndex;
+
+  if (Parent->LastChild) { Tree->Nodes[Parent->LastChild].NextSibling = Result; }
+  else                   { Parent->FirstChild = Result; }
+  Parent->LastChild = Result;
+
+  return Result;
+}
+
+link_internal void
+AccumulateMergedNode(debug_merged_tree *Tree, u32 NodeIndex, u32 FrameId, u64 Calls, u64 Ns, u64 Payload)
+{
+  if (!NodeIndex) return;
+
+  debug_merged_node *Node = Tree->Nodes + NodeIndex;
+  if (Node->TouchedFrameId != FrameId+1)
+  {
+    Node->TouchedFrameId = FrameId+1;
+    Clear(&Node->Frame);
+    Tree->Touched[Tree->TouchedCount++] = NodeIndex;
+  }
+
+  Node->Frame.Calls   += Calls;
+  Node->Frame.Ns      += Ns;
+  Node->Frame.Payload += Payload;
+}
+
+link_internal void
+EvictOldestMergedFrame(debug_merged_tree *Tree)
+{
+  Assert(Tree->WindowFrameCount);
+
+  debug_merged_frame *Frame = Tree->Frames + Tree->FirstWindowFrame;
+  for ( u64 DeltaIndex = Frame->FirstDelta;
+            DeltaIndex < Frame->FirstDelta + Frame->DeltaCount;
+          ++DeltaIndex )
+  {
+    debug_merged_delta *Delta = Tree->Deltas + (DeltaIndex % DEBUG_MERGED_TREE_DELTAS);
+    debug_merged_totals *Window = &Tree->Nodes[Delta->Node].Window;
+    Window->Calls   -= Delta->Calls;
+    Window->Ns      -= Delta->Ns;
+    Window->Payload -= Delta->Payload;
+  }
+
+  Tree->WindowFrameMs -= Frame->FrameMs;
+  Tree->FirstWindowFrame = (Tree->FirstWindowFrame + 1) % DEBUG_MERGED_TREE_MAX_WINDOW;
+  Tree->WindowFrameCount--;
+}
+
+// NOTE(Jesse): Main thread only, once every thread's part of the frame has
+// been accumulated.
+link_internal void
+CloseMergedFrame(debug_merged_tree *Tree, r32 FrameMs)
+{
+  u32 WindowFrames = Min(Max(Tree->WindowFrames, 1u), (u32)DEBUG_MERGED_TREE_MAX_WINDOW);
+
+  // NOTE(Jesse): Make room for this one, in frames and in deltas
+  while ( Tree->WindowFrameCount &&
+          ( Tree->WindowFrameCount >= WindowFrames ||
+            Tree->DeltaAt + Tree->TouchedCount - Tree->Frames[Tree->FirstWindowFrame].FirstDelta > DEBUG_MERGED_TREE_DELTAS ) )
+  {
+    EvictOldestMergedFrame(Tree);
+  }
+
+  debug_merged_frame *Frame = Tree->Frames + ((Tree->FirstWindowFrame + Tree->WindowFrameCount) % DEBUG_MERGED_TREE_MAX_WINDOW);
+  Frame->FirstDelta = Tree->DeltaAt;
+  Frame->DeltaCount = Tree->TouchedCount;
+  Frame->FrameMs    = FrameMs;
+
+  for ( u32 TouchedIndex = 0;
+            TouchedIndex < Tree->TouchedCount;
+          ++TouchedIndex )
+  {
+    u32 NodeIndex = Tree->Touched[TouchedIndex];
+    debug_merged_node *Node = Tree->Nodes + NodeIndex;
+
+    debug_merged_delta *Delta = Tree->Deltas + (Tree->DeltaAt++ % DEBUG_MERGED_TREE_DELTAS);
+    Delta->Node    = NodeIndex;
+    Delta->Calls   = (u32)Node->Frame.Calls;
+    Delta->Ns      = Node->Frame.Ns;
+    Delta->Payload = Node->Frame.Payload;
+
+    Node->Window.Calls    += Delta->Calls;
+    Node->Window.Ns       += Delta->Ns;
+    Node->Window.Payload  += Delta->Payload;
+    Node->Session.Calls   += Delta->Calls;
+    Node->Session.Ns      += Delta->Ns;
+    Node->Session.Payload += Delta->Payload;
+
+    Node->TouchedFrameId = 0;
+  }
+  Tree->TouchedCount = 0;
+
+  Tree->WindowFrameCount++;
+  Tree->WindowFrameMs += FrameMs;
+  Tree->SessionFrames++;
+  Tree->SessionFrameMs += FrameMs;
+}
+
+
+
+/*****************************                 *****************************/
+/*****************************  History Tiers  *****************************/
+/*****************************                 *****************************/
+
+
+
+link_internal void
+InitHistoryTier(debug_history_tier *Tier, memory_arena *Memory, r64 BucketMs, u32 BucketCount, u32 AggregateCount)
+{
+  Assert((AggregateCount & (AggregateCount-1)) == 0);
+
+  Tier->BucketMs      = BucketMs;
+  Tier->BucketCount   = BucketCount;
+  Tier->Buckets       = Allocate(debug_history_bucket, Memory, BucketCount);
+  Tier->AggregateMask = AggregateCount-1;
+  Tier->Aggregates    = Allocate(debug_callsite_aggregate, Memory, AggregateCount);
+  Tier->OpenNs        = Allocate(u64, Memory, MAX_DEBUG_SCOPE_CALLSITES);
+  Tier->OpenCalls     = Allocate(u32, Memory, MAX_DEBUG_SCOPE_CALLSITES);
+}
+
+link_internal debug_history_bucket *
+GetHistoryBucket(debug_history_tier *Tier, u64 BucketIndex)
+{
+  debug_history_bucket *Result = 0;
+  if (BucketIndex < Tier->BucketAt && Tier->BucketAt - BucketIndex <= Tier->BucketCount)
+  {
+    Result = Tier->Buckets + (BucketIndex % Tier->BucketCount);
+  }
+  return Result;
+}
+
+// NOTE(Jesse): 0 if the aggregates ring has lapped this bucket
+link_internal debug_callsite_aggregate *
+GetHistoryAggregates(debug_history_tier *Tier, debug_history_bucket *Bucket)
+{
+  debug_callsite_aggregate *Result = 0;
+  if (Tier->AggregateAt - Bucket->FirstAggregate <= Tier->AggregateMask+1)
+  {
+    Result = Tier->Aggregates;
+  }
+  return Result;
+}
+
+link_internal void
+AccumulateHistoryBucket(debug_history_bucket *Open, u32 FrameCount, r64 TotalFrameMs, r32 MaxFrameMs)
+{
+  Open->FrameCount   += FrameCount;
+  Open->TotalFrameMs += TotalFrameMs;
+  Open->MaxFrameMs    = Max(Open->MaxFrameMs, MaxFrameMs);
+}
+
+link_internal void
+CloseHistoryBucket(debug_state *State, u32 TierIndex)
+{
+  debug_history_tier *Tier = State->HistoryTiers + TierIndex;
+  debug_history_tier *NextTier = TierIndex+1 < DEBUG_HISTORY_TIER_COUNT ? Tier+1 : 0;
+
+  debug_history_bucket *Bucket = Tier->Buckets + (Tier->BucketAt % Tier->BucketCount);
+  *Bucket = Tier->Open;
+  Bucket->FirstAggregate = Tier->AggregateAt;
+  Bucket->AggregateCount = 0;
+
+  for ( u32 CallsiteIndex = 1;
+            CallsiteIndex < State->ScopeCallsiteCount;
+          ++CallsiteIndex )
+  {
+    u32 Calls = Tier->OpenCalls[CallsiteIndex];
+    if (Calls)
+    {
+      u64 Ns = Tier->OpenNs[CallsiteIndex];
+
+      debug_callsite_aggregate *Aggregate = Tier->Aggregates + (Tier->AggregateAt++ & Tier->AggregateMask);
+      Aggregate->CallsiteId = (u16)CallsiteIndex;
+      Aggregate->Calls = Calls;
+      Aggregate->Ns = Ns;
+      Bucket->AggregateCount++;
+
+      if (NextTier)
+      {
+        NextTier->OpenCalls[CallsiteIndex] += Calls;
+        NextTier->OpenNs[CallsiteIndex] += Ns;
+      }
+
+      Tier->OpenCalls[CallsiteIndex] = 0;
+      Tier->OpenNs[CallsiteIndex] = 0;
+    }
+  }
+
+  Tier->BucketAt++;
+
+  if (NextTier)
+  {
+    AccumulateHistoryBucket(&NextTier->Open, Bucket->FrameCount, Bucket->TotalFrameMs, Bucket->MaxFrameMs);
+    if (NextTier->Open.TotalFrameMs >= NextTier->BucketMs)
+    {
+      CloseHistoryBucket(State, TierIndex+1);
+    }
+  }
+
+  Tier->Open = {};
+
+  return;
+}
+
+// NOTE(Jesse): A scope closed in the walk below, held until we know the ring
+// didn't lap the chunk it came out of.  Payload only entries are the payload
+// of a scope that closed in an earlier chunk.
+struct debug_history_closed_scope
+{
+  u16 CallsiteId;
+  b32 Closed;
+  u32 Calls;
+  u32 Node;
+  u64 Cycles;
+  u64 CorrectedNs;
+  u64 Payload;
+};
+
+#define DEBUG_HISTORY_CHUNK_EVENTS (512)
+
+link_internal void
+ApplyHistoryClosedScopes(debug_state *State, debug_history_tier *Tier, debug_history_closed_scope *Closed, u32 ClosedCount, u32 FrameId, r64 NsPerCycle)
+{
+  debug_merged_tree *Merged = &State->MergedTree;
+
+  for ( u32 ClosedIndex = 0;
+            ClosedIndex < ClosedCount;
+          ++ClosedIndex )
+  {
+    debug_history_closed_scope *Scope = Closed + ClosedIndex;
+    if (Scope->Closed)
+    {
+      u64 Ns = (u64)(r64(Scope->Cycles) * NsPerCycle);
+      Tier->OpenCalls[Scope->CallsiteId] += Scope->Calls;
+      Tier->OpenNs[Scope->CallsiteId] += Ns * Scope->Calls;
+
+      RecordDuration(State, GetCallsiteDurations(State, Scope->CallsiteId), Ns, Scope->Calls);
+
+      CheckScopeCaptureTrigger(State, Scope->CallsiteId, Scope->Cycles, FrameId);
+
+      AccumulateMergedNode(Merged, Scope->Node, FrameId, Scope->Calls, Scope->CorrectedNs * Scope->Calls, 0);
+    }
+
+    if (Scope->Payload)
+    {
+      AccumulateMergedNode(Merged, Scope->Node, FrameId, 0, 0, Scope->Payload * Scope->Calls);
+    }
+  }
+}
+
+// NOTE(Jesse): A flat walk over the events, without building a tree, which
+// feeds the history tier, the duration histograms and the merged call tree.
+// Scopes that were still open when the last frame was sealed are picked up
+// from GetOpenScopesAtStart, same as BuildScopeTree, and every scope is
+// counted once, in the frame it ends in.
+//
+// The owning thread keeps writing the ring while we walk it, so this goes a
+// chunk at a time and throws a chunk away, along with the rest of the frame,
+// if the ring lapped it before we were done.
+link_internal void
+AccumulateHistoryCallsites(debug_state *State, debug_history_tier *Tier, debug_thread_state *ThreadState, debug_scope_tree *Tree, u32 FrameId, r64 NsPerCycle)
+{
+  debug_scope_event_ring *Ring = ThreadState->ScopeEvents;
+  if (ScopeEventsOverwritten(Ring, Tree->FirstEvent)) return;
+
+  u64 FrameRecorded = Tree->FrameRecorded;
+  debug_merged_tree *Merged = &State->MergedTree;
+  debug_profiler_overhead *Overhead = &State->Overhead;
+
+  // NOTE(Jesse): Copies of the Begins, since the continued ones are older
+  // than anything we check for laps as we go.  Lapped continued Begins keep
+  // their slot so their End still pops, but get Valid = False.
+  b32 OpenValid[DEBUG_MAX_CONTINUED_SCOPES];
+  u16 OpenCallsite[DEBUG_MAX_CONTINUED_SCOPES];
+  u16 OpenSampleMask[DEBUG_MAX_CONTINUED_SCOPES];
+  u64 OpenCycle[DEBUG_MAX_CONTINUED_SCOPES];
+  u32 OpenNode[DEBUG_MAX_CONTINUED_SCOPES];
+  u32 OpenBeginCount[DEBUG_MAX_CONTINUED_SCOPES];
+  u32 OpenDepth = 0;
+
+  debug_open_scope_stack Continued = GetOpenScopesAtStart(ThreadState, Tree);
+  u32 TrackedDepth = Min(Continued.Depth, (u32)DEBUG_MAX_CONTINUED_SCOPES);
+  for ( u32 OpenIndex = 0;
+            OpenIndex < TrackedDepth;
+          ++OpenIndex )
+  {
+    u64 BeginEvent = Continued.Begins[OpenIndex];
+    debug_scope_event *Event = Ring->Events + (BeginEvent & Ring->Mask);
+
+    u32 ParentNode = OpenIndex ? OpenNode[OpenIndex-1] : 0;
+    OpenValid[OpenIndex] = Event->Type == ScopeEvent_Begin;
+    OpenCallsite[OpenIndex] = Event->CallsiteId;
+    OpenSampleMask[OpenIndex] = Event->SampleMask;
+    OpenCycle[OpenIndex] = Event->Cycle;
+
+    // NOTE(Jesse): Overhead of whatever they had nested in earlier frames is
+    // lost; only the Begins in this frame get corrected for.
+    OpenBeginCount[OpenIndex] = 0;
+
+    if (ScopeEventsOverwritten(Ring, BeginEvent)) { OpenValid[OpenIndex] = False; }
+
+    OpenNode[OpenIndex] = OpenValid[OpenIndex] ? GetMergedChild(Merged, ParentNode, OpenCallsite[OpenIndex], OpenIndex && !ParentNode) : 0;
+  }
+  OpenDepth = Continued.Depth;
+
+  // NOTE(Jesse): Kept alongside, so we can leave what's open at the end on
+  // the tree and the next frame doesn't have to walk this one again.
+  debug_open_scope_stack Open = Continued;
+
+  debug_history_closed_scope Closed[DEBUG_HISTORY_CHUNK_EVENTS];
+
+  u32 BeginCount = 0;
+  u32 LastClosedNode = 0;
+  u32 LastClosedCalls = 0;
+
+  for ( u64 ChunkStart = Tree->FirstEvent;
+            ChunkStart < Tree->OnePastLastEvent;
+            ChunkStart += DEBUG_HISTORY_CHUNK_EVENTS )
+  {
+    u64 ChunkEnd = Min(Tree->OnePastLastEvent, ChunkStart + DEBUG_HISTORY_CHUNK_EVENTS);
+    u32 ClosedCount = 0;
+
+    for ( u64 EventIndex = ChunkStart;
+              EventIndex < ChunkEnd;
+            ++EventIndex )
+    {
+      debug_scope_event *Event = Ring->Events + (EventIndex & Ring->Mask);
+      switch (Event->Type)
+      {
+        case ScopeEvent_Begin:
+        {
+          ++BeginCount;
+          PushOpenScope(&Open, EventIndex);
+
+          // NOTE(Jesse): See debug_callsite_sampling::HasChildren
+          if (OpenDepth && OpenDepth <= DEBUG_MAX_CONTINUED_SCOPES && OpenValid[OpenDepth-1] && OpenCallsite[OpenDepth-1] < State->ScopeCallsiteCount)
+          {
+            State->ScopeCallsiteSampling[OpenCallsite[OpenDepth-1]].HasChildren = True;
+          }
+
+          if (OpenDepth < DEBUG_MAX_CONTINUED_SCOPES)
+          {
+            u32 ParentNode = OpenDepth ? OpenNode[OpenDepth-1] : 0;
+            OpenValid[OpenDepth] = True;
+            OpenCallsite[OpenDepth] = Event->CallsiteId;
+            OpenSampleMask[OpenDepth] = Event->SampleMask;
+            OpenCycle[OpenDepth] = Event->Cycle;
+            OpenNode[OpenDepth] = GetMergedChild(Merged, ParentNode, Event->CallsiteId, OpenDepth && !ParentNode);
+            OpenBeginCount[OpenDepth] = BeginCount;
+          }
+          ++OpenDepth;
+        } break;
+
+        case ScopeEvent_End:
+        {
+          PopOpenScope(&Open);
+          LastClosedNode = 0;
+          LastClosedCalls = 0;
+
+          if (OpenDepth && --OpenDepth < DEBUG_MAX_CONTINUED_SCOPES && OpenValid[OpenDepth])
+          {
+            debug_history_closed_scope *Scope = Closed + ClosedCount++;
+            *Scope = {};
+            Scope->Closed = True;
+            Scope->CallsiteId = OpenCallsite[OpenDepth];
+            Scope->Calls = OpenSampleMask[OpenDepth] + 1u;
+            Scope->Node = OpenNode[OpenDepth];
+            Scope->Cycles = Event->Cycle - OpenCycle[OpenDepth];
+
+            u64 ProfilerCycles = Overhead->RdtscCycles + (BeginCount - OpenBeginCount[OpenDepth]) * Overhead->ScopeCycles;
+            Scope->CorrectedNs = (u64)(r64(Scope->Cycles > ProfilerCycles ? Scope->Cycles - ProfilerCycles : 0) * NsPerCycle);
+
+            LastClosedNode = Scope->Node;
+            LastClosedCalls = Scope->Calls;
+          }
+        } break;
+
+        case ScopeEvent_Payload:
+        {
+          // NOTE(Jesse): Belongs to the scope that just closed, which may
+          // have been in the last chunk
+          if (LastClosedNode)
+          {
+            debug_history_closed_scope *Scope = ClosedCount ? Closed + (ClosedCount-1) : 0;
+            if (!Scope || Scope->Node != LastClosedNode || Scope->Payload)
+            {
+              Scope = Closed + ClosedCount++;
+              *Scope = {};
+              Scope->Node = LastClosedNode;
+              Scope->Calls = LastClosedCalls;
+            }
+            Scope->Payload = Event->Cycle;
+          }
+        } break;
+
+        // NOTE(Jesse): A slot the ring lapped while we were reading it; the
+        // check below throws the chunk away.
+        default: {} break;
+      }
+    }
+
+    if (ScopeEventsOverwritten(Ring, ChunkStart)) return;
+
+    ApplyHistoryClosedScopes(State, Tier, Closed, ClosedCount, FrameId, NsPerCycle);
+  }
+
+  if (Tree->FrameRecorded == FrameRecorded)
+  {
+    Tree->OpenAtEnd = Open;
+    Tree->OpenAtEndFrame = FrameRecorded+1;
+    Tree->BeginCount = BeginCount;
+  }
+
+  return;
+}
+
+// NOTE(Jesse): Main thread only, once per frame.  Aggregates the frame that
+// ended DEBUG_SEALED_FRAME_LAG frames ago into the first tier.
+link_internal void
+UpdateHistoryTiers(debug_state *State, u32 LastFrameId)
+{
+  if (LastFrameId < DEBUG_SEALED_FRAME_LAG) return;
+
+  u32 FrameId = LastFrameId - DEBUG_SEALED_FRAME_LAG;
+  frame_stats *Frame = State->Frames + GetFrameSlot(FrameId);
+  debug_history_tier *Tier = State->HistoryTiers;
+
+  u32 TotalThreadCount = GetTotalThreadCount();
+  for ( u32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadIndex);
+    debug_scope_tree *Tree = ThreadState->ScopeTrees + GetFrameSlot(FrameId);
+
+    // NOTE(Jesse): Workers that are still busy with something long haven't
+    // sealed it yet; we don't wait for them.
+    if (Tree->Closed && Tree->FrameRecorded == FrameId)
+    {
+      AccumulateHistoryCallsites(State, Tier, ThreadState, Tree, FrameId, Frame->NsPerCycle);
+    }
+  }
+
+  CloseMergedFrame(&State->MergedTree, Frame->FrameMs);
+
+  AccumulateHistoryBucket(&Tier->Open, 1, Frame->FrameMs, Frame->FrameMs);
+  if (Tier->Open.TotalFrameMs >= Tier->BucketMs)
+  {
+    CloseHistoryBucket(State, 0);
+  }
+
+  return;
+}
+
+/******************************              *******************************/
+/******************************  Frame Diff  *******************************/
+/******************************              *******************************/
+
+
+
+// NOTE(Jesse): Iterative; a 100k scope frame can be a lot deeper than we'd
+// like to recurse.  Scopes deeper than DEBUG_FRAME_DIFF_MAX_DEPTH, or that
+// don't fit, are left in their parent's inclusive time.
+link_internal void
+AccumulateFrameDiff(debug_frame_diff *Diff, debug_profile_scope *Root, u32 Side, r64 CycleScale)
+{
+  u32 ParentEntries[DEBUG_FRAME_DIFF_MAX_DEPTH];
+  ParentEntries[0] = 0;
+  u32 Depth = 0;
+
+  debug_profile_scope *Scope = Root;
+  while (Scope)
+  {
+    u32 PathCount = Diff->Paths.Count;
+    u32 EntryIndex = GetCallPath(&Diff->Paths, ParentEntries[Depth], Scope->CallsiteId);
+    if (EntryIndex)
+    {
+      u32 Calls = Scope->SampleMask + 1u;
+      debug_frame_diff_entry *Entry = Diff->Entries + EntryIndex;
+      if (Diff->Paths.Count != PathCount) { Clear(Entry); }
+      Entry->Calls[Side]  += Calls;
+      Entry->Cycles[Side] += u64(r64(GetCorrectedCycleCount(Scope)) * CycleScale) * Calls;
+    }
+    else
+    {
+      Diff->EntriesDropped++;
+    }
+
+    if (EntryIndex && Scope->Child && Depth+1 < DEBUG_FRAME_DIFF_MAX_DEPTH)
+    {
+      ParentEntries[++Depth] = EntryIndex;
+      Scope = Scope->Child;
+      continue;
+    }
+
+    if (Scope->Child && EntryIndex) { Diff->EntriesDropped++; }
+
+    // NOTE(Jesse): Next sibling, or the next sibling of the nearest ancestor
+    while (Scope && !Scope->Sibling)
+    {
+      if (Depth) { Scope = Scope->Parent; --Depth; }
+      else       { Scope = 0; }
+    }
+
+    if (Scope) { Scope = Scope->Sibling; }
+  }
+
+  return;
+}
+
+link_internal u64
+GetFrameDiffDelta(debug_frame_diff_entry *Entry)
+{
+  u64 Result = Entry->Cycles[1] > Entry->Cycles[0] ? Entry->Cycles[1] - Entry->Cycles[0] : Entry->Cycles[0] - Entry->Cycles[1];
+  return Result;
+}
+
+// NOTE(Jesse): Keeps the DEBUG_FRAME_DIFF_ROWS biggest changes in a min-heap
+// so we don't sort every entry, then sorts those.
+link_internal void
+SelectFrameDiffRows(debug_frame_diff *Diff)
+{
+  u32 *Heap = Diff->Rows;
+  u32 HeapCount = 0;
+
+  for ( u32 EntryIndex = 1;
+            EntryIndex < Diff->Paths.Count;
+          ++EntryIndex )
+  {
+    debug_frame_diff_entry *Entry = Diff->Entries + EntryIndex;
+    u64 Delta = GetFrameDiffDelta(Entry);
+    if (Delta == 0 && Entry->Calls[0] == Entry->Calls[1]) continue;
+
+    u32 At = 0;
+    if (HeapCount < DEBUG_FRAME_DIFF_ROWS)
+    {
+      At = HeapCount++;
+      while (At && GetFrameDiffDelta(Diff->Entries + Heap[(At-1)/2]) > Delta)
+      {
+        Heap[At] = Heap[(At-1)/2];
+        At = (At-1)/2;
+      }
+    }
+    else if (Delta > GetFrameDiffDelta(Diff->Entries + Heap[0]))
+    {
+      for (;;)
+      {
+        u32 Smallest = At;
+        u64 SmallestDelta = Delta;
+        for (u32 Child = 2*At+1; Child <= 2*At+2 && Child < HeapCount; ++Child)
+        {
+          u64 ChildDelta = GetFrameDiffDelta(Diff->Entries + Heap[Child]);
+          if (ChildDelta < SmallestDelta) { Smallest = Child; SmallestDelta = ChildDelta; }
+        }
+
+        if (Smallest == At) break;
+        Heap[At] = Heap[Smallest];
+        At = Smallest;
+      }
+    }
+    else
+    {
+      continue;
+    }
+
+    Heap[At] = EntryIndex;
+  }
+
+  for (u32 RowIndex = 1; RowIndex < HeapCount; ++RowIndex)
+  {
+    u32 Row = Heap[RowIndex];
+    u64 Delta = GetFrameDiffDelta(Diff->Entries + Row);
+
+    u32 At = RowIndex;
+    while (At && GetFrameDiffDelta(Diff->Entries + Heap[At-1]) < Delta)
+    {
+      Heap[At] = Heap[At-1];
+      --At;
+    }
+    Heap[At] = Row;
+  }
+
+  Diff->RowCount = HeapCount;
+}
+
+// NOTE(Jesse): Main thread only.  Cached until either frame gets recorded
+// over, so it only gets rebuilt every frame while the profiler is running.
+// The baseline is scaled to the other frame's timestamp units.
+link_internal debug_frame_diff *
+GetFrameDiff(debug_state *State, u32 BaselineSlot, u32 TargetSlot)
+{
+  TIMED_FUNCTION();
+
+  if (!State->FrameDiff)
+  {
+    memory_arena *DiffArena = AllocateArena();
+    DEBUG_REGISTER_NAMED_ARENA(DiffArena, 0, "debug_lib FrameDiff");
+
+    State->FrameDiff = Allocate(debug_frame_diff, DiffArena, 1);
+    State->FrameDiff->Entries = Allocate(debug_frame_diff_entry, DiffArena, DEBUG_FRAME_DIFF_MAX_ENTRIES);
+    State->FrameDiff->Rows    = Allocate(u32, DiffArena, DEBUG_FRAME_DIFF_ROWS);
+    InitCallPathTable(&State->FrameDiff->Paths, DEBUG_FRAME_DIFF_MAX_ENTRIES, DiffArena);
+  }
+
+  debug_frame_diff *Diff = State->FrameDiff;
+
+  u32 Slots[2] = { BaselineSlot, TargetSlot };
+  u32 FrameRecorded[2] = { GetThreadLocalStateFor(0)->ScopeTrees[BaselineSlot].FrameRecorded,
+                           GetThreadLocalStateFor(0)->ScopeTrees[TargetSlot].FrameRecorded };
+
+  b32 Cached = Diff->Paths.Count &&
+               Diff->BaselineSlot == BaselineSlot && Diff->TargetSlot == TargetSlot &&
+               Diff->FrameRecorded[0] == FrameRecorded[0] && Diff->FrameRecorded[1] == FrameRecorded[1];
+
+  if (!Cached)
+  {
+    u64 StartCycles = GetDebugTimestamp(State);
+
+    ResetCallPathTable(&Diff->Paths);
+    Clear(Diff->Entries);
+    Diff->EntriesDropped = 0;
+    Diff->BaselineSlot = BaselineSlot;
+    Diff->TargetSlot = TargetSlot;
+
+    r64 TargetNsPerCycle = State->Frames[TargetSlot].NsPerCycle;
+
+    u32 TotalThreadCount = GetTotalThreadCount();
+    for (u32 Side = 0; Side < 2; ++Side)
+    {
+      frame_stats *Frame = State->Frames + Slots[Side];
+      r64 CycleScale = TargetNsPerCycle > 0.0 ? Frame->NsPerCycle / TargetNsPerCycle : 1.0;
+
+      Diff->FrameRecorded[Side] = FrameRecorded[Side];
+      Diff->TotalCycles[Side] = u64(r64(Frame->TotalCycles) * CycleScale);
+
+      for ( u32 ThreadIndex = 0;
+                ThreadIndex < TotalThreadCount;
+              ++ThreadIndex )
+      {
+        debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadIndex);
+        debug_scope_tree *Tree = ThreadState->ScopeTrees + Slots[Side];
+
+        BuildScopeTree(ThreadState, Tree);
+        if (Tree->FrameRecorded == FrameRecorded[Side])
+        {
+          AccumulateFrameDiff(Diff, Tree->Root, Side, CycleScale);
+        }
+      }
+    }
+
+    SelectFrameDiffRows(Diff);
+
+    Diff->BuildCycles = GetDebugTimestamp(State) - StartCycles;
+  }
+
+  return Diff;
+}
+
+
+
+/*****************************                 *****************************/
+/*****************************  Frame Advance  *****************************/
+/*****************************                 *****************************/
+
+
+
+// NOTE(Jesse): Payload events carry a count rather than a timestamp, so they
+// go by the End in front of them.  That also keeps them on the same side of a
+// split as their End.
+link_internal u64
+GetScopeEventCycle(debug_scope_event_ring *Ring, u64 EventIndex)
+{
+  debug_scope_event *Event = Ring->Events + (EventIndex & Ring->Mask);
+  if (Event->Type == ScopeEvent_Payload)
+  {
+    Event = Ring->Events + ((EventIndex-1) & Ring->Mask);
+  }
+  return Event->Cycle;
+}
+
+// NOTE(Jesse): Owning thread only, so the range is stable.  Events on a
+// thread are recorded in timestamp order.
+link_internal u64
+FindFirstScopeEventAtOrAfter(debug_scope_event_ring *Ring, u64 FirstEvent, u64 OnePastLastEvent, u64 Cycle)
+{
+  u64 Lo = FirstEvent;
+  u64 Hi = OnePastLastEvent;
+  while (Lo < Hi)
+  {
+    u64 Mid = Lo + (Hi-Lo)/2;
+    if (GetScopeEventCycle(Ring, Mid) < Cycle) { Lo = Mid+1; }
+    else                                       { Hi = Mid;   }
+  }
+  return Lo;
+}
+
+// NOTE(Jesse): Cuts the events recorded since LastFrameId at the main
+// threads frame starts and seals one tree per frame.  The trees in between
+// usually have no events at all, but they're sealed back to back, so the
+// scopes that were open across them get continued; see BuildScopeTree.
+link_internal void
+SplitSkippedFrames(debug_thread_state *ThreadState, u32 LastFrameId, u32 NextFrameId)
+{
+  debug_state *SharedState = GetDebugState();
+  debug_scope_event_ring *Ring = ThreadState->ScopeEvents;
+
+  debug_scope_tree *Tree = ThreadState->ScopeTrees + GetFrameSlot(LastFrameId);
+  for ( u32 FrameId = LastFrameId+1;
+            FrameId <= NextFrameId;
+          ++FrameId )
+  {
+    u64 OnePastLastEvent = Ring->At;
+    if (FrameId < NextFrameId)
+    {
+      u64 FrameStartingCycle = SharedState->Frames[GetFrameSlot(FrameId)].StartingCycle;
+      OnePastLastEvent = FindFirstScopeEventAtOrAfter(Ring, Tree->FirstEvent, Ring->At, FrameStartingCycle);
+    }
+
+    Tree->OnePastLastEvent = OnePastLastEvent;
+    Tree->Closed = True;
+
+    if (FrameId < NextFrameId)
+    {
+      Tree = ThreadState->ScopeTrees + GetFrameSlot(FrameId);
+      OpenWriteScopeTree(ThreadState, FrameId);
+      Tree->FirstEvent = OnePastLastEvent;
+      ThreadState->MutexOps[GetFrameSlot(FrameId)].NextRecord = 0;
+    }
+  }
+
+  return;
+}
+
+inline void
+AdvanceThreadState(debug_thread_state *ThreadState, u32 LastFrameId, u32 NextFrameId)
+{
+  /* TIMED_FUNCTION(); */
+  // The scope that would be pushed here straddles the frame boundary, which
+  // isn't super useful.
+
+  // NOTE(Jesse): This used to free the scopes of the next write tree, which
+  // was O(scopes).  Now we just seal the range of events that belongs to the
+  // frame we just finished; the reader rebuilds the tree if it wants it.
+  debug_scope_tree *LastWriteTree = ThreadState->ScopeTrees + GetFrameSlot(LastFrameId);
+  RecordSampledCallCounts(ThreadState, LastWriteTree);
+
+  // NOTE(Jesse): A worker that was busy for a few frames skipped the frames
+  // in between; give each of them the events it recorded during it instead
+  // of piling them all onto the frame it last advanced in.
+  u32 FramesSkipped = NextFrameId - LastFrameId - 1;
+  if (FramesSkipped && FramesSkipped < GetDebugState()->FramesTracked-1)
+  {
+    SplitSkippedFrames(ThreadState, LastFrameId, NextFrameId);
+  }
+  else
+  {
+    LastWriteTree->OnePastLastEvent = ThreadState->ScopeEvents->At;
+    LastWriteTree->Closed = True;
+  }
+
+  ThreadState->Counters.ScopeEvents = ThreadState->ScopeEvents->At;
+
+  u32 NextWriteIndex = GetFrameSlot(NextFrameId);
+  ThreadState->MutexOps[NextWriteIndex].NextRecord = 0;
+
+  ThreadState->ScopeEvents->TimestampMode = GetDebugState()->Timestamps.Mode;
+  OpenWriteScopeTree(ThreadState, NextFrameId);
+
+  return;
+}
+
+inline void
+WorkerThreadAdvanceDebugSystem()
+{
+  /* Assert(ThreadLocal_ThreadIndex != 0); */
+
+  debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadLocal_ThreadIndex);
+  debug_thread_state *MainThreadState = GetThreadLocalStateFor(0);
+
+  if (ThreadState != MainThreadState)
+  {
+    u32 NextFrameId = MainThreadState->WriteIndex;
+
+    // Note(Jesse): WriteIndex must not straddle a cache line!
+    Assert(sizeof(MainThreadState->WriteIndex) == 4);
+    Assert((umm)(&MainThreadState->WriteIndex)%64 <= 60 );
+
+    if (NextFrameId != ThreadState->WriteIndex)
+    {
+      u32 LastFrameId = ThreadState->WriteIndex;
+      ThreadState->WriteIndex = NextFrameId;
+      AdvanceThreadState(ThreadState, LastFrameId, NextFrameId);
+    }
+
+  }
+}
+
+// NOTE(Jesse): Main thread only.  Workers that haven't advanced yet still
+// have last frames scope counts in theirs, which come out in the next frame.
+link_internal void
+CollectThreadCounters(debug_state *State, frame_stats *Frame)
+{
+  debug_thread_counters Totals = {};
+  u64 ContextSwitchTotal = 0;
+
+  u32 TotalThreadCount = GetTotalThreadCount();
+  for ( u32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    debug_thread_state *ThreadState = State->ThreadStates + ThreadIndex;
+    debug_thread_counters *Counters = &ThreadState->Counters;
+
+    Totals.Scopes      += Counters->Scopes;
+    Totals.ScopeEvents += Counters->ScopeEvents;
+    Totals.MutexOps    += Counters->MutexOps;
+    Totals.Allocations += Counters->Allocations;
+    Totals.Dropped     += Counters->Dropped;
+
+    ContextSwitchTotal += ThreadState->ContextSwitches->Ingested;
+  }
+
+  debug_thread_counters *Last = &State->LastCounterTotals;
+
+  // NOTE(Jesse): CalibrateProfilerOverhead rewinds the rings, so ScopeEvents
+  // can go backwards.
+  Frame->Counters.Scopes          = (u32)(Totals.Scopes - Last->Scopes);
+  Frame->Counters.ScopeEvents     = (u32)(Totals.ScopeEvents > Last->ScopeEvents ? Totals.ScopeEvents - Last->ScopeEvents : 0);
+  Frame->Counters.MutexOps        = (u32)(Totals.MutexOps - Last->MutexOps);
+  Frame->Counters.Allocations     = (u32)(Totals.Allocations - Last->Allocations);
+  Frame->Counters.Dropped         = (u32)(Totals.Dropped - Last->Dropped);
+  Frame->Counters.ContextSwitches = (u32)(ContextSwitchTotal - State->LastContextSwitchTotal);
+
+  *Last = Totals;
+  State->LastContextSwitchTotal = ContextSwitchTotal;
+
+  return;
+}
+
+global_variable r64 LastMs;
+
+void
+MainThreadAdvanceDebugSystem(r32 Dt)
+{
+  TIMED_FUNCTION();
+  Assert(ThreadLocal_ThreadIndex == 0);
+
+  Assert(ThreadLocal_ThreadIndex == 0);
+  debug_thread_state *MainThreadState = GetThreadLocalStateFor(ThreadLocal_ThreadIndex);
+  debug_state *SharedState = GetDebugState();
+
+  if (SharedState->DebugDoScopeProfiling)
+  {
+    u64 CurrentCycles = GetDebugTimestamp(SharedState);
+    u64 NextStartingCycle = CurrentCycles;
+
+    // NOTE(Jesse): Has to change before WriteIndex does; every thread picks
+    // up the new mode when it sees the new frame.
+    debug_timestamps *Timestamps = &SharedState->Timestamps;
+    b32 TimestampModeChanged = (Timestamps->RequestedMode != Timestamps->Mode);
+    if (TimestampModeChanged)
+    {
+      Timestamps->Mode = Timestamps->RequestedMode;
+      NextStartingCycle = GetDebugTimestamp(SharedState);
+    }
+
+    u32 ThisFrameWriteIndex = GetFrameSlot(MainThreadState->WriteIndex);
+
+    u32 LastFrameId = MainThreadState->WriteIndex;
+    AtomicIncrement(&MainThreadState->WriteIndex);
+    AdvanceThreadState(MainThreadState, LastFrameId, MainThreadState->WriteIndex);
+
+    if (TimestampModeChanged)
+    {
+      CalibrateProfilerOverhead(SharedState);
+      UpdateCallsiteBudgets(SharedState);
+    }
+
+    CollectBudgetViolations(SharedState);
+
+    /* SharedState->ReadScopeIndex = GetNextDebugFrameIndex(SharedState->ReadScopeIndex); */
+    SharedState->ReadScopeIndex = ThisFrameWriteIndex;
+
+
+    /* Record frame cycle counts */
+
+    frame_stats *ThisFrame = SharedState->Frames + ThisFrameWriteIndex;
+    ThisFrame->FrameMs = Dt * 1000.0f;
+    ThisFrame->TotalCycles = CurrentCycles - ThisFrame->StartingCycle;
+
+    CollectFlowEvents(SharedState, ThisFrame, LastFrameId);
+    CollectThreadCounters(SharedState, ThisFrame);
+    RecordFrameDuration(SharedState, ThisFrame, LastFrameId);
+    UpdateHistoryTiers(SharedState, LastFrameId);
+    if (LastFrameId >= DEBUG_SEALED_FRAME_LAG) { HandOffTraceFrame(SharedState, LastFrameId - DEBUG_SEALED_FRAME_LAG); }
+    UpdateFlightRecorder(SharedState, ThisFrame, LastFrameId);
+
+    // NOTE(Jesse): Anything still waiting on its other end was stamped in the
+    // old units, so it would come out as garbage latency.
+    if (TimestampModeChanged) { ClearPendingFlows(SharedState); }
+
+
+    u32 NextFrameWriteIndex = GetNextDebugFrameIndex(ThisFrameWriteIndex);
+    frame_stats *NextFrame = SharedState->Frames + NextFrameWriteIndex;
+    Clear(NextFrame);
+    NextFrame->StartingCycle = NextStartingCycle;
+    NextFrame->NsPerCycle = GetNsPerCycle(Timestamps, Timestamps->Mode);
+
+    UpdateScopeSampling(SharedState);
+  }
+}
+
+min_max_avg_dt
+ComputeMinMaxAvgDt()
+{
+  TIMED_FUNCTION();
+
+  debug_state *SharedState = GetDebugState();
+
+  min_max_avg_dt Dt = {};
+  Dt.Min = f32_MAX;
+
+  u32 FrameCount = 0;
+  for (u32 FrameIndex = 0;
+      FrameIndex < SharedState->FramesTracked;
+      ++FrameIndex )
+  {
+    frame_stats *Frame = SharedState->Frames + FrameIndex;
+
+    if (Frame->FrameMs > 0.1f) { ++FrameCount; }
+    if (Frame->FrameMs > 0.1f) { Dt.Min = Min(Dt.Min, Frame->FrameMs); }
+    Dt.Max = Max(Dt.Max, Frame->FrameMs);
+    Dt.Avg += Frame->FrameMs;
+  }
+
+  Dt.Avg = SafeDivide0(Dt.Avg, r32(FrameCount));
+
+  return Dt;
+}
+
+#if 0
+inline void
+DoDebugFrameRecord(debug_recording_state *State, hotkeys *Hotkeys)
+{
+  {
+    static b32 Toggled = False;
+    if (Hotkeys->Debug_ToggleLoopedGamePlayback  && !Toggled)
     {
       Toggled = True;
       State->Mode = (debug_recording_mode)((State->Mode + 1) % RecordingMode_Count);
@@ -678,31 +2874,503 @@ ThreadsafeDebugMemoryAllocator()
 
 
 
-debug_profile_scope *
-GetProfileScope()
+// NOTE(Jesse): Returns 0 once the thread has ProfileScopeBudget worth of
+// blocks out.
+link_internal debug_profile_scope_block *
+GetProfileScopeBlock(debug_thread_state *State)
+{
+  debug_profile_scope_block *Result = 0;
+
+  u32 MaxLiveBlocks = (u32)(GetDebugState()->ProfileScopeBudget / sizeof(debug_profile_scope_block));
+  if (State->LiveBlockCount < MaxLiveBlocks)
+  {
+    if (State->FirstFreeBlock)
+    {
+      Result = State->FirstFreeBlock;
+      State->FirstFreeBlock = Result->Next;
+    }
+    else
+    {
+      memory_arena *Memory = State->MemoryFor_debug_profile_scope;
+      Result = AllocateAligned(debug_profile_scope_block, Memory, 1, CACHE_LINE_SIZE);
+    }
+  }
+
+  if (Result)
+  {
+    Result->Next = 0;
+    Result->At = 0;
+
+    State->LiveBlockCount++;
+    State->PeakBlockCount = Max(State->PeakBlockCount, State->LiveBlockCount);
+  }
+
+  return Result;
+}
+
+// NOTE(Jesse): Scopes for a given thread are only ever allocated and freed by
+// whoever is reading that threads trees (the main thread), never by the thread
+// that recorded the events.
+link_internal debug_profile_scope *
+GetProfileScope(debug_thread_state *State, debug_scope_tree *Tree)
 {
   debug_profile_scope *Result = 0;
-  debug_thread_state *State = GetThreadLocalState();
 
-  if (State)
+  if (Tree->FirstFreeScope)
+  {
+    Result = Tree->FirstFreeScope;
+    Tree->FirstFreeScope = Result->Sibling;
+  }
+  else
+  {
+    debug_profile_scope_block *Block = Tree->FirstBlock;
+    if (!Block || Block->At == DEBUG_PROFILE_SCOPES_PER_BLOCK)
+    {
+      Block = GetProfileScopeBlock(State);
+      if (Block)
+      {
+        if (!Tree->LastBlock) { Tree->LastBlock = Block; }
+
+        Block->Next = Tree->FirstBlock;
+        Tree->FirstBlock = Block;
+        Tree->BlockCount++;
+      }
+    }
+
+    if (Block) { Result = Block->Scopes + Block->At++; }
+  }
+
+  if (Result) { Clear(Result); }
+
+  return Result;
+}
+
+// NOTE(Jesse): Closed scopes always come before the open one in a sibling
+// chain, so we collapse the closed scopes nearest the root first and only go
+// down the open scope once there's nothing left to take at this level.
+// Collapsed scopes keep their DescendantCount, so their corrected time is
+// still right; they just can't be expanded anymore.
+link_internal b32
+CollapseClosedScopes(debug_scope_tree *Tree, debug_profile_scope *FirstSibling)
+{
+  b32 Result = False;
+
+  debug_profile_scope *Open = 0;
+  for ( debug_profile_scope *Scope = FirstSibling;
+                             Scope && !Result;
+                             Scope = Scope->Sibling )
+  {
+    if (Scope->EndingCycle == 0)
+    {
+      Open = Scope;
+    }
+    else if (Scope->Child)
+    {
+      Tree->ScopesCollapsed += FreeScopes(Tree, Scope->Child);
+      Scope->Child = 0;
+      Result = True;
+    }
+  }
+
+  if (!Result && Open)
+  {
+    Result = CollapseClosedScopes(Tree, Open->Child);
+  }
+
+  return Result;
+}
+
+link_internal debug_scope_tree *
+GetOldestBuiltScopeTree(debug_thread_state *ThreadState, debug_scope_tree *Exclude)
+{
+  debug_scope_tree *Result = 0;
+
+  for ( u32 TreeIndex = 0;
+            TreeIndex < GetDebugState()->FramesTracked;
+          ++TreeIndex )
+  {
+    debug_scope_tree *Tree = ThreadState->ScopeTrees + TreeIndex;
+    if (Tree != Exclude && Tree->FirstBlock)
+    {
+      if (!Result || Tree->FrameRecorded < Result->FrameRecorded)
+      {
+        Result = Tree;
+      }
+    }
+  }
+
+  return Result;
+}
+
+// NOTE(Jesse): GetProfileScope, but when we're over budget we try to make room
+// according to ProfileScopeOverflowPolicy before giving up.
+link_internal debug_profile_scope *
+GetBudgetedProfileScope(debug_thread_state *ThreadState, debug_scope_tree *Tree)
+{
+  debug_profile_scope *Result = GetProfileScope(ThreadState, Tree);
+
+  if (!Result)
+  {
+    switch (GetDebugState()->ProfileScopeOverflowPolicy)
+    {
+      case ScopeOverflow_Drop:
+      {
+      } break;
+
+      case ScopeOverflow_Collapse:
+      {
+        if (CollapseClosedScopes(Tree, Tree->Root))
+        {
+          Result = GetProfileScope(ThreadState, Tree);
+        }
+      } break;
+
+      case ScopeOverflow_StealOldest:
+      {
+        debug_scope_tree *Oldest = GetOldestBuiltScopeTree(ThreadState, Tree);
+        if (Oldest)
+        {
+          // NOTE(Jesse): It gets rebuilt if anyone asks for it again
+          Tree->BlocksStolen += Oldest->BlockCount;
+          FreeScopeTree(ThreadState, Oldest);
+          ResetScopeTreeCursor(Oldest);
+
+          Result = GetProfileScope(ThreadState, Tree);
+        }
+      } break;
+
+      InvalidDefaultCase;
+    }
+  }
+
+  return Result;
+}
+
+link_internal b32
+ScopeEventsOverwritten(debug_scope_event_ring *Ring, u64 FirstEvent)
+{
+  u64 EventCount = Ring->Mask + 1;
+  b32 Result = (Ring->At - FirstEvent) > EventCount;
+  return Result;
+}
+
+link_internal void
+PushOpenScope(debug_open_scope_stack *Stack, u64 BeginEvent)
+{
+  if (Stack->Depth < DEBUG_MAX_CONTINUED_SCOPES)
+  {
+    Stack->Begins[Stack->Depth] = BeginEvent;
+  }
+  ++Stack->Depth;
+}
+
+link_internal void
+PopOpenScope(debug_open_scope_stack *Stack)
+{
+  // NOTE(Jesse): Depth is 0 for the End of a scope that was opened before we
+  // started tracking anything, or whose Begin got lapped
+  if (Stack->Depth) { --Stack->Depth; }
+}
+
+// NOTE(Jesse): The tree this one picks up from, if the owning thread sealed
+// them back to back.  When it didn't there's nothing to continue.
+link_internal debug_scope_tree *
+GetPreviousScopeTree(debug_thread_state *ThreadState, debug_scope_tree *Tree)
+{
+  debug_scope_tree *Result = 0;
+
+  if (Tree->FrameRecorded)
+  {
+    debug_scope_tree *Prev = ThreadState->ScopeTrees + GetFrameSlot(Tree->FrameRecorded-1);
+    if ( Prev->Closed &&
+         Prev->FrameRecorded+1 == Tree->FrameRecorded &&
+         Prev->OnePastLastEvent == Tree->FirstEvent )
+    {
+      Result = Prev;
+    }
+  }
+
+  return Result;
+}
+
+// NOTE(Jesse): BuildScopeTree and AccumulateHistoryCallsites fill this in as
+// they go, so it's normally there already.  When it isn't we go back to the
+// nearest tree that has it, or has been lapped, and walk forward from there,
+// only looking at the events.  That's a loop rather than recursing through
+// GetOpenScopesAtStart, since the chain can be as long as FramesTracked.
+link_internal debug_open_scope_stack *
+GetOpenScopesAtEnd(debug_thread_state *ThreadState, debug_scope_tree *Tree)
+{
+  u64 TreeFrame = Tree->FrameRecorded;
+  if (Tree->OpenAtEndFrame != TreeFrame+1 && Tree->Closed)
+  {
+    debug_scope_event_ring *Ring = ThreadState->ScopeEvents;
+
+    debug_scope_tree *First = Tree;
+    debug_scope_tree *Prev = GetPreviousScopeTree(ThreadState, First);
+    while ( Prev &&
+            Prev->OpenAtEndFrame != Prev->FrameRecorded+1 &&
+            !ScopeEventsOverwritten(Ring, First->FirstEvent) )
+    {
+      First = Prev;
+      Prev = GetPreviousScopeTree(ThreadState, First);
+    }
+
+    debug_open_scope_stack Open = {};
+    if (Prev && Prev->OpenAtEndFrame == Prev->FrameRecorded+1) { Open = Prev->OpenAtEnd; }
+
+    for ( u64 FrameRecorded = First->FrameRecorded;
+              FrameRecorded <= TreeFrame;
+            ++FrameRecorded )
+    {
+      debug_scope_tree *At = ThreadState->ScopeTrees + GetFrameSlot(FrameRecorded);
+      b32 Valid = At->Closed && At->FrameRecorded == FrameRecorded && !ScopeEventsOverwritten(Ring, At->FirstEvent);
+      u32 BeginCount = 0;
+
+      if (Valid)
+      {
+        for ( u64 EventIndex = At->FirstEvent;
+                  EventIndex < At->OnePastLastEvent;
+                ++EventIndex )
+        {
+          debug_scope_event *Event = Ring->Events + (EventIndex & Ring->Mask);
+          if (Event->Type == ScopeEvent_Begin)    { PushOpenScope(&Open, EventIndex); ++BeginCount; }
+          else if (Event->Type == ScopeEvent_End) { PopOpenScope(&Open); }
+        }
+
+        Valid = !ScopeEventsOverwritten(Ring, At->FirstEvent) && At->FrameRecorded == FrameRecorded;
+      }
+
+      if (!Valid)
+      {
+        Open = {};
+        BeginCount = 0;
+      }
+
+      At->OpenAtEnd = Open;
+      At->OpenAtEndFrame = FrameRecorded+1;
+      At->BeginCount = BeginCount;
+    }
+  }
+
+  return &Tree->OpenAtEnd;
+}
+
+link_internal debug_open_scope_stack
+GetOpenScopesAtStart(debug_thread_state *ThreadState, debug_scope_tree *Tree)
+{
+  debug_open_scope_stack Result = {};
+
+  debug_scope_tree *Prev = GetPreviousScopeTree(ThreadState, Tree);
+  if (Prev)
+  {
+    Result = *GetOpenScopesAtEnd(ThreadState, Prev);
+  }
+
+  return Result;
+}
+
+// NOTE(Jesse): Scopes that were open when the last frame was sealed get
+// pushed before we look at any events, so the End that closes them here
+// finds them on the stack.  They keep the StartingCycle of their Begin, which
+// means a scope open for three frames is built into all three with the same
+// start and drawn as one bar running off both edges of the middle one.
+//
+// Returns the oldest event it read, which is what the caller has to check for
+// being lapped once it's done building.
+link_internal u64
+PushContinuedScopes(debug_thread_state *ThreadState, debug_scope_tree *Tree, debug_open_scope_stack *Open, u32 *UnbuiltDepth)
+{
+  debug_scope_event_ring *Ring = ThreadState->ScopeEvents;
+  u64 Result = Tree->FirstEvent;
+
+  u32 TrackedDepth = Min(Open->Depth, (u32)DEBUG_MAX_CONTINUED_SCOPES);
+  for ( u32 OpenIndex = 0;
+            OpenIndex < TrackedDepth;
+          ++OpenIndex )
   {
-    if (State->FirstFreeScope)
+    u64 BeginEvent = Open->Begins[OpenIndex];
+
+    // NOTE(Jesse): Lapped Begins are the outermost ones.  Their End falls
+    // through as if it was never opened.
+    if (ScopeEventsOverwritten(Ring, BeginEvent)) continue;
+
+    // NOTE(Jesse): If it gets lapped from here on this might not be a Begin
+    // anymore; the tree is thrown out after, so we just carry on.
+    debug_scope_event *Event = Ring->Events + (BeginEvent & Ring->Mask);
+    Result = Min(Result, BeginEvent);
+
+    debug_profile_scope *Scope = *UnbuiltDepth ? 0 : GetBudgetedProfileScope(ThreadState, Tree);
+    if (Scope)
     {
-      Result = State->FirstFreeScope;
-      State->FirstFreeScope = State->FirstFreeScope->Sibling;
+      (*Tree->WriteScope) = Scope;
+      Tree->WriteScope = &Scope->Child;
 
-      Clear(Result);
+      Scope->Parent = Tree->ParentOfNextScope;
+      Tree->ParentOfNextScope = Scope;
+
+      Scope->CallsiteId = Event->CallsiteId;
+      Scope->SampleMask = Event->SampleMask;
+      Scope->StartingCycle = Event->Cycle;
+      Scope->Flags |= ScopeFlag_ContinuedFromPreviousFrame;
     }
     else
     {
-      memory_arena *Memory = ThreadsafeDebugMemoryAllocator_debug_profile_scope_only();
-      Result = AllocateProtection(debug_profile_scope, Memory, 1, False);
+      ++(*UnbuiltDepth);
+      ++Tree->ScopesDropped;
     }
   }
 
+  // NOTE(Jesse): Nested deeper than we kept track of; skip their Ends
+  (*UnbuiltDepth) += Open->Depth - TrackedDepth;
+
   return Result;
 }
 
+link_internal void
+BuildScopeTree(debug_thread_state *ThreadState, debug_scope_tree *Tree)
+{
+  // Timing this adds scopes to the thing we're building
+  /* TIMED_FUNCTION(); */
+
+  u64 FrameRecorded = Tree->FrameRecorded;
+  if (Tree->BuiltFrame == FrameRecorded+1) return;
+
+  FreeScopeTree(ThreadState, Tree);
+  ResetScopeTreeCursor(Tree);
+
+  if (!Tree->Closed) return;
+
+  debug_scope_event_ring *Ring = ThreadState->ScopeEvents;
+  u64 FirstEvent = Tree->FirstEvent;
+  u64 OnePastLastEvent = Tree->OnePastLastEvent;
+
+  // NOTE(Jesse): Begin events we couldn't get a scope for; their matching End
+  // events have to be skipped too or we'd pop the wrong scope.
+  u32 UnbuiltDepth = 0;
+
+  // NOTE(Jesse): Payload events belong to whatever scope was just closed
+  debug_profile_scope *LastClosedScope = 0;
+
+  debug_open_scope_stack Open = GetOpenScopesAtStart(ThreadState, Tree);
+
+  // NOTE(Jesse): The owning thread can lap us while we build, which can
+  // happen with an old frame picked out of the ticker.  Nothing in here
+  // trusts what it reads to be consistent; we check once we're done and
+  // throw the tree out if it was lapped.
+  u64 OldestEvent = FirstEvent;
+  u32 BeginCount = 0;
+
+  if (!ScopeEventsOverwritten(Ring, FirstEvent))
+  {
+    OldestEvent = PushContinuedScopes(ThreadState, Tree, &Open, &UnbuiltDepth);
+
+    for ( u64 EventIndex = FirstEvent;
+              EventIndex < OnePastLastEvent;
+            ++EventIndex )
+    {
+      debug_scope_event *Event = Ring->Events + (EventIndex & Ring->Mask);
+      switch (Event->Type)
+      {
+        case ScopeEvent_Begin:
+        {
+          PushOpenScope(&Open, EventIndex);
+          ++BeginCount;
+
+          debug_profile_scope *Scope = UnbuiltDepth ? 0 : GetBudgetedProfileScope(ThreadState, Tree);
+          if (Scope)
+          {
+            (*Tree->WriteScope) = Scope;
+            Tree->WriteScope = &Scope->Child;
+
+            Scope->Parent = Tree->ParentOfNextScope;
+            Tree->ParentOfNextScope = Scope;
+
+            Scope->CallsiteId = Event->CallsiteId;
+            Scope->SampleMask = Event->SampleMask;
+            Scope->StartingCycle = Event->Cycle;
+          }
+          else
+          {
+            ++UnbuiltDepth;
+            ++Tree->ScopesDropped;
+          }
+        } break;
+
+        case ScopeEvent_End:
+        {
+          PopOpenScope(&Open);
+
+          debug_profile_scope *Scope = Tree->ParentOfNextScope;
+          LastClosedScope = 0;
+          if (UnbuiltDepth)
+          {
+            --UnbuiltDepth;
+          }
+          else if (Scope)
+          {
+            // NOTE(Jesse): Only goes backwards if we were lapped
+            Scope->EndingCycle = Max(Event->Cycle, Scope->StartingCycle);
+
+            if (Scope->Parent)
+            {
+              Scope->Parent->DescendantCount += Scope->DescendantCount + 1;
+            }
+
+            debug_callsite_sampling *Sampling = GetDebugState()->ScopeCallsiteSampling + Scope->CallsiteId;
+            Sampling->BuiltCycles += GetCorrectedCycleCount(Scope);
+            Sampling->BuiltCalls++;
+
+            // 'Pop' the scope stack
+            Tree->WriteScope = &Scope->Sibling;
+            Tree->ParentOfNextScope = Scope->Parent;
+            LastClosedScope = Scope;
+          }
+          else
+          {
+            // NOTE(Jesse): This scope was opened before anything we can
+            // continue from; see PushContinuedScopes
+          }
+        } break;
+
+        case ScopeEvent_Payload:
+        {
+          if (LastClosedScope) { LastClosedScope->Payload = Event->Cycle; }
+        } break;
+
+        // NOTE(Jesse): A slot being written as we read it
+        default: {} break;
+      }
+    }
+
+    for ( debug_profile_scope *Scope = Tree->ParentOfNextScope;
+                               Scope;
+                               Scope = Scope->Parent )
+    {
+      Scope->Flags |= ScopeFlag_ContinuesIntoNextFrame;
+    }
+  }
+
+  // NOTE(Jesse): The owning thread could have lapped us, or started recording
+  // into this slot again, while we were building.  In that case the tree is
+  // garbage and we throw it away.
+  if (ScopeEventsOverwritten(Ring, OldestEvent) || Tree->FrameRecorded != FrameRecorded)
+  {
+    FreeScopeTree(ThreadState, Tree);
+    ResetScopeTreeCursor(Tree);
+    Open = {};
+    BeginCount = 0;
+  }
+
+  Tree->OpenAtEnd = Open;
+  Tree->OpenAtEndFrame = FrameRecorded+1;
+  Tree->BeginCount = BeginCount;
+
+  Tree->BuiltFrame = FrameRecorded+1;
+
+  return;
+}
+
 inline mutex_op_record *
 ReserveMutexOpRecord(mutex *Mutex, mutex_op Op, debug_state *State)
 {
@@ -710,18 +3378,21 @@ ReserveMutexOpRecord(mutex *Mutex, mutex_op Op, debug_state *State)
 
   mutex_op_record *Record = 0;
   debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadLocal_ThreadIndex);
-  u32 WriteIndex = ThreadState->WriteIndex % DEBUG_FRAMES_TRACKED;
+  u32 WriteIndex = GetFrameSlot(ThreadState->WriteIndex);
   mutex_op_array *MutexOps = &ThreadState->MutexOps[WriteIndex];
 
   if (MutexOps->NextRecord < MUTEX_OPS_PER_FRAME)
   {
     Record = MutexOps->Records + MutexOps->NextRecord++;
-    Record->Cycle = GetCycleCount();
+    Record->Cycle = ReadBeginTimestamp(ThreadState->ScopeEvents->TimestampMode);
     Record->Op = Op;
     Record->Mutex = Mutex;
+
+    ThreadState->Counters.MutexOps++;
   }
   else
   {
+    ThreadState->Counters.Dropped++;
     Warn("Total debug mutex operations of %u exceeded, discarding record info.", MUTEX_OPS_PER_FRAME);
   }
 
@@ -779,6 +3450,54 @@ FindRecord(mutex_op_record *WaitRecord, mutex_op_record *FinalRecord, mutex_op S
 /*****************************              **********************************/
 
 
+// NOTE(Jesse): Self time of every scope goes to its category, so the
+// categories add up to the time covered by the trees roots.  Sampled
+// children only show up one in N times; the rest of their time stays in
+// their parents self time.
+link_internal void
+AccumulateCategoryCycles(debug_profile_scope *FirstSibling, u32 ParentCategory, u64 *CategoryCycles)
+{
+  for ( debug_profile_scope *Scope = FirstSibling;
+                             Scope;
+                             Scope = Scope->Sibling )
+  {
+    if (Scope->EndingCycle == 0) continue;
+
+    u32 Category = GetCallsite(Scope)->Category;
+    if (Category == Category_Default) { Category = ParentCategory; }
+
+    u64 ChildCycles = 0;
+    for ( debug_profile_scope *Child = Scope->Child;
+                               Child;
+                               Child = Child->Sibling )
+    {
+      if (Child->EndingCycle) { ChildCycles += Child->EndingCycle - Child->StartingCycle; }
+    }
+
+    u64 Cycles = Scope->EndingCycle - Scope->StartingCycle;
+    CategoryCycles[Category] += Cycles > ChildCycles ? Cycles - ChildCycles : 0;
+
+    AccumulateCategoryCycles(Scope->Child, Category, CategoryCycles);
+  }
+
+  return;
+}
+
+link_internal void
+GetCategoryCycles(debug_scope_tree *Tree, u64 *CategoryCycles)
+{
+  for ( u32 Category = 0;
+            Category < Category_Count;
+          ++Category )
+  {
+    CategoryCycles[Category] = 0;
+  }
+
+  AccumulateCategoryCycles(Tree->Root, Category_Default, CategoryCycles);
+
+  return;
+}
+
 inline u32
 GetTotalMutexOpsForReadFrame()
 {
@@ -832,7 +3551,7 @@ InitDebugMemoryAllocationSystem(debug_state *State)
    * are atomic that don't span a cache-line boundary.  This ensures we never
    * hit that case.
    */
-  CAssert(sizeof(debug_thread_state) == CACHE_LINE_SIZE);
+  CAssert(sizeof(debug_thread_state) % CACHE_LINE_SIZE == 0);
   for (s32 ThreadIndex = 0;
            ThreadIndex < (s32)TotalThreadCount;
          ++ThreadIndex)
@@ -855,7 +3574,7 @@ InitDebugMemoryAllocationSystem(debug_state *State)
 
     ThreadState->Memory = DebugThreadArena;
 
-    umm DebugProfileScopeArenaSize = Megabytes(32);
+    umm DebugProfileScopeArenaSize = DEBUG_PROFILE_SCOPE_BUDGET_DEFAULT;
 
     memory_arena *DebugThreadArenaFor_debug_profile_scope = AllocateArena(DebugProfileScopeArenaSize);
     DEBUG_REGISTER_ARENA(DebugThreadArenaFor_debug_profile_scope, ThreadIndex);
@@ -863,8 +3582,24 @@ InitDebugMemoryAllocationSystem(debug_state *State)
     ThreadState->MemoryFor_debug_profile_scope = DebugThreadArenaFor_debug_profile_scope;
 
     ThreadState->MetaTable = (memory_record*)PushStruct(ThreadsafeDebugMemoryAllocator(), MetaTableSize, CACHE_LINE_SIZE);
-    ThreadState->MutexOps = AllocateAligned(mutex_op_array, DebugThreadArena, DEBUG_FRAMES_TRACKED, CACHE_LINE_SIZE);
-    ThreadState->ScopeTrees = AllocateAligned(debug_scope_tree, DebugThreadArena, DEBUG_FRAMES_TRACKED, CACHE_LINE_SIZE);
+    ThreadState->MutexOps = AllocateAligned(mutex_op_array, DebugThreadArena, State->FramesTracked, CACHE_LINE_SIZE);
+    ThreadState->ScopeTrees = AllocateAligned(debug_scope_tree, DebugThreadArena, State->FramesTracked, CACHE_LINE_SIZE);
+
+    umm ScopeEventArenaSize = State->ScopeEventsPerThread * sizeof(debug_scope_event);
+    memory_arena *DebugThreadArenaFor_debug_scope_event = AllocateArena(ScopeEventArenaSize + CACHE_LINE_SIZE);
+    DEBUG_REGISTER_ARENA(DebugThreadArenaFor_debug_scope_event, ThreadIndex);
+
+    debug_scope_event_ring *ScopeEvents = AllocateAligned(debug_scope_event_ring, DebugThreadArena, 1, CACHE_LINE_SIZE);
+    ScopeEvents->Mask = State->ScopeEventsPerThread-1;
+    ScopeEvents->Events = AllocateAligned(debug_scope_event, DebugThreadArenaFor_debug_scope_event, State->ScopeEventsPerThread, CACHE_LINE_SIZE);
+    ScopeEvents->EnabledCategories = GetEnabledScopeCategories(State);
+    ScopeEvents->CallCounts = AllocateAligned(u32, DebugThreadArena, MAX_DEBUG_SCOPE_CALLSITES, CACHE_LINE_SIZE);
+    ScopeEvents->SampleMasks = State->ScopeCallsiteSampleMasks;
+    ThreadState->ReportedCallCounts = AllocateAligned(u32, DebugThreadArena, MAX_DEBUG_SCOPE_CALLSITES, CACHE_LINE_SIZE);
+    ScopeEvents->BudgetCycles = State->ScopeCallsiteBudgetCycles;
+    ThreadState->BudgetViolations = AllocateAligned(debug_budget_violation_ring, DebugThreadArena, 1, CACHE_LINE_SIZE);
+    ThreadState->FlowEvents = AllocateAligned(debug_flow_event_ring, DebugThreadArena, 1, CACHE_LINE_SIZE);
+    ThreadState->ScopeEvents = ScopeEvents;
   }
 
   return;
@@ -908,10 +3643,47 @@ InitDebugDataSystem(debug_state *DebugState)
 {
   Assert(ThreadLocal_ThreadIndex == 0);
 
+  // NOTE(Jesse): Sizes everything per-frame, so it has to be settled before
+  // we allocate any of it.
+  if (DebugState->FramesTracked == 0) { DebugState->FramesTracked = DEBUG_FRAMES_TRACKED_DEFAULT; }
+  DebugState->FramesTracked = Min(Max(DebugState->FramesTracked, (u32)DEBUG_FRAMES_TRACKED_MIN), (u32)DEBUG_FRAMES_TRACKED_MAX);
+
+  if (DebugState->ScopeEventsPerFrame == 0) { DebugState->ScopeEventsPerFrame = DEBUG_SCOPE_EVENTS_PER_FRAME_DEFAULT; }
+
+  // NOTE(Jesse): The frames still being recorded and sealed need room too
+  u64 EventsWanted = u64(DebugState->FramesTracked + DEBUG_SEALED_FRAME_LAG + 2) * DebugState->ScopeEventsPerFrame;
+  u32 EventsPerThread = DEBUG_SCOPE_EVENTS_PER_THREAD_MIN;
+  while (EventsPerThread < EventsWanted && EventsPerThread < DEBUG_SCOPE_EVENTS_PER_THREAD_MAX) { EventsPerThread <<= 1; }
+  DebugState->ScopeEventsPerThread = EventsPerThread;
+
+  if (EventsPerThread < EventsWanted)
+  {
+    Warn("Scope event rings can't hold %u frames of %u events; older frames will come back empty", DebugState->FramesTracked, DebugState->ScopeEventsPerFrame);
+  }
+
   InitDebugMemoryAllocationSystem(DebugState);
 
+  memory_arena *HistoryArena = AllocateArena();
+  DEBUG_REGISTER_NAMED_ARENA(HistoryArena, 0, "debug_lib History");
+
+  DebugState->Frames = Allocate(frame_stats, HistoryArena, DebugState->FramesTracked);
+  InitHistoryTier(DebugState->HistoryTiers + 0, HistoryArena, 1000.0,  DEBUG_HISTORY_SECOND_BUCKETS, DEBUG_HISTORY_SECOND_AGGREGATES);
+  InitHistoryTier(DebugState->HistoryTiers + 1, HistoryArena, 60000.0, DEBUG_HISTORY_MINUTE_BUCKETS, DEBUG_HISTORY_MINUTE_AGGREGATES);
+
+  InitMergedTree(&DebugState->MergedTree, HistoryArena);
+
+  DebugState->DurationArena = AllocateArena();
+  DEBUG_REGISTER_NAMED_ARENA(DebugState->DurationArena, 0, "debug_lib Durations");
+
+  InitScopeCallsites(DebugState);
+
+  DebugState->ProfileScopeBudget = DEBUG_PROFILE_SCOPE_BUDGET_DEFAULT;
+  DebugState->ProfileScopeOverflowPolicy = ScopeOverflow_StealOldest;
+  DebugState->ScopeCategoryMask = u32_MAX;
+
   debug_thread_state *MainThreadState = GetThreadLocalStateFor(0);
   MainThreadState->ThreadId = GetCurrentThreadId();
+  ThreadLocal_ScopeEvents = MainThreadState->ScopeEvents;
 
   s32 TotalThreadCount = (s32)GetTotalThreadCount();
   for (s32 ThreadIndex = 0;
@@ -922,14 +3694,18 @@ InitDebugDataSystem(debug_state *DebugState)
     ThreadState->ContextSwitches = AllocateContextSwitchBufferStream(ThreadsafeDebugMemoryAllocator(), MAX_CONTEXT_SWITCH_EVENTS );
 
     for (u32 TreeIndex = 0;
-        TreeIndex < DEBUG_FRAMES_TRACKED;
+        TreeIndex < DebugState->FramesTracked;
         ++TreeIndex)
     {
       InitScopeTree(ThreadState->ScopeTrees + TreeIndex);
       ThreadState->WriteIndex = GetDebugState()->ReadScopeIndex + 1;
     }
+
+    OpenWriteScopeTree(ThreadState, ThreadState->WriteIndex);
   }
 
+  InitFlightRecorder(DebugState);
+
 
 
 
@@ -0,0 +1,84 @@
+// NOTE(Jesse): Headless baseline comparison, for CI.  Both files come from
+// DEBUG_SAVE_BASELINE; the exit status is a debug_baseline_exit_status.
+//
+//   debug_perf_gate <baseline> <current> [-v] [-max-change 0.05] [-min-z 3]
+//                   [-min-samples 100] [-min-change-us 1]
+
+#define DEBUG_SYSTEM_API 1
+
+#include <stdlib.h>
+
+#include <bonsai_stdlib/bonsai_stdlib.h>
+#include <bonsai_stdlib/bonsai_stdlib.cpp>
+
+#include <bonsai_debug/debug.h>
+#include <bonsai_debug/debug_baseline.cpp>
+
+link_internal void
+PrintPerfGateUsage()
+{
+  DebugLine("usage: debug_perf_gate <baseline> <current> [-v] [-max-change fraction] [-min-z z] [-min-samples count] [-min-change-us us]");
+}
+
+s32
+main(s32 ArgCount, const char **Args)
+{
+  if (ArgCount < 3)
+  {
+    PrintPerfGateUsage();
+    return BaselineExit_Error;
+  }
+
+  debug_baseline_thresholds Thresholds = Global_DefaultBaselineThresholds;
+  b32 Verbose = False;
+
+  for ( s32 ArgIndex = 3;
+            ArgIndex < ArgCount;
+          ++ArgIndex )
+  {
+    const char *Arg = Args[ArgIndex];
+    const char *Value = ArgIndex+1 < ArgCount ? Args[ArgIndex+1] : 0;
+
+    if (StringsMatch(Arg, "-v"))
+    {
+      Verbose = True;
+    }
+    else if (Value && StringsMatch(Arg, "-max-change"))
+    {
+      Thresholds.MaxChange = atof(Value);
+      ++ArgIndex;
+    }
+    else if (Value && StringsMatch(Arg, "-min-z"))
+    {
+      Thresholds.MinZ = atof(Value);
+      ++ArgIndex;
+    }
+    else if (Value && StringsMatch(Arg, "-min-samples"))
+    {
+      Thresholds.MinSamples = strtoull(Value, 0, 10);
+      ++ArgIndex;
+    }
+    else if (Value && StringsMatch(Arg, "-min-change-us"))
+    {
+      Thresholds.MinChangeNs = u64(atof(Value) * 1000.0);
+      ++ArgIndex;
+    }
+    else
+    {
+      Error("Unknown argument (%s)", Arg);
+      PrintPerfGateUsage();
+      return BaselineExit_Error;
+    }
+  }
+
+  memory_arena *Memory = AllocateArena();
+
+  debug_baseline Baseline, Current;
+  if (!ReadBaseline(Args[1], &Baseline, Memory)) { return BaselineExit_Error; }
+  if (!ReadBaseline(Args[2], &Current, Memory))  { return BaselineExit_Error; }
+
+  debug_baseline_report Report = CompareBaselines(&Baseline, &Current, &Thresholds, Verbose);
+
+  s32 Result = GetBaselineExitStatus(&Report);
+  return Result;
+}
@@ -0,0 +1,711 @@
+/******************************                  *****************************/
+/******************************  Perfetto Trace  *****************************/
+/******************************                  *****************************/
+
+
+// NOTE(Jesse): The second format the trace writer knows; a Perfetto Trace
+// proto, which is nothing but a stream of TracePackets, so it can be written
+// a frame at a time and opened in ui.perfetto.dev however far it got.
+//
+// Sequences (trusted_packet_sequence_id)
+//
+//   1            Track descriptors, the frame time counter and context
+//                switches.  Absolute timestamps on the default clock.
+//   2 + 2*T      Thread T's scopes, straight from its event ring
+//   3 + 2*T      Thread T's lock waits and holds
+//
+// The per-thread sequences get their incremental state set up by the first
+// packet written on them: a clock snapshot defining an incremental clock, so
+// every timestamp after that is a delta, the track to put events on by
+// default, and the names that don't come from callsites.  Callsite names are
+// interned the first time a sequence needs them, iid CallsiteId+1, so a
+// slice costs a dozen bytes or so.
+//
+// A scope ends up a SLICE_BEGIN and SLICE_END, in whatever frames it was
+// recorded in.  Payloads ride along on the SLICE_END as an "items" debug
+// annotation.
+
+#define DEBUG_PERFETTO_PID (1)
+
+#define DEBUG_PERFETTO_PROCESS_SEQUENCE (1)
+#define DEBUG_PERFETTO_INCREMENTAL_CLOCK (64) // First of the sequence-scoped ids
+#define DEBUG_PERFETTO_BOOTTIME_CLOCK (6)
+
+#define DEBUG_PERFETTO_PROCESS_TRACK     (1)
+#define DEBUG_PERFETTO_FRAME_MS_TRACK    (2)
+#define DEBUG_PERFETTO_THREAD_TRACK      (0x100)  // Plus the ThreadIndex
+#define DEBUG_PERFETTO_LOCK_TRACK        (0x200)  // Plus the ThreadIndex
+#define DEBUG_PERFETTO_CPU_TRACK         (0x1000) // Plus the ProcessorNumber
+
+#define DEBUG_PERFETTO_WAIT_NAME_IID     (MAX_DEBUG_SCOPE_CALLSITES + 1)
+#define DEBUG_PERFETTO_HELD_NAME_IID     (MAX_DEBUG_SCOPE_CALLSITES + 2)
+#define DEBUG_PERFETTO_ITEMS_ANNOTATION_IID (1)
+
+// NOTE(Jesse): Worst case for one slice packet, with a payload
+#define DEBUG_PERFETTO_MAX_EVENT_BYTES (64)
+#define DEBUG_PERFETTO_SCRATCH_SIZE (512)
+
+// NOTE(Jesse): Field numbers, from perfetto/protos/perfetto/trace
+enum debug_proto_field
+{
+  Proto_Trace_Packet                     = 1,
+
+  Proto_TracePacket_ClockSnapshot        = 6,
+  Proto_TracePacket_Timestamp            = 8,
+  Proto_TracePacket_SequenceId           = 10, // trusted_packet_sequence_id
+  Proto_TracePacket_TrackEvent           = 11,
+  Proto_TracePacket_InternedData         = 12,
+  Proto_TracePacket_SequenceFlags        = 13,
+  Proto_TracePacket_TimestampClockId     = 58,
+  Proto_TracePacket_Defaults             = 59,
+  Proto_TracePacket_TrackDescriptor      = 60,
+
+  Proto_ClockSnapshot_Clocks             = 1,
+  Proto_Clock_ClockId                    = 1,
+  Proto_Clock_Timestamp                  = 2,
+  Proto_Clock_IsIncremental              = 3,
+
+  Proto_TracePacketDefaults_TrackEventDefaults = 11,
+  Proto_TrackEventDefaults_TrackUuid     = 11,
+
+  Proto_InternedData_EventNames          = 2,
+  Proto_InternedData_AnnotationNames     = 3,
+  Proto_InternedString_Iid               = 1,
+  Proto_InternedString_Name              = 2,
+
+  Proto_TrackEvent_DebugAnnotations      = 4,
+  Proto_TrackEvent_Type                  = 9,
+  Proto_TrackEvent_NameIid               = 10,
+  Proto_TrackEvent_TrackUuid             = 11,
+  Proto_TrackEvent_Name                  = 23,
+  Proto_TrackEvent_DoubleCounterValue    = 44,
+
+  Proto_DebugAnnotation_NameIid          = 1,
+  Proto_DebugAnnotation_UIntValue        = 3,
+
+  Proto_TrackDescriptor_Uuid             = 1,
+  Proto_TrackDescriptor_Name             = 2,
+  Proto_TrackDescriptor_Process          = 3,
+  Proto_TrackDescriptor_Thread           = 4,
+  Proto_TrackDescriptor_ParentUuid       = 5,
+  Proto_TrackDescriptor_Counter          = 8,
+
+  Proto_ProcessDescriptor_Pid            = 1,
+  Proto_ProcessDescriptor_Name           = 6,
+  Proto_ThreadDescriptor_Pid             = 1,
+  Proto_ThreadDescriptor_Tid             = 2,
+  Proto_ThreadDescriptor_Name            = 5,
+  Proto_CounterDescriptor_UnitName       = 6,
+};
+
+enum debug_proto_wire_type
+{
+  ProtoWire_Varint  = 0,
+  ProtoWire_Fixed64 = 1,
+  ProtoWire_Bytes   = 2,
+};
+
+enum debug_perfetto_event_type
+{
+  PerfettoEvent_SliceBegin = 1,
+  PerfettoEvent_SliceEnd   = 2,
+  PerfettoEvent_Counter    = 4,
+};
+
+enum debug_perfetto_sequence_flags
+{
+  PerfettoSequence_IncrementalStateCleared = 1,
+  PerfettoSequence_NeedsIncrementalState   = 2,
+};
+
+// NOTE(Jesse): Nested messages are length prefixed, so they get built in one
+// of these on the stack and copied into whatever contains them.
+struct debug_proto_buffer
+{
+  u8 *Bytes;
+  u32 At;
+  u32 Size;
+};
+
+#define ProtoBuffer(Bytes) { Bytes, 0, (u32)sizeof(Bytes) }
+
+link_internal void
+PushProtoVarint(debug_proto_buffer *Buffer, u64 Value)
+{
+  Assert(Buffer->At + 10 <= Buffer->Size);
+  while (Value >= 0x80)
+  {
+    Buffer->Bytes[Buffer->At++] = u8(Value | 0x80);
+    Value >>= 7;
+  }
+  Buffer->Bytes[Buffer->At++] = u8(Value);
+}
+
+link_internal void
+PushProtoTag(debug_proto_buffer *Buffer, u32 Field, debug_proto_wire_type WireType)
+{
+  PushProtoVarint(Buffer, (Field << 3) | WireType);
+}
+
+link_internal void
+PushProtoUInt(debug_proto_buffer *Buffer, u32 Field, u64 Value)
+{
+  PushProtoTag(Buffer, Field, ProtoWire_Varint);
+  PushProtoVarint(Buffer, Value);
+}
+
+link_internal void
+PushProtoDouble(debug_proto_buffer *Buffer, u32 Field, r64 Value)
+{
+  PushProtoTag(Buffer, Field, ProtoWire_Fixed64);
+  Assert(Buffer->At + sizeof(r64) <= Buffer->Size);
+  MemCopy((u8*)&Value, Buffer->Bytes + Buffer->At, sizeof(r64));
+  Buffer->At += sizeof(r64);
+}
+
+link_internal void
+PushProtoBytes(debug_proto_buffer *Buffer, u32 Field, u8 *Bytes, u32 Count)
+{
+  PushProtoTag(Buffer, Field, ProtoWire_Bytes);
+  PushProtoVarint(Buffer, Count);
+  Assert(Buffer->At + Count <= Buffer->Size);
+  MemCopy(Bytes, Buffer->Bytes + Buffer->At, Count);
+  Buffer->At += Count;
+}
+
+link_internal void
+PushProtoString(debug_proto_buffer *Buffer, u32 Field, const char *String)
+{
+  u32 Count = String ? (u32)Min(Length(String), (umm)255) : 0;
+  PushProtoBytes(Buffer, Field, (u8*)String, Count);
+}
+
+link_internal void
+PushProtoMessage(debug_proto_buffer *Buffer, u32 Field, debug_proto_buffer *Message)
+{
+  PushProtoBytes(Buffer, Field, Message->Bytes, Message->At);
+}
+
+// NOTE(Jesse): Callers reserve room; chunks of events reserve for all of them
+// up front so they can be taken back out, same as the BDTR records.
+link_internal void
+WritePerfettoPacket(debug_trace_writer *Writer, debug_proto_buffer *Packet)
+{
+  WriteTraceVarint(Writer, (Proto_Trace_Packet << 3) | ProtoWire_Bytes);
+  WriteTraceVarint(Writer, Packet->At);
+  WriteTraceBytes(Writer, Packet->Bytes, Packet->At);
+}
+
+link_internal void
+WritePerfettoPacketReserved(debug_trace_writer *Writer, debug_proto_buffer *Packet)
+{
+  ReserveTraceBuffer(Writer, Packet->At + 1 + 5);
+  WritePerfettoPacket(Writer, Packet);
+}
+
+// NOTE(Jesse): Frames are converted with their own NsPerCycle and chained
+// together off of the first one, so a timestamp mode change doesn't make
+// time jump.  Context switches get whatever the current frame has.
+link_internal void
+UpdatePerfettoClock(debug_trace_writer *Writer, debug_trace_frame *Frame)
+{
+  if (Writer->FrameStartingCycle == 0)
+  {
+    Writer->FrameStartNs = r64(Frame->StartingCycle) * Frame->NsPerCycle;
+  }
+  else
+  {
+    Writer->FrameStartNs += (r64(Frame->StartingCycle) - r64(Writer->FrameStartingCycle)) * Writer->NsPerCycle;
+  }
+
+  Writer->FrameStartingCycle = Frame->StartingCycle;
+  Writer->NsPerCycle = Frame->NsPerCycle;
+}
+
+link_internal u64
+GetPerfettoNs(debug_trace_writer *Writer, u64 Cycle)
+{
+  r64 Ns = Writer->FrameStartNs + (r64(Cycle) - r64(Writer->FrameStartingCycle)) * Writer->NsPerCycle;
+  u64 Result = Ns > 0.0 ? u64(Ns) : 0;
+  return Result;
+}
+
+link_internal void
+PushPerfettoInternedString(debug_proto_buffer *InternedData, u32 Field, u64 Iid, const char *Name)
+{
+  u8 StringBytes[DEBUG_PERFETTO_SCRATCH_SIZE];
+  debug_proto_buffer String = ProtoBuffer(StringBytes);
+  PushProtoUInt(&String, Proto_InternedString_Iid, Iid);
+  PushProtoString(&String, Proto_InternedString_Name, Name);
+
+  PushProtoMessage(InternedData, Field, &String);
+}
+
+// NOTE(Jesse): Written in front of the first event on a sequence, which is
+// where its incremental clock starts from.
+link_internal void
+ClearPerfettoSequence(debug_trace_writer *Writer, u32 SequenceId, u64 TrackUuid, u64 Ns, b32 LockNames)
+{
+  debug_perfetto_sequence *Sequence = Writer->Sequences + SequenceId - 1;
+
+  u8 ClockBytes[2][32];
+  debug_proto_buffer Clocks[2] = { ProtoBuffer(ClockBytes[0]), ProtoBuffer(ClockBytes[1]) };
+  PushProtoUInt(Clocks+0, Proto_Clock_ClockId, DEBUG_PERFETTO_INCREMENTAL_CLOCK);
+  PushProtoUInt(Clocks+0, Proto_Clock_Timestamp, Ns);
+  PushProtoUInt(Clocks+0, Proto_Clock_IsIncremental, True);
+  PushProtoUInt(Clocks+1, Proto_Clock_ClockId, DEBUG_PERFETTO_BOOTTIME_CLOCK);
+  PushProtoUInt(Clocks+1, Proto_Clock_Timestamp, Ns);
+
+  u8 SnapshotBytes[96];
+  debug_proto_buffer Snapshot = ProtoBuffer(SnapshotBytes);
+  PushProtoMessage(&Snapshot, Proto_ClockSnapshot_Clocks, Clocks+0);
+  PushProtoMessage(&Snapshot, Proto_ClockSnapshot_Clocks, Clocks+1);
+
+  u8 EventDefaultsBytes[32];
+  debug_proto_buffer EventDefaults = ProtoBuffer(EventDefaultsBytes);
+  PushProtoUInt(&EventDefaults, Proto_TrackEventDefaults_TrackUuid, TrackUuid);
+
+  u8 DefaultsBytes[64];
+  debug_proto_buffer Defaults = ProtoBuffer(DefaultsBytes);
+  PushProtoUInt(&Defaults, Proto_TracePacket_TimestampClockId, DEBUG_PERFETTO_INCREMENTAL_CLOCK);
+  PushProtoMessage(&Defaults, Proto_TracePacketDefaults_TrackEventDefaults, &EventDefaults);
+
+  u8 InternedBytes[DEBUG_PERFETTO_SCRATCH_SIZE];
+  debug_proto_buffer Interned = ProtoBuffer(InternedBytes);
+  PushPerfettoInternedString(&Interned, Proto_InternedData_AnnotationNames, DEBUG_PERFETTO_ITEMS_ANNOTATION_IID, "items");
+  if (LockNames)
+  {
+    PushPerfettoInternedString(&Interned, Proto_InternedData_EventNames, DEBUG_PERFETTO_WAIT_NAME_IID, "wait");
+    PushPerfettoInternedString(&Interned, Proto_InternedData_EventNames, DEBUG_PERFETTO_HELD_NAME_IID, "held");
+  }
+
+  u8 PacketBytes[DEBUG_PERFETTO_SCRATCH_SIZE + 256];
+  debug_proto_buffer Packet = ProtoBuffer(PacketBytes);
+  PushProtoUInt(&Packet, Proto_TracePacket_Timestamp, Ns);
+  PushProtoUInt(&Packet, Proto_TracePacket_TimestampClockId, DEBUG_PERFETTO_BOOTTIME_CLOCK);
+  PushProtoUInt(&Packet, Proto_TracePacket_SequenceId, SequenceId);
+  PushProtoUInt(&Packet, Proto_TracePacket_SequenceFlags, PerfettoSequence_IncrementalStateCleared);
+  PushProtoMessage(&Packet, Proto_TracePacket_ClockSnapshot, &Snapshot);
+  PushProtoMessage(&Packet, Proto_TracePacket_Defaults, &Defaults);
+  PushProtoMessage(&Packet, Proto_TracePacket_InternedData, &Interned);
+
+  WritePerfettoPacketReserved(Writer, &Packet);
+
+  Sequence->Cleared = True;
+  Sequence->LastNs = Ns;
+}
+
+link_internal void
+InternPerfettoCallsite(debug_trace_writer *Writer, u32 SequenceId, u32 ThreadIndex, u16 CallsiteId)
+{
+  u64 ThreadBit = u64(1) << ThreadIndex;
+  if (Writer->CallsiteInterned[CallsiteId] & ThreadBit) return;
+  Writer->CallsiteInterned[CallsiteId] |= ThreadBit;
+
+  u8 InternedBytes[DEBUG_PERFETTO_SCRATCH_SIZE];
+  debug_proto_buffer Interned = ProtoBuffer(InternedBytes);
+  PushPerfettoInternedString(&Interned, Proto_InternedData_EventNames, CallsiteId+1u, GetCallsite(CallsiteId)->Name);
+
+  u8 PacketBytes[DEBUG_PERFETTO_SCRATCH_SIZE + 32];
+  debug_proto_buffer Packet = ProtoBuffer(PacketBytes);
+  PushProtoUInt(&Packet, Proto_TracePacket_SequenceId, SequenceId);
+  PushProtoUInt(&Packet, Proto_TracePacket_SequenceFlags, PerfettoSequence_NeedsIncrementalState);
+  PushProtoMessage(&Packet, Proto_TracePacket_InternedData, &Interned);
+
+  WritePerfettoPacketReserved(Writer, &Packet);
+}
+
+// NOTE(Jesse): On the default track of a per-thread sequence.  Timestamps
+// can't go backwards on the incremental clock; a timestamp mode change is
+// the only way they would, and those get pinned to the last one.
+link_internal void
+WritePerfettoSlice(debug_trace_writer *Writer, u32 SequenceId, u64 Ns, debug_perfetto_event_type Type, u64 NameIid, b32 HasPayload, u64 Payload)
+{
+  debug_perfetto_sequence *Sequence = Writer->Sequences + SequenceId - 1;
+  Ns = Max(Ns, Sequence->LastNs);
+
+  u8 EventBytes[48];
+  debug_proto_buffer Event = ProtoBuffer(EventBytes);
+  PushProtoUInt(&Event, Proto_TrackEvent_Type, Type);
+  if (NameIid) { PushProtoUInt(&Event, Proto_TrackEvent_NameIid, NameIid); }
+  if (HasPayload)
+  {
+    u8 AnnotationBytes[24];
+    debug_proto_buffer Annotation = ProtoBuffer(AnnotationBytes);
+    PushProtoUInt(&Annotation, Proto_DebugAnnotation_NameIid, DEBUG_PERFETTO_ITEMS_ANNOTATION_IID);
+    PushProtoUInt(&Annotation, Proto_DebugAnnotation_UIntValue, Payload);
+    PushProtoMessage(&Event, Proto_TrackEvent_DebugAnnotations, &Annotation);
+  }
+
+  u8 PacketBytes[DEBUG_PERFETTO_MAX_EVENT_BYTES];
+  debug_proto_buffer Packet = ProtoBuffer(PacketBytes);
+  PushProtoUInt(&Packet, Proto_TracePacket_Timestamp, Ns - Sequence->LastNs);
+  PushProtoUInt(&Packet, Proto_TracePacket_SequenceId, SequenceId);
+  PushProtoUInt(&Packet, Proto_TracePacket_SequenceFlags, PerfettoSequence_NeedsIncrementalState);
+  PushProtoMessage(&Packet, Proto_TracePacket_TrackEvent, &Event);
+
+  WritePerfettoPacket(Writer, &Packet);
+  Sequence->LastNs = Ns;
+}
+
+link_internal void
+WritePerfettoTrackDescriptor(debug_trace_writer *Writer, debug_proto_buffer *Descriptor)
+{
+  u8 PacketBytes[DEBUG_PERFETTO_SCRATCH_SIZE + 32];
+  debug_proto_buffer Packet = ProtoBuffer(PacketBytes);
+  PushProtoUInt(&Packet, Proto_TracePacket_SequenceId, DEBUG_PERFETTO_PROCESS_SEQUENCE);
+  PushProtoMessage(&Packet, Proto_TracePacket_TrackDescriptor, Descriptor);
+
+  WritePerfettoPacketReserved(Writer, &Packet);
+}
+
+// NOTE(Jesse): Threads can only show up, never go away, so we describe the
+// new ones as we see them.
+link_internal void
+WritePerfettoDescriptors(debug_trace_writer *Writer, u32 TotalThreadCount)
+{
+  if (Writer->ThreadsDescribed == 0)
+  {
+    u8 ProcessBytes[DEBUG_PERFETTO_SCRATCH_SIZE];
+    debug_proto_buffer Process = ProtoBuffer(ProcessBytes);
+    PushProtoUInt(&Process, Proto_ProcessDescriptor_Pid, DEBUG_PERFETTO_PID);
+    PushProtoString(&Process, Proto_ProcessDescriptor_Name, "debug_lib");
+
+    u8 DescriptorBytes[DEBUG_PERFETTO_SCRATCH_SIZE];
+    debug_proto_buffer Descriptor = ProtoBuffer(DescriptorBytes);
+    PushProtoUInt(&Descriptor, Proto_TrackDescriptor_Uuid, DEBUG_PERFETTO_PROCESS_TRACK);
+    PushProtoMessage(&Descriptor, Proto_TrackDescriptor_Process, &Process);
+    WritePerfettoTrackDescriptor(Writer, &Descriptor);
+  }
+
+  if (!Writer->FrameCounterDescribed)
+  {
+    Writer->FrameCounterDescribed = True;
+
+    u8 CounterBytes[DEBUG_PERFETTO_SCRATCH_SIZE];
+    debug_proto_buffer Counter = ProtoBuffer(CounterBytes);
+    PushProtoString(&Counter, Proto_CounterDescriptor_UnitName, "ms");
+
+    u8 DescriptorBytes[DEBUG_PERFETTO_SCRATCH_SIZE];
+    debug_proto_buffer Descriptor = ProtoBuffer(DescriptorBytes);
+    PushProtoUInt(&Descriptor, Proto_TrackDescriptor_Uuid, DEBUG_PERFETTO_FRAME_MS_TRACK);
+    PushProtoUInt(&Descriptor, Proto_TrackDescriptor_ParentUuid, DEBUG_PERFETTO_PROCESS_TRACK);
+    PushProtoString(&Descriptor, Proto_TrackDescriptor_Name, "Frame");
+    PushProtoMessage(&Descriptor, Proto_TrackDescriptor_Counter, &Counter);
+    WritePerfettoTrackDescriptor(Writer, &Descriptor);
+  }
+
+  for ( u32 ThreadIndex = Writer->ThreadsDescribed;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadIndex);
+
+    char Name[32];
+    snprintf(Name, sizeof(Name), "Thread %u", ThreadIndex);
+
+    u8 ThreadBytes[DEBUG_PERFETTO_SCRATCH_SIZE];
+    debug_proto_buffer Thread = ProtoBuffer(ThreadBytes);
+    PushProtoUInt(&Thread, Proto_ThreadDescriptor_Pid, DEBUG_PERFETTO_PID);
+    PushProtoUInt(&Thread, Proto_ThreadDescriptor_Tid, ThreadState->ThreadId ? ThreadState->ThreadId : DEBUG_PERFETTO_THREAD_TRACK + ThreadIndex);
+    PushProtoString(&Thread, Proto_ThreadDescriptor_Name, Name);
+
+    u8 DescriptorBytes[DEBUG_PERFETTO_SCRATCH_SIZE];
+    debug_proto_buffer Descriptor = ProtoBuffer(DescriptorBytes);
+    PushProtoUInt(&Descriptor, Proto_TrackDescriptor_Uuid, DEBUG_PERFETTO_THREAD_TRACK + ThreadIndex);
+    PushProtoMessage(&Descriptor, Proto_TrackDescriptor_Thread, &Thread);
+    WritePerfettoTrackDescriptor(Writer, &Descriptor);
+
+    Descriptor.At = 0;
+    PushProtoUInt(&Descriptor, Proto_TrackDescriptor_Uuid, DEBUG_PERFETTO_LOCK_TRACK + ThreadIndex);
+    PushProtoUInt(&Descriptor, Proto_TrackDescriptor_ParentUuid, DEBUG_PERFETTO_THREAD_TRACK + ThreadIndex);
+    PushProtoString(&Descriptor, Proto_TrackDescriptor_Name, "Locks");
+    WritePerfettoTrackDescriptor(Writer, &Descriptor);
+  }
+
+  Writer->ThreadsDescribed = Max(Writer->ThreadsDescribed, TotalThreadCount);
+}
+
+// NOTE(Jesse): On the process sequence, so absolute timestamps
+link_internal void
+WritePerfettoProcessEvent(debug_trace_writer *Writer, u64 Ns, u64 TrackUuid, debug_perfetto_event_type Type, const char *Name, b32 HasValue, r64 Value)
+{
+  u8 EventBytes[DEBUG_PERFETTO_SCRATCH_SIZE];
+  debug_proto_buffer Event = ProtoBuffer(EventBytes);
+  PushProtoUInt(&Event, Proto_TrackEvent_Type, Type);
+  PushProtoUInt(&Event, Proto_TrackEvent_TrackUuid, TrackUuid);
+  if (Name) { PushProtoString(&Event, Proto_TrackEvent_Name, Name); }
+  if (HasValue) { PushProtoDouble(&Event, Proto_TrackEvent_DoubleCounterValue, Value); }
+
+  u8 PacketBytes[DEBUG_PERFETTO_SCRATCH_SIZE + 32];
+  debug_proto_buffer Packet = ProtoBuffer(PacketBytes);
+  PushProtoUInt(&Packet, Proto_TracePacket_Timestamp, Ns);
+  PushProtoUInt(&Packet, Proto_TracePacket_SequenceId, DEBUG_PERFETTO_PROCESS_SEQUENCE);
+  PushProtoMessage(&Packet, Proto_TracePacket_TrackEvent, &Event);
+
+  WritePerfettoPacketReserved(Writer, &Packet);
+}
+
+// NOTE(Jesse): Same deal as WriteTraceScopeEvents; straight out of the ring,
+// and taken back out if the ring lapped us while we were at it.  Ends are
+// held onto for an event in case a payload comes after them, across chunks
+// too, since the payload can be the first event of the next one.
+link_internal void
+WritePerfettoScopeEvents(debug_trace_writer *Writer, debug_thread_state *ThreadState, u32 ThreadIndex, u64 FirstEvent, u64 OnePastLastEvent)
+{
+  debug_scope_event_ring *Ring = ThreadState->ScopeEvents;
+
+  u32 SequenceId = 2 + 2*ThreadIndex;
+  debug_perfetto_sequence *Sequence = Writer->Sequences + SequenceId - 1;
+
+  b32 EndPending = False;
+  u64 EndNs = 0;
+
+  for ( u64 ChunkStart = FirstEvent;
+            ChunkStart < OnePastLastEvent;
+            ChunkStart += DEBUG_TRACE_CHUNK_EVENTS )
+  {
+    u64 ChunkEnd = Min(OnePastLastEvent, ChunkStart + DEBUG_TRACE_CHUNK_EVENTS);
+    u64 EventCount = ChunkEnd - ChunkStart;
+
+    if (ScopeEventsOverwritten(Ring, ChunkStart))
+    {
+      if (EndPending)
+      {
+        ReserveTraceBuffer(Writer, DEBUG_PERFETTO_MAX_EVENT_BYTES);
+        WritePerfettoSlice(Writer, SequenceId, EndNs, PerfettoEvent_SliceEnd, 0, False, 0);
+        EndPending = False;
+      }
+
+      Writer->EventsLost += EventCount;
+      continue;
+    }
+
+    if (!Sequence->Cleared)
+    {
+      u64 Ns = GetPerfettoNs(Writer, Ring->Events[ChunkStart & Ring->Mask].Cycle);
+      ClearPerfettoSequence(Writer, SequenceId, DEBUG_PERFETTO_THREAD_TRACK + ThreadIndex, Ns, False);
+    }
+
+    for ( u64 EventIndex = ChunkStart;
+              EventIndex < ChunkEnd;
+            ++EventIndex )
+    {
+      debug_scope_event *Event = Ring->Events + (EventIndex & Ring->Mask);
+      if (Event->Type == ScopeEvent_Begin) { InternPerfettoCallsite(Writer, SequenceId, ThreadIndex, Event->CallsiteId); }
+    }
+
+    ReserveTraceBuffer(Writer, (EventCount+1)*DEBUG_PERFETTO_MAX_EVENT_BYTES);
+    umm RecordStart = Writer->BufferAt;
+    u64 RecordLastNs = Sequence->LastNs;
+    b32 RecordEndPending = EndPending;
+    u64 RecordEndNs = EndNs;
+
+    for ( u64 EventIndex = ChunkStart;
+              EventIndex < ChunkEnd;
+            ++EventIndex )
+    {
+      debug_scope_event *Event = Ring->Events + (EventIndex & Ring->Mask);
+      switch (Event->Type)
+      {
+        case ScopeEvent_Begin:
+        case ScopeEvent_End:
+        {
+          if (EndPending)
+          {
+            WritePerfettoSlice(Writer, SequenceId, EndNs, PerfettoEvent_SliceEnd, 0, False, 0);
+            EndPending = False;
+          }
+
+          u64 Ns = GetPerfettoNs(Writer, Event->Cycle);
+          if (Event->Type == ScopeEvent_Begin)
+          {
+            WritePerfettoSlice(Writer, SequenceId, Ns, PerfettoEvent_SliceBegin, Event->CallsiteId+1u, False, 0);
+          }
+          else
+          {
+            EndPending = True;
+            EndNs = Ns;
+          }
+        } break;
+
+        case ScopeEvent_Payload:
+        {
+          if (EndPending)
+          {
+            WritePerfettoSlice(Writer, SequenceId, EndNs, PerfettoEvent_SliceEnd, 0, True, Event->Cycle);
+            EndPending = False;
+          }
+        } break;
+
+        InvalidDefaultCase;
+      }
+    }
+
+    // NOTE(Jesse): An end held over from the chunk before was fine; it's only
+    // this chunk's events we can't vouch for.
+    if (ScopeEventsOverwritten(Ring, ChunkStart))
+    {
+      Writer->BufferAt = RecordStart;
+      Sequence->LastNs = RecordLastNs;
+      EndPending = RecordEndPending;
+      EndNs = RecordEndNs;
+      Writer->EventsLost += EventCount;
+    }
+  }
+
+  if (EndPending)
+  {
+    ReserveTraceBuffer(Writer, DEBUG_PERFETTO_MAX_EVENT_BYTES);
+    WritePerfettoSlice(Writer, SequenceId, EndNs, PerfettoEvent_SliceEnd, 0, False, 0);
+  }
+}
+
+// NOTE(Jesse): Waits and holds nest like scopes as long as locks are let go
+// of in the opposite order they were taken, which is the usual case.  A wait
+// is ended by whatever the thread does next, since it can't do anything while
+// it's blocked; that's usually taking the lock it was waiting on, but the
+// records don't always line up, and a wait can go on into the next frame.
+link_internal void
+WritePerfettoMutexOps(debug_trace_writer *Writer, debug_thread_state *ThreadState, debug_scope_tree *Tree, u32 ThreadIndex, u32 FrameId)
+{
+  mutex_op_array *MutexOps = ThreadState->MutexOps + GetFrameSlot(FrameId);
+  u32 Count = Min(MutexOps->NextRecord, (u32)MUTEX_OPS_PER_FRAME);
+  if (Count == 0) return;
+
+  u32 SequenceId = 3 + 2*ThreadIndex;
+  debug_perfetto_sequence *Sequence = Writer->Sequences + SequenceId - 1;
+
+  if (!Sequence->Cleared)
+  {
+    ClearPerfettoSequence(Writer, SequenceId, DEBUG_PERFETTO_LOCK_TRACK + ThreadIndex, GetPerfettoNs(Writer, MutexOps->Records[0].Cycle), True);
+  }
+
+  ReserveTraceBuffer(Writer, 2*Count*DEBUG_PERFETTO_MAX_EVENT_BYTES);
+  umm RecordStart = Writer->BufferAt;
+  u64 RecordLastNs = Sequence->LastNs;
+  b32 RecordWaitOpen = Sequence->WaitOpen;
+
+  for ( u32 RecordIndex = 0;
+            RecordIndex < Count;
+          ++RecordIndex )
+  {
+    mutex_op_record *Record = MutexOps->Records + RecordIndex;
+    u64 Ns = GetPerfettoNs(Writer, Record->Cycle);
+
+    b32 KnownOp = Record->Op == MutexOp_Waiting || Record->Op == MutexOp_Aquired || Record->Op == MutexOp_Released;
+    if (KnownOp && Sequence->WaitOpen)
+    {
+      WritePerfettoSlice(Writer, SequenceId, Ns, PerfettoEvent_SliceEnd, 0, False, 0);
+      Sequence->WaitOpen = False;
+    }
+
+    switch (Record->Op)
+    {
+      case MutexOp_Waiting:
+      {
+        WritePerfettoSlice(Writer, SequenceId, Ns, PerfettoEvent_SliceBegin, DEBUG_PERFETTO_WAIT_NAME_IID, False, 0);
+        Sequence->WaitOpen = True;
+      } break;
+
+      case MutexOp_Aquired:
+      {
+        WritePerfettoSlice(Writer, SequenceId, Ns, PerfettoEvent_SliceBegin, DEBUG_PERFETTO_HELD_NAME_IID, False, 0);
+      } break;
+
+      case MutexOp_Released:
+      {
+        WritePerfettoSlice(Writer, SequenceId, Ns, PerfettoEvent_SliceEnd, 0, False, 0);
+      } break;
+
+      default: {} break;
+    }
+  }
+
+  // NOTE(Jesse): The thread reset the slot for a new frame under us
+  if (Tree->FrameRecorded != FrameId)
+  {
+    Writer->BufferAt = RecordStart;
+    Sequence->LastNs = RecordLastNs;
+    Sequence->WaitOpen = RecordWaitOpen;
+    AtomicIncrement(&Writer->MutexFramesLost);
+  }
+}
+
+// NOTE(Jesse): A track per CPU; a thread being switched on starts a slice
+// on it and being switched off ends it, which is always on the same CPU.
+link_internal void
+WritePerfettoContextSwitches(debug_trace_writer *Writer)
+{
+  u32 WriteAt = Writer->ContextSwitchWriteAt;
+  u32 ReadAt = Writer->ContextSwitchReadAt;
+
+  for (; ReadAt != WriteAt; ++ReadAt)
+  {
+    debug_trace_context_switch *CSwitch = Writer->ContextSwitches + (ReadAt % DEBUG_TRACE_CSWITCH_QUEUE);
+    if (CSwitch->ProcessorNumber >= DEBUG_PERFETTO_MAX_CPUS) continue;
+
+    u64 TrackUuid = DEBUG_PERFETTO_CPU_TRACK + CSwitch->ProcessorNumber;
+    if (!Writer->CpuDescribed[CSwitch->ProcessorNumber])
+    {
+      Writer->CpuDescribed[CSwitch->ProcessorNumber] = True;
+
+      char Name[32];
+      snprintf(Name, sizeof(Name), "CPU %u", CSwitch->ProcessorNumber);
+
+      u8 DescriptorBytes[DEBUG_PERFETTO_SCRATCH_SIZE];
+      debug_proto_buffer Descriptor = ProtoBuffer(DescriptorBytes);
+      PushProtoUInt(&Descriptor, Proto_TrackDescriptor_Uuid, TrackUuid);
+      PushProtoString(&Descriptor, Proto_TrackDescriptor_Name, Name);
+      WritePerfettoTrackDescriptor(Writer, &Descriptor);
+    }
+
+    u64 Ns = GetPerfettoNs(Writer, CSwitch->CycleCount);
+    if (CSwitch->Type == ContextSwitch_On)
+    {
+      char Name[32];
+      snprintf(Name, sizeof(Name), "Thread %u", CSwitch->ThreadIndex);
+      WritePerfettoProcessEvent(Writer, Ns, TrackUuid, PerfettoEvent_SliceBegin, Name, False, 0.0);
+    }
+    else if (CSwitch->Type == ContextSwitch_Off)
+    {
+      WritePerfettoProcessEvent(Writer, Ns, TrackUuid, PerfettoEvent_SliceEnd, 0, False, 0.0);
+    }
+  }
+
+  Writer->ContextSwitchReadAt = ReadAt;
+}
+
+link_internal void
+WritePerfettoFrameData(debug_trace_writer *Writer, debug_trace_frame *Frame)
+{
+  UpdatePerfettoClock(Writer, Frame);
+
+  u32 TotalThreadCount = Min(GetTotalThreadCount(), (u32)DEBUG_PERFETTO_MAX_THREADS);
+  WritePerfettoDescriptors(Writer, TotalThreadCount);
+
+  WritePerfettoProcessEvent(Writer, GetPerfettoNs(Writer, Frame->StartingCycle), DEBUG_PERFETTO_FRAME_MS_TRACK, PerfettoEvent_Counter, 0, True, r64(Frame->FrameMs));
+
+  for ( u32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadIndex);
+    debug_scope_tree *Tree = ThreadState->ScopeTrees + GetFrameSlot(Frame->FrameId);
+
+    if (Tree->FrameRecorded == Frame->FrameId && (Tree->Closed || Writer->IncludeOpenTrees))
+    {
+      u64 OnePastLastEvent = Tree->Closed ? Tree->OnePastLastEvent : ThreadState->ScopeEvents->At;
+      WritePerfettoScopeEvents(Writer, ThreadState, ThreadIndex, Tree->FirstEvent, OnePastLastEvent);
+      WritePerfettoMutexOps(Writer, ThreadState, Tree, ThreadIndex, Frame->FrameId);
+    }
+    else
+    {
+      AtomicIncrement(&Writer->ThreadFramesUnsealed);
+    }
+  }
+
+  WritePerfettoContextSwitches(Writer);
+
+  AtomicIncrement(&Writer->FramesWritten);
+}
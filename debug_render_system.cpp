@@ -237,19 +237,41 @@ BuildNameStringFor(char Prefix, counted_string Name, u32 DepthAdvance)
   return Result;
 }
 
+global_variable counted_string Global_TimestampModeNames[TimestampMode_Count] =
+{
+  CSz("rdtsc"),
+  CSz("serialized"),
+  CSz("clock"),
+};
+
 link_internal void
 BufferScopeTreeEntry(debug_ui_render_group *Group, debug_profile_scope *Scope,
-                     u64 TotalCycles, u64 TotalFrameCycles, u64 CallCount, u32 Depth)
+                     u64 TotalCycles, u64 TotalFrameCycles, r64 NsPerCycle, u64 CallCount, u64 TotalPayload, u32 Depth)
 {
   Assert(TotalFrameCycles);
 
   r32 Percentage = 100.0f * (r32)SafeDivide0((r64)TotalCycles, (r64)TotalFrameCycles);
   u64 AvgCycles = (u64)SafeDivide0(TotalCycles, CallCount);
+  u64 AvgNs = (u64)((r64)AvgCycles * NsPerCycle);
+  r32 TotalUs = (r32)((r64)TotalCycles * NsPerCycle / 1000.0);
 
   PushColumn(Group, CS(Percentage));
   PushColumn(Group, CS(AvgCycles));
+  PushColumn(Group, CS(AvgNs));
+  PushColumn(Group, CS(TotalUs));
   PushColumn(Group, CS(CallCount));
 
+  if (TotalPayload)
+  {
+    PushColumn(Group, CS(u64(GetItemsPerSecond(TotalCycles, TotalPayload, NsPerCycle))));
+    PushColumn(Group, CS(r32(GetCyclesPerItem(TotalCycles, TotalPayload))));
+  }
+  else
+  {
+    PushColumn(Group, CSz(""));
+    PushColumn(Group, CSz(""));
+  }
+
   char Prefix = ' ';
   if (Scope->Expanded && Scope->Child)
   {
@@ -261,12 +283,53 @@ BufferScopeTreeEntry(debug_ui_render_group *Group, debug_profile_scope *Scope,
   }
 
   u32 DepthSpaces = (Depth*2)+1;
-  counted_string NameString = BuildNameStringFor(Prefix, CS(Scope->Name), DepthSpaces);
+  counted_string NameString = BuildNameStringFor(Prefix, CS(GetCallsite(Scope)->Name), DepthSpaces);
   PushColumn(Group, NameString, &DefaultStyle, DefaultColumnPadding, ColumnRenderParam_LeftAlign);
 
   return;
 }
 
+#define SAMPLE_RATE_OVERRIDE_COUNT (7)
+global_variable u32 Global_SampleRateOverrides[SAMPLE_RATE_OVERRIDE_COUNT] = { 0, 1, 4, 16, 64, 256, 1024 };
+
+// NOTE(Jesse): Clicking this cycles the callsite through automatic sampling,
+// never sampling and a handful of fixed rates.
+link_internal void
+BufferScopeSamplingEntry(debug_ui_render_group *Group, debug_scope_tree *Tree, debug_profile_scope *Scope)
+{
+  debug_callsite_sampling *Sampling = GetDebugState()->ScopeCallsiteSampling + Scope->CallsiteId;
+
+  counted_string Mode = Sampling->Override ? FormatCountedString(TranArena, CSz("1/%u"), Sampling->Override) : CSz("auto");
+  if (Sampling->HasChildren) { Mode = CSz("never (has children)"); }
+
+  counted_string Text = Mode;
+  if (Scope->SampleMask)
+  {
+    u32 CallCount = GetSampledCallCount(Tree, Scope->CallsiteId);
+    Text = FormatCountedString(TranArena, CSz("%S (1/%u of %u)"), Mode, Scope->SampleMask + 1u, CallCount);
+  }
+
+  interactable_handle SamplingInteraction = PushButtonStart(Group, (umm)"ScopeSamplingInteraction"^(umm)Scope);
+    PushColumn(Group, Text, &DefaultStyle, DefaultColumnPadding, ColumnRenderParam_LeftAlign);
+  PushButtonEnd(Group);
+
+  if (Clicked(Group, &SamplingInteraction))
+  {
+    u32 OverrideIndex = 0;
+    for ( u32 Index = 0;
+              Index < SAMPLE_RATE_OVERRIDE_COUNT;
+            ++Index )
+    {
+      if (Global_SampleRateOverrides[Index] == Sampling->Override) { OverrideIndex = Index; }
+    }
+
+    OverrideIndex = (OverrideIndex + 1) % SAMPLE_RATE_OVERRIDE_COUNT;
+    Sampling->Override = Global_SampleRateOverrides[OverrideIndex];
+  }
+
+  return;
+}
+
 /* #if 1 */
 /* bonsai_function scope_stats */
 /* GetStatsFor( debug_profile_scope *Target, debug_profile_scope *Root) */
@@ -372,12 +435,19 @@ PushScopeBarsRecursive( debug_ui_render_group *Group,
                         random_series *Entropy,
                         u32 Depth = 0 )
 {
+  u64 FrameEndCycle = Frame->StartCycle + Frame->TotalCycles;
+
   while (Scope)
   {
-    cycle_range Range = {Scope->StartingCycle, GetCycleCount(Scope)};
+    // NOTE(Jesse): Scopes that straddle the frame run off whichever edge they
+    // cross, so the same scope lines up with itself in the next frame.
+    u64 StartCycle = Max(Scope->StartingCycle, Frame->StartCycle);
+    u64 EndCycle = Scope->EndingCycle;
+    if (Scope->Flags & ScopeFlag_ContinuesIntoNextFrame) { EndCycle = Max(FrameEndCycle, StartCycle); }
+    cycle_range Range = {StartCycle, EndCycle > StartCycle ? EndCycle - StartCycle : 0};
 
-    /* umm NameHash = Hash(CS(Scope->Name)) ^ Hash(CS(Scope->Location)); */
-    umm NameHash = Hash(CS(Scope->Name));
+    debug_scope_callsite *Callsite = GetCallsite(Scope);
+    umm NameHash = Hash(CS(Callsite->Name)) ^ Hash(CS(Callsite->File)) ^ Callsite->Line;
 
     random_series ScopeSeries = {.Seed = (u64)Scope};
     r32 Tint = RandomBetween(0.5f, &ScopeSeries, 1.0f);
@@ -387,11 +457,21 @@ PushScopeBarsRecursive( debug_ui_render_group *Group,
     r32 yOffsetFunction = Depth * BarHeight;
 
     {
-      cs ScopeName = CS(Scope->Name);
+      cs ScopeName = CS(Callsite->Name);
       interactable_handle Bar = PushButtonStart(Group, (umm)"CycleBarHoverInteraction"^(umm)Scope);
         PushCycleBar(Group, &Range, Frame, TotalGraphWidth, BarHeight, yOffsetFunction, &FunctionStyle, V4(0), ScopeName);
       PushButtonEnd(Group);
-      if (Hover(Group, &Bar)) { PushTooltip(Group, ScopeName); }
+      if (Hover(Group, &Bar))
+      {
+        cs Continued = CSz("");
+        switch (Scope->Flags & (ScopeFlag_ContinuedFromPreviousFrame|ScopeFlag_ContinuesIntoNextFrame))
+        {
+          case ScopeFlag_ContinuedFromPreviousFrame: { Continued = CSz(" <- continued"); } break;
+          case ScopeFlag_ContinuesIntoNextFrame:     { Continued = CSz(" continues ->"); } break;
+          case ScopeFlag_ContinuedFromPreviousFrame|ScopeFlag_ContinuesIntoNextFrame: { Continued = CSz(" <- continued, continues ->"); } break;
+        }
+        PushTooltip(Group, FormatCountedString(TranArena, CSz("%S (%S)%S"), ScopeName, GetCallsiteLocation(Callsite), Continued));
+      }
       if (Clicked(Group, &Bar)) { Scope->Expanded = !Scope->Expanded; }
     }
 
@@ -401,6 +481,213 @@ PushScopeBarsRecursive( debug_ui_render_group *Group,
 
   return;
 }
+global_variable counted_string Global_ScopeCategoryNames[Category_Count] =
+{
+  CSz("default"),
+  CSz("render"),
+  CSz("sim"),
+  CSz("io"),
+  CSz("audio"),
+  CSz("network"),
+  CSz("debug"),
+};
+
+global_variable v3 Global_ScopeCategoryColors[Category_Count] =
+{
+  V3(0.5f, 0.5f, 0.5f),
+  V3(0.2f, 0.8f, 0.2f),
+  V3(0.2f, 0.4f, 1.0f),
+  V3(1.0f, 0.6f, 0.1f),
+  V3(0.8f, 0.2f, 0.8f),
+  V3(0.1f, 0.8f, 0.8f),
+  V3(0.8f, 0.2f, 0.2f),
+};
+
+// NOTE(Jesse): One stacked bar per thread, each as wide as the Threads
+// window graph would make the whole frame.
+link_internal void
+PushCategoryBreakdown(debug_ui_render_group *Group, debug_scope_tree *MainThreadReadTree, frame_stats *FrameStats, r32 TotalGraphWidth)
+{
+  for ( u32 Category = 0;
+            Category < Category_Count;
+          ++Category )
+  {
+    ui_style Style = UiStyleFromLightestColor(Global_ScopeCategoryColors[Category]);
+    PushColumn(Group, Global_ScopeCategoryNames[Category], &Style);
+  }
+  PushNewRow(Group);
+
+  u64 CategoryCycles[Category_Count];
+
+  u32 TotalThreadCount = GetTotalThreadCount();
+  for ( u32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    debug_scope_tree *ReadTree = GetReadScopeTree(ThreadIndex);
+    if (MainThreadReadTree->FrameRecorded != ReadTree->FrameRecorded) continue;
+
+    GetCategoryCycles(ReadTree, CategoryCycles);
+
+    PushColumn(Group, FormatCountedString(TranArena, CSz("T %u "), ThreadIndex));
+    for ( u32 Category = 0;
+              Category < Category_Count;
+            ++Category )
+    {
+      r32 BarWidth = TotalGraphWidth * SafeDivide0(r32(CategoryCycles[Category]), r32(FrameStats->TotalCycles));
+      if (BarWidth > 0.15f)
+      {
+        ui_style Style = UiStyleFromLightestColor(Global_ScopeCategoryColors[Category]);
+        PushUntexturedQuad(Group, V2(0), V2(BarWidth, (r32)Global_Font.Size.y), zDepth_Text, &Style);
+      }
+    }
+    PushNewRow(Group);
+  }
+
+  return;
+}
+
+// NOTE(Jesse): Summed over every thread.  Clicking a category turns its scopes
+// off, or back on, at runtime; categories compiled out of this lib can't be
+// turned on from here but the rest of the program might still have them.
+link_internal void
+PushCategoryTable(debug_ui_render_group *Group, debug_state *DebugState, debug_scope_tree *MainThreadReadTree, frame_stats *FrameStats)
+{
+  u64 TotalCategoryCycles[Category_Count] = {};
+  u64 CategoryCycles[Category_Count];
+
+  u32 TotalThreadCount = GetTotalThreadCount();
+  for ( u32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    debug_scope_tree *ReadTree = GetReadScopeTree(ThreadIndex);
+    if (MainThreadReadTree->FrameRecorded != ReadTree->FrameRecorded) continue;
+
+    GetCategoryCycles(ReadTree, CategoryCycles);
+    for ( u32 Category = 0;
+              Category < Category_Count;
+            ++Category )
+    {
+      TotalCategoryCycles[Category] += CategoryCycles[Category];
+    }
+  }
+
+  PushColumn(Group, CSz("Category"));
+  PushColumn(Group, CSz("Frame %"));
+  PushColumn(Group, CSz("ms"));
+  PushColumn(Group, CSz("Recording"));
+  PushNewRow(Group);
+
+  for ( u32 Category = 0;
+            Category < Category_Count;
+          ++Category )
+  {
+    b32 Recording = (DebugState->ScopeCategoryMask >> Category) & 1;
+    r32 FramePerc = 100.f * SafeDivide0(r32(TotalCategoryCycles[Category]), r32(FrameStats->TotalCycles));
+    r64 Ms = r64(TotalCategoryCycles[Category]) * FrameStats->NsPerCycle / 1000000.0;
+
+    ui_style Style = UiStyleFromLightestColor(Global_ScopeCategoryColors[Category]);
+    interactable_handle ToggleInteraction = PushButtonStart(Group, (umm)"ScopeCategoryToggle"+(umm)Category);
+      PushColumn(Group, Global_ScopeCategoryNames[Category], &Style);
+      PushColumn(Group, FormatCountedString(TranArena, CSz("%.2f"), r64(FramePerc)));
+      PushColumn(Group, FormatCountedString(TranArena, CSz("%.3f"), Ms));
+      PushColumn(Group, Recording ? CSz("on") : CSz("off"));
+      PushNewRow(Group);
+    PushButtonEnd(Group);
+
+    if (Clicked(Group, &ToggleInteraction)) { ToggleScopeCategory(DebugState, Category); }
+  }
+
+  return;
+}
+
+link_internal r32
+GetFlowLinkX(u64 Cycle, cycle_range *Frame, r32 TotalGraphWidth)
+{
+  r32 Result = 0.f;
+  if (Cycle > Frame->StartCycle)
+  {
+    Result = Min(TotalGraphWidth, GetXOffsetForHorizontalBar(Cycle - Frame->StartCycle, Frame->TotalCycles, TotalGraphWidth));
+  }
+  return Result;
+}
+
+// NOTE(Jesse): Drawn from the row of the thread that queued the job; across
+// to when it got picked up, then up or down to the row of the thread that
+// picked it up.  Offsets are relative to the top of the submitting threads row.
+link_internal void
+PushFlowLinks(debug_ui_render_group *Group, debug_state *SharedState, u32 ThreadIndex, cycle_range *Frame, r32 TotalGraphWidth, r32 RowHeight, r32 BarY)
+{
+  r32 LineWidth = 1.f;
+  r32 MarkerDim = 4.f;
+
+  ui_style Style = UiStyleFromLightestColor(V3(0.2f, 0.8f, 1.0f));
+
+  u64 FrameEndCycle = Frame->StartCycle + Frame->TotalCycles;
+
+  u32 LinkCount = Min(SharedState->RecentFlowLinkAt, (u32)DEBUG_RECENT_FLOW_LINKS);
+  for ( u32 LinkIndex = 0;
+            LinkIndex < LinkCount;
+          ++LinkIndex )
+  {
+    debug_flow_link *Link = SharedState->RecentFlowLinks + LinkIndex;
+    if (Link->BeginThreadIndex != ThreadIndex) continue;
+    if (Link->EndCycle < Frame->StartCycle || Link->BeginCycle > FrameEndCycle) continue;
+
+    r32 BeginX = GetFlowLinkX(Link->BeginCycle, Frame, TotalGraphWidth);
+    r32 EndX   = GetFlowLinkX(Link->EndCycle,   Frame, TotalGraphWidth);
+    r32 EndY   = BarY + RowHeight*((r32)Link->EndThreadIndex - (r32)Link->BeginThreadIndex);
+
+    PushUntexturedQuad(Group, V2(BeginX, BarY), V2(MarkerDim), zDepth_Border, &Style, V4(0), QuadRenderParam_NoAdvance);
+    PushUntexturedQuad(Group, V2(BeginX, BarY), V2(Max(LineWidth, EndX-BeginX), LineWidth), zDepth_Border, &Style, V4(0), QuadRenderParam_NoAdvance);
+    PushUntexturedQuad(Group, V2(EndX, Min(BarY, EndY)), V2(LineWidth, Max(BarY, EndY)-Min(BarY, EndY)+LineWidth), zDepth_Border, &Style, V4(0), QuadRenderParam_NoAdvance);
+    PushUntexturedQuad(Group, V2(EndX, EndY), V2(MarkerDim), zDepth_Border, &Style, V4(0), QuadRenderParam_NoAdvance);
+  }
+
+  return;
+}
+
+link_internal void
+PushFlowLatencyHistogram(debug_ui_render_group *Group, debug_state *SharedState, frame_stats *FrameStats)
+{
+  debug_flow_latency_histogram *Histogram = &FrameStats->FlowLatency;
+
+  PushColumn(Group, FormatCountedString(TranArena, CSz("Queued -> started : %u jobs, max %.1fus, pending %u, dropped %u, evicted %u, rejected %u"),
+        Histogram->Total, r64(Histogram->MaxNs)/1000.0, SharedState->PendingFlowCount,
+        SharedState->FlowsDropped, SharedState->FlowsEvicted, SharedState->FlowsRejected));
+  PushNewRow(Group);
+
+  u32 MaxCount = 0;
+  for ( u32 BucketIndex = 0;
+            BucketIndex < DEBUG_FLOW_LATENCY_BUCKETS;
+          ++BucketIndex )
+  {
+    MaxCount = Max(MaxCount, Histogram->Counts[BucketIndex]);
+  }
+
+  r32 MaxBarWidth = 200.f;
+  ui_style Style = UiStyleFromLightestColor(V3(0.2f, 0.8f, 1.0f));
+
+  for ( u32 BucketIndex = 0;
+            BucketIndex < DEBUG_FLOW_LATENCY_BUCKETS;
+          ++BucketIndex )
+  {
+    u32 Count = Histogram->Counts[BucketIndex];
+    if (Count == 0) continue;
+
+    r64 MinUs = r64(1ull << BucketIndex)/1000.0;
+    PushColumn(Group, FormatCountedString(TranArena, CSz(">= %.3fus"), MinUs));
+    PushColumn(Group, CS(Count));
+
+    r32 BarWidth = MaxBarWidth * SafeDivide0(r32(Count), r32(MaxCount));
+    PushUntexturedQuad(Group, V2(0), V2(BarWidth, (r32)Global_Font.Size.y), zDepth_Text, &Style);
+    PushNewRow(Group);
+  }
+
+  return;
+}
+
 
 link_internal window_layout *
 DrawThreadsWindow(debug_ui_render_group *Group, debug_state *SharedState, v2 BasisP)
@@ -446,6 +733,7 @@ DrawThreadsWindow(debug_ui_render_group *Group, debug_state *SharedState, v2 Bas
   cycle_range FrameCycles              = {FrameStats->StartingCycle, FrameStats->TotalCycles};
 
   r32 BarHeight = (r32)Global_Font.Size.y;
+  r32 RowHeight = Global_CoreBarHeight + (Global_CoreBarPadding*2.f) + BarHeight;
 
 #if 1
   /* r32 TotalMs = Max(33.333333f, (r32)FrameStats->FrameMs); */
@@ -471,8 +759,7 @@ DrawThreadsWindow(debug_ui_render_group *Group, debug_state *SharedState, v2 Bas
 #endif
 
 
-  debug_thread_state *MainThreadState  = GetThreadLocalStateFor(0);
-  debug_scope_tree *MainThreadReadTree = MainThreadState->ScopeTrees + SharedState->ReadScopeIndex;
+  debug_scope_tree *MainThreadReadTree = GetReadScopeTree(0);
 
   /* PushTableStart(Group); */
   for ( s32 ThreadIndex = 0;
@@ -486,6 +773,8 @@ DrawThreadsWindow(debug_ui_render_group *Group, debug_state *SharedState, v2 Bas
 
     StartColumn(Group);
 
+    PushFlowLinks(Group, SharedState, (u32)ThreadIndex, &FrameCycles, TotalGraphWidth, RowHeight, Global_CoreBarHeight + Global_CoreBarPadding*2);
+
     /* PushColumn(Group, CSz("Foo")); */
 
     debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadIndex);
@@ -539,10 +828,10 @@ DrawThreadsWindow(debug_ui_render_group *Group, debug_state *SharedState, v2 Bas
 #endif
 
 
-    debug_scope_tree *ReadTree = ThreadState->ScopeTrees + SharedState->ReadScopeIndex;
+    debug_scope_tree *ReadTree = GetReadScopeTree((u32)ThreadIndex);
     if (MainThreadReadTree->FrameRecorded == ReadTree->FrameRecorded)
     {
-      debug_timed_function BlockTimer2("Push Scope Bars");
+      TIMED_NAMED_BLOCK("Push Scope Bars");
       PushScopeBarsRecursive(Group, ReadTree->Root, &FrameCycles, TotalGraphWidth, BarHeight, &Entropy);
     }
 
@@ -553,6 +842,12 @@ DrawThreadsWindow(debug_ui_render_group *Group, debug_state *SharedState, v2 Bas
 
   /* PushTableEnd(Group); */
 
+  PushNewRow(Group);
+  PushCategoryBreakdown(Group, MainThreadReadTree, FrameStats, TotalGraphWidth);
+
+  PushNewRow(Group);
+  PushFlowLatencyHistogram(Group, SharedState, FrameStats);
+
 #if 0
   u32 UnclosedMutexRecords = 0;
   u32 TotalMutexRecords = 0;
@@ -610,7 +905,7 @@ static called_function NullFunctionCall = {};
 link_internal void
 CollateAllFunctionCalls(debug_profile_scope* Current)
 {
-  if (!Current || !Current->Name)
+  if (!Current || !Current->CallsiteId)
     return;
 
   called_function* Prev = 0;
@@ -620,9 +915,9 @@ CollateAllFunctionCalls(debug_profile_scope* Current)
   {
     called_function* Func = ProgramFunctionCalls + FunctionIndex;
 
-    if (Func->Name == Current->Name || !Func->Name)
+    if (Func->CallsiteId == Current->CallsiteId || !Func->CallsiteId)
     {
-      Func->Name = Current->Name;
+      Func->CallsiteId = Current->CallsiteId;
       Func->CallCount++;
       s32 SwapIndex = MAX_RECORDED_FUNCTION_CALLS;
       for (s32 PrevIndex = (s32)FunctionIndex -1;
@@ -676,7 +971,7 @@ ListContainsScope(unique_debug_profile_scope* List, debug_profile_scope* Query)
   unique_debug_profile_scope* Result = 0;
   while (List)
   {
-    if (StringsMatch(List->Name, Query->Name))
+    if (List->CallsiteId == Query->CallsiteId)
     {
       Result = List;
       break;
@@ -703,10 +998,11 @@ DumpScopeTreeDataToConsole_Internal(debug_profile_scope *Scope_in, debug_profile
       UniqueScopes = GotUniqueScope;
     }
 
-    GotUniqueScope->Name = CurrentUniqueScopeQuery->Name;
+    GotUniqueScope->CallsiteId = CurrentUniqueScopeQuery->CallsiteId;
     GotUniqueScope->CallCount++;
     u64 CycleCount = GetCycleCount(CurrentUniqueScopeQuery);
     GotUniqueScope->TotalCycles += CycleCount;
+    GotUniqueScope->TotalPayload += CurrentUniqueScopeQuery->Payload;
     GotUniqueScope->MinCycles = Min(CycleCount, GotUniqueScope->MinCycles);
     GotUniqueScope->MaxCycles = Max(CycleCount, GotUniqueScope->MaxCycles);
     GotUniqueScope->Scope = CurrentUniqueScopeQuery;
@@ -718,7 +1014,8 @@ DumpScopeTreeDataToConsole_Internal(debug_profile_scope *Scope_in, debug_profile
   {
 
     DebugLine("\n------------------------\n");
-    DebugLine("%s\n", UniqueScopes->Name);
+    debug_scope_callsite *Callsite = GetCallsite(UniqueScopes->CallsiteId);
+    DebugLine("%s (%s:%u)\n", Callsite->Name, Callsite->File, Callsite->Line);
     DebugLine("%u\n", UniqueScopes->CallCount);
     Assert(UniqueScopes->CallCount);
 
@@ -727,6 +1024,14 @@ DumpScopeTreeDataToConsole_Internal(debug_profile_scope *Scope_in, debug_profile
     DebugLine("Max: %lu\n", UniqueScopes->MaxCycles);
     DebugLine("Avg: %f\n", r64(UniqueScopes->TotalCycles / UniqueScopes->CallCount));
 
+    if (UniqueScopes->TotalPayload)
+    {
+      frame_stats *Frame = GetDebugState()->Frames + GetDebugState()->ReadScopeIndex;
+      DebugLine("Items: %lu\n", UniqueScopes->TotalPayload);
+      DebugLine("Cycles/Item: %f\n", GetCyclesPerItem(UniqueScopes->TotalCycles, UniqueScopes->TotalPayload));
+      DebugLine("Items/Sec: %f\n", GetItemsPerSecond(UniqueScopes->TotalCycles, UniqueScopes->TotalPayload, Frame->NsPerCycle));
+    }
+
     DumpScopeTreeDataToConsole_Internal(UniqueScopes->Scope->Child, TreeRoot, Memory);
     UniqueScopes = UniqueScopes->NextUnique;
   }
@@ -736,8 +1041,8 @@ DumpScopeTreeDataToConsole_Internal(debug_profile_scope *Scope_in, debug_profile
 
 link_internal void
 BufferFirstCallToEach(debug_ui_render_group *Group,
-                      debug_profile_scope *Scope_in, debug_profile_scope *TreeRoot,
-                      memory_arena *Memory, window_layout* Window, u64 TotalFrameCycles, u32 Depth)
+                      debug_profile_scope *Scope_in, debug_scope_tree *Tree,
+                      memory_arena *Memory, window_layout* Window, u64 TotalFrameCycles, r64 NsPerCycle, u32 Depth)
 {
   unique_debug_profile_scope* UniqueScopes = {};
 
@@ -750,14 +1055,18 @@ BufferFirstCallToEach(debug_ui_render_group *Group,
       GotUniqueScope = AllocateProtection(unique_debug_profile_scope, TranArena, 1, False);
       GotUniqueScope->NextUnique = UniqueScopes;
       UniqueScopes = GotUniqueScope;
-      GotUniqueScope->Name = CurrentUniqueScopeQuery->Name;
+      GotUniqueScope->CallsiteId = CurrentUniqueScopeQuery->CallsiteId;
       GotUniqueScope->Scope = CurrentUniqueScopeQuery;
     }
 
-    GotUniqueScope->CallCount++;
+    // NOTE(Jesse): A scope recorded from a sampled callsite stands in for
+    // SampleMask+1 calls, so the totals are estimates for those.
+    u32 SampleRate = CurrentUniqueScopeQuery->SampleMask + 1u;
+    GotUniqueScope->CallCount += SampleRate;
 
-    u64 CycleCount = GetCycleCount(CurrentUniqueScopeQuery);
-    GotUniqueScope->TotalCycles += CycleCount;
+    u64 CycleCount = GetCorrectedCycleCount(CurrentUniqueScopeQuery);
+    GotUniqueScope->TotalCycles += CycleCount*SampleRate;
+    GotUniqueScope->TotalPayload += CurrentUniqueScopeQuery->Payload*SampleRate;
     GotUniqueScope->MinCycles = Min(CycleCount, GotUniqueScope->MinCycles);
     GotUniqueScope->MaxCycles = Max(CycleCount, GotUniqueScope->MaxCycles);
 
@@ -767,12 +1076,13 @@ BufferFirstCallToEach(debug_ui_render_group *Group,
   while (UniqueScopes)
   {
     interactable_handle ScopeTextInteraction = PushButtonStart(Group, (umm)UniqueScopes->Scope);
-      BufferScopeTreeEntry(Group, UniqueScopes->Scope, UniqueScopes->TotalCycles, TotalFrameCycles, UniqueScopes->CallCount, Depth);
+      BufferScopeTreeEntry(Group, UniqueScopes->Scope, UniqueScopes->TotalCycles, TotalFrameCycles, NsPerCycle, UniqueScopes->CallCount, UniqueScopes->TotalPayload, Depth);
     PushButtonEnd(Group);
+    BufferScopeSamplingEntry(Group, Tree, UniqueScopes->Scope);
     PushNewRow(Group);
 
     if (UniqueScopes->Scope->Expanded)
-      BufferFirstCallToEach(Group, UniqueScopes->Scope->Child, TreeRoot, Memory, Window, TotalFrameCycles, Depth+1);
+      BufferFirstCallToEach(Group, UniqueScopes->Scope->Child, Tree, Memory, Window, TotalFrameCycles, NsPerCycle, Depth+1);
 
     if (Clicked(Group, &ScopeTextInteraction))
     {
@@ -786,38 +1096,179 @@ BufferFirstCallToEach(debug_ui_render_group *Group,
   return;
 }
 
+global_variable counted_string Global_FrameTickerTierNames[DEBUG_HISTORY_TIER_COUNT+1] =
+{
+  CSz("frames"),
+  CSz("seconds"),
+  CSz("minutes"),
+};
+
+#define DEBUG_FRAME_TICKER_WIDTH (2176.0f)
+#define DEBUG_HISTORY_TICKER_BUCKETS (720)
+
 link_internal void
-DrawFrameTicker(debug_ui_render_group *Group, debug_state *DebugState, r32 MaxMs)
+PushFrameTickerTierSelector(debug_ui_render_group *Group, debug_state *DebugState)
+{
+  PushTableStart(Group);
+  for ( u32 TierIndex = 0;
+            TierIndex <= DEBUG_HISTORY_TIER_COUNT;
+          ++TierIndex )
+  {
+    ui_style Style = TierIndex == DebugState->FrameTickerTier ? DefaultSelectedStyle : DefaultStyle;
+    interactable_handle B = PushButtonStart(Group, (umm)"FrameTickerTierInteraction"+(umm)TierIndex);
+      PushColumn(Group, Global_FrameTickerTierNames[TierIndex], &Style);
+    PushButtonEnd(Group);
+
+    if (Clicked(Group, &B))
+    {
+      DebugState->FrameTickerTier = TierIndex;
+      DebugState->SelectedHistoryBucket = 0;
+    }
+  }
+  PushNewRow(Group);
+  PushTableEnd(Group);
+}
+
+link_internal void
+PushFrameTickerTargetLines(debug_ui_render_group *Group, v2 MaxBarDim, r32 Width, r32 MaxMs)
+{
+  v2 LineDim = V2(Width, 2.0f);
+  {
+    r32 MsPerc = SafeDivide0(33.333f, MaxMs);
+    r32 MinPOffset = MaxBarDim.y * MsPerc;
+    v2 MinP = {{ 0.0f, MaxBarDim.y - MinPOffset }};
+    PushUntexturedQuad(Group, MinP, LineDim, zDepth_Text, &Global_DefaultWarnStyle, V4(0), QuadRenderParam_NoAdvance);
+  }
+
+  {
+    r32 MsPerc = (r32)SafeDivide0(16.666f, MaxMs);
+    r32 MinPOffset = MaxBarDim.y * MsPerc;
+    v2 MinP = {{ 0.0f, MaxBarDim.y - MinPOffset }};
+    PushUntexturedQuad(Group, MinP, LineDim, zDepth_Text, &Global_DefaultSuccessStyle, V4(0), QuadRenderParam_NoAdvance);
+  }
+}
+
+// NOTE(Jesse): One bar per bucket, the average frame time with the worst
+// frame behind it.  Zoomed out far enough to see something drift over hours.
+link_internal void
+DrawHistoryTicker(debug_ui_render_group *Group, debug_state *DebugState, debug_history_tier *Tier)
 {
   TIMED_FUNCTION();
 
+  u64 BucketCount = Min(Tier->BucketAt, (u64)Min(Tier->BucketCount, (u32)DEBUG_HISTORY_TICKER_BUCKETS));
+  u64 FirstBucket = Tier->BucketAt - BucketCount;
+
+  r32 MaxMs = 33.3f;
+  for ( u64 BucketIndex = FirstBucket;
+            BucketIndex < Tier->BucketAt;
+          ++BucketIndex )
+  {
+    debug_history_bucket *Bucket = GetHistoryBucket(Tier, BucketIndex);
+    MaxMs = Max(MaxMs, r32(SafeDivide0(Bucket->TotalFrameMs, r64(Bucket->FrameCount))));
+  }
+
   PushTableStart(Group);
 
-    v4 Pad = V4(1, 0, 1, 0);
-    v2 MaxBarDim = V2(15.0f, 80.0f);
+    v4 Pad = V4(1, 0, 0, 0);
+    v2 MaxBarDim = V2(2.0f, 80.0f);
     r32 HorizontalAdvance = (MaxBarDim.x+Pad.Left+Pad.Right);
-    r32 VerticalAdvance = MaxBarDim.y;
 
-    v2 LineDim = V2( HorizontalAdvance * DEBUG_FRAMES_TRACKED, 2.0f);
+    PushFrameTickerTargetLines(Group, MaxBarDim, HorizontalAdvance * DEBUG_HISTORY_TICKER_BUCKETS, MaxMs);
+
+    for ( u64 BucketIndex = FirstBucket;
+              BucketIndex < Tier->BucketAt;
+            ++BucketIndex )
     {
-      r32 MsPerc = SafeDivide0(33.333f, MaxMs);
-      r32 MinPOffset = MaxBarDim.y * MsPerc;
-      v2 MinP = {{ 0.0f, MaxBarDim.y - MinPOffset }};
-      PushUntexturedQuad(Group, MinP, LineDim, zDepth_Text, &Global_DefaultWarnStyle, V4(0), QuadRenderParam_NoAdvance);
+      debug_history_bucket *Bucket = GetHistoryBucket(Tier, BucketIndex);
+      r32 AvgMs = r32(SafeDivide0(Bucket->TotalFrameMs, r64(Bucket->FrameCount)));
+
+      v2 AvgDim = MaxBarDim * V2(1.0f, Min(1.0f, SafeDivide0(AvgMs, MaxMs)));
+      v2 MaxDim = MaxBarDim * V2(1.0f, Min(1.0f, SafeDivide0(Bucket->MaxFrameMs, MaxMs)));
+
+      r32 Brightness = 0.35f;
+      b32 Selected = (DebugState->SelectedHistoryBucket == BucketIndex+1);
+
+      ui_style Style = Selected ?
+        UiStyleFromLightestColor(V3(Brightness,       0.0f, Brightness)) :
+        UiStyleFromLightestColor(V3(Brightness, Brightness,       0.0f));
+      ui_style MaxStyle = UiStyleFromLightestColor(V3(Brightness*0.5f));
+
+      interactable_handle B = PushButtonStart(Group, (umm)"HistoryTickerHoverInteraction"^(umm)Bucket);
+        PushUntexturedQuad(Group, V2(Pad.x, MaxBarDim.y-MaxDim.y), MaxDim, zDepth_Background, &MaxStyle, {}, QuadRenderParam_NoAdvance);
+        PushUntexturedQuad(Group, V2(0.f, MaxBarDim.y-AvgDim.y), AvgDim, zDepth_Background, &Style, Pad);
+      PushButtonEnd(Group);
+
+      if (Hover(Group, &B))
+      {
+        r64 SecondsAgo = r64(Tier->BucketAt - BucketIndex) * Tier->BucketMs / 1000.0;
+        PushTooltip(Group, FormatCountedString(TranArena, CSz("%u frames, avg %.2fms, max %.2fms, %.0fs ago"),
+              Bucket->FrameCount, r64(AvgMs), r64(Bucket->MaxFrameMs), SecondsAgo));
+      }
+      if (Clicked(Group, &B)) { DebugState->SelectedHistoryBucket = BucketIndex+1; }
     }
 
+  PushTableEnd(Group);
+
+  return;
+}
+
+// NOTE(Jesse): Frame time percentiles for the session and the window;
+// clicking one jumps to a frame that took about that long.  Drawn in more
+// than one place, so each one passes its own InteractionName.
+link_internal void
+PushFramePercentiles(debug_ui_render_group *Group, debug_state *DebugState, const char *InteractionName)
+{
+  PushTableStart(Group);
+  for (u32 Window = 0; Window < 2; ++Window)
+  {
+    debug_duration_summary Summary = SummarizeDurations(&DebugState->FrameDurations, Window);
+
+    PushColumn(Group, Window ? CSz("Window") : CSz("Session"));
+    for ( u32 PercentileIndex = 0;
+              PercentileIndex < DEBUG_DURATION_PERCENTILE_COUNT;
+            ++PercentileIndex )
     {
-      r32 MsPerc = (r32)SafeDivide0(16.666f, MaxMs);
-      r32 MinPOffset = MaxBarDim.y * MsPerc;
-      v2 MinP = {{ 0.0f, MaxBarDim.y - MinPOffset }};
-      PushUntexturedQuad(Group, MinP, LineDim, zDepth_Text, &Global_DefaultSuccessStyle, V4(0), QuadRenderParam_NoAdvance);
+      interactable_handle B = PushButtonStart(Group, (umm)InteractionName+(umm)(Window*DEBUG_DURATION_PERCENTILE_COUNT + PercentileIndex));
+        PushColumn(Group, FormatCountedString(TranArena, CSz("%s %.2fms"), Global_DurationPercentileNames[PercentileIndex], r64(Summary.Ns[PercentileIndex])/1000000.0));
+      PushButtonEnd(Group);
+
+      if (Clicked(Group, &B)) { SelectFrameAtPercentile(DebugState, PercentileIndex, Window); }
     }
+    PushColumn(Group, FormatCountedString(TranArena, CSz("(%lu frames)"), Summary.Total));
+    PushNewRow(Group);
+  }
+  PushTableEnd(Group);
+}
+
+link_internal void
+DrawFrameTicker(debug_ui_render_group *Group, debug_state *DebugState, r32 MaxMs)
+{
+  TIMED_FUNCTION();
+
+  PushFrameTickerTierSelector(Group, DebugState);
+
+  if (DebugState->FrameTickerTier)
+  {
+    DrawHistoryTicker(Group, DebugState, DebugState->HistoryTiers + (DebugState->FrameTickerTier-1));
+    return;
+  }
+
+  PushTableStart(Group);
+
+    // NOTE(Jesse): The default depth gets 15px bars; deeper histories get
+    // squeezed into the same width.
+    v4 Pad = V4(1, 0, 1, 0);
+    v2 MaxBarDim = V2(Min(15.0f, Max(1.0f, DEBUG_FRAME_TICKER_WIDTH/DebugState->FramesTracked - 2.0f)), 80.0f);
+    r32 HorizontalAdvance = (MaxBarDim.x+Pad.Left+Pad.Right);
+    r32 VerticalAdvance = MaxBarDim.y;
+
+    PushFrameTickerTargetLines(Group, MaxBarDim, HorizontalAdvance * DebugState->FramesTracked, MaxMs);
 
     volatile umm MinCycles = u64_MAX;
     volatile umm MaxCycles = 0;
 
     for ( u32 FrameIndex = 0;
-              FrameIndex < DEBUG_FRAMES_TRACKED;
+              FrameIndex < DebugState->FramesTracked;
             ++FrameIndex )
     {
       frame_stats *Frame = DebugState->Frames + FrameIndex;
@@ -841,18 +1292,25 @@ DrawFrameTicker(debug_ui_render_group *Group, debug_state *DebugState, r32 MaxMs
       ui_style Style =
         FrameIndex == DebugState->ReadScopeIndex ?
         UiStyleFromLightestColor(V3(Brightness,       0.0f, Brightness)) :
+        FrameIndex+1 == DebugState->DiffBaselineIndex ?
+        UiStyleFromLightestColor(V3(      0.0f, Brightness, Brightness)) :
         UiStyleFromLightestColor(V3(Brightness, Brightness,       0.0f));
 
       ui_style BackgroundStyle = FrameIndex == DebugState->ReadScopeIndex ?
          UiStyleFromLightestColor(V3(Brightness, Brightness, Brightness)) :
          DefaultBlurredStyle;
 
-      interactable_handle B = PushButtonStart(Group, (umm)"FrameTickerHoverInteraction"+(umm)FrameIndex);
+      interactable_handle B = PushButtonStart(Group, (umm)"FrameTickerHoverInteraction"^(umm)Frame);
         PushUntexturedQuad(Group, V2(Pad.x, 0), MaxBarDim, zDepth_Background, &BackgroundStyle, {}, QuadRenderParam_NoAdvance);
         PushUntexturedQuad(Group, Offset, QuadDim, zDepth_Background, &Style, Pad);
       PushButtonEnd(Group);
 
-      if (Clicked(Group, &B)) { DebugState->ReadScopeIndex = FrameIndex; }
+      // NOTE(Jesse): Shift picks the frame to diff the selected one against
+      if (Clicked(Group, &B))
+      {
+        if (Group->Input->Shift.Pressed) { DebugState->DiffBaselineIndex = FrameIndex+1; }
+        else                             { DebugState->ReadScopeIndex = FrameIndex; }
+      }
     }
 
     DebugState->MaxCycles = MaxCycles;
@@ -878,6 +1336,283 @@ DrawFrameTicker(debug_ui_render_group *Group, debug_state *DebugState, r32 MaxMs
   return;
 }
 
+// NOTE(Jesse): What the callgraph window shows when the frame ticker is
+// zoomed out; there are no trees this far back, just per-callsite totals.
+link_internal void
+PushHistoryBucketTable(debug_ui_render_group *Group, debug_state *DebugState, debug_history_tier *Tier, u64 BucketIndex)
+{
+  debug_history_bucket *Bucket = GetHistoryBucket(Tier, BucketIndex);
+  if (!Bucket) return;
+
+  r64 AvgMs = SafeDivide0(Bucket->TotalFrameMs, r64(Bucket->FrameCount));
+  PushColumn(Group, FormatCountedString(TranArena, CSz("%u frames, avg %.2fms, max %.2fms"), Bucket->FrameCount, AvgMs, r64(Bucket->MaxFrameMs)));
+  PushNewRow(Group);
+
+  debug_callsite_aggregate *Ring = GetHistoryAggregates(Tier, Bucket);
+  if (!Ring)
+  {
+    PushColumn(Group, CSz("Callsite totals for this bucket were overwritten"));
+    PushNewRow(Group);
+    return;
+  }
+
+  // NOTE(Jesse): Most expensive first
+  debug_callsite_aggregate *Sorted = Allocate(debug_callsite_aggregate, TranArena, Bucket->AggregateCount);
+  for ( u32 AggregateIndex = 0;
+            AggregateIndex < Bucket->AggregateCount;
+          ++AggregateIndex )
+  {
+    debug_callsite_aggregate Aggregate = Ring[(Bucket->FirstAggregate + AggregateIndex) & Tier->AggregateMask];
+
+    u32 Insert = AggregateIndex;
+    while (Insert && Sorted[Insert-1].Ns < Aggregate.Ns)
+    {
+      Sorted[Insert] = Sorted[Insert-1];
+      --Insert;
+    }
+    Sorted[Insert] = Aggregate;
+  }
+
+  PushColumn(Group, CSz("Frame %"));
+  PushColumn(Group, CSz("ms/frame"));
+  PushColumn(Group, CSz("Calls/frame"));
+  PushColumn(Group, CSz("Name"));
+  PushNewRow(Group);
+
+  r64 FrameCount = r64(Bucket->FrameCount);
+  for ( u32 AggregateIndex = 0;
+            AggregateIndex < Bucket->AggregateCount;
+          ++AggregateIndex )
+  {
+    debug_callsite_aggregate *Aggregate = Sorted + AggregateIndex;
+    debug_scope_callsite *Callsite = GetCallsite(Aggregate->CallsiteId);
+
+    r64 MsPerFrame = SafeDivide0(r64(Aggregate->Ns) / 1000000.0, FrameCount);
+    PushColumn(Group, FormatCountedString(TranArena, CSz("%.2f"), 100.0 * SafeDivide0(MsPerFrame, AvgMs)));
+    PushColumn(Group, FormatCountedString(TranArena, CSz("%.3f"), MsPerFrame));
+    PushColumn(Group, FormatCountedString(TranArena, CSz("%.1f"), SafeDivide0(r64(Aggregate->Calls), FrameCount)));
+    PushColumn(Group, CS(Callsite->Name), &DefaultStyle, DefaultColumnPadding, ColumnRenderParam_LeftAlign);
+    PushNewRow(Group);
+  }
+
+  return;
+}
+
+// NOTE(Jesse): A path is shown as its last few callsites
+#define FRAME_DIFF_PATH_DEPTH (3)
+
+link_internal counted_string
+GetFrameDiffPath(debug_frame_diff *Diff, u32 EntryIndex)
+{
+  debug_call_path *Paths = Diff->Paths.Paths;
+  counted_string Result = CS(GetCallsite(Paths[EntryIndex].CallsiteId)->Name);
+
+  u32 Parent = Paths[EntryIndex].Parent;
+  for (u32 Depth = 1; Parent && Depth < FRAME_DIFF_PATH_DEPTH; ++Depth)
+  {
+    Result = FormatCountedString(TranArena, CSz("%s > %S"), GetCallsite(Paths[Parent].CallsiteId)->Name, Result);
+    Parent = Paths[Parent].Parent;
+  }
+
+  if (Parent) { Result = FormatCountedString(TranArena, CSz(".. > %S"), Result); }
+  return Result;
+}
+
+link_internal void
+DebugDrawFrameDiff(debug_ui_render_group *Group, debug_state *DebugState, v2 Basis)
+{
+  TIMED_FUNCTION();
+
+  local_persist window_layout FrameDiffWindow = WindowLayout("Frame Diff", Basis);
+  PushWindowStart(Group, &FrameDiffWindow);
+
+  u32 BaselineSlot = DebugState->DiffBaselineIndex-1;
+  u32 TargetSlot = DebugState->ReadScopeIndex;
+  debug_frame_diff *Diff = GetFrameDiff(DebugState, BaselineSlot, TargetSlot);
+
+  frame_stats *Baseline = DebugState->Frames + BaselineSlot;
+  frame_stats *Target = DebugState->Frames + TargetSlot;
+  r64 NsPerCycle = Target->NsPerCycle;
+
+  PushTableStart(Group);
+    PushColumn(Group, FormatCountedString(TranArena, CSz("Frame %u (%.2fms) vs baseline %u (%.2fms), %u paths, %u dropped, built in %.2fms"),
+          Diff->FrameRecorded[1], r64(Target->FrameMs), Diff->FrameRecorded[0], r64(Baseline->FrameMs),
+          Diff->Paths.Count-1, Diff->EntriesDropped, r64(Diff->BuildCycles)*GetNsPerCycle(&DebugState->Timestamps, DebugState->Timestamps.Mode)/1000000.0));
+
+    interactable_handle ClearButton = PushButtonStart(Group, (umm)"FrameDiffClearInteraction");
+      PushColumn(Group, CSz("Clear baseline"));
+    PushButtonEnd(Group);
+    if (Clicked(Group, &ClearButton)) { DebugState->DiffBaselineIndex = 0; }
+    PushNewRow(Group);
+  PushTableEnd(Group);
+
+  PushTableStart(Group);
+
+  PushColumn(Group, CSz("Delta us"));
+  PushColumn(Group, CSz("Delta cycles"));
+  PushColumn(Group, CSz("Delta calls"));
+  PushColumn(Group, CSz("Baseline us"));
+  PushColumn(Group, CSz("Frame us"));
+  PushColumn(Group, CSz(""));
+  PushColumn(Group, CSz("Path"));
+  PushNewRow(Group);
+
+  for ( u32 RowIndex = 0;
+            RowIndex < Diff->RowCount;
+          ++RowIndex )
+  {
+    debug_frame_diff_entry *Entry = Diff->Entries + Diff->Rows[RowIndex];
+
+    s64 DeltaCycles = s64(Entry->Cycles[1]) - s64(Entry->Cycles[0]);
+    s64 DeltaCalls = s64(Entry->Calls[1]) - s64(Entry->Calls[0]);
+
+    counted_string Change = CSz("");
+    if (Entry->Calls[0] == 0) { Change = CSz("new"); }
+    if (Entry->Calls[1] == 0) { Change = CSz("gone"); }
+
+    const char *CyclesSign = DeltaCycles < 0 ? "-" : "+";
+    const char *CallsSign = DeltaCalls < 0 ? "-" : "+";
+    u64 AbsDeltaCycles = u64(DeltaCycles < 0 ? -DeltaCycles : DeltaCycles);
+    u64 AbsDeltaCalls = u64(DeltaCalls < 0 ? -DeltaCalls : DeltaCalls);
+
+    PushColumn(Group, FormatCountedString(TranArena, CSz("%s%.1f"), CyclesSign, r64(AbsDeltaCycles)*NsPerCycle/1000.0));
+    PushColumn(Group, FormatCountedString(TranArena, CSz("%s%lu"), CyclesSign, AbsDeltaCycles));
+    PushColumn(Group, FormatCountedString(TranArena, CSz("%s%lu"), CallsSign, AbsDeltaCalls));
+    PushColumn(Group, FormatCountedString(TranArena, CSz("%.1f"), r64(Entry->Cycles[0])*NsPerCycle/1000.0));
+    PushColumn(Group, FormatCountedString(TranArena, CSz("%.1f"), r64(Entry->Cycles[1])*NsPerCycle/1000.0));
+    PushColumn(Group, Change);
+    PushColumn(Group, GetFrameDiffPath(Diff, Diff->Rows[RowIndex]), &DefaultStyle, DefaultColumnPadding, ColumnRenderParam_LeftAlign);
+    PushNewRow(Group);
+  }
+
+  PushTableEnd(Group);
+
+  PushWindowEnd(Group, &FrameDiffWindow);
+  return;
+}
+
+global_variable counted_string Global_CallgraphModeNames[CallgraphMode_Count] = { CSz("This frame"), CSz("Last N"), CSz("Session") };
+#define MERGED_TREE_WINDOW_SIZE_COUNT (4)
+global_variable u32 Global_MergedTreeWindowSizes[MERGED_TREE_WINDOW_SIZE_COUNT] = { 30, 120, 480, DEBUG_MERGED_TREE_MAX_WINDOW };
+
+link_internal void
+PushCallgraphModeSelector(debug_ui_render_group *Group, debug_state *DebugState)
+{
+  debug_merged_tree *Tree = &DebugState->MergedTree;
+
+  PushTableStart(Group);
+  for ( u32 Mode = 0;
+            Mode < CallgraphMode_Count;
+          ++Mode )
+  {
+    ui_style Style = Mode == DebugState->CallgraphMode ? DefaultSelectedStyle : DefaultStyle;
+    interactable_handle B = PushButtonStart(Group, (umm)"CallgraphModeInteraction"+(umm)Mode);
+      PushColumn(Group, Global_CallgraphModeNames[Mode], &Style);
+    PushButtonEnd(Group);
+
+    if (Clicked(Group, &B)) { DebugState->CallgraphMode = Mode; }
+  }
+
+  if (DebugState->CallgraphMode == CallgraphMode_Window)
+  {
+    for ( u32 SizeIndex = 0;
+              SizeIndex < MERGED_TREE_WINDOW_SIZE_COUNT;
+            ++SizeIndex )
+    {
+      u32 Size = Global_MergedTreeWindowSizes[SizeIndex];
+      ui_style Style = Size == Tree->WindowFrames ? DefaultSelectedStyle : DefaultStyle;
+      interactable_handle B = PushButtonStart(Group, (umm)"MergedTreeWindowInteraction"+(umm)SizeIndex);
+        PushColumn(Group, CS(Size), &Style);
+      PushButtonEnd(Group);
+
+      if (Clicked(Group, &B)) { Tree->WindowFrames = Size; }
+    }
+  }
+
+  if (DebugState->CallgraphMode != CallgraphMode_Frame)
+  {
+    b32 Session = DebugState->CallgraphMode == CallgraphMode_Session;
+    u32 Frames = Session ? Tree->SessionFrames : Tree->WindowFrameCount;
+    PushColumn(Group, FormatCountedString(TranArena, CSz("averaged over %u frames, %u paths, %u dropped"), Frames, Tree->NodeCount-1, Tree->NodesDropped));
+  }
+  PushNewRow(Group);
+  PushTableEnd(Group);
+}
+
+// NOTE(Jesse): Everything is per frame, averaged over the frames in the
+// window or the session.  Frame % is against main thread frame time, so
+// paths on several threads can add up to more than 100.
+link_internal void
+PushMergedTreeRecursive(debug_ui_render_group *Group, debug_merged_tree *Tree, u32 ParentIndex, b32 Session, r64 FrameCount, r64 TotalFrameNs)
+{
+  for ( u32 NodeIndex = Tree->Nodes[ParentIndex].FirstChild;
+            NodeIndex;
+            NodeIndex = Tree->Nodes[NodeIndex].NextSibling )
+  {
+    debug_merged_node *Node = Tree->Nodes + NodeIndex;
+    debug_merged_totals *Totals = Session ? &Node->Session : &Node->Window;
+    if (!Totals->Calls) continue;
+
+    r32 Percentage = 100.0f * (r32)SafeDivide0(r64(Totals->Ns), TotalFrameNs);
+
+    interactable_handle B = PushButtonStart(Group, (umm)"MergedTreeNodeInteraction"^(umm)Node);
+      PushColumn(Group, CS(Percentage));
+      PushColumn(Group, CS(u64(SafeDivide0(r64(Totals->Ns), r64(Totals->Calls)))));
+      PushColumn(Group, CS(r32(SafeDivide0(r64(Totals->Ns), FrameCount)/1000.0)));
+      PushColumn(Group, CS(r32(SafeDivide0(r64(Totals->Calls), FrameCount))));
+
+      if (Totals->Payload)
+      {
+        PushColumn(Group, CS(u64(SafeDivide0(r64(Totals->Payload), r64(Totals->Ns)) * 1000000000.0)));
+        PushColumn(Group, CS(r32(SafeDivide0(r64(Totals->Ns), r64(Totals->Payload)))));
+      }
+      else
+      {
+        PushColumn(Group, CSz(""));
+        PushColumn(Group, CSz(""));
+      }
+
+      char Prefix = Node->FirstChild ? (Node->Expanded ? '-' : '+') : ' ';
+      u32 DepthSpaces = ((Node->Depth-1u)*2)+1;
+      counted_string NameString = BuildNameStringFor(Prefix, CS(GetCallsite(Node->CallsiteId)->Name), DepthSpaces);
+      PushColumn(Group, NameString, &DefaultStyle, DefaultColumnPadding, ColumnRenderParam_LeftAlign);
+    PushButtonEnd(Group);
+    PushNewRow(Group);
+
+    if (Node->Expanded)
+    {
+      PushMergedTreeRecursive(Group, Tree, NodeIndex, Session, FrameCount, TotalFrameNs);
+    }
+
+    if (Clicked(Group, &B)) { Node->Expanded = !Node->Expanded; }
+  }
+}
+
+link_internal void
+PushMergedTreeTable(debug_ui_render_group *Group, debug_state *DebugState)
+{
+  debug_merged_tree *Tree = &DebugState->MergedTree;
+  b32 Session = DebugState->CallgraphMode == CallgraphMode_Session;
+
+  r64 FrameCount = Session ? r64(Tree->SessionFrames) : r64(Tree->WindowFrameCount);
+  r64 TotalFrameNs = (Session ? Tree->SessionFrameMs : Tree->WindowFrameMs) * 1000000.0;
+
+  PushTableStart(Group);
+
+  PushColumn(Group, CSz("Frame %"));
+  PushColumn(Group, CSz("ns/call"));
+  PushColumn(Group, CSz("us/frame"));
+  PushColumn(Group, CSz("calls/frame"));
+  PushColumn(Group, CSz("items/s"));
+  PushColumn(Group, CSz("ns/item"));
+  PushColumn(Group, CSz("Name"));
+  PushNewRow(Group);
+
+  PushMergedTreeRecursive(Group, Tree, 0, Session, FrameCount, TotalFrameNs);
+
+  PushTableEnd(Group);
+}
+
 link_internal void
 DebugDrawCallGraph(debug_ui_render_group *Group, debug_state *DebugState, r32 MaxMs)
 {
@@ -887,8 +1622,7 @@ DebugDrawCallGraph(debug_ui_render_group *Group, debug_state *DebugState, r32 Ma
 
   s32 TotalThreadCount = (s32)GetTotalThreadCount();
 
-  debug_thread_state *MainThreadState  = GetThreadLocalStateFor(0);
-  debug_scope_tree *MainThreadReadTree = MainThreadState->ScopeTrees + DebugState->ReadScopeIndex;
+  debug_scope_tree *MainThreadReadTree = GetReadScopeTree(0);
 
   v2 Basis = DefaultWindowBasis(Group->ScreenDim);
   window_layout *ThreadWindow = DrawThreadsWindow(Group, DebugState, Basis);
@@ -900,33 +1634,71 @@ DebugDrawCallGraph(debug_ui_render_group *Group, debug_state *DebugState, r32 Ma
 
     PushWindowStart(Group, &CallgraphWindow);
 
-    PushTableStart(Group);
+    if (DebugState->FrameTickerTier)
+    {
+      PushTableStart(Group);
+      if (DebugState->SelectedHistoryBucket)
+      {
+        debug_history_tier *Tier = DebugState->HistoryTiers + (DebugState->FrameTickerTier-1);
+        PushHistoryBucketTable(Group, DebugState, Tier, DebugState->SelectedHistoryBucket-1);
+      }
+      else
+      {
+        PushColumn(Group, CSz("Click a bar in the ticker"));
+        PushNewRow(Group);
+      }
+      PushTableEnd(Group);
+    }
+    else if (DebugState->CallgraphMode != CallgraphMode_Frame)
+    {
+      PushCallgraphModeSelector(Group, DebugState);
+      PushMergedTreeTable(Group, DebugState);
+    }
+    else
+    {
+      PushCallgraphModeSelector(Group, DebugState);
 
-    PushColumn(Group, CSz("Frame %"));
-    PushColumn(Group, CSz("Cycles"));
-    PushColumn(Group, CSz("Calls"));
-    PushColumn(Group, CSz("Name"));
-    PushNewRow(Group);
+      PushTableStart(Group);
+        PushCategoryTable(Group, DebugState, MainThreadReadTree, DebugState->Frames + DebugState->ReadScopeIndex);
+      PushTableEnd(Group);
 
-    for ( s32 ThreadIndex = 0;
-          ThreadIndex < TotalThreadCount;
-        ++ThreadIndex )
-    {
-      debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadIndex);
-      debug_scope_tree *ReadTree = ThreadState->ScopeTrees + DebugState->ReadScopeIndex;
-      frame_stats *Frame = DebugState->Frames + DebugState->ReadScopeIndex;
+      PushTableStart(Group);
+
+      PushColumn(Group, CSz("Frame %"));
+      PushColumn(Group, CSz("Cycles"));
+      PushColumn(Group, CSz("ns"));
+      PushColumn(Group, CSz("Total us"));
+      PushColumn(Group, CSz("Calls"));
+      PushColumn(Group, CSz("items/s"));
+      PushColumn(Group, CSz("cy/item"));
+      PushColumn(Group, CSz("Name"));
+      PushColumn(Group, CSz("Sampling"));
+      PushNewRow(Group);
 
-      if (Frame->TotalCycles && MainThreadReadTree->FrameRecorded == ReadTree->FrameRecorded)
+      for ( s32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
       {
-        debug_timed_function BlockTimer2("Buffer First Call To Each");
-        BufferFirstCallToEach(Group, ReadTree->Root, ReadTree->Root, ThreadsafeDebugMemoryAllocator(), &CallgraphWindow, Frame->TotalCycles, 0);
+        debug_scope_tree *ReadTree = GetReadScopeTree((u32)ThreadIndex);
+        frame_stats *Frame = DebugState->Frames + DebugState->ReadScopeIndex;
+
+        if (Frame->TotalCycles && MainThreadReadTree->FrameRecorded == ReadTree->FrameRecorded)
+        {
+          TIMED_NAMED_BLOCK("Buffer First Call To Each");
+          BufferFirstCallToEach(Group, ReadTree->Root, ReadTree, ThreadsafeDebugMemoryAllocator(), &CallgraphWindow, Frame->TotalCycles, Frame->NsPerCycle, 0);
+        }
       }
+      PushTableEnd(Group);
     }
-    PushTableEnd(Group);
     PushWindowEnd(Group, &CallgraphWindow);
 
   END_BLOCK("Call Graph");
 
+  if (DebugState->DiffBaselineIndex)
+  {
+    DebugDrawFrameDiff(Group, DebugState, BasisRightOf(&CallgraphWindow));
+  }
+
 
   return;
 }
@@ -955,8 +1727,9 @@ DumpScopeTreeDataToConsole()
 
   /* Print("Starting debug data dump"); */
 
-  /* debug_thread_state *ThreadState = GetThreadLocalStateFor(0); */
-  debug_scope_tree *ReadTree = DebugState->GetWriteScopeTree();
+  // NOTE(Jesse): The write tree is only a range of events until the thread
+  // advances, so dump the last complete frame instead.
+  debug_scope_tree *ReadTree = GetReadScopeTree(ThreadLocal_ThreadIndex);
   DumpScopeTreeDataToConsole_Internal(ReadTree->Root, ReadTree->Root, Temp);
 
   /* Print("Ending debug data dump"); */
@@ -978,8 +1751,12 @@ PushCallgraphRecursive(debug_ui_render_group *Group, debug_profile_scope* At)
   if (At)
   {
     u64 CycleCount = GetCycleCount(At);
-    PushColumn(Group, CS(At->Name));
+    PushColumn(Group, CS(GetCallsite(At)->Name));
     PushColumn(Group, CS(CycleCount));
+    if (At->Payload)
+    {
+      PushColumn(Group, FormatCountedString(TranArena, CSz("%lu items, %.1f cy/item"), At->Payload, GetCyclesPerItem(CycleCount, At->Payload)));
+    }
     PushNewRow(Group);
 
     if (At->Child)
@@ -1007,7 +1784,14 @@ DumpCallgraphRecursive(debug_ui_render_group *Group, debug_profile_scope* At, u3
   }
 
   u64 CycleCount = GetCycleCount(At);
-  DebugChars("%s (%lu) \n", At->Name, CycleCount);
+  if (At->Payload)
+  {
+    DebugChars("%s (%lu) (%lu items, %.1f cy/item) \n", GetCallsite(At)->Name, CycleCount, At->Payload, GetCyclesPerItem(CycleCount, At->Payload));
+  }
+  else
+  {
+    DebugChars("%s (%lu) \n", GetCallsite(At)->Name, CycleCount);
+  }
 
   if (At->Child)
   {
@@ -1039,9 +1823,9 @@ DebugDrawCollatedFunctionCalls(debug_ui_render_group *Group, debug_state *DebugS
         ++FunctionIndex)
     {
       called_function *Func = ProgramFunctionCalls + FunctionIndex;
-      if (Func->Name)
+      if (Func->CallsiteId)
       {
-        PushColumn(Group, CS(Func->Name));
+        PushColumn(Group, CS(GetCallsite(Func->CallsiteId)->Name));
         PushColumn(Group, CS(Func->CallCount));
         PushNewRow(Group);
       }
@@ -1059,14 +1843,14 @@ DebugDrawCollatedFunctionCalls(debug_ui_render_group *Group, debug_state *DebugS
 
     if (DebugState->HotFunction)
     {
-      const char* NameOfHotFunction = DebugState->HotFunction->Name;
+      u16 HotCallsiteId = DebugState->HotFunction->CallsiteId;
 
       u32 SortKeyCount = 0;
       {
         debug_profile_scope* CurrentScope = DebugState->HotFunction;
         while (CurrentScope)
         {
-          if (StringsMatch(CurrentScope->Name, NameOfHotFunction))
+          if (CurrentScope->CallsiteId == HotCallsiteId)
           {
             ++SortKeyCount;
           }
@@ -1081,7 +1865,7 @@ DebugDrawCollatedFunctionCalls(debug_ui_render_group *Group, debug_state *DebugS
         debug_profile_scope* CurrentScope = DebugState->HotFunction;
         while (CurrentScope)
         {
-          if (StringsMatch(CurrentScope->Name, NameOfHotFunction))
+          if (CurrentScope->CallsiteId == HotCallsiteId)
           {
             Assert(CurrentSortKeyIndex < SortKeyCount);
             SortBuffer[CurrentSortKeyIndex].Index = (u64)CurrentScope;
@@ -1106,14 +1890,14 @@ DebugDrawCollatedFunctionCalls(debug_ui_render_group *Group, debug_state *DebugS
 
 #define TEXT_OUTPUT_FOR_FUNCTION_CALLS 0
 #if TEXT_OUTPUT_FOR_FUNCTION_CALLS
-          Print(CS(CurrentScope->Name));
+          Print(CS(GetCallsite(CurrentScope)->Name));
           DebugChars("\n");
           Print(CS(GetCycleCount(CurrentScope)));
           DebugChars("\n");
           DumpCallgraphRecursive(Group, CurrentScope->Child);
           DebugChars("\n");
 #else
-          PushColumn(Group, CS(CurrentScope->Name));
+          PushColumn(Group, CS(GetCallsite(CurrentScope)->Name));
           PushNewRow(Group);
           PushColumn(Group, CS(GetCycleCount(CurrentScope)));
           PushNewRow(Group);
@@ -1215,6 +1999,397 @@ DebugDrawDrawCalls(debug_ui_render_group *Group)
 
 
 
+/**************************                     ******************************/
+/**************************  Budget Violations  ******************************/
+/**************************                     ******************************/
+
+
+
+link_internal void
+DebugDrawBudgetViolations(debug_ui_render_group *Group, debug_state *DebugState)
+{
+  TIMED_FUNCTION();
+
+  local_persist window_layout BudgetWindow = WindowLayout("Budget Violations", V2(0));
+  PushWindowStart(Group, &BudgetWindow);
+
+  PushTableStart(Group);
+
+  PushColumn(Group, FormatCountedString(TranArena, CSz("Session total %u, dropped %u"), DebugState->BudgetViolationCount, DebugState->BudgetViolationsDropped));
+  PushNewRow(Group);
+  PushNewRow(Group);
+
+  PushColumn(Group, CSz("Name"));
+  PushColumn(Group, CSz("Budget us"));
+  PushColumn(Group, CSz("Count"));
+  PushColumn(Group, CSz("Worst over us"));
+  PushColumn(Group, CSz("Avg over us"));
+  PushColumn(Group, CSz("Last frame"));
+  PushColumn(Group, CSz("Last thread"));
+  PushNewRow(Group);
+
+  for ( u32 CallsiteIndex = 1;
+            CallsiteIndex < DebugState->ScopeCallsiteCount;
+          ++CallsiteIndex )
+  {
+    debug_callsite_budget_stats *Stats = DebugState->ScopeCallsiteBudgetStats + CallsiteIndex;
+    if (Stats->Violations)
+    {
+      debug_scope_callsite *Callsite = GetCallsite((u16)CallsiteIndex);
+      PushColumn(Group, CS(Callsite->Name));
+      PushColumn(Group, CS(Callsite->BudgetUs));
+      PushColumn(Group, CS(Stats->Violations));
+      PushColumn(Group, CS(r32(Stats->WorstOverrunNs/1000.0)));
+      PushColumn(Group, CS(r32(SafeDivide0(r64(Stats->TotalOverrunNs), r64(Stats->Violations))/1000.0)));
+      PushColumn(Group, CS(Stats->LastFrameId));
+      PushColumn(Group, CS(Stats->LastThreadIndex));
+      PushNewRow(Group);
+    }
+  }
+
+  PushNewRow(Group);
+  PushColumn(Group, CSz("Most recent"));
+  PushNewRow(Group);
+
+  u32 RecentCount = Min(DebugState->RecentBudgetViolationAt, (u32)DEBUG_RECENT_BUDGET_VIOLATIONS);
+  for ( u32 RecentIndex = 0;
+            RecentIndex < RecentCount;
+          ++RecentIndex )
+  {
+    u32 ViolationIndex = (DebugState->RecentBudgetViolationAt - 1 - RecentIndex) % DEBUG_RECENT_BUDGET_VIOLATIONS;
+    debug_budget_violation *Violation = DebugState->RecentBudgetViolations + ViolationIndex;
+
+    PushColumn(Group, CS(GetCallsite(Violation->CallsiteId)->Name));
+    PushColumn(Group, FormatCountedString(TranArena, CSz("%.1fus"), r64(Violation->DurationNs)/1000.0));
+    PushColumn(Group, FormatCountedString(TranArena, CSz("+%.1fus"), r64(Violation->OverrunNs)/1000.0));
+    PushColumn(Group, FormatCountedString(TranArena, CSz("frame %u"), Violation->FrameId));
+    PushColumn(Group, FormatCountedString(TranArena, CSz("thread %u"), u32(Violation->ThreadIndex)));
+    PushNewRow(Group);
+  }
+
+  PushTableEnd(Group);
+
+  PushWindowEnd(Group, &BudgetWindow);
+  return;
+}
+
+
+
+/*****************************               ********************************/
+/*****************************  Percentiles  ********************************/
+/*****************************               ********************************/
+
+
+
+link_internal void
+PushDurationSummaryColumns(debug_ui_render_group *Group, debug_duration_summary *Summary)
+{
+  for ( u32 PercentileIndex = 0;
+            PercentileIndex < DEBUG_DURATION_PERCENTILE_COUNT;
+          ++PercentileIndex )
+  {
+    PushColumn(Group, FormatCountedString(TranArena, CSz("%.1f"), r64(Summary->Ns[PercentileIndex])/1000.0));
+  }
+}
+
+// NOTE(Jesse): Every callsite we've seen, worst windowed p99 first
+link_internal void
+DebugDrawPercentiles(debug_ui_render_group *Group, debug_state *DebugState)
+{
+  TIMED_FUNCTION();
+
+  local_persist window_layout PercentileWindow = WindowLayout("Percentiles", V2(0));
+  PushWindowStart(Group, &PercentileWindow);
+
+  PushFramePercentiles(Group, DebugState, "PercentileWindowFramePercentileInteraction");
+
+  u32 CallsiteCount = DebugState->ScopeCallsiteCount;
+  u16 *Sorted = Allocate(u16, TranArena, CallsiteCount);
+  debug_duration_summary *Windowed = Allocate(debug_duration_summary, TranArena, CallsiteCount);
+
+  u32 SortedCount = 0;
+  for ( u32 CallsiteIndex = 1;
+            CallsiteIndex < CallsiteCount;
+          ++CallsiteIndex )
+  {
+    debug_duration_stats *Stats = DebugState->CallsiteDurations[CallsiteIndex];
+    if (!Stats) continue;
+
+    Windowed[CallsiteIndex] = SummarizeDurations(Stats, True);
+
+    u32 InsertAt = SortedCount++;
+    while (InsertAt && Windowed[Sorted[InsertAt-1]].Ns[2] < Windowed[CallsiteIndex].Ns[2])
+    {
+      Sorted[InsertAt] = Sorted[InsertAt-1];
+      --InsertAt;
+    }
+    Sorted[InsertAt] = (u16)CallsiteIndex;
+  }
+
+  PushTableStart(Group);
+
+  PushColumn(Group, CSz("Name"));
+  PushColumn(Group, CSz("Calls"));
+  for (u32 Window = 0; Window < 2; ++Window)
+  {
+    for ( u32 PercentileIndex = 0;
+              PercentileIndex < DEBUG_DURATION_PERCENTILE_COUNT;
+            ++PercentileIndex )
+    {
+      PushColumn(Group, FormatCountedString(TranArena, CSz("%s %s us"), Window ? "win" : "all", Global_DurationPercentileNames[PercentileIndex]));
+    }
+  }
+  PushNewRow(Group);
+
+  for ( u32 SortedIndex = 0;
+            SortedIndex < SortedCount;
+          ++SortedIndex )
+  {
+    u16 CallsiteId = Sorted[SortedIndex];
+    debug_duration_summary Session = SummarizeDurations(DebugState->CallsiteDurations[CallsiteId], False);
+
+    PushColumn(Group, CS(GetCallsite(CallsiteId)->Name));
+    PushColumn(Group, CS(Session.Total));
+    PushDurationSummaryColumns(Group, &Session);
+    PushDurationSummaryColumns(Group, Windowed + CallsiteId);
+    PushNewRow(Group);
+  }
+
+  PushTableEnd(Group);
+
+  PushWindowEnd(Group, &PercentileWindow);
+  return;
+}
+
+
+
+/*******************************             *********************************/
+/*******************************   Capture   *********************************/
+/*******************************             *********************************/
+
+
+
+// NOTE(Jesse): Maps the file and reads its index, nothing else.  Frames get
+// decoded one at a time as they're clicked on in the Capture window.
+link_internal b32
+OpenCaptureFile(const char *Path)
+{
+  debug_state *DebugState = GetDebugState();
+
+  if (!DebugState->Capture)
+  {
+    memory_arena *CaptureArena = AllocateArena();
+    DEBUG_REGISTER_NAMED_ARENA(CaptureArena, 0, "debug_lib CaptureViewer");
+
+    DebugState->Capture = Allocate(debug_capture, CaptureArena, 1);
+    DebugState->CaptureFrame = Allocate(debug_capture_frame, CaptureArena, 1);
+
+    DebugState->CaptureFrameMemory = AllocateArena();
+    DEBUG_REGISTER_NAMED_ARENA(DebugState->CaptureFrameMemory, 0, "debug_lib CaptureFrame");
+  }
+
+  CloseCapture(DebugState->Capture);
+  Clear(DebugState->CaptureFrame);
+  RewindArena(DebugState->CaptureFrameMemory);
+
+  DebugState->CaptureSelectedFrame = 0;
+  DebugState->CaptureFirstVisibleFrame = 0;
+
+  b32 Result = OpenCapture(DebugState->Capture, Path);
+  if (Result)
+  {
+    Info("Opened capture (%s), %u frames%s", Path, DebugState->Capture->FrameCount, DebugState->Capture->Indexed ? "" : ", not indexed");
+    DebugState->UIType |= DebugUIType_Capture;
+  }
+
+  return Result;
+}
+
+link_internal void
+SelectCaptureFrame(debug_state *DebugState, u32 FrameIndex)
+{
+  RewindArena(DebugState->CaptureFrameMemory);
+  DecodeCaptureFrame(DebugState->Capture, FrameIndex, DebugState->CaptureFrame, DebugState->CaptureFrameMemory);
+  DebugState->CaptureSelectedFrame = FrameIndex+1;
+}
+
+#define DEBUG_CAPTURE_TICKER_FRAMES (256)
+
+// NOTE(Jesse): Only reads the index, so paging through a huge capture never
+// touches the frames themselves.
+link_internal void
+DrawCaptureTicker(debug_ui_render_group *Group, debug_state *DebugState)
+{
+  debug_capture *Capture = DebugState->Capture;
+
+  u32 FirstFrame = DebugState->CaptureFirstVisibleFrame;
+  u32 OnePastLastFrame = Min(Capture->FrameCount, FirstFrame + DEBUG_CAPTURE_TICKER_FRAMES);
+
+  PushTableStart(Group);
+    interactable_handle PrevButton = PushButtonStart(Group, (umm)"CapturePrevPageInteraction");
+      PushColumn(Group, CSz("<"));
+    PushButtonEnd(Group);
+
+    interactable_handle NextButton = PushButtonStart(Group, (umm)"CaptureNextPageInteraction");
+      PushColumn(Group, CSz(">"));
+    PushButtonEnd(Group);
+
+    PushColumn(Group, FormatCountedString(TranArena, CSz("frames %u-%u of %u"), FirstFrame, OnePastLastFrame ? OnePastLastFrame-1 : 0, Capture->FrameCount));
+    PushNewRow(Group);
+  PushTableEnd(Group);
+
+  if (Clicked(Group, &PrevButton))
+  {
+    DebugState->CaptureFirstVisibleFrame = FirstFrame > DEBUG_CAPTURE_TICKER_FRAMES ? FirstFrame - DEBUG_CAPTURE_TICKER_FRAMES : 0;
+  }
+
+  if (Clicked(Group, &NextButton) && OnePastLastFrame < Capture->FrameCount)
+  {
+    DebugState->CaptureFirstVisibleFrame = OnePastLastFrame;
+  }
+
+  r32 MaxMs = 33.3f;
+  for (u32 FrameIndex = FirstFrame; FrameIndex < OnePastLastFrame; ++FrameIndex)
+  {
+    MaxMs = Max(MaxMs, Capture->Frames[FrameIndex].FrameMs);
+  }
+
+  PushTableStart(Group);
+
+    v4 Pad = V4(1, 0, 1, 0);
+    v2 MaxBarDim = V2(Min(15.0f, Max(1.0f, DEBUG_FRAME_TICKER_WIDTH/DEBUG_CAPTURE_TICKER_FRAMES - 2.0f)), 80.0f);
+
+    for ( u32 FrameIndex = FirstFrame;
+              FrameIndex < OnePastLastFrame;
+            ++FrameIndex )
+    {
+      debug_capture_frame_index *Frame = Capture->Frames + FrameIndex;
+      r32 Perc = SafeDivide0(Frame->FrameMs, MaxMs);
+
+      v2 QuadDim = MaxBarDim * V2(1.0f, Perc);
+      v2 Offset = V2(0.f, MaxBarDim.y-QuadDim.y);
+
+      r32 Brightness = 0.35f;
+      b32 Selected = FrameIndex+1 == DebugState->CaptureSelectedFrame;
+
+      ui_style Style = Selected ?
+        UiStyleFromLightestColor(V3(Brightness,       0.0f, Brightness)) :
+        UiStyleFromLightestColor(V3(Brightness, Brightness,       0.0f));
+
+      ui_style BackgroundStyle = Selected ?
+         UiStyleFromLightestColor(V3(Brightness, Brightness, Brightness)) :
+         DefaultBlurredStyle;
+
+      interactable_handle B = PushButtonStart(Group, (umm)"CaptureTickerInteraction"^(umm)Frame);
+        PushUntexturedQuad(Group, V2(Pad.x, 0), MaxBarDim, zDepth_Background, &BackgroundStyle, {}, QuadRenderParam_NoAdvance);
+        PushUntexturedQuad(Group, Offset, QuadDim, zDepth_Background, &Style, Pad);
+      PushButtonEnd(Group);
+
+      if (Clicked(Group, &B)) { SelectCaptureFrame(DebugState, FrameIndex); }
+    }
+
+  PushTableEnd(Group);
+}
+
+link_internal void
+PushCaptureScopeRecursive(debug_ui_render_group *Group, debug_capture *Capture, debug_capture_scope *FirstScope, r64 NsPerCycle, u32 Depth)
+{
+  for ( debug_capture_scope *Scope = FirstScope;
+                             Scope;
+                             Scope = Scope->Sibling )
+  {
+    interactable_handle B = PushButtonStart(Group, (umm)Scope);
+
+      if (Scope->EndingCycle) { PushColumn(Group, CS(r32(r64(Scope->EndingCycle - Scope->StartingCycle) * NsPerCycle / 1000.0))); }
+      else                    { PushColumn(Group, CSz("open")); }
+
+      if (Scope->Payload) { PushColumn(Group, CS(Scope->Payload)); }
+      else                { PushColumn(Group, CSz("")); }
+
+      char Prefix = Scope->Child ? (Scope->Expanded ? '-' : '+') : ' ';
+      counted_string Name = Scope->Continued ? CSz("(continued)") : GetCaptureCallsite(Capture, Scope->CallsiteId)->Name;
+      PushColumn(Group, BuildNameStringFor(Prefix, Name, (Depth*2)+1), &DefaultStyle, DefaultColumnPadding, ColumnRenderParam_LeftAlign);
+
+    PushButtonEnd(Group);
+    PushNewRow(Group);
+
+    if (Scope->Expanded)
+    {
+      PushCaptureScopeRecursive(Group, Capture, Scope->Child, NsPerCycle, Depth+1);
+    }
+
+    if (Clicked(Group, &B)) { Scope->Expanded = !Scope->Expanded; }
+  }
+}
+
+link_internal void
+DebugDrawCapture(debug_ui_render_group *Group, debug_state *DebugState)
+{
+  TIMED_FUNCTION();
+
+  local_persist window_layout CaptureWindow = WindowLayout("Capture", V2(0));
+  PushWindowStart(Group, &CaptureWindow);
+
+  debug_capture *Capture = DebugState->Capture;
+  if (Capture && Capture->Data)
+  {
+    DrawCaptureTicker(Group, DebugState);
+
+    debug_capture_frame *Frame = DebugState->CaptureFrame;
+    if (DebugState->CaptureSelectedFrame && Frame->Index)
+    {
+      PushTableStart(Group);
+        PushColumn(Group, FormatCountedString(TranArena, CSz("frame %u"), Frame->Index->FrameId));
+        PushColumn(Group, FormatCountedString(TranArena, CSz("%.2fms"), r64(Frame->Index->FrameMs)));
+        PushColumn(Group, FormatCountedString(TranArena, CSz("%lu bytes"), Frame->Index->Size));
+        PushColumn(Group, FormatCountedString(TranArena, CSz("%u context switches"), Frame->ContextSwitchCount));
+        PushNewRow(Group);
+      PushTableEnd(Group);
+
+      PushTableStart(Group);
+        PushColumn(Group, CSz("us"));
+        PushColumn(Group, CSz("Payload"));
+        PushColumn(Group, CSz("Name"));
+        PushNewRow(Group);
+
+        for ( u32 ThreadIndex = 0;
+                  ThreadIndex < Frame->ThreadCount;
+                ++ThreadIndex )
+        {
+          debug_capture_thread *Thread = Frame->Threads + ThreadIndex;
+          if (!Thread->Root && !Thread->MutexOpCount) continue;
+
+          PushColumn(Group, CSz(""));
+          PushColumn(Group, CSz(""));
+          PushColumn(Group, FormatCountedString(TranArena, CSz("Thread %u, %u scopes, %u lock ops"), ThreadIndex, Thread->ScopeCount, Thread->MutexOpCount), &DefaultStyle, DefaultColumnPadding, ColumnRenderParam_LeftAlign);
+          PushNewRow(Group);
+
+          PushCaptureScopeRecursive(Group, Capture, Thread->Root, Frame->Index->NsPerCycle, 0);
+        }
+      PushTableEnd(Group);
+    }
+    else
+    {
+      PushTableStart(Group);
+        PushColumn(Group, CSz("Click a bar in the ticker"));
+        PushNewRow(Group);
+      PushTableEnd(Group);
+    }
+  }
+  else
+  {
+    PushTableStart(Group);
+      PushColumn(Group, CSz("No capture open, see DEBUG_OPEN_CAPTURE"));
+      PushNewRow(Group);
+    PushTableEnd(Group);
+  }
+
+  PushWindowEnd(Group, &CaptureWindow);
+  return;
+}
+
+
+
 /*******************************            **********************************/
 /*******************************   Memory   **********************************/
 /*******************************            **********************************/
@@ -1453,6 +2628,62 @@ PushDebugPushMetaData(debug_ui_render_group *Group, selected_arenas *SelectedAre
   return;
 }
 
+global_variable counted_string Global_ScopeOverflowPolicyNames[ScopeOverflow_Count] =
+{
+  CSz("drop"),
+  CSz("collapse"),
+  CSz("steal oldest"),
+};
+
+// NOTE(Jesse): The dropped/collapsed/stolen counts are for the frame being
+// viewed, since that's the tree that got built last.
+link_internal void
+PushProfileScopeMemory(debug_ui_render_group *Group, debug_state *DebugState)
+{
+  PushNewRow(Group);
+
+  interactable_handle PolicyInteraction = PushButtonStart(Group, (umm)"ScopeOverflowPolicyInteraction");
+    PushColumn(Group, FormatCountedString(TranArena, CSz("Profile scopes, %S per thread, on overflow (%S)"),
+          MemorySize(DebugState->ProfileScopeBudget), Global_ScopeOverflowPolicyNames[DebugState->ProfileScopeOverflowPolicy]));
+    PushNewRow(Group);
+  PushButtonEnd(Group);
+
+  if (Clicked(Group, &PolicyInteraction))
+  {
+    DebugState->ProfileScopeOverflowPolicy = (DebugState->ProfileScopeOverflowPolicy + 1) % ScopeOverflow_Count;
+  }
+
+  PushColumn(Group, CSz("Thread"));
+  PushColumn(Group, CSz("Used"));
+  PushColumn(Group, CSz("Peak"));
+  PushColumn(Group, CSz("Dropped"));
+  PushColumn(Group, CSz("Collapsed"));
+  PushColumn(Group, CSz("Stolen"));
+  PushNewRow(Group);
+
+  u32 TotalThreadCount = GetTotalThreadCount();
+  for ( u32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadIndex);
+    debug_scope_tree *ReadTree = ThreadState->ScopeTrees + DebugState->ReadScopeIndex;
+
+    umm UsedBytes = ThreadState->LiveBlockCount*sizeof(debug_profile_scope_block);
+    r32 UsedPerc = SafeDivide0(r32(UsedBytes), r32(DebugState->ProfileScopeBudget));
+
+    PushColumn(Group, CS(ThreadIndex));
+    PushColumn(Group, FormatCountedString(TranArena, CSz("%S (%.1f%%)"), MemorySize(UsedBytes), r64(UsedPerc*100.f)));
+    PushColumn(Group, MemorySize(ThreadState->PeakBlockCount*sizeof(debug_profile_scope_block)));
+    PushColumn(Group, CS(ReadTree->ScopesDropped));
+    PushColumn(Group, CS(ReadTree->ScopesCollapsed));
+    PushColumn(Group, MemorySize(ReadTree->BlocksStolen*sizeof(debug_profile_scope_block)));
+    PushNewRow(Group);
+  }
+
+  return;
+}
+
 link_internal void
 DebugDrawMemoryHud(debug_ui_render_group *Group, debug_state *DebugState)
 {
@@ -1602,6 +2833,11 @@ DebugDrawMemoryHud(debug_ui_render_group *Group, debug_state *DebugState)
   }
 
   PushTableEnd(Group);
+
+  PushTableStart(Group);
+    PushProfileScopeMemory(Group, DebugState);
+  PushTableEnd(Group);
+
   PushWindowEnd(Group, MemoryArenaList);
 
 
@@ -0,0 +1,713 @@
+#include <stdio.h>
+#include <stdarg.h>
+
+/*****************************                 *******************************/
+/*****************************  Export Writer  *******************************/
+/*****************************                 *******************************/
+
+
+// NOTE(Jesse): Formats into a fixed buffer and hands it to fwrite whenever it
+// fills up, so exports never hold more than DEBUG_EXPORT_BUFFER_SIZE of text.
+
+#define DEBUG_EXPORT_BUFFER_SIZE (Kilobytes(256))
+
+struct debug_export_writer
+{
+  FILE *File;
+  char *Buffer;
+  umm At;
+
+  u64 EventCount;
+  b32 Failed;
+};
+
+link_internal void
+FlushExport(debug_export_writer *Writer)
+{
+  if (Writer->At)
+  {
+    if (fwrite(Writer->Buffer, 1, Writer->At, Writer->File) != Writer->At) { Writer->Failed = True; }
+    Writer->At = 0;
+  }
+}
+
+link_internal void
+WriteExport(debug_export_writer *Writer, const char *Format, ...)
+{
+  for (u32 Attempt = 0; Attempt < 2; ++Attempt)
+  {
+    va_list Args;
+    va_start(Args, Format);
+    umm Remaining = DEBUG_EXPORT_BUFFER_SIZE - Writer->At;
+    s32 Count = vsnprintf(Writer->Buffer + Writer->At, Remaining, Format, Args);
+    va_end(Args);
+
+    if (Count < 0) { Writer->Failed = True; return; }
+    if ((umm)Count < Remaining) { Writer->At += (umm)Count; return; }
+
+    FlushExport(Writer);
+  }
+
+  Writer->Failed = True;
+}
+
+// NOTE(Jesse): Quotes and escapes; callsite names are whatever people typed
+link_internal void
+WriteJsonString(debug_export_writer *Writer, const char *String)
+{
+  if (DEBUG_EXPORT_BUFFER_SIZE - Writer->At < 2*Length(String) + 3) { FlushExport(Writer); }
+
+  Writer->Buffer[Writer->At++] = '"';
+  for (const char *C = String; *C && Writer->At < DEBUG_EXPORT_BUFFER_SIZE-8; ++C)
+  {
+    if (*C == '"' || *C == '\\')  { Writer->Buffer[Writer->At++] = '\\'; Writer->Buffer[Writer->At++] = *C; }
+    else if ((u8)*C < 0x20)       { Writer->Buffer[Writer->At++] = ' '; }
+    else                          { Writer->Buffer[Writer->At++] = *C; }
+  }
+  Writer->Buffer[Writer->At++] = '"';
+}
+
+// NOTE(Jesse): Starts an event object, up to and including the opening brace
+link_internal void
+BeginJsonEvent(debug_export_writer *Writer)
+{
+  WriteExport(Writer, Writer->EventCount++ ? ",\n{" : "\n{");
+}
+
+link_internal b32
+OpenExportWriter(debug_export_writer *Writer, const char *Path, memory_arena *Memory)
+{
+  Clear(Writer);
+
+  Writer->File = fopen(Path, "wb");
+  if (Writer->File)
+  {
+    Writer->Buffer = Allocate(char, Memory, DEBUG_EXPORT_BUFFER_SIZE);
+  }
+  else
+  {
+    Error("Couldn't open export file (%s)", Path);
+  }
+
+  b32 Result = Writer->File != 0;
+  return Result;
+}
+
+// NOTE(Jesse): False if any of it didn't make it to disk
+link_internal b32
+CloseExportWriter(debug_export_writer *Writer, const char *Path)
+{
+  FlushExport(Writer);
+
+  b32 Result = !Writer->Failed;
+  if (fclose(Writer->File) != 0) { Result = False; }
+  Writer->File = 0;
+
+  if (!Result) { Error("Couldn't write export file (%s)", Path); }
+  return Result;
+}
+
+
+
+/*****************************                *******************************/
+/*****************************  Frame Ranges  *******************************/
+/*****************************                *******************************/
+
+
+struct debug_export_frame
+{
+  u32 FrameId;
+  b32 First;
+  b32 Last;
+
+  u64 StartingCycle;
+  u64 EndingCycle;
+  r64 UsPerCycle;
+  r64 StartUs; // Since the first frame in the range
+};
+
+link_internal r64
+GetExportUs(debug_export_frame *Frame, u64 Cycle)
+{
+  r64 Result = Frame->StartUs + (r64(Cycle) - r64(Frame->StartingCycle)) * Frame->UsPerCycle;
+  return Result;
+}
+
+// NOTE(Jesse): Returns where the next frame starts
+link_internal r64
+InitExportFrame(debug_state *State, debug_export_frame *Frame, u32 FrameId, u32 FirstFrameId, u32 LastFrameId, r64 StartUs)
+{
+  frame_stats *Stats = State->Frames + GetFrameSlot(FrameId);
+
+  Frame->FrameId       = FrameId;
+  Frame->First         = FrameId == FirstFrameId;
+  Frame->Last          = FrameId == LastFrameId;
+  Frame->StartingCycle = Stats->StartingCycle;
+  Frame->EndingCycle   = Stats->StartingCycle + Stats->TotalCycles;
+  Frame->UsPerCycle    = Stats->NsPerCycle / 1000.0;
+  Frame->StartUs       = StartUs;
+
+  r64 Result = StartUs + r64(Stats->TotalCycles) * Frame->UsPerCycle;
+  return Result;
+}
+
+// NOTE(Jesse): Main thread only.  0, 0 is everything we still have.  The
+// range gets clamped to frames every thread has sealed and that won't get
+// recorded over while we write them out, so the profiler keeps running.
+link_internal b32
+ClampExportFrameRange(debug_state *State, u32 *FirstFrameId, u32 *LastFrameId)
+{
+  u32 WriteIndex = GetThreadLocalStateFor(0)->WriteIndex;
+  u32 Newest = WriteIndex > DEBUG_SEALED_FRAME_LAG+1 ? WriteIndex - DEBUG_SEALED_FRAME_LAG - 1 : 0;
+  u32 Oldest = WriteIndex > State->FramesTracked-2 ? WriteIndex - (State->FramesTracked-2) : 1;
+
+  if (*FirstFrameId == 0 && *LastFrameId == 0)
+  {
+    *FirstFrameId = Oldest;
+    *LastFrameId = Newest;
+  }
+
+  *FirstFrameId = Max(*FirstFrameId, Oldest);
+  *LastFrameId = Min(*LastFrameId, Newest);
+
+  b32 Result = *FirstFrameId <= *LastFrameId;
+  return Result;
+}
+
+/*****************************                *******************************/
+/*****************************  Chrome Trace  *******************************/
+/*****************************                *******************************/
+
+
+// NOTE(Jesse): The Trace Event Format that chrome://tracing, Perfetto and
+// speedscope all read.  Timestamps are microseconds from the start of the
+// first frame, each frame converted with its own NsPerCycle so a timestamp
+// mode change partway through doesn't wreck the timeline.
+//
+//   pid 1  One tid per thread, scopes.  Scopes that fit in a frame are X
+//          events; ones that straddle frames are B/E pairs, the E in
+//          whichever frame the scope actually ended in.  Scopes still open
+//          at the end of the range get an E there, marked truncated.
+//          Lock waits and holds go on a lane per thread next to it.
+//          Per frame counters.
+//   pid 2  One tid per CPU, which thread was running on it.
+
+#define DEBUG_CHROME_TRACE_THREADS_PID (1)
+#define DEBUG_CHROME_TRACE_CPUS_PID    (2)
+#define DEBUG_CHROME_TRACE_LOCK_TID    (1 << 16) // Plus the ThreadIndex
+
+link_internal void
+WriteChromeTraceScopes(debug_export_writer *Writer, debug_export_frame *Frame, debug_profile_scope *Scope, u32 ThreadIndex)
+{
+  while (Scope)
+  {
+    b32 Continued = (Scope->Flags & ScopeFlag_ContinuedFromPreviousFrame) != 0;
+    b32 Continues = (Scope->Flags & ScopeFlag_ContinuesIntoNextFrame) != 0;
+    const char *Name = GetCallsite(Scope)->Name;
+
+    if (!Continued && !Continues)
+    {
+      BeginJsonEvent(Writer);
+      WriteExport(Writer, "\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+          DEBUG_CHROME_TRACE_THREADS_PID, ThreadIndex, GetExportUs(Frame, Scope->StartingCycle),
+          r64(GetCycleCount(Scope)) * Frame->UsPerCycle);
+      WriteJsonString(Writer, Name);
+      if (Scope->Payload || Scope->SampleMask)
+      {
+        WriteExport(Writer, ",\"args\":{\"items\":%lu,\"sampled_one_in\":%u}", Scope->Payload, Scope->SampleMask + 1u);
+      }
+      WriteExport(Writer, "}");
+    }
+    else if (!Continued || Frame->First)
+    {
+      BeginJsonEvent(Writer);
+      WriteExport(Writer, "\"ph\":\"B\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"name\":",
+          DEBUG_CHROME_TRACE_THREADS_PID, ThreadIndex, GetExportUs(Frame, Scope->StartingCycle));
+      WriteJsonString(Writer, Name);
+      WriteExport(Writer, "}");
+    }
+
+    WriteChromeTraceScopes(Writer, Frame, Scope->Child, ThreadIndex);
+
+    if (Continued && !Continues)
+    {
+      BeginJsonEvent(Writer);
+      WriteExport(Writer, "\"ph\":\"E\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f}",
+          DEBUG_CHROME_TRACE_THREADS_PID, ThreadIndex, GetExportUs(Frame, Scope->EndingCycle));
+    }
+    else if (Continues && Frame->Last)
+    {
+      BeginJsonEvent(Writer);
+      WriteExport(Writer, "\"ph\":\"E\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"args\":{\"truncated\":true}}",
+          DEBUG_CHROME_TRACE_THREADS_PID, ThreadIndex, GetExportUs(Frame, Frame->EndingCycle));
+    }
+
+    Scope = Scope->Sibling;
+  }
+}
+
+link_internal u32
+FindMutexOp(mutex_op_array *MutexOps, u32 Count, u32 StartIndex, mutex *Mutex, mutex_op Op)
+{
+  u32 Result = Count;
+  for (u32 RecordIndex = StartIndex; RecordIndex < Count; ++RecordIndex)
+  {
+    mutex_op_record *Record = MutexOps->Records + RecordIndex;
+    if (Record->Mutex == Mutex && Record->Op == Op) { Result = RecordIndex; break; }
+  }
+  return Result;
+}
+
+// NOTE(Jesse): Waiting -> Aquired is a wait, Aquired -> Released a hold.
+// Ones whose other end isn't in this frame get left out.
+link_internal void
+WriteChromeTraceMutexOps(debug_export_writer *Writer, debug_export_frame *Frame, mutex_op_array *MutexOps, u32 ThreadIndex)
+{
+  u32 Count = Min(MutexOps->NextRecord, (u32)MUTEX_OPS_PER_FRAME);
+  for (u32 RecordIndex = 0; RecordIndex < Count; ++RecordIndex)
+  {
+    mutex_op_record *Record = MutexOps->Records + RecordIndex;
+
+    const char *Name = 0;
+    u32 EndIndex = Count;
+    switch (Record->Op)
+    {
+      case MutexOp_Waiting: { Name = "wait"; EndIndex = FindMutexOp(MutexOps, Count, RecordIndex+1, Record->Mutex, MutexOp_Aquired);  } break;
+      case MutexOp_Aquired: { Name = "held"; EndIndex = FindMutexOp(MutexOps, Count, RecordIndex+1, Record->Mutex, MutexOp_Released); } break;
+      default: {} break;
+    }
+
+    if (EndIndex < Count)
+    {
+      mutex_op_record *End = MutexOps->Records + EndIndex;
+      BeginJsonEvent(Writer);
+      WriteExport(Writer, "\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":\"%s\",\"args\":{\"mutex\":\"%p\"}}",
+          DEBUG_CHROME_TRACE_THREADS_PID, DEBUG_CHROME_TRACE_LOCK_TID + ThreadIndex,
+          GetExportUs(Frame, Record->Cycle), r64(End->Cycle - Record->Cycle) * Frame->UsPerCycle,
+          Name, (void*)Record->Mutex);
+    }
+  }
+}
+
+// NOTE(Jesse): The stream covers more than the range, so we clip to it.  An
+// On and the next event for the same thread bound the time it ran.
+link_internal void
+WriteChromeTraceContextSwitches(debug_export_writer *Writer, debug_export_frame *First, debug_export_frame *Last, debug_context_switch_event_buffer_stream *Stream, u32 ThreadIndex)
+{
+  debug_context_switch_event *Prev = 0;
+  for ( debug_context_switch_event_buffer_stream_block *Block = Stream->FirstBlock;
+                                                        Block;
+                                                        Block = Block->Next )
+  {
+    debug_context_switch_event_buffer *Buffer = &Block->Buffer;
+    for (u32 EventIndex = 0; EventIndex < Buffer->At; ++EventIndex)
+    {
+      debug_context_switch_event *Event = Buffer->Events + EventIndex;
+
+      if ( Prev && Prev->Type == ContextSwitch_On &&
+           Event->CycleCount > First->StartingCycle && Prev->CycleCount < Last->EndingCycle )
+      {
+        u64 Start = Max(Prev->CycleCount, First->StartingCycle);
+        u64 End = Min(Event->CycleCount, Last->EndingCycle);
+
+        // NOTE(Jesse): Not worth converting per frame; the ETW clock isn't
+        // necessarily ours anyway.
+        BeginJsonEvent(Writer);
+        WriteExport(Writer, "\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":\"Thread %u\"}",
+            DEBUG_CHROME_TRACE_CPUS_PID, Prev->ProcessorNumber,
+            GetExportUs(First, Start), r64(End - Start) * Last->UsPerCycle, ThreadIndex);
+      }
+
+      Prev = Event;
+    }
+  }
+}
+
+link_internal void
+WriteChromeTraceMetadata(debug_export_writer *Writer, u32 Pid, u32 Tid, const char *Kind, const char *Name)
+{
+  BeginJsonEvent(Writer);
+  WriteExport(Writer, "\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"name\":\"%s\",\"args\":{\"name\":", Pid, Tid, Kind);
+  WriteJsonString(Writer, Name);
+  WriteExport(Writer, "}}");
+}
+
+link_internal b32
+ExportChromeTrace(const char *Path, u32 FirstFrameId, u32 LastFrameId)
+{
+  TIMED_FUNCTION();
+
+  debug_state *State = GetDebugState();
+
+  b32 Result = ClampExportFrameRange(State, &FirstFrameId, &LastFrameId);
+  if (!Result) { Error("None of the frames asked for are available to export"); return False; }
+
+  memory_arena *ExportArena = AllocateArena(DEBUG_EXPORT_BUFFER_SIZE + Kilobytes(64));
+
+  debug_export_writer Writer;
+  Result = OpenExportWriter(&Writer, Path, ExportArena);
+  if (Result)
+  {
+    WriteExport(&Writer, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    u32 TotalThreadCount = GetTotalThreadCount();
+    WriteChromeTraceMetadata(&Writer, DEBUG_CHROME_TRACE_THREADS_PID, 0, "process_name", "Threads");
+    WriteChromeTraceMetadata(&Writer, DEBUG_CHROME_TRACE_CPUS_PID, 0, "process_name", "CPUs");
+    for (u32 ThreadIndex = 0; ThreadIndex < TotalThreadCount; ++ThreadIndex)
+    {
+      char Name[64];
+      snprintf(Name, sizeof(Name), "Thread %u (%u)", ThreadIndex, GetThreadLocalStateFor(ThreadIndex)->ThreadId);
+      WriteChromeTraceMetadata(&Writer, DEBUG_CHROME_TRACE_THREADS_PID, ThreadIndex, "thread_name", Name);
+
+      snprintf(Name, sizeof(Name), "Locks %u", ThreadIndex);
+      WriteChromeTraceMetadata(&Writer, DEBUG_CHROME_TRACE_THREADS_PID, DEBUG_CHROME_TRACE_LOCK_TID + ThreadIndex, "thread_name", Name);
+    }
+
+    debug_export_frame FirstFrame = {};
+    debug_export_frame Frame = {};
+    r64 StartUs = 0.0;
+
+    for ( u32 FrameId = FirstFrameId;
+              FrameId <= LastFrameId;
+            ++FrameId )
+    {
+      frame_stats *Stats = State->Frames + GetFrameSlot(FrameId);
+
+      r64 NextStartUs = InitExportFrame(State, &Frame, FrameId, FirstFrameId, LastFrameId, StartUs);
+      if (Frame.First) { FirstFrame = Frame; }
+
+      BeginJsonEvent(&Writer);
+      WriteExport(&Writer, "\"ph\":\"C\",\"pid\":%u,\"tid\":0,\"ts\":%.3f,\"name\":\"Frame\",\"args\":{\"ms\":%.3f,\"scopes\":%u,\"mutex_ops\":%u,\"context_switches\":%u,\"dropped\":%u}}",
+          DEBUG_CHROME_TRACE_THREADS_PID, StartUs, r64(Stats->FrameMs),
+          Stats->Counters.Scopes, Stats->Counters.MutexOps, Stats->Counters.ContextSwitches, Stats->Counters.Dropped);
+
+      for (u32 ThreadIndex = 0; ThreadIndex < TotalThreadCount; ++ThreadIndex)
+      {
+        debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadIndex);
+        debug_scope_tree *Tree = ThreadState->ScopeTrees + GetFrameSlot(FrameId);
+
+        if (Tree->Closed && Tree->FrameRecorded == FrameId)
+        {
+          BuildScopeTree(ThreadState, Tree);
+          WriteChromeTraceScopes(&Writer, &Frame, Tree->Root, ThreadIndex);
+          WriteChromeTraceMutexOps(&Writer, &Frame, ThreadState->MutexOps + GetFrameSlot(FrameId), ThreadIndex);
+        }
+      }
+
+      StartUs = NextStartUs;
+    }
+
+    for (u32 ThreadIndex = 0; ThreadIndex < TotalThreadCount; ++ThreadIndex)
+    {
+      WriteChromeTraceContextSwitches(&Writer, &FirstFrame, &Frame, GetThreadLocalStateFor(ThreadIndex)->ContextSwitches, ThreadIndex);
+    }
+
+    WriteExport(&Writer, "\n]}\n");
+    Result = CloseExportWriter(&Writer, Path);
+  }
+
+  VaporizeArena(ExportArena);
+
+  return Result;
+}
+
+
+
+/*****************************                *******************************/
+/*****************************  Flame Graphs  *******************************/
+/*****************************                *******************************/
+
+
+// NOTE(Jesse): Collapsed stacks, for flamegraph.pl and friends, and
+// speedscope's evented format, out of the same walk over every threads trees.
+// The walk goes a thread at a time so speedscope's per-thread event lists can
+// be streamed as we go.  The collapsed stacks get merged into a call path
+// table along the way and written out at the end, one line per path with
+// its self time in nanoseconds:
+//
+//   Thread 0;Main;DebugFrameEnd;Draw Debug Menu 12345
+//
+// Scopes that straddle frames are counted once, in the frame they end in,
+// clipped to the start of the range; ones still open at the end of the range
+// are counted up to there.
+
+#define DEBUG_FLAME_GRAPH_MAX_NODES (1 << 16)
+#define DEBUG_FLAME_GRAPH_MAX_DEPTH (256)
+
+// NOTE(Jesse): Indexed by Paths.  Thread roots are keyed by a Parent of 0 and
+// the ThreadIndex in place of a CallsiteId.  Node 0 is nothing.
+struct debug_flame_graph_node
+{
+  r64 TotalNs;
+  r64 ChildNs;
+};
+
+struct debug_flame_graph_pass
+{
+  debug_flame_graph_node *Nodes;
+  debug_call_path_table Paths;
+  u32 ScopesDropped; // Table was full
+
+  u64 RangeStartingCycle;
+
+  // NOTE(Jesse): Speedscope, when it's wanted
+  debug_export_writer *Speedscope;
+  u16 *SpeedscopeFrames;    // Indexed by callsite id, index into the shared frames +1
+  u16 *SpeedscopeCallsites; // The other way
+  u32 SpeedscopeFrameCount;
+
+  u16 OpenCallsites[DEBUG_FLAME_GRAPH_MAX_DEPTH]; // Scopes left open at the end of the last frame
+  u32 OpenDepth;
+  r64 LastAtNs;
+};
+
+link_internal void
+WriteSpeedscopeEvent(debug_flame_graph_pass *Pass, const char *Type, u16 CallsiteId, r64 AtNs)
+{
+  u32 FrameIndex = Pass->SpeedscopeFrames[CallsiteId];
+  if (FrameIndex == 0)
+  {
+    FrameIndex = ++Pass->SpeedscopeFrameCount;
+    Pass->SpeedscopeFrames[CallsiteId] = (u16)FrameIndex;
+    Pass->SpeedscopeCallsites[FrameIndex-1] = CallsiteId;
+  }
+
+  // NOTE(Jesse): Speedscope wants these in order; only a timestamp mode
+  // change between frames would put them out of it.
+  Pass->LastAtNs = Max(Pass->LastAtNs, AtNs);
+
+  BeginJsonEvent(Pass->Speedscope);
+  WriteExport(Pass->Speedscope, "\"type\":\"%s\",\"frame\":%u,\"at\":%.0f}", Type, FrameIndex-1, Pass->LastAtNs);
+}
+
+// NOTE(Jesse): Scopes left open at the end of a frame are the chain down the
+// left edge of the next one, so the depth of what's open is all we need to
+// know whether a continued scope still needs its open event.
+link_internal void
+AccumulateFlameGraphScopes(debug_flame_graph_pass *Pass, debug_export_frame *Frame, debug_profile_scope *Scope, u32 ParentNode, u32 Depth)
+{
+  while (Scope)
+  {
+    b32 Continued = (Scope->Flags & ScopeFlag_ContinuedFromPreviousFrame) != 0;
+    b32 Continues = (Scope->Flags & ScopeFlag_ContinuesIntoNextFrame) != 0;
+
+    u64 StartingCycle = Continued ? Max(Scope->StartingCycle, Pass->RangeStartingCycle) : Scope->StartingCycle;
+    u64 EndingCycle = Continues ? Frame->EndingCycle : Scope->EndingCycle;
+
+    u32 Node = ParentNode ? GetCallPath(&Pass->Paths, ParentNode, Scope->CallsiteId) : 0;
+    if (!Node) { ++Pass->ScopesDropped; }
+
+    if ((!Continues || Frame->Last) && EndingCycle > StartingCycle)
+    {
+      r64 Ns = r64(EndingCycle - StartingCycle) * Frame->UsPerCycle * 1000.0;
+      Pass->Nodes[Node].TotalNs += Ns;
+      Pass->Nodes[ParentNode].ChildNs += Ns;
+    }
+
+    b32 Evented = Pass->Speedscope && Depth < DEBUG_FLAME_GRAPH_MAX_DEPTH;
+    if (Evented && (!Continued || Depth >= Pass->OpenDepth))
+    {
+      WriteSpeedscopeEvent(Pass, "O", Scope->CallsiteId, GetExportUs(Frame, StartingCycle) * 1000.0);
+      if (Continues)
+      {
+        Pass->OpenCallsites[Depth] = Scope->CallsiteId;
+        Pass->OpenDepth = Depth+1;
+      }
+    }
+
+    AccumulateFlameGraphScopes(Pass, Frame, Scope->Child, Node, Depth+1);
+
+    if (Evented && !Continues)
+    {
+      WriteSpeedscopeEvent(Pass, "C", Scope->CallsiteId, GetExportUs(Frame, EndingCycle) * 1000.0);
+      if (Continued) { Pass->OpenDepth = Min(Pass->OpenDepth, Depth); }
+    }
+
+    Scope = Scope->Sibling;
+  }
+}
+
+// NOTE(Jesse): flamegraph.pl splits frames on ';' and the count off of the
+// last space, so names get the former swapped out.
+link_internal void
+WriteFoldedName(debug_export_writer *Writer, const char *Name)
+{
+  if (DEBUG_EXPORT_BUFFER_SIZE - Writer->At < Length(Name) + 2) { FlushExport(Writer); }
+
+  for (const char *C = Name; *C && Writer->At < DEBUG_EXPORT_BUFFER_SIZE-2; ++C)
+  {
+    Writer->Buffer[Writer->At++] = (*C == ';' || (u8)*C < 0x20) ? ' ' : *C;
+  }
+}
+
+link_internal void
+WriteFoldedStacks(debug_export_writer *Writer, debug_flame_graph_pass *Pass)
+{
+  u32 Path[DEBUG_FLAME_GRAPH_MAX_DEPTH];
+
+  for ( u32 NodeIndex = 1;
+            NodeIndex < Pass->Paths.Count;
+          ++NodeIndex )
+  {
+    debug_flame_graph_node *Node = Pass->Nodes + NodeIndex;
+    if (Pass->Paths.Paths[NodeIndex].Parent == 0) continue;
+
+    r64 SelfNs = Node->TotalNs - Node->ChildNs;
+    if (SelfNs < 1.0) continue;
+
+    u32 Depth = 0;
+    for ( u32 PathNode = NodeIndex;
+              PathNode && Depth < DEBUG_FLAME_GRAPH_MAX_DEPTH;
+              PathNode = Pass->Paths.Paths[PathNode].Parent )
+    {
+      Path[Depth++] = PathNode;
+    }
+
+    for (u32 PathIndex = Depth; PathIndex-- > 0;)
+    {
+      debug_call_path *PathNode = Pass->Paths.Paths + Path[PathIndex];
+      if (PathNode->Parent)
+      {
+        WriteExport(Writer, ";");
+        WriteFoldedName(Writer, GetCallsite(PathNode->CallsiteId)->Name);
+      }
+      else
+      {
+        WriteExport(Writer, "Thread %u", PathNode->CallsiteId);
+      }
+    }
+
+    WriteExport(Writer, " %lu\n", u64(SelfNs));
+  }
+}
+
+link_internal void
+WriteSpeedscopeFrames(debug_export_writer *Writer, debug_flame_graph_pass *Pass)
+{
+  WriteExport(Writer, "],\"shared\":{\"frames\":[");
+  for ( u32 FrameIndex = 0;
+            FrameIndex < Pass->SpeedscopeFrameCount;
+          ++FrameIndex )
+  {
+    debug_scope_callsite *Callsite = GetCallsite(Pass->SpeedscopeCallsites[FrameIndex]);
+    WriteExport(Writer, FrameIndex ? ",\n{\"name\":" : "\n{\"name\":");
+    WriteJsonString(Writer, Callsite->Name);
+    WriteExport(Writer, ",\"file\":");
+    WriteJsonString(Writer, Callsite->File ? Callsite->File : "");
+    WriteExport(Writer, ",\"line\":%u}", Callsite->Line);
+  }
+  WriteExport(Writer, "\n]}}\n");
+}
+
+// NOTE(Jesse): Main thread only.  Either path can be 0 to skip that one.  If
+// one of the two can't be written the other still is; the result is whether
+// both made it.
+link_internal b32
+ExportFlameGraph(const char *FoldedPath, const char *SpeedscopePath, u32 FirstFrameId, u32 LastFrameId)
+{
+  TIMED_FUNCTION();
+
+  debug_state *State = GetDebugState();
+
+  b32 Result = ClampExportFrameRange(State, &FirstFrameId, &LastFrameId);
+  if (!Result) { Error("None of the frames asked for are available to export"); return False; }
+
+  memory_arena *ExportArena = AllocateArena(Megabytes(4));
+
+  debug_flame_graph_pass Pass = {};
+  Pass.Nodes = Allocate(debug_flame_graph_node, ExportArena, DEBUG_FLAME_GRAPH_MAX_NODES);
+  InitCallPathTable(&Pass.Paths, DEBUG_FLAME_GRAPH_MAX_NODES, ExportArena);
+  ResetCallPathTable(&Pass.Paths);
+  Pass.RangeStartingCycle = State->Frames[GetFrameSlot(FirstFrameId)].StartingCycle;
+
+  debug_export_writer Speedscope;
+  if (SpeedscopePath)
+  {
+    if (OpenExportWriter(&Speedscope, SpeedscopePath, ExportArena))
+    {
+      Pass.Speedscope = &Speedscope;
+      Pass.SpeedscopeFrames = Allocate(u16, ExportArena, MAX_DEBUG_SCOPE_CALLSITES);
+      Pass.SpeedscopeCallsites = Allocate(u16, ExportArena, MAX_DEBUG_SCOPE_CALLSITES);
+
+      WriteExport(&Speedscope, "{\"$schema\":\"https://www.speedscope.app/file-format-schema.json\",\"exporter\":\"bonsai_debug\",\"name\":\"Frames %u to %u\",\"activeProfileIndex\":0,\"profiles\":[", FirstFrameId, LastFrameId);
+    }
+    else
+    {
+      Result = False;
+    }
+  }
+
+  u32 TotalThreadCount = GetTotalThreadCount();
+  for ( u32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadIndex);
+    u32 ThreadNode = GetCallPath(&Pass.Paths, 0, (u16)ThreadIndex);
+
+    Pass.OpenDepth = 0;
+    Pass.LastAtNs = 0.0;
+    if (Pass.Speedscope)
+    {
+      Speedscope.EventCount = 0;
+      WriteExport(&Speedscope, "%s{\"type\":\"evented\",\"name\":\"Thread %u\",\"unit\":\"nanoseconds\",\"startValue\":0,\"events\":[", ThreadIndex ? ",\n" : "\n", ThreadIndex);
+    }
+
+    debug_export_frame Frame = {};
+    r64 StartUs = 0.0;
+    for ( u32 FrameId = FirstFrameId;
+              FrameId <= LastFrameId;
+            ++FrameId )
+    {
+      r64 NextStartUs = InitExportFrame(State, &Frame, FrameId, FirstFrameId, LastFrameId, StartUs);
+
+      debug_scope_tree *Tree = ThreadState->ScopeTrees + GetFrameSlot(FrameId);
+      if (Tree->Closed && Tree->FrameRecorded == FrameId)
+      {
+        BuildScopeTree(ThreadState, Tree);
+        AccumulateFlameGraphScopes(&Pass, &Frame, Tree->Root, ThreadNode, 0);
+      }
+
+      StartUs = NextStartUs;
+    }
+
+    if (Pass.Speedscope)
+    {
+      r64 EndNs = StartUs * 1000.0;
+      while (Pass.OpenDepth)
+      {
+        WriteSpeedscopeEvent(&Pass, "C", Pass.OpenCallsites[--Pass.OpenDepth], EndNs);
+      }
+      WriteExport(&Speedscope, "\n],\"endValue\":%.0f}", Max(EndNs, Pass.LastAtNs));
+    }
+  }
+
+  if (Pass.Speedscope)
+  {
+    WriteSpeedscopeFrames(&Speedscope, &Pass);
+    Result &= CloseExportWriter(&Speedscope, SpeedscopePath);
+  }
+
+  if (FoldedPath)
+  {
+    debug_export_writer Folded;
+    if (OpenExportWriter(&Folded, FoldedPath, ExportArena))
+    {
+      WriteFoldedStacks(&Folded, &Pass);
+      Result &= CloseExportWriter(&Folded, FoldedPath);
+    }
+    else
+    {
+      Result = False;
+    }
+  }
+
+  if (Pass.ScopesDropped)
+  {
+    Warn("Flame graph export ran out of call paths; %u scopes were left out of the collapsed stacks", Pass.ScopesDropped);
+  }
+
+  VaporizeArena(ExportArena);
+
+  return Result;
+}
@@ -0,0 +1,1072 @@
+#include <stdio.h>
+
+#include <time.h>
+
+#if !BONSAI_WIN32
+#include <pthread.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#endif
+
+/******************************                *******************************/
+/******************************  Trace Writer  *******************************/
+/******************************                *******************************/
+
+
+// NOTE(Jesse): File format
+//
+// A header, "BDTR" and a u32 version, followed by records.  Every record
+// starts with a debug_trace_record_type byte; everything after that is a
+// LEB128 varint, signed values zigzagged, unless it says otherwise.
+// debug_capture.cpp reads it back.
+//
+//   Callsite       Id, Line, Category, Name length, Name, File length, File
+//                  Written once, before the first event that refers to it.
+//
+//   Frame          FrameId, StartingCycle, TotalCycles,
+//                  NsPerCycle (raw r64), FrameMs (raw r32)
+//                  Everything up to the next Frame record belongs to it, and
+//                  none of it is relative to anything before it, so any frame
+//                  can be decoded by itself.
+//
+//   ScopeEvents    ThreadIndex, EventCount, then per event
+//                    (Cycle delta << 2) | Type   (signed for the delta)
+//                    CallsiteId, SampleMask      Begin only
+//                  Cycles are relative to the threads previous event in the
+//                  frame, the first to the frames StartingCycle.  Payload
+//                  events carry their count in place of the delta.  A lone
+//                  0 is a None event, a slot a crash dump found half
+//                  written, and doesn't mean anything.
+//
+//   MutexOps       ThreadIndex, Count, then per op
+//                    Op, Cycle delta (signed), Mutex address delta (signed)
+//                  Relative to the frames StartingCycle and the last address
+//                  in the frame.
+//
+//   ContextSwitches  Count, then per switch
+//                    ThreadIndex, Type, ProcessorNumber, Cycle delta (signed)
+//                  In whatever units ETW stamps them with, relative to the
+//                  frames StartingCycle and then the previous switch.
+//
+//   Index          Written when the capture is closed, not by the crash
+//                  handler.  Callsite count, every callsite (same as above,
+//                  without the record type), zeroes up to an 8 byte boundary,
+//                  a debug_capture_frame_index per frame, and finally a
+//                  debug_capture_trailer, which is the end of the file.
+//
+// Scopes that straddle frames show up as a Begin in one ScopeEvents record
+// and the End in a later one, same as they're recorded.  Version 1 files had
+// the Frame record and the mutex and context switch deltas relative to the
+// frame before.
+
+link_internal void WritePerfettoFrameData(debug_trace_writer *Writer, debug_trace_frame *Frame);
+
+link_internal void
+FlushTraceBuffer(debug_trace_writer *Writer)
+{
+  if (Writer->BufferAt)
+  {
+    umm Written = 0;
+#if !BONSAI_WIN32
+    if (Writer->Fd > 0)
+    {
+      ssize_t Result = write(Writer->Fd, Writer->Buffer, Writer->BufferAt);
+      Written = Result > 0 ? (umm)Result : 0;
+    }
+    else
+#endif
+    {
+      Written = fwrite(Writer->Buffer, 1, Writer->BufferAt, (FILE*)Writer->File);
+    }
+
+    if (Written != Writer->BufferAt) { AtomicIncrement(&Writer->WriteErrors); }
+
+    Writer->BytesWritten += Written;
+    Writer->BufferAt = 0;
+  }
+}
+
+// NOTE(Jesse): Records never get split across flushes, so whoever starts one
+// asks for enough room for all of it up front.
+link_internal void
+ReserveTraceBuffer(debug_trace_writer *Writer, umm Bytes)
+{
+  Assert(Bytes <= DEBUG_TRACE_BUFFER_SIZE);
+  if (Writer->BufferAt + Bytes > DEBUG_TRACE_BUFFER_SIZE)
+  {
+    FlushTraceBuffer(Writer);
+  }
+}
+
+link_internal void
+WriteTraceU8(debug_trace_writer *Writer, u8 Value)
+{
+  Writer->Buffer[Writer->BufferAt++] = Value;
+}
+
+link_internal void
+WriteTraceBytes(debug_trace_writer *Writer, void *Bytes, umm Count)
+{
+  MemCopy((u8*)Bytes, Writer->Buffer + Writer->BufferAt, Count);
+  Writer->BufferAt += Count;
+}
+
+link_internal void
+WriteTraceVarint(debug_trace_writer *Writer, u64 Value)
+{
+  while (Value >= 0x80)
+  {
+    WriteTraceU8(Writer, u8(Value | 0x80));
+    Value >>= 7;
+  }
+  WriteTraceU8(Writer, u8(Value));
+}
+
+link_internal void
+WriteTraceSigned(debug_trace_writer *Writer, s64 Value)
+{
+  u64 ZigZag = (u64(Value) << 1) ^ u64(Value >> 63);
+  WriteTraceVarint(Writer, ZigZag);
+}
+
+link_internal void
+WriteTraceString(debug_trace_writer *Writer, const char *String)
+{
+  u32 Count = String ? (u32)Min(Length(String), (umm)255) : 0;
+  WriteTraceVarint(Writer, Count);
+  WriteTraceBytes(Writer, (void*)String, Count);
+}
+
+link_internal u64
+GetTraceFileOffset(debug_trace_writer *Writer)
+{
+  u64 Result = Writer->BytesWritten + Writer->BufferAt;
+  return Result;
+}
+
+link_internal void
+WriteTraceCallsiteBody(debug_trace_writer *Writer, u16 CallsiteId)
+{
+  debug_scope_callsite *Callsite = GetCallsite(CallsiteId);
+
+  WriteTraceVarint(Writer, CallsiteId);
+  WriteTraceVarint(Writer, Callsite->Line);
+  WriteTraceVarint(Writer, Callsite->Category);
+  WriteTraceString(Writer, Callsite->Name);
+  WriteTraceString(Writer, Callsite->File);
+}
+
+link_internal void
+WriteTraceCallsite(debug_trace_writer *Writer, u16 CallsiteId)
+{
+  if (Writer->CallsiteWritten[CallsiteId]) return;
+  Writer->CallsiteWritten[CallsiteId] = True;
+
+  ReserveTraceBuffer(Writer, 1 + 3*10 + 2*(2 + 255));
+  WriteTraceU8(Writer, TraceRecord_Callsite);
+  WriteTraceCallsiteBody(Writer, CallsiteId);
+}
+
+// NOTE(Jesse): Everything in here is already in the file somewhere; it's for
+// readers that want to get at a frame without reading what came before it.
+link_internal void
+WriteCaptureIndex(debug_trace_writer *Writer)
+{
+  u64 IndexOffset = GetTraceFileOffset(Writer);
+  if (Writer->LastIndexed) { Writer->LastIndexed->Size = IndexOffset - Writer->LastIndexed->Offset; }
+
+  u32 CallsiteCount = 0;
+  for (u32 CallsiteIndex = 0; CallsiteIndex < MAX_DEBUG_SCOPE_CALLSITES; ++CallsiteIndex)
+  {
+    if (Writer->CallsiteWritten[CallsiteIndex]) { ++CallsiteCount; }
+  }
+
+  ReserveTraceBuffer(Writer, 1 + 10);
+  WriteTraceU8(Writer, TraceRecord_Index);
+  WriteTraceVarint(Writer, CallsiteCount);
+
+  for (u32 CallsiteIndex = 0; CallsiteIndex < MAX_DEBUG_SCOPE_CALLSITES; ++CallsiteIndex)
+  {
+    if (Writer->CallsiteWritten[CallsiteIndex])
+    {
+      ReserveTraceBuffer(Writer, 3*10 + 2*(2 + 255));
+      WriteTraceCallsiteBody(Writer, (u16)CallsiteIndex);
+    }
+  }
+
+  ReserveTraceBuffer(Writer, 8);
+  while (GetTraceFileOffset(Writer) % 8) { WriteTraceU8(Writer, 0); }
+
+  debug_capture_trailer Trailer = {};
+  Trailer.IndexOffset      = IndexOffset;
+  Trailer.FrameIndexOffset = GetTraceFileOffset(Writer);
+  Trailer.Magic            = DEBUG_CAPTURE_TRAILER_MAGIC;
+
+  // NOTE(Jesse): Blocks past the current one are left over from an earlier capture
+  for ( debug_capture_index_block *Block = Writer->CurrentIndexBlock ? Writer->FirstIndexBlock : 0;
+                                   Block;
+                                   Block = Block->Next )
+  {
+    for (u32 FrameIndex = 0; FrameIndex < Block->Count; ++FrameIndex)
+    {
+      ReserveTraceBuffer(Writer, sizeof(debug_capture_frame_index));
+      WriteTraceBytes(Writer, Block->Frames + FrameIndex, sizeof(debug_capture_frame_index));
+      ++Trailer.FrameCount;
+    }
+
+    if (Block == Writer->CurrentIndexBlock) break;
+  }
+
+  ReserveTraceBuffer(Writer, sizeof(Trailer));
+  WriteTraceBytes(Writer, &Trailer, sizeof(Trailer));
+}
+
+link_internal void
+PushCaptureIndexEntry(debug_trace_writer *Writer, debug_trace_frame *Frame, u64 Offset)
+{
+  debug_capture_index_block *Block = Writer->CurrentIndexBlock;
+  if (!Block || Block->Count == DEBUG_CAPTURE_INDEX_BLOCK_FRAMES)
+  {
+    debug_capture_index_block *Next = Block ? Block->Next : Writer->FirstIndexBlock;
+    if (!Next)
+    {
+      Next = Allocate(debug_capture_index_block, Writer->IndexMemory, 1);
+      if (Block) { Block->Next = Next; }
+      else       { Writer->FirstIndexBlock = Next; }
+    }
+
+    Next->Count = 0;
+    Writer->CurrentIndexBlock = Block = Next;
+  }
+
+  if (Writer->LastIndexed) { Writer->LastIndexed->Size = Offset - Writer->LastIndexed->Offset; }
+
+  debug_capture_frame_index *Entry = Block->Frames + Block->Count++;
+  Entry->FrameId       = Frame->FrameId;
+  Entry->FrameMs       = Frame->FrameMs;
+  Entry->Offset        = Offset;
+  Entry->Size          = 0;
+  Entry->StartingCycle = Frame->StartingCycle;
+  Entry->TotalCycles   = Frame->TotalCycles;
+  Entry->NsPerCycle    = Frame->NsPerCycle;
+
+  Writer->LastIndexed = Entry;
+}
+
+link_internal void
+WriteTraceFrame(debug_trace_writer *Writer, debug_trace_frame *Frame)
+{
+  ReserveTraceBuffer(Writer, 1 + 3*10 + sizeof(r64) + sizeof(r32));
+  if (Writer->WriteIndex) { PushCaptureIndexEntry(Writer, Frame, GetTraceFileOffset(Writer)); }
+
+  WriteTraceU8(Writer, TraceRecord_Frame);
+  WriteTraceVarint(Writer, Frame->FrameId);
+  WriteTraceVarint(Writer, Frame->StartingCycle);
+  WriteTraceVarint(Writer, Frame->TotalCycles);
+  WriteTraceBytes(Writer, &Frame->NsPerCycle, sizeof(r64));
+  WriteTraceBytes(Writer, &Frame->FrameMs, sizeof(r32));
+
+  Writer->LastContextSwitchCycle = Frame->StartingCycle;
+  Writer->LastMutex = 0;
+}
+
+// NOTE(Jesse): Encodes straight out of the owning threads ring, which keeps
+// getting written while we do it.  If it lapped us by the time we're done we
+// take the chunk back out of the buffer and count it as lost.
+link_internal void
+WriteTraceScopeEvents(debug_trace_writer *Writer, debug_thread_state *ThreadState, u32 ThreadIndex, u64 FirstEvent, u64 OnePastLastEvent, u64 StartingCycle)
+{
+  debug_scope_event_ring *Ring = ThreadState->ScopeEvents;
+
+  u64 LastCycle = StartingCycle;
+  for ( u64 ChunkStart = FirstEvent;
+            ChunkStart < OnePastLastEvent;
+            ChunkStart += DEBUG_TRACE_CHUNK_EVENTS )
+  {
+    u64 ChunkEnd = Min(OnePastLastEvent, ChunkStart + DEBUG_TRACE_CHUNK_EVENTS);
+    u64 EventCount = ChunkEnd - ChunkStart;
+
+    if (ScopeEventsOverwritten(Ring, ChunkStart))
+    {
+      Writer->EventsLost += EventCount;
+      continue;
+    }
+
+    for ( u64 EventIndex = ChunkStart;
+              EventIndex < ChunkEnd;
+            ++EventIndex )
+    {
+      debug_scope_event *Event = Ring->Events + (EventIndex & Ring->Mask);
+      if (Event->Type == ScopeEvent_Begin) { WriteTraceCallsite(Writer, Event->CallsiteId); }
+    }
+
+    ReserveTraceBuffer(Writer, 1 + 2*10 + EventCount*(10 + 3 + 3));
+    umm RecordStart = Writer->BufferAt;
+    u64 RecordLastCycle = LastCycle;
+
+    WriteTraceU8(Writer, TraceRecord_ScopeEvents);
+    WriteTraceVarint(Writer, ThreadIndex);
+    WriteTraceVarint(Writer, EventCount);
+
+    for ( u64 EventIndex = ChunkStart;
+              EventIndex < ChunkEnd;
+            ++EventIndex )
+    {
+      debug_scope_event *Event = Ring->Events + (EventIndex & Ring->Mask);
+      switch (Event->Type)
+      {
+        case ScopeEvent_Begin:
+        case ScopeEvent_End:
+        {
+          s64 Delta = s64(Event->Cycle - LastCycle);
+          LastCycle = Event->Cycle;
+
+          u64 ZigZag = (u64(Delta) << 1) ^ u64(Delta >> 63);
+          WriteTraceVarint(Writer, (ZigZag << 2) | Event->Type);
+
+          if (Event->Type == ScopeEvent_Begin)
+          {
+            WriteTraceVarint(Writer, Event->CallsiteId);
+            WriteTraceVarint(Writer, Event->SampleMask);
+          }
+        } break;
+
+        case ScopeEvent_Payload:
+        {
+          WriteTraceVarint(Writer, (Event->Cycle << 2) | Event->Type);
+        } break;
+
+        // NOTE(Jesse): Only the crash handler reads slots that can still be
+        // getting written; the count's already out so they go in as None.
+        default:
+        {
+          WriteTraceVarint(Writer, ScopeEvent_None);
+        } break;
+      }
+    }
+
+    if (ScopeEventsOverwritten(Ring, ChunkStart))
+    {
+      Writer->BufferAt = RecordStart;
+      LastCycle = RecordLastCycle;
+      Writer->EventsLost += EventCount;
+    }
+  }
+}
+
+link_internal void
+WriteTraceMutexOps(debug_trace_writer *Writer, debug_thread_state *ThreadState, debug_scope_tree *Tree, u32 ThreadIndex, u32 FrameId, u64 StartingCycle)
+{
+  mutex_op_array *MutexOps = ThreadState->MutexOps + GetFrameSlot(FrameId);
+  u32 Count = Min(MutexOps->NextRecord, (u32)MUTEX_OPS_PER_FRAME);
+  if (Count == 0) return;
+
+  ReserveTraceBuffer(Writer, 1 + 2*10 + Count*(1 + 2*10));
+  umm RecordStart = Writer->BufferAt;
+  u64 RecordLastMutex = Writer->LastMutex;
+
+  WriteTraceU8(Writer, TraceRecord_MutexOps);
+  WriteTraceVarint(Writer, ThreadIndex);
+  WriteTraceVarint(Writer, Count);
+
+  u64 LastCycle = StartingCycle;
+  for ( u32 RecordIndex = 0;
+            RecordIndex < Count;
+          ++RecordIndex )
+  {
+    mutex_op_record *Record = MutexOps->Records + RecordIndex;
+    WriteTraceU8(Writer, u8(Record->Op));
+    WriteTraceSigned(Writer, s64(Record->Cycle - LastCycle));
+    WriteTraceSigned(Writer, s64(u64(Record->Mutex) - Writer->LastMutex));
+
+    LastCycle = Record->Cycle;
+    Writer->LastMutex = u64(Record->Mutex);
+  }
+
+  // NOTE(Jesse): The thread reset the slot for a new frame under us
+  if (Tree->FrameRecorded != FrameId)
+  {
+    Writer->BufferAt = RecordStart;
+    Writer->LastMutex = RecordLastMutex;
+    AtomicIncrement(&Writer->MutexFramesLost);
+  }
+}
+
+link_internal void
+WriteTraceContextSwitches(debug_trace_writer *Writer)
+{
+  u32 WriteAt = Writer->ContextSwitchWriteAt;
+  u32 ReadAt = Writer->ContextSwitchReadAt;
+
+  while (ReadAt != WriteAt)
+  {
+    u32 Count = Min(WriteAt - ReadAt, (u32)DEBUG_TRACE_CHUNK_EVENTS);
+
+    ReserveTraceBuffer(Writer, 1 + 10 + Count*4*10);
+    WriteTraceU8(Writer, TraceRecord_ContextSwitches);
+    WriteTraceVarint(Writer, Count);
+
+    for ( u32 Index = 0;
+              Index < Count;
+            ++Index )
+    {
+      debug_trace_context_switch *CSwitch = Writer->ContextSwitches + ((ReadAt + Index) % DEBUG_TRACE_CSWITCH_QUEUE);
+      WriteTraceVarint(Writer, CSwitch->ThreadIndex);
+      WriteTraceVarint(Writer, CSwitch->Type);
+      WriteTraceVarint(Writer, CSwitch->ProcessorNumber);
+      WriteTraceSigned(Writer, s64(CSwitch->CycleCount - Writer->LastContextSwitchCycle));
+      Writer->LastContextSwitchCycle = CSwitch->CycleCount;
+    }
+
+    ReadAt += Count;
+  }
+
+  Writer->ContextSwitchReadAt = ReadAt;
+}
+
+link_internal void
+WriteTraceFrameData(debug_trace_writer *Writer, debug_trace_frame *Frame)
+{
+  WriteTraceFrame(Writer, Frame);
+
+  u32 TotalThreadCount = GetTotalThreadCount();
+  for ( u32 ThreadIndex = 0;
+            ThreadIndex < TotalThreadCount;
+          ++ThreadIndex )
+  {
+    debug_thread_state *ThreadState = GetThreadLocalStateFor(ThreadIndex);
+    debug_scope_tree *Tree = ThreadState->ScopeTrees + GetFrameSlot(Frame->FrameId);
+
+    if (Tree->FrameRecorded == Frame->FrameId && (Tree->Closed || Writer->IncludeOpenTrees))
+    {
+      // NOTE(Jesse): The owning thread bumps At before it fills the slot in,
+      // so the last one might not be written yet.
+      u64 At = ThreadState->ScopeEvents->At;
+      u64 OnePastLastEvent = Tree->Closed ? Tree->OnePastLastEvent : Max(Tree->FirstEvent, At ? At-1 : 0);
+      WriteTraceScopeEvents(Writer, ThreadState, ThreadIndex, Tree->FirstEvent, OnePastLastEvent, Frame->StartingCycle);
+      WriteTraceMutexOps(Writer, ThreadState, Tree, ThreadIndex, Frame->FrameId, Frame->StartingCycle);
+    }
+    else
+    {
+      AtomicIncrement(&Writer->ThreadFramesUnsealed);
+    }
+  }
+
+  WriteTraceContextSwitches(Writer);
+
+  AtomicIncrement(&Writer->FramesWritten);
+}
+
+link_internal void
+RunTraceWriter(debug_trace_writer *Writer)
+{
+  while (!Writer->StopRequested || Writer->FrameReadAt != Writer->FrameWriteAt)
+  {
+    u32 WriteAt = Writer->FrameWriteAt;
+    if (Writer->FrameReadAt == WriteAt)
+    {
+      // NOTE(Jesse): Nothing handed off yet; frames come in at 60hz or so
+      FlushTraceBuffer(Writer);
+#if BONSAI_WIN32
+      Sleep(1);
+#else
+      usleep(1000);
+#endif
+      continue;
+    }
+
+    debug_trace_frame Frame = Writer->Frames[Writer->FrameReadAt % DEBUG_TRACE_FRAME_QUEUE];
+    switch (Writer->Format)
+    {
+      case TraceFormat_Bonsai:   { WriteTraceFrameData(Writer, &Frame); } break;
+      case TraceFormat_Perfetto: { WritePerfettoFrameData(Writer, &Frame); } break;
+    }
+    AtomicIncrement(&Writer->FrameReadAt);
+  }
+
+  if (Writer->WriteIndex) { WriteCaptureIndex(Writer); }
+
+  FlushTraceBuffer(Writer);
+  fflush((FILE*)Writer->File);
+
+  Writer->Finished = True;
+}
+
+#if BONSAI_WIN32
+link_internal DWORD WINAPI
+TraceWriterThreadMain(void *Writer)
+{
+  RunTraceWriter((debug_trace_writer*)Writer);
+  return 0;
+}
+#else
+link_internal void *
+TraceWriterThreadMain(void *Writer)
+{
+  RunTraceWriter((debug_trace_writer*)Writer);
+  return 0;
+}
+#endif
+
+link_internal debug_trace_writer *
+AllocateTraceWriter(const char *Name)
+{
+  memory_arena *TraceArena = AllocateArena(DEBUG_TRACE_BUFFER_SIZE + Megabytes(3));
+  DEBUG_REGISTER_NAMED_ARENA(TraceArena, 0, Name);
+
+  debug_trace_writer *Result = AllocateAligned(debug_trace_writer, TraceArena, 1, CACHE_LINE_SIZE);
+  Result->Buffer          = Allocate(u8, TraceArena, DEBUG_TRACE_BUFFER_SIZE);
+  Result->ContextSwitches = Allocate(debug_trace_context_switch, TraceArena, DEBUG_TRACE_CSWITCH_QUEUE);
+  Result->CallsiteWritten = Allocate(u8, TraceArena, MAX_DEBUG_SCOPE_CALLSITES);
+
+  Result->Sequences        = Allocate(debug_perfetto_sequence, TraceArena, DEBUG_PERFETTO_MAX_SEQUENCES);
+  Result->CallsiteInterned = Allocate(u64, TraceArena, MAX_DEBUG_SCOPE_CALLSITES);
+  Result->CpuDescribed     = Allocate(u8, TraceArena, DEBUG_PERFETTO_MAX_CPUS);
+
+  Result->IndexMemory = AllocateArena(sizeof(debug_capture_index_block)*4);
+  DEBUG_REGISTER_NAMED_ARENA(Result->IndexMemory, 0, "debug_lib CaptureIndex");
+  return Result;
+}
+
+// NOTE(Jesse): Keeps the buffers, starts over on everything else, and writes
+// the file header.  Doesn't allocate or call into libc, so the fatal signal
+// handler can use it.
+link_internal void
+ResetTraceWriter(debug_trace_writer *Writer, debug_trace_format Format)
+{
+  u8 *Buffer = Writer->Buffer;
+  debug_trace_context_switch *ContextSwitches = Writer->ContextSwitches;
+  u8 *CallsiteWritten = Writer->CallsiteWritten;
+  debug_perfetto_sequence *Sequences = Writer->Sequences;
+  u64 *CallsiteInterned = Writer->CallsiteInterned;
+  u8 *CpuDescribed = Writer->CpuDescribed;
+  memory_arena *IndexMemory = Writer->IndexMemory;
+  debug_capture_index_block *FirstIndexBlock = Writer->FirstIndexBlock;
+
+  Clear(Writer);
+
+  Writer->Buffer = Buffer;
+  Writer->ContextSwitches = ContextSwitches;
+  Writer->CallsiteWritten = CallsiteWritten;
+  Writer->Sequences = Sequences;
+  Writer->CallsiteInterned = CallsiteInterned;
+  Writer->CpuDescribed = CpuDescribed;
+  Writer->IndexMemory = IndexMemory;
+  Writer->FirstIndexBlock = FirstIndexBlock;
+  Writer->Format = Format;
+
+  for (u32 CallsiteIndex = 0; CallsiteIndex < MAX_DEBUG_SCOPE_CALLSITES; ++CallsiteIndex)
+  {
+    CallsiteWritten[CallsiteIndex] = False;
+    CallsiteInterned[CallsiteIndex] = 0;
+  }
+  for (u32 SequenceIndex = 0; SequenceIndex < DEBUG_PERFETTO_MAX_SEQUENCES; ++SequenceIndex) { Clear(Sequences + SequenceIndex); }
+  for (u32 CpuIndex = 0; CpuIndex < DEBUG_PERFETTO_MAX_CPUS; ++CpuIndex) { CpuDescribed[CpuIndex] = False; }
+
+  // NOTE(Jesse): A Perfetto trace is just the packets
+  if (Format == TraceFormat_Bonsai)
+  {
+    u32 Version = DEBUG_TRACE_VERSION;
+    WriteTraceBytes(Writer, (void*)"BDTR", 4);
+    WriteTraceBytes(Writer, &Version, sizeof(Version));
+  }
+}
+
+// NOTE(Jesse): Main thread only
+link_internal b32
+OpenTraceWriter(debug_trace_writer *Writer, const char *Path, debug_trace_format Format)
+{
+  if (Writer->Running) return False;
+
+  FILE *File = fopen(Path, "wb");
+  if (!File) { Error("Couldn't open trace file (%s)", Path); return False; }
+
+  ResetTraceWriter(Writer, Format);
+  Writer->File = File;
+  Writer->WriteIndex = (Format == TraceFormat_Bonsai);
+
+  b32 Result = False;
+#if BONSAI_WIN32
+  HANDLE Thread = CreateThread(0, 0, TraceWriterThreadMain, Writer, 0, 0);
+  if (Thread) { Writer->Thread = (umm)Thread; Result = True; }
+#else
+  pthread_t Thread;
+  if (pthread_create(&Thread, 0, TraceWriterThreadMain, Writer) == 0) { Writer->Thread = (umm)Thread; Result = True; }
+#endif
+
+  if (Result)
+  {
+    Writer->Running = True;
+  }
+  else
+  {
+    Error("Couldn't start a trace writer thread");
+    fclose(File);
+    Writer->File = 0;
+  }
+
+  return Result;
+}
+
+// NOTE(Jesse): Main thread only.  Blocks until everything that was handed off
+// is on disk.
+link_internal void
+CloseTraceWriter(debug_trace_writer *Writer)
+{
+  if (!Writer->Running) return;
+
+  Writer->StopRequested = True;
+
+#if BONSAI_WIN32
+  WaitForSingleObject((HANDLE)Writer->Thread, INFINITE);
+  CloseHandle((HANDLE)Writer->Thread);
+#else
+  pthread_join((pthread_t)Writer->Thread, 0);
+#endif
+
+  fclose((FILE*)Writer->File);
+  Writer->File = 0;
+  Writer->Running = False;
+}
+
+// NOTE(Jesse): Main thread only
+link_internal b32
+QueueTraceFrame(debug_state *State, debug_trace_writer *Writer, u32 FrameId)
+{
+  b32 Result = False;
+
+  u32 WriteAt = Writer->FrameWriteAt;
+  if (WriteAt - Writer->FrameReadAt < DEBUG_TRACE_FRAME_QUEUE)
+  {
+    frame_stats *Stats = State->Frames + GetFrameSlot(FrameId);
+
+    debug_trace_frame *Frame = Writer->Frames + (WriteAt % DEBUG_TRACE_FRAME_QUEUE);
+    Frame->FrameId       = FrameId;
+    Frame->FrameMs       = Stats->FrameMs;
+    Frame->StartingCycle = Stats->StartingCycle;
+    Frame->TotalCycles   = Stats->TotalCycles;
+    Frame->NsPerCycle    = Stats->NsPerCycle;
+
+    AtomicIncrement(&Writer->FrameWriteAt);
+    Result = True;
+  }
+
+  return Result;
+}
+
+link_internal b32
+StartTraceCapture(const char *Path)
+{
+  debug_state *State = GetDebugState();
+  if (!State->TraceWriter) { State->TraceWriter = AllocateTraceWriter("debug_lib TraceWriter"); }
+
+  b32 Result = OpenTraceWriter(State->TraceWriter, Path, TraceFormat_Bonsai);
+  return Result;
+}
+
+// NOTE(Jesse): Same thing, written as Perfetto protobuf instead of BDTR.
+// Stopped by StopTraceCapture.
+link_internal b32
+StartPerfettoCapture(const char *Path)
+{
+  debug_state *State = GetDebugState();
+  if (!State->TraceWriter) { State->TraceWriter = AllocateTraceWriter("debug_lib TraceWriter"); }
+
+  b32 Result = OpenTraceWriter(State->TraceWriter, Path, TraceFormat_Perfetto);
+  return Result;
+}
+
+link_internal void
+StopTraceCapture()
+{
+  debug_trace_writer *Writer = GetDebugState()->TraceWriter;
+  if (Writer) { CloseTraceWriter(Writer); }
+}
+
+// NOTE(Jesse): All the main thread pays for a frame; called once a frame is
+// old enough that every thread has sealed it.
+link_internal void
+HandOffTraceFrame(debug_state *State, u32 FrameId)
+{
+  debug_trace_writer *Writer = State->TraceWriter;
+  if (!Writer || !Writer->Running || Writer->StopRequested) return;
+
+  if (!QueueTraceFrame(State, Writer, FrameId))
+  {
+    AtomicIncrement(&Writer->FramesDropped);
+  }
+}
+
+// NOTE(Jesse): ETW thread only
+link_internal void
+PushTraceContextSwitch(debug_state *State, u32 ThreadIndex, debug_context_switch_event *Event)
+{
+  debug_trace_writer *Writer = State->TraceWriter;
+  if (!Writer || !Writer->Running) return;
+
+  u32 WriteAt = Writer->ContextSwitchWriteAt;
+  if (WriteAt - Writer->ContextSwitchReadAt < DEBUG_TRACE_CSWITCH_QUEUE)
+  {
+    debug_trace_context_switch *CSwitch = Writer->ContextSwitches + (WriteAt % DEBUG_TRACE_CSWITCH_QUEUE);
+    CSwitch->ThreadIndex     = (u16)ThreadIndex;
+    CSwitch->Type            = (u16)Event->Type;
+    CSwitch->ProcessorNumber = Event->ProcessorNumber;
+    CSwitch->CycleCount      = Event->CycleCount;
+
+    AtomicIncrement(&Writer->ContextSwitchWriteAt);
+  }
+  else
+  {
+    AtomicIncrement(&Writer->ContextSwitchesDropped);
+  }
+}
+
+
+
+/*****************************                   ****************************/
+/*****************************  Flight Recorder  ****************************/
+/*****************************                   ****************************/
+
+
+
+// NOTE(Jesse): No snprintf; this runs in the fatal signal handler too.
+// Reasons get anything that isn't a letter or a digit turned into '_'.
+link_internal void
+BuildCapturePath(char *Dest, u32 DestSize, const char *Kind, u64 Seconds, u32 FrameId, const char *Reason)
+{
+  u32 At = 0;
+
+  for (const char *C = "bonsai_"; *C && At < DestSize-1; ++C) { Dest[At++] = *C; }
+  for (const char *C = Kind;      *C && At < DestSize-1; ++C) { Dest[At++] = *C; }
+
+  u64 Numbers[2] = { Seconds, FrameId };
+  for (u32 NumberIndex = 0; NumberIndex < 2; ++NumberIndex)
+  {
+    char Digits[20];
+    u32 DigitCount = 0;
+    u64 Number = Numbers[NumberIndex];
+    do { Digits[DigitCount++] = char('0' + (Number % 10)); Number /= 10; } while (Number);
+
+    if (At < DestSize-1) { Dest[At++] = '_'; }
+    while (DigitCount && At < DestSize-1) { Dest[At++] = Digits[--DigitCount]; }
+  }
+
+  if (At < DestSize-1) { Dest[At++] = '_'; }
+  for (const char *C = Reason; *C && At < DestSize-1-5; ++C)
+  {
+    b32 Keep = (*C >= 'a' && *C <= 'z') || (*C >= 'A' && *C <= 'Z') || (*C >= '0' && *C <= '9');
+    Dest[At++] = Keep ? *C : '_';
+  }
+
+  for (const char *C = ".bdtr"; *C && At < DestSize-1; ++C) { Dest[At++] = *C; }
+  Dest[At] = 0;
+}
+
+link_internal void
+CopyCaptureReason(char *Dest, const char *Reason)
+{
+  u32 At = 0;
+  while (Reason && Reason[At] && At < DEBUG_CAPTURE_REASON_LENGTH-1) { Dest[At] = Reason[At]; ++At; }
+  Dest[At] = 0;
+}
+
+// NOTE(Jesse): How far back we can reach without the slots, or the events,
+// we want getting reused before the writer is done with them.  Scope triggers
+// come in DEBUG_SEALED_FRAME_LAG frames late, and it's that much again before
+// a frame is sealed.  The frames after the trigger stream out as they're
+// sealed, but the whole capture has to fit in the writer's queue in case it
+// falls behind.
+link_internal void
+ClampCaptureFrames(debug_state *State, debug_flight_recorder *Recorder)
+{
+  u32 RingFrames = State->ScopeEventsPerThread / State->ScopeEventsPerFrame;
+  u32 Held = Min(State->FramesTracked, RingFrames);
+  u32 Slack = 2*DEBUG_SEALED_FRAME_LAG + 2;
+  u32 Available = Held > Slack ? Held - Slack : 0;
+
+  u32 QueueFrames = DEBUG_TRACE_FRAME_QUEUE-1 - 1; // Less the trigger frame
+  Recorder->FramesBefore = Min(Recorder->FramesBefore, Min(Available, QueueFrames));
+  Recorder->FramesAfter  = Min(Recorder->FramesAfter, QueueFrames - Recorder->FramesBefore);
+}
+
+// NOTE(Jesse): Any thread
+link_internal void
+RequestCapture(const char *Reason)
+{
+  debug_flight_recorder *Recorder = &GetDebugState()->FlightRecorder;
+  if (AtomicCompareExchange(&Recorder->Requested, 1, 0))
+  {
+    Recorder->RequestedReason = Reason;
+    AtomicIncrement(&Recorder->Requested);
+  }
+  else
+  {
+    AtomicIncrement(&Recorder->TriggersIgnored);
+  }
+}
+
+// NOTE(Jesse): Callsites get registered whenever they first run, so this
+// happens both when the trigger is set and when a new callsite shows up.
+link_internal void
+UpdateCallsiteCaptureTrigger(debug_state *State, u16 CallsiteId)
+{
+  const char *TriggerName = State->FlightRecorder.ScopeTriggerName;
+  State->ScopeCallsiteCaptureTriggers[CallsiteId] = TriggerName[0] && StringsMatch(State->ScopeCallsites[CallsiteId].Name, TriggerName);
+}
+
+link_internal void
+SetCaptureTriggers(r32 FrameMs, const char *ScopeName, u64 ScopeCycles, u32 FramesBefore, u32 FramesAfter)
+{
+  debug_state *State = GetDebugState();
+  debug_flight_recorder *Recorder = &State->FlightRecorder;
+
+  Recorder->FrameMsTrigger = FrameMs;
+  Recorder->FramesBefore = FramesBefore;
+  Recorder->FramesAfter = FramesAfter;
+  ClampCaptureFrames(State, Recorder);
+
+  Recorder->ScopeTriggerCycles = ScopeCycles;
+  CopyCaptureReason(Recorder->ScopeTriggerName, ScopeName);
+
+  for ( u32 CallsiteIndex = 1;
+            CallsiteIndex < State->ScopeCallsiteCount;
+          ++CallsiteIndex )
+  {
+    UpdateCallsiteCaptureTrigger(State, (u16)CallsiteIndex);
+  }
+}
+
+// NOTE(Jesse): Main thread only
+link_internal void
+TriggerCapture(debug_state *State, u32 FrameId, const char *Reason)
+{
+  debug_flight_recorder *Recorder = &State->FlightRecorder;
+
+  if (Recorder->Pending || (Recorder->Writer && Recorder->Writer->Running))
+  {
+    AtomicIncrement(&Recorder->TriggersIgnored);
+    return;
+  }
+
+  if (!Recorder->Writer) { Recorder->Writer = AllocateTraceWriter("debug_lib FlightRecorder"); }
+
+  BuildCapturePath(Recorder->LastCapturePath, DEBUG_CAPTURE_PATH_LENGTH, "capture", (u64)time(0), FrameId, Reason);
+  if (!OpenTraceWriter(Recorder->Writer, Recorder->LastCapturePath, TraceFormat_Bonsai)) return;
+
+  Recorder->Pending        = True;
+  Recorder->TriggerFrameId = FrameId;
+  Recorder->FirstFrameId   = FrameId > Recorder->FramesBefore ? FrameId - Recorder->FramesBefore : 1;
+  Recorder->LastFrameId    = FrameId + Recorder->FramesAfter;
+  Recorder->NextFrameId    = Recorder->FirstFrameId;
+  CopyCaptureReason(Recorder->Reason, Reason);
+}
+
+// NOTE(Jesse): Main thread only, once a frame.  LastFrameId is the frame that
+// just ended.
+link_internal void
+UpdateFlightRecorder(debug_state *State, frame_stats *ThisFrame, u32 LastFrameId)
+{
+  debug_flight_recorder *Recorder = &State->FlightRecorder;
+
+  if (Recorder->Writer && Recorder->Writer->Running && Recorder->Writer->Finished)
+  {
+    CloseTraceWriter(Recorder->Writer);
+    Recorder->CapturesWritten++;
+  }
+
+  if (Recorder->FrameMsTrigger > 0.f && ThisFrame->FrameMs > Recorder->FrameMsTrigger)
+  {
+    TriggerCapture(State, LastFrameId, "frame_ms");
+  }
+
+  if (Recorder->Signalled)
+  {
+    Recorder->Signalled = False;
+    TriggerCapture(State, LastFrameId, "SIGUSR1");
+  }
+
+  if (Recorder->Requested == 2)
+  {
+    TriggerCapture(State, LastFrameId, Recorder->RequestedReason);
+    Recorder->Requested = 0;
+  }
+
+  // NOTE(Jesse): Everything up to the trigger goes the first time through,
+  // before the rings lap it; after that it's a frame at a time as they're
+  // sealed.
+  if (Recorder->Pending && LastFrameId >= DEBUG_SEALED_FRAME_LAG)
+  {
+    u32 SealedFrameId = Min(LastFrameId - DEBUG_SEALED_FRAME_LAG, Recorder->LastFrameId);
+    for (; Recorder->NextFrameId <= SealedFrameId; ++Recorder->NextFrameId)
+    {
+      if (!QueueTraceFrame(State, Recorder->Writer, Recorder->NextFrameId))
+      {
+        Recorder->FramesDropped++;
+      }
+    }
+
+    if (Recorder->NextFrameId > Recorder->LastFrameId)
+    {
+      // NOTE(Jesse): Drains what we gave it and quits; we join it once it
+      // says it's done.
+      Recorder->Pending = False;
+      Recorder->Writer->StopRequested = True;
+    }
+  }
+}
+
+// NOTE(Jesse): Called when a scope closes in the flat walk UpdateHistoryTiers
+// does, so it's DEBUG_SEALED_FRAME_LAG frames late; the capture is centered
+// on the frame the scope ended in all the same.
+link_internal void
+CheckScopeCaptureTrigger(debug_state *State, u16 CallsiteId, u64 Cycles, u32 FrameId)
+{
+  if (State->ScopeCallsiteCaptureTriggers[CallsiteId] && Cycles > State->FlightRecorder.ScopeTriggerCycles)
+  {
+    TriggerCapture(State, FrameId, GetCallsite(CallsiteId)->Name);
+  }
+}
+
+#if !BONSAI_WIN32
+
+// NOTE(Jesse): These live in the lib, so they go away when it's reloaded.
+// BonsaiDebug_OnUnload puts the old handlers back first and OnLoad installs
+// ours again.
+global_variable struct sigaction Global_PreviousFatalSignalActions[32];
+global_variable struct sigaction Global_PreviousCaptureSignalAction;
+global_variable volatile u32 Global_InFatalSignalHandler;
+
+#define DEBUG_FATAL_SIGNAL_COUNT (5)
+global_variable int Global_FatalSignals[DEBUG_FATAL_SIGNAL_COUNT] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+link_internal void
+CaptureSignalHandler(int Signal)
+{
+  GetDebugState()->FlightRecorder.Signalled = True;
+}
+
+// NOTE(Jesse): Best effort.  Everything in here has to stay away from malloc
+// and stdio; whatever state the process is in, the rings are just memory.
+// The last frame isn't sealed so we take whatever its trees have so far.
+link_internal void
+FatalSignalHandler(int Signal, siginfo_t *Info, void *Context)
+{
+  debug_state *State = GetDebugState();
+
+  if (State && AtomicCompareExchange(&Global_InFatalSignalHandler, 1, 0))
+  {
+    debug_flight_recorder *Recorder = &State->FlightRecorder;
+    debug_trace_writer *Writer = Recorder->CrashWriter;
+
+    char Path[DEBUG_CAPTURE_PATH_LENGTH];
+    u32 LastFrameId = GetThreadLocalStateFor(0)->WriteIndex;
+    BuildCapturePath(Path, DEBUG_CAPTURE_PATH_LENGTH, "crash", (u64)time(0), LastFrameId, "signal");
+
+    s32 Fd = open(Path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (Writer && Fd > 0)
+    {
+      ResetTraceWriter(Writer, TraceFormat_Bonsai);
+      Writer->Fd = Fd;
+      Writer->IncludeOpenTrees = True;
+
+      u32 FramesBefore = Min(Recorder->FramesBefore + Recorder->FramesAfter, State->FramesTracked-2);
+      u32 FirstFrameId = LastFrameId > FramesBefore ? LastFrameId - FramesBefore : 1;
+      for ( u32 FrameId = FirstFrameId;
+                FrameId <= LastFrameId;
+              ++FrameId )
+      {
+        debug_trace_frame Frame = {};
+        frame_stats *Stats = State->Frames + GetFrameSlot(FrameId);
+        Frame.FrameId       = FrameId;
+        Frame.FrameMs       = Stats->FrameMs;
+        Frame.StartingCycle = Stats->StartingCycle;
+        Frame.TotalCycles   = Stats->TotalCycles;
+        Frame.NsPerCycle    = Stats->NsPerCycle;
+        WriteTraceFrameData(Writer, &Frame);
+      }
+
+      FlushTraceBuffer(Writer);
+      close(Fd);
+    }
+  }
+
+  // NOTE(Jesse): Put back whatever was there before us.  A fault the kernel
+  // sent happens again as soon as we return, so whoever's next gets the real
+  // siginfo and context; anything raised has to be raised again.
+  sigaction(Signal, Global_PreviousFatalSignalActions + Signal, 0);
+  if (Info->si_code <= 0) { raise(Signal); }
+}
+
+link_internal void
+InstallCaptureSignalHandlers(debug_state *State)
+{
+  debug_flight_recorder *Recorder = &State->FlightRecorder;
+  if (!Recorder->CrashWriter) { Recorder->CrashWriter = AllocateTraceWriter("debug_lib CrashWriter"); }
+
+  struct sigaction Action = {};
+  Action.sa_handler = CaptureSignalHandler;
+  sigemptyset(&Action.sa_mask);
+  Action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &Action, &Global_PreviousCaptureSignalAction);
+
+  Action = {};
+  Action.sa_sigaction = FatalSignalHandler;
+  sigemptyset(&Action.sa_mask);
+  Action.sa_flags = SA_SIGINFO|SA_RESETHAND;
+  for (u32 SignalIndex = 0; SignalIndex < DEBUG_FATAL_SIGNAL_COUNT; ++SignalIndex)
+  {
+    int Signal = Global_FatalSignals[SignalIndex];
+    sigaction(Signal, &Action, Global_PreviousFatalSignalActions + Signal);
+  }
+}
+
+link_internal void
+UninstallCaptureSignalHandlers(debug_state *State)
+{
+  sigaction(SIGUSR1, &Global_PreviousCaptureSignalAction, 0);
+
+  for (u32 SignalIndex = 0; SignalIndex < DEBUG_FATAL_SIGNAL_COUNT; ++SignalIndex)
+  {
+    int Signal = Global_FatalSignals[SignalIndex];
+    sigaction(Signal, Global_PreviousFatalSignalActions + Signal, 0);
+  }
+}
+
+#else
+
+// NOTE(Jesse): No SIGUSR1, and the fatal dump wants a vectored exception
+// handler we don't have yet.  DEBUG_CAPTURE and the thresholds still work.
+link_internal void
+InstallCaptureSignalHandlers(debug_state *State)
+{
+}
+
+link_internal void
+UninstallCaptureSignalHandlers(debug_state *State)
+{
+}
+
+#endif
+
+// NOTE(Jesse): Off unless asked for; the host might well have crash handling
+// of its own.
+link_internal void
+InstallCrashHandlers()
+{
+  debug_state *State = GetDebugState();
+  if (!State->FlightRecorder.HandlersInstalled)
+  {
+    InstallCaptureSignalHandlers(State);
+    State->FlightRecorder.HandlersInstalled = True;
+  }
+}
+
+link_internal void
+InitFlightRecorder(debug_state *State)
+{
+  debug_flight_recorder *Recorder = &State->FlightRecorder;
+  Recorder->FramesBefore = DEBUG_CAPTURE_FRAMES_BEFORE_DEFAULT;
+  Recorder->FramesAfter  = DEBUG_CAPTURE_FRAMES_AFTER_DEFAULT;
+  ClampCaptureFrames(State, Recorder);
+}
@@ -1,9 +1,16 @@
 #if DEBUG_SYSTEM_API
 
+#if !BONSAI_WIN32
+#include <time.h>
+#endif
+
 struct debug_state;
 struct debug_scope_tree;
 struct debug_profile_scope;
+struct debug_profile_scope_block;
 struct debug_thread_state;
+struct debug_scope_event_ring;
+struct debug_scope_callsite;
 
 struct input;
 struct memory_arena;
@@ -33,6 +40,21 @@ struct memory_record
 
 typedef debug_scope_tree*    (*get_read_scope_tree_proc)(u32);
 typedef debug_scope_tree*    (*get_write_scope_tree_proc)();
+typedef debug_scope_event_ring* (*get_write_scope_events_proc)();
+typedef void                 (*debug_register_scope_callsite_proc)     (debug_scope_callsite*);
+typedef void                 (*debug_record_budget_violation_proc)     (u16, u64);
+typedef void                 (*debug_record_flow_event_proc)           (u64, u32);
+typedef b32                  (*debug_start_trace_capture_proc)         (const char*);
+typedef void                 (*debug_stop_trace_capture_proc)          ();
+typedef void                 (*debug_request_capture_proc)             (const char*);
+typedef void                 (*debug_set_capture_triggers_proc)        (r32, const char*, u64, u32, u32);
+typedef void                 (*debug_install_crash_handlers_proc)      ();
+typedef b32                  (*debug_save_baseline_proc)               (const char*);
+typedef s32                  (*debug_compare_to_baseline_proc)         (const char*);
+typedef void                 (*debug_set_baseline_thresholds_proc)     (r64, r64, u64, u64);
+typedef b32                  (*debug_export_trace_proc)                (const char*, u32, u32);
+typedef b32                  (*debug_export_flame_graph_proc)          (const char*, const char*, u32, u32);
+typedef b32                  (*debug_open_capture_proc)                (const char*);
 typedef void                 (*debug_clear_framebuffers_proc)          (render_entity_to_texture_group*);
 typedef void                 (*debug_frame_end_proc)                   (v2 *MouseP, v2 *MouseDP, v2 ScreenDim, input *Input, r32 dt, picked_world_chunk_static_buffer*);
 typedef void                 (*debug_frame_begin_proc)                 (b32, b32);
@@ -45,7 +67,6 @@ typedef void                 (*debug_mutex_waiting_proc)               (mutex*);
 typedef void                 (*debug_mutex_aquired_proc)               (mutex*);
 typedef void                 (*debug_mutex_released_proc)              (mutex*);
 
-typedef debug_profile_scope* (*debug_get_profile_scope_proc)           ();
 typedef void*                (*debug_allocate_proc)                    (memory_arena*, umm, umm, const char*, s32 , const char*, umm, b32);
 typedef void                 (*debug_register_thread_proc)             (thread_startup_params*);
 typedef void                 (*debug_track_draw_call_proc)             (const char*, u32);
@@ -66,16 +87,238 @@ typedef debug_state*         (*get_debug_state_proc)  ();
 typedef u64                  (*query_memory_requirements_proc)();
 typedef get_debug_state_proc (*init_debug_system_proc)(debug_state *, u64 DebugStateSize);
 typedef void                 (*patch_debug_lib_pointers_proc)(debug_state *, thread_local_state *);
+typedef void                 (*unload_debug_lib_proc)(debug_state *);
+
+
+enum debug_scope_event_type
+{
+  ScopeEvent_None,
+
+  ScopeEvent_Begin,
+  ScopeEvent_End,
 
+  // NOTE(Jesse): Follows the End of the scope it belongs to, the count is
+  // stored in Cycle.  See TIMED_BLOCK_N
+  ScopeEvent_Payload,
+};
+
+enum debug_flow_event_type
+{
+  FlowEvent_Begin, // The job got queued
+  FlowEvent_End,   // .. and some thread started working on it
+};
+
+enum debug_timestamp_mode
+{
+  TimestampMode_Rdtsc,      // Plain __rdtsc; the CPU is free to move it around the code being timed
+  TimestampMode_Serialized, // lfence'd __rdtsc / __rdtscp; slower, but nothing leaks across it
+  TimestampMode_Clock,      // Monotonic clock in nanoseconds, for when the TSC can't be trusted
+
+  TimestampMode_Count,
+};
+
+inline u64
+GetMonotonicNanoseconds()
+{
+#if BONSAI_WIN32
+  // NOTE(Jesse): The frequency is fixed at boot.  Threads racing to fill this
+  // in all write the same thing.
+  local_persist r64 NsPerTick = 0.0;
+  if (NsPerTick == 0.0)
+  {
+    LARGE_INTEGER Frequency;
+    QueryPerformanceFrequency(&Frequency);
+    NsPerTick = 1000000000.0 / (r64)Frequency.QuadPart;
+  }
+
+  LARGE_INTEGER Counter;
+  QueryPerformanceCounter(&Counter);
+  u64 Result = (u64)((r64)Counter.QuadPart * NsPerTick);
+#else
+  timespec Time;
+  clock_gettime(CLOCK_MONOTONIC, &Time);
+  u64 Result = ((u64)Time.tv_sec * 1000000000ull) + (u64)Time.tv_nsec;
+#endif
+  return Result;
+}
+
+// NOTE(Jesse): Begin and end are serialized differently so that in
+// TimestampMode_Serialized the code being timed can't start before the begin
+// timestamp or still be running at the end one.
+inline u64
+ReadBeginTimestamp(u32 Mode)
+{
+  u64 Result = 0;
+  if (Mode == TimestampMode_Rdtsc)
+  {
+    Result = __rdtsc();
+  }
+  else if (Mode == TimestampMode_Serialized)
+  {
+    _mm_lfence();
+    Result = __rdtsc();
+    _mm_lfence();
+  }
+  else
+  {
+    Result = GetMonotonicNanoseconds();
+  }
+  return Result;
+}
+
+inline u64
+ReadEndTimestamp(u32 Mode)
+{
+  u64 Result = 0;
+  if (Mode == TimestampMode_Rdtsc)
+  {
+    Result = __rdtsc();
+  }
+  else if (Mode == TimestampMode_Serialized)
+  {
+    u32 Aux;
+    Result = __rdtscp(&Aux);
+    _mm_lfence();
+  }
+  else
+  {
+    Result = GetMonotonicNanoseconds();
+  }
+  return Result;
+}
+
+// NOTE(Jesse): Optional last argument to every TIMED_ macro, eg.
+// TIMED_FUNCTION(Category_Render).  Untagged scopes are Category_Default and
+// get counted as whatever category their parent is in the rollups.
+enum debug_scope_category
+{
+  Category_Default,
+  Category_Render,
+  Category_Sim,
+  Category_IO,
+  Category_Audio,
+  Category_Network,
+  Category_Debug,
+
+  Category_Count,
+};
+CAssert(Category_Count <= 32);
+
+// NOTE(Jesse): Define this to a mask of (1 << debug_scope_category) before
+// including this header and the scopes in the categories that aren't in it
+// compile to nothing.
+#ifndef DEBUG_COMPILED_SCOPE_CATEGORIES
+#define DEBUG_COMPILED_SCOPE_CATEGORIES (0xFFFFFFFF)
+#endif
+
+constexpr debug_scope_category
+DebugScopeCategory(debug_scope_category Category = Category_Default)
+{
+  return Category;
+}
+
+constexpr bool
+DebugScopeCategoryCompiled(debug_scope_category Category)
+{
+  return ((u32)(DEBUG_COMPILED_SCOPE_CATEGORIES) >> Category) & 1;
+}
+
+// NOTE(Jesse): One of these is declared static at every TIMED_FUNCTION /
+// TIMED_BLOCK site.  The first time the site is hit it gets registered with
+// the debug lib and handed a dense Id, which is all that gets recorded from
+// then on.  Two sites with the same name in different places get different
+// Ids.
+struct debug_scope_callsite
+{
+  const char* Name;
+  const char* File;
+  u32 Line;
+  u32 BudgetUs; // 0 for no budget, see TIMED_BLOCK_BUDGET
+
+  volatile u16 Id; // 0 until registered
+  u16 Category;    // debug_scope_category
+};
+
+#define MAX_DEBUG_SCOPE_CALLSITES (4096)
+CAssert(MAX_DEBUG_SCOPE_CALLSITES <= u16_MAX);
+
+// NOTE(Jesse): debug_timed_function only ever appends these to the per-thread
+// debug_scope_event_ring.  The debug_profile_scope trees are rebuilt from them
+// when somebody actually reads a frame (see GetReadScopeTree)
+struct debug_scope_event
+{
+  u64 Cycle;
+  u16 CallsiteId;
+  u16 SampleMask; // Begin only; one in every SampleMask+1 calls got recorded
+  debug_scope_event_type Type;
+};
+CAssert(sizeof(debug_scope_event) == 16);
+
+struct debug_scope_event_ring
+{
+  u64 Mask; // EventCount-1, EventCount must be a power of two
+
+  // NOTE(Jesse): One-past-last event ever written.  Only the owning thread
+  // writes this; it never wraps, the index into Events does.
+  volatile u64 At;
+
+  debug_scope_event *Events;
+
+  // NOTE(Jesse): Both indexed by debug_scope_callsite::Id.  CallCounts is
+  // this threads exact count of calls, sampled or not, and never gets reset.
+  // SampleMasks is shared by every thread and owned by the main thread (see
+  // UpdateScopeSampling).
+  u32 *CallCounts;
+  volatile u16 *SampleMasks;
+
+  // NOTE(Jesse): Shared, indexed by debug_scope_callsite::Id, in the units of
+  // the current timestamp mode.  u64_MAX for callsites without a budget.
+  volatile u64 *BudgetCycles;
+
+  // NOTE(Jesse): One bit per debug_scope_category; debug_state::ScopeCategoryMask
+  // while profiling is on, 0 while it's off.  Mirrored here so the owning
+  // thread doesn't have to touch the debug_state to find out.  Written by the
+  // main thread.
+  volatile u32 EnabledCategories;
+
+  // NOTE(Jesse): debug_timestamp_mode.  Only changed by the owning thread
+  // when it advances, so every scope in a frame is in the same units.
+  u32 TimestampMode;
+
+  u8 Pad[CACHE_LINE_SIZE - sizeof(u64)*2 - sizeof(void*)*4 - sizeof(u32) - sizeof(u32)];
+};
+CAssert(sizeof(debug_scope_event_ring) == CACHE_LINE_SIZE);
+
+inline debug_scope_event *
+ReserveScopeEvent(debug_scope_event_ring *Ring)
+{
+  debug_scope_event *Result = Ring->Events + (Ring->At & Ring->Mask);
+  ++Ring->At;
+  return Result;
+}
+
+// NOTE(Jesse): Scopes that straddle a frame advance are built into every
+// frame they were open in; see BuildScopeTree
+enum debug_profile_scope_flags
+{
+  ScopeFlag_ContinuedFromPreviousFrame = (1 << 0), // StartingCycle is from an earlier frame
+  ScopeFlag_ContinuesIntoNextFrame     = (1 << 1), // Still open when the frame was sealed; EndingCycle is 0
+};
 
 struct debug_profile_scope
 {
   u64 StartingCycle;
   u64 EndingCycle;
-  const char* Name;
 
+  u16 CallsiteId;
+  u16 SampleMask;
   b32 Expanded;
 
+  u32 DescendantCount; // Every one of these added a TIMED_BLOCK worth of overhead
+  u32 Flags;           // debug_profile_scope_flags
+
+  u64 Payload; // Work items processed, for TIMED_BLOCK_N.  0 otherwise
+
   debug_profile_scope* Sibling;
   debug_profile_scope* Child;
   debug_profile_scope* Parent;
@@ -84,12 +327,41 @@ struct debug_profile_scope
 };
 // NOTE(Jesse): I thought maybe this would increase perf .. it had a negligible
 // effect These structs are per-thread so there's no sense in having them
-// cache-line sized.  Something that would probably speed this up is not storing
-// the sibling/child/parent pointers and instead store a one-past-last index into
-// a statically allocated buffer (instead of dynamically allocating new scopes
-// every time we need another one)
+// cache-line sized.
+//
+// These are no longer allocated on the hot path; see debug_scope_event
 /* CAssert(sizeof(debug_profile_scope) == CACHE_LINE_SIZE); */
 
+// NOTE(Jesse): Trees get their debug_profile_scopes in blocks of this many,
+// see debug_scope_tree::FirstBlock
+#define DEBUG_PROFILE_SCOPES_PER_BLOCK (1024)
+struct debug_profile_scope_block
+{
+  debug_profile_scope_block *Next;
+  u32 At;
+
+  debug_profile_scope Scopes[DEBUG_PROFILE_SCOPES_PER_BLOCK];
+};
+
+struct debug_sampled_call_count
+{
+  u16 CallsiteId;
+  u32 CallCount;
+};
+
+// NOTE(Jesse): Sampling only gets turned on for this many callsites at once
+#define MAX_SAMPLED_CALLSITES (64)
+
+// NOTE(Jesse): Indices of Begin events that hadn't been closed yet, outermost
+// first.  Depth keeps counting past what we have room for so the End events
+// of untracked scopes still pop the right thing.
+#define DEBUG_MAX_CONTINUED_SCOPES (32)
+struct debug_open_scope_stack
+{
+  u64 Begins[DEBUG_MAX_CONTINUED_SCOPES];
+  u32 Depth;
+};
+
 struct debug_scope_tree
 {
   debug_profile_scope *Root;
@@ -97,6 +369,44 @@ struct debug_scope_tree
   debug_profile_scope **WriteScope;
   debug_profile_scope *ParentOfNextScope;
   u64 FrameRecorded;
+
+  // NOTE(Jesse): The range of the owning threads debug_scope_event_ring that
+  // was written while this was the write slot.  Written by the owning thread
+  // when it advances, at which point Closed gets set and the tree can be built
+  // by the reader.  Root, WriteScope and ParentOfNextScope are only ever
+  // touched by the reader.
+  u64 FirstEvent;
+  u64 OnePastLastEvent;
+  volatile b32 Closed;
+
+  u64 BuiltFrame; // FrameRecorded+1 of the events Root was built from
+
+  // NOTE(Jesse): Every scope in the tree comes out of these blocks, newest
+  // first, so throwing the whole tree away is handing the chain back to the
+  // thread.  Scopes freed one at a time (see CollapseClosedScopes) only go on
+  // FirstFreeScope, for this tree to reuse.
+  debug_profile_scope_block *FirstBlock;
+  debug_profile_scope_block *LastBlock;
+  u32 BlockCount;
+  debug_profile_scope *FirstFreeScope;
+
+  // NOTE(Jesse): Exact call counts for the callsites that were being sampled
+  // when the owning thread closed this slot.  Written along with Closed.
+  u32 SampledCallCount;
+  debug_sampled_call_count SampledCalls[MAX_SAMPLED_CALLSITES];
+
+  // NOTE(Jesse): What the last build of this tree lost to the thread going
+  // over its ProfileScopeBudget.  See debug_scope_overflow_policy
+  u32 ScopesDropped;
+  u32 ScopesCollapsed;
+  u32 BlocksStolen; // Taken from older frames to make room for this one
+
+  // NOTE(Jesse): Scopes still open at OnePastLastEvent, which the next frame's
+  // tree starts with.  Worked out by the reader, and kept when the scopes are
+  // thrown away, so only the first build after a jump has to walk back.
+  debug_open_scope_stack OpenAtEnd;
+  u64 OpenAtEndFrame; // FrameRecorded+1 OpenAtEnd was worked out for
+  u32 BeginCount;     // Begin events in the range, counted along with OpenAtEnd
 };
 
 enum debug_ui_type
@@ -110,6 +420,20 @@ enum debug_ui_type
   DebugUIType_Network               = (1 << 5),
   DebugUIType_DrawCalls             = (1 << 6),
   DebugUIType_PickedChunks          = (1 << 7),
+  DebugUIType_BudgetViolations      = (1 << 8),
+  DebugUIType_Percentiles           = (1 << 9),
+  DebugUIType_Capture               = (1 << 10),
+};
+
+// NOTE(Jesse): What the Callgraph window shows.  The frame is the per-thread
+// trees of the selected frame; the others are averages out of the MergedTree.
+enum debug_callgraph_mode
+{
+  CallgraphMode_Frame,
+  CallgraphMode_Window,
+  CallgraphMode_Session,
+
+  CallgraphMode_Count,
 };
 
 struct debug_state
@@ -120,8 +444,6 @@ struct debug_state
   u64 BytesBufferedToCard;
   b32 DebugDoScopeProfiling = True;
 
-  u64 NumScopes;
-
   debug_clear_framebuffers_proc             ClearFramebuffers;
   debug_frame_end_proc                      FrameEnd;
   debug_frame_begin_proc                    FrameBegin;
@@ -134,7 +456,6 @@ struct debug_state
   debug_mutex_aquired_proc                  MutexAquired;
   debug_mutex_released_proc                 MutexReleased;
 
-  debug_get_profile_scope_proc              GetProfileScope;
   debug_allocate_proc                       Debug_Allocate;
   debug_register_thread_proc                RegisterThread;
 
@@ -156,6 +477,22 @@ struct debug_state
 
   get_read_scope_tree_proc GetReadScopeTree;
   get_write_scope_tree_proc GetWriteScopeTree;
+  get_write_scope_events_proc GetWriteScopeEvents;
+  debug_register_scope_callsite_proc RegisterScopeCallsite;
+  debug_record_budget_violation_proc RecordBudgetViolation;
+  debug_record_flow_event_proc RecordFlowEvent;
+  debug_start_trace_capture_proc StartTraceCapture;
+  debug_start_trace_capture_proc StartPerfettoCapture;
+  debug_stop_trace_capture_proc StopTraceCapture;
+  debug_request_capture_proc RequestCapture;
+  debug_set_capture_triggers_proc SetCaptureTriggers;
+  debug_install_crash_handlers_proc InstallCrashHandlers;
+  debug_save_baseline_proc SaveBaseline;
+  debug_compare_to_baseline_proc CompareToBaseline;
+  debug_set_baseline_thresholds_proc SetBaselineThresholds;
+  debug_export_trace_proc ExportChromeTrace;
+  debug_export_flame_graph_proc ExportFlameGraph;
+  debug_open_capture_proc OpenCaptureFile;
 
   // TODO(Jesse): Remove these.  Need to expose the UI drawing code to the user
   // of the library.
@@ -164,6 +501,22 @@ struct debug_state
 
   debug_thread_state *ThreadStates;
 
+  // NOTE(Jesse): How many frames are kept in full detail.  Read once by
+  // InitDebugState, so set it before that; 0 gets the default.  Each thread's
+  // scope event ring is sized to hold FramesTracked frames of
+  // ScopeEventsPerFrame events, which is a Begin and an End per scope (and a
+  // Payload for TIMED_BLOCK_N ones).  Threads that record more than that per
+  // frame get their older trees back empty.  Older history is kept as
+  // per-callsite aggregates, see debug_history_tier.
+#define DEBUG_FRAMES_TRACKED_DEFAULT (128)
+#define DEBUG_FRAMES_TRACKED_MIN     (8)
+#define DEBUG_FRAMES_TRACKED_MAX     (8192)
+  u32 FramesTracked;
+
+#define DEBUG_SCOPE_EVENTS_PER_FRAME_DEFAULT (1u << 13) // 2M event rings at the default FramesTracked
+  u32 ScopeEventsPerFrame;
+  u32 ScopeEventsPerThread; // Worked out from the two above, a power of two
+
   render_entity_to_texture_group PickedChunksRenderGroup;
   // TODO(Jesse): Put this into some sort of debug_render struct such that
   // users of the library (externally) don't have to include all the rendering
@@ -188,12 +541,89 @@ struct debug_state
 
   volatile umm MinCycles; // span of start/end frame cycles
   volatile umm MaxCycles;
-#define DEBUG_FRAMES_TRACKED (128)
-  frame_stats Frames[DEBUG_FRAMES_TRACKED];
+  frame_stats *Frames; // FramesTracked of them
+
+  u32 FrameTickerTier;        // 0 is frames, otherwise HistoryTiers[FrameTickerTier-1]
+  u64 SelectedHistoryBucket;  // Bucket index +1 in that tier, 0 for none
+  debug_history_tier HistoryTiers[DEBUG_HISTORY_TIER_COUNT];
+
+  u32 CallgraphMode; // debug_callgraph_mode
+
+  u32 DiffBaselineIndex; // Frame slot +1 of the baseline picked off the ticker, 0 for none
+  debug_frame_diff *FrameDiff; // Allocated the first time one is asked for
+  debug_merged_tree MergedTree;
+
+  // NOTE(Jesse): A BDTR capture opened for viewing.  Only the selected frame
+  // is ever decoded; CaptureFrameMemory gets rewound for each one.
+  debug_capture *Capture;
+  memory_arena *CaptureFrameMemory;
+  debug_capture_frame *CaptureFrame;
+  u32 CaptureSelectedFrame; // Index +1, 0 for none
+  u32 CaptureFirstVisibleFrame;
 
   u32 ReadScopeIndex;
   s32 FreeScopeCount;
 
+  // NOTE(Jesse): Indexed by debug_scope_callsite::Id.  Index 0 is never handed
+  // out, the last index is where everything goes once we run out.
+  volatile u32 ScopeCallsiteLock;
+  u32 ScopeCallsiteCount;
+  memory_arena *ScopeCallsiteMemory;
+  debug_scope_callsite ScopeCallsites[MAX_DEBUG_SCOPE_CALLSITES];
+
+  // NOTE(Jesse): Also indexed by debug_scope_callsite::Id.  The masks are
+  // read by every thread on every scope, the rest is main-thread only.
+  volatile u16 ScopeCallsiteSampleMasks[MAX_DEBUG_SCOPE_CALLSITES];
+  debug_callsite_sampling ScopeCallsiteSampling[MAX_DEBUG_SCOPE_CALLSITES];
+
+  debug_profiler_overhead Overhead;
+  debug_timestamps Timestamps;
+
+  volatile u64 ScopeCallsiteBudgetCycles[MAX_DEBUG_SCOPE_CALLSITES];
+  debug_callsite_budget_stats ScopeCallsiteBudgetStats[MAX_DEBUG_SCOPE_CALLSITES];
+
+  u32 BudgetViolationCount;
+  u32 BudgetViolationsDropped;
+  u32 RecentBudgetViolationAt;
+  debug_budget_violation RecentBudgetViolations[DEBUG_RECENT_BUDGET_VIOLATIONS];
+
+  u32 PendingFlowCount;
+  u32 FlowsDropped;  // Summed over the per-thread rings
+  u32 FlowsEvicted;  // Never saw the other end
+  u32 FlowsRejected; // Pending table was full
+  debug_pending_flow PendingFlows[DEBUG_PENDING_FLOWS];
+
+  u32 RecentFlowLinkAt;
+  debug_flow_link RecentFlowLinks[DEBUG_RECENT_FLOW_LINKS];
+
+  umm ProfileScopeBudget;         // Bytes of debug_profile_scope per thread
+  u32 ProfileScopeOverflowPolicy; // debug_scope_overflow_policy
+
+  u32 ScopeCategoryMask; // Which categories get recorded at runtime
+
+  debug_trace_writer *TraceWriter; // Allocated the first time a capture starts
+
+  // NOTE(Jesse): Frame time goes in every frame, callsites when UpdateHistoryTiers
+  // gets to their frame.  Callsite stats are allocated the first time one is seen.
+  memory_arena *DurationArena;
+  u32 DurationWindowAt;
+  u32 DurationWindowFrames;
+  debug_duration_stats FrameDurations;
+  u32 FrameDurationExemplars[DEBUG_DURATION_HISTOGRAM_BUCKETS]; // Last FrameId to land in each bucket
+  debug_duration_stats *CallsiteDurations[MAX_DEBUG_SCOPE_CALLSITES];
+
+  debug_flight_recorder FlightRecorder;
+  debug_baseline_thresholds BaselineThresholds;
+  u8 ScopeCallsiteCaptureTriggers[MAX_DEBUG_SCOPE_CALLSITES]; // Named by FlightRecorder.ScopeTriggerName
+
+  // NOTE(Jesse): Sum of every threads counters as of the last frame
+  debug_thread_counters LastCounterTotals;
+  u64 LastContextSwitchTotal;
+
+  u32 FramesSinceSamplingUpdate;
+  volatile u32 SampledCallsiteCount;
+  volatile u16 SampledCallsites[MAX_SAMPLED_CALLSITES];
+
 #define REGISTERED_MEMORY_ARENA_COUNT (256)
   registered_memory_arena RegisteredMemoryArenas[REGISTERED_MEMORY_ARENA_COUNT];
 
@@ -206,72 +636,228 @@ struct debug_state
 #define GetDebugState() Global_DebugStatePointer
 global_variable debug_state *Global_DebugStatePointer;
 
-
-struct debug_timed_function
+// NOTE(Jesse): The write cursor for the calling thread.  Every module that
+// includes this header gets its own copy, so it gets filled in lazily, once
+// per thread per module, by asking the debug lib (see
+// FetchThreadLocalScopeEvents).  The debug lib fills in its own copy from
+// RegisterThread and BonsaiDebug_OnLoad.
+//
+// The rings themselves hang off the debug_state, which the loader owns, so a
+// cached pointer is still good after lib_debug_system gets reloaded.
+global_variable thread_local debug_scope_event_ring *ThreadLocal_ScopeEvents;
+
+inline debug_scope_event_ring *
+FetchThreadLocalScopeEvents()
 {
-  debug_profile_scope *Scope;
-  debug_scope_tree *Tree;
+  debug_scope_event_ring *Result = 0;
 
-  debug_timed_function(const char *Name)
+  debug_state *DebugState = GetDebugState();
+  if (DebugState && DebugState->GetWriteScopeEvents)
   {
-    this->Scope = 0;
-    this->Tree = 0;
+    Result = DebugState->GetWriteScopeEvents();
+    ThreadLocal_ScopeEvents = Result;
+  }
 
-    debug_state *DebugState = GetDebugState();
-    if (DebugState)
-    {
-      if (!DebugState->DebugDoScopeProfiling) return;
+  return Result;
+}
+
+// NOTE(Jesse): Once the cursor is cached and the callsite is registered this
+// is a thread_local load, a flag check, a counter bump and a store; no calls
+// through the debug_state.  Callsites that are being sampled only record
+// every (SampleMask+1)th call, but count every one.
+//
+// Returns the ring the matching EndTimedScope has to go to, or 0 if nothing
+// got recorded.
+inline debug_scope_event_ring *
+BeginTimedScope(debug_scope_callsite *Callsite, u32 *TimestampMode, u64 *StartingCycle)
+{
+  debug_scope_event_ring *Ring = ThreadLocal_ScopeEvents;
+  if (!Ring)
+  {
+    Ring = FetchThreadLocalScopeEvents();
+    if (!Ring) return 0;
+  }
 
-      ++DebugState->NumScopes;
+  if (!(Ring->EnabledCategories & (1u << Callsite->Category))) return 0;
 
-      this->Scope = DebugState->GetProfileScope();
-      this->Tree = DebugState->GetWriteScopeTree();
+  if (!Callsite->Id) { GetDebugState()->RegisterScopeCallsite(Callsite); }
 
-      if (this->Scope && this->Tree)
-      {
-        (*this->Tree->WriteScope) = this->Scope;
-        this->Tree->WriteScope = &this->Scope->Child;
+  u16 CallsiteId = Callsite->Id;
+  u32 CallIndex = Ring->CallCounts[CallsiteId]++;
+  u16 SampleMask = Ring->SampleMasks[CallsiteId];
+  if (CallIndex & SampleMask) return 0;
 
-        this->Scope->Parent = this->Tree->ParentOfNextScope;
-        this->Tree->ParentOfNextScope = this->Scope;
+  *TimestampMode = Ring->TimestampMode;
 
-        this->Scope->Name = Name;
-        this->Scope->StartingCycle = __rdtsc(); // Intentionally last
-      }
-    }
+  debug_scope_event *Event = ReserveScopeEvent(Ring);
+  Event->Type = ScopeEvent_Begin;
+  Event->CallsiteId = CallsiteId;
+  Event->SampleMask = SampleMask;
+  Event->Cycle = *StartingCycle = ReadBeginTimestamp(*TimestampMode); // Intentionally last
+
+  return Ring;
+}
+
+inline u64
+EndTimedScope(debug_scope_event_ring *Ring, u32 TimestampMode)
+{
+  u64 EndingCycle = ReadEndTimestamp(TimestampMode); // Intentionally first
+
+  debug_scope_event *Event = ReserveScopeEvent(Ring);
+  Event->Type = ScopeEvent_End;
+  Event->CallsiteId = 0;
+  Event->SampleMask = 0;
+  Event->Cycle = EndingCycle;
+
+  return EndingCycle;
+}
 
+struct debug_timed_function
+{
+  debug_scope_event_ring *Events;
+  u32 TimestampMode;
+
+  debug_timed_function(debug_scope_callsite *Callsite)
+  {
+    u64 StartingCycle;
+    this->Events = BeginTimedScope(Callsite, &this->TimestampMode, &StartingCycle);
     return;
   }
 
   ~debug_timed_function()
   {
-    debug_state *DebugState = GetDebugState();
-    if (DebugState)
-    {
-      if (!DebugState->DebugDoScopeProfiling) return;
-      if (!this->Scope) return;
+    // NOTE(Jesse): If we wrote a Begin we always write the matching End, even
+    // if profiling got toggled off in the meantime, otherwise the tree we
+    // rebuild from the events would be unbalanced.
+    if (!this->Events) return;
+
+    EndTimedScope(this->Events, this->TimestampMode);
+  }
+
+};
+
+inline void
+RecordScopePayload(debug_scope_event_ring *Ring, u64 Payload)
+{
+  debug_scope_event *Event = ReserveScopeEvent(Ring);
+  Event->Type = ScopeEvent_Payload;
+  Event->CallsiteId = 0;
+  Event->SampleMask = 0;
+  Event->Cycle = Payload;
+}
+
+// NOTE(Jesse): A timed scope that also records how many things it worked on,
+// so we can report cycles per item.  The payload goes in after the End event
+// so it's not part of the time measured.
+struct debug_counted_timed_function
+{
+  debug_scope_event_ring *Events;
+  u32 TimestampMode;
+  u64 Payload;
+
+  debug_counted_timed_function(debug_scope_callsite *Callsite, u64 Payload)
+  {
+    u64 StartingCycle;
+    this->Payload = Payload;
+    this->Events = BeginTimedScope(Callsite, &this->TimestampMode, &StartingCycle);
+    return;
+  }
 
-      this->Scope->EndingCycle = __rdtsc(); // Intentionally first;
+  ~debug_counted_timed_function()
+  {
+    if (!this->Events) return;
+
+    EndTimedScope(this->Events, this->TimestampMode);
+    RecordScopePayload(this->Events, this->Payload);
+  }
+
+};
+
+// NOTE(Jesse): Separate from debug_timed_function so plain scopes don't pay
+// for carrying a budget around.  Going over budget calls into the debug lib,
+// staying under it costs one compare.
+struct debug_budgeted_timed_function
+{
+  debug_scope_event_ring *Events;
+  u32 TimestampMode;
+  u16 CallsiteId;
+  u64 StartingCycle;
+  u64 BudgetCycles;
+
+  debug_budgeted_timed_function(debug_scope_callsite *Callsite)
+  {
+    this->Events = BeginTimedScope(Callsite, &this->TimestampMode, &this->StartingCycle);
+    if (this->Events)
+    {
+      this->CallsiteId = Callsite->Id;
+      this->BudgetCycles = this->Events->BudgetCycles[this->CallsiteId];
+    }
+    return;
+  }
 
-      Assert(this->Scope->EndingCycle > this->Scope->StartingCycle);
-      Assert(this->Scope->Parent != this->Scope);
-      Assert(this->Scope->Sibling != this->Scope);
-      Assert(this->Scope->Child != this->Scope);
+  ~debug_budgeted_timed_function()
+  {
+    if (!this->Events) return;
 
-      // 'Pop' the scope stack
-      this->Tree->WriteScope = &this->Scope->Sibling;
-      this->Tree->ParentOfNextScope = this->Scope->Parent;
+    u64 Cycles = EndTimedScope(this->Events, this->TimestampMode) - this->StartingCycle;
+    if (Cycles > this->BudgetCycles)
+    {
+      GetDebugState()->RecordBudgetViolation(this->CallsiteId, Cycles);
     }
   }
 
 };
 
-#define TIMED_FUNCTION() debug_timed_function FunctionTimer(__func__)
-#define TIMED_NAMED_BLOCK(BlockName) debug_timed_function BlockTimer1(BlockName)
+// NOTE(Jesse): What a scope turns into when its category isn't in
+// DEBUG_COMPILED_SCOPE_CATEGORIES.  Takes the same arguments and does nothing
+// with them, so the optimizer throws away the whole thing, callsite included.
+struct debug_null_timed_function
+{
+  template <typename... arg_types>
+  debug_null_timed_function(arg_types...) {}
+};
+
+template <bool Compiled, typename scope_type>
+struct debug_compiled_timed_function
+{
+  typedef scope_type type;
+};
+
+template <typename scope_type>
+struct debug_compiled_timed_function<false, scope_type>
+{
+  typedef debug_null_timed_function type;
+};
+
+#define DEBUG_TIMED_FUNCTION_TYPE(ScopeType, Category) debug_compiled_timed_function<DebugScopeCategoryCompiled(Category), ScopeType>::type
+
+#define DEBUG_SCOPE_CALLSITE(Var, ScopeName, Category) static debug_scope_callsite Var = { ScopeName, __FILE__, __LINE__, 0, 0, (u16)(Category) }
+#define DEBUG_SCOPE_CALLSITE_BUDGET(Var, ScopeName, Us, Category) static debug_scope_callsite Var = { ScopeName, __FILE__, __LINE__, (Us), 0, (u16)(Category) }
+
+// NOTE(Jesse): Every one of these takes an optional debug_scope_category as
+// its last argument.
+#define TIMED_FUNCTION(...) DEBUG_SCOPE_CALLSITE(FunctionTimer_Callsite, __func__, DebugScopeCategory(__VA_ARGS__)); DEBUG_TIMED_FUNCTION_TYPE(debug_timed_function, DebugScopeCategory(__VA_ARGS__)) FunctionTimer(&FunctionTimer_Callsite)
+#define TIMED_NAMED_BLOCK(BlockName, ...) DEBUG_SCOPE_CALLSITE(BlockTimer1_Callsite, BlockName, DebugScopeCategory(__VA_ARGS__)); DEBUG_TIMED_FUNCTION_TYPE(debug_timed_function, DebugScopeCategory(__VA_ARGS__)) BlockTimer1(&BlockTimer1_Callsite)
 
-#define TIMED_BLOCK(BlockName) { debug_timed_function BlockTimer0(BlockName)
+#define TIMED_BLOCK(BlockName, ...) { DEBUG_SCOPE_CALLSITE(BlockTimer0_Callsite, BlockName, DebugScopeCategory(__VA_ARGS__)); DEBUG_TIMED_FUNCTION_TYPE(debug_timed_function, DebugScopeCategory(__VA_ARGS__)) BlockTimer0(&BlockTimer0_Callsite)
+
+// NOTE(Jesse): Closed with END_BLOCK like TIMED_BLOCK.  Every time the block
+// takes longer than BudgetUs microseconds it gets logged to the Budget
+// Violations window.
+#define TIMED_BLOCK_BUDGET(BlockName, BudgetUs, ...) { DEBUG_SCOPE_CALLSITE_BUDGET(BlockTimer0_Callsite, BlockName, BudgetUs, DebugScopeCategory(__VA_ARGS__)); DEBUG_TIMED_FUNCTION_TYPE(debug_budgeted_timed_function, DebugScopeCategory(__VA_ARGS__)) BlockTimer0(&BlockTimer0_Callsite)
+
+// NOTE(Jesse): Closed with END_BLOCK.  ItemCount is evaluated once, when the
+// block is entered.
+#define TIMED_BLOCK_N(BlockName, ItemCount, ...) { DEBUG_SCOPE_CALLSITE(BlockTimer0_Callsite, BlockName, DebugScopeCategory(__VA_ARGS__)); DEBUG_TIMED_FUNCTION_TYPE(debug_counted_timed_function, DebugScopeCategory(__VA_ARGS__)) BlockTimer0(&BlockTimer0_Callsite, (u64)(ItemCount))
 #define END_BLOCK(BlockName) } do {} while (0)
 
+// NOTE(Jesse): Links the thread that queues a job to the one that runs it.
+// Call FLOW_BEGIN when the job gets submitted and FLOW_END, with the same
+// Id, as the worker starts on it.  Ids only have to be unique among the jobs
+// in flight.
+#define FLOW_BEGIN(Id) do {GetDebugState()->RecordFlowEvent((u64)(Id), FlowEvent_Begin);} while (false)
+#define FLOW_END(Id)   do {GetDebugState()->RecordFlowEvent((u64)(Id), FlowEvent_End);} while (false)
+
 #define DEBUG_VALUE_r32(Pointer) do {GetDebugState()->DebugValue_r32(Pointer, #Pointer);} while (false)
 #define DEBUG_VALUE_u32(Pointer) do {GetDebugState()->DebugValue_u32(Pointer, #Pointer);} while (false)
 
@@ -290,6 +876,50 @@ void DebugTimedMutexReleased(mutex *Mut);
 #define MAIN_THREAD_ADVANCE_DEBUG_SYSTEM(dt)               do {GetDebugState()->MainThreadAdvanceDebugSystem(dt);} while (false)
 #define WORKER_THREAD_ADVANCE_DEBUG_SYSTEM()               do {GetDebugState()->WorkerThreadAdvanceDebugSystem();} while (false)
 
+// NOTE(Jesse): Streams every frame to Path on a thread of its own until it's
+// stopped; see debug_trace_writer.cpp.  The Perfetto one writes a .pftrace
+// that ui.perfetto.dev opens directly; see debug_perfetto.cpp
+#define DEBUG_START_TRACE_CAPTURE(Path)                    do {GetDebugState()->StartTraceCapture(Path);} while (false)
+#define DEBUG_START_PERFETTO_CAPTURE(Path)                 do {GetDebugState()->StartPerfettoCapture(Path);} while (false)
+#define DEBUG_STOP_TRACE_CAPTURE()                         do {GetDebugState()->StopTraceCapture();} while (false)
+
+// NOTE(Jesse): Writes the frames around this one to a file of their own,
+// without stopping anything.  Frame spikes, slow scopes and SIGUSR1 do the
+// same when they're set up to; see debug_flight_recorder.
+#define DEBUG_CAPTURE(Reason)                              do {GetDebugState()->RequestCapture(Reason);} while (false)
+#define DEBUG_SET_CAPTURE_TRIGGERS(FrameMs, ScopeName, ScopeCycles, FramesBefore, FramesAfter) \
+  do {GetDebugState()->SetCaptureTriggers(FrameMs, ScopeName, ScopeCycles, FramesBefore, FramesAfter);} while (false)
+
+// NOTE(Jesse): SIGUSR1 captures, and a dump of the last frames on SIGSEGV,
+// SIGBUS, SIGFPE, SIGILL and SIGABRT before handing the signal on to whatever
+// was installed before.  Off unless this gets called.
+#define DEBUG_INSTALL_CRASH_HANDLERS()                     do {GetDebugState()->InstallCrashHandlers();} while (false)
+
+// NOTE(Jesse): Per-callsite duration histograms for the whole session.
+// DEBUG_COMPARE_TO_BASELINE is an expression, 0 if nothing regressed, 1 if
+// something did and 2 if the file couldn't be read, so a soak run can exit
+// with it.  MinChangeUs and the fraction both have to be exceeded, and the
+// shift has to be significant to MinZ, for a callsite to count.
+#define DEBUG_SAVE_BASELINE(Path)                          do {GetDebugState()->SaveBaseline(Path);} while (false)
+#define DEBUG_COMPARE_TO_BASELINE(Path)                    (GetDebugState()->CompareToBaseline(Path))
+#define DEBUG_SET_BASELINE_THRESHOLDS(MaxChange, MinZ, MinSamples, MinChangeUs) \
+  do {GetDebugState()->SetBaselineThresholds(MaxChange, MinZ, MinSamples, (MinChangeUs)*1000);} while (false)
+
+// NOTE(Jesse): Writes frames FirstFrameId through LastFrameId out as Chrome
+// trace JSON, for chrome://tracing or ui.perfetto.dev.  0, 0 is every frame
+// still in the ring.  Call it from the main thread.
+#define DEBUG_EXPORT_CHROME_TRACE(Path, FirstFrameId, LastFrameId) \
+  do {GetDebugState()->ExportChromeTrace(Path, FirstFrameId, LastFrameId);} while (false)
+
+// NOTE(Jesse): Same frames, as collapsed stacks for flamegraph.pl and as a
+// speedscope profile per thread.  Either path can be 0.
+#define DEBUG_EXPORT_FLAME_GRAPH(FoldedPath, SpeedscopePath, FirstFrameId, LastFrameId) \
+  do {GetDebugState()->ExportFlameGraph(FoldedPath, SpeedscopePath, FirstFrameId, LastFrameId);} while (false)
+
+// NOTE(Jesse): Maps a BDTR capture and shows it in the Capture window.  Works
+// on anything StartTraceCapture wrote, from this process or not.
+#define DEBUG_OPEN_CAPTURE(Path) (GetDebugState()->OpenCaptureFile(Path))
+
 #define DEBUG_CLEAR_MEMORY_RECORDS_FOR(Arena)                do {GetDebugState()->ClearMemoryRecordsFor(Arena);} while (false)
 #define DEBUG_TRACK_DRAW_CALL(CallingFunction, VertCount)  do {GetDebugState()->TrackDrawCall(CallingFunction, VertCount);} while (false)
 
@@ -307,6 +937,7 @@ struct bonsai_debug_api
   query_memory_requirements_proc QueryMemoryRequirements;
   init_debug_system_proc         InitDebugState;
   patch_debug_lib_pointers_proc  BonsaiDebug_OnLoad;
+  unload_debug_lib_proc          BonsaiDebug_OnUnload; // Call before closing the lib to reload it
 };
 
 global_variable r64 Global_LastDebugTime = 0;
@@ -332,11 +963,14 @@ InitializeBootstrapDebugApi(shared_lib DebugLib, bonsai_debug_api *Api)
   Api->BonsaiDebug_OnLoad = (patch_debug_lib_pointers_proc)GetProcFromLib(DebugLib, "BonsaiDebug_OnLoad");
   Result &= (Api->InitDebugState != 0);
 
+  Api->BonsaiDebug_OnUnload = (unload_debug_lib_proc)GetProcFromLib(DebugLib, "BonsaiDebug_OnUnload");
+  Result &= (Api->BonsaiDebug_OnUnload != 0);
+
   return Result;
 }
 
 shared_lib
-InitializeBonsaiDebug(const char* DebugLibName, thread_local_state *ThreadStates)
+InitializeBonsaiDebug(const char* DebugLibName, thread_local_state *ThreadStates, u32 FramesTracked = DEBUG_FRAMES_TRACKED_DEFAULT, u32 ScopeEventsPerFrame = DEBUG_SCOPE_EVENTS_PER_FRAME_DEFAULT)
 {
   shared_lib DebugLib = OpenLibrary(DebugLibName); //, RTLD_NOW);
 
@@ -351,6 +985,8 @@ InitializeBonsaiDebug(const char* DebugLibName, thread_local_state *ThreadStates
       Global_DebugStatePointer = (debug_state*)calloc(BytesRequested, 1);
 
       DebugApi.BonsaiDebug_OnLoad(Global_DebugStatePointer, ThreadStates);
+      Global_DebugStatePointer->FramesTracked = FramesTracked;
+      Global_DebugStatePointer->ScopeEventsPerFrame = ScopeEventsPerFrame;
 
       if (DebugApi.InitDebugState(Global_DebugStatePointer, BytesRequested))
       {
@@ -376,8 +1012,28 @@ InitializeBonsaiDebug(const char* DebugLibName, thread_local_state *ThreadStates
 #define TIMED_NAMED_BLOCK(...)
 
 #define TIMED_BLOCK(...)
+#define TIMED_BLOCK_BUDGET(...)
+#define TIMED_BLOCK_N(...)
 #define END_BLOCK(...)
 
+#define FLOW_BEGIN(...)
+#define FLOW_END(...)
+
+#define DEBUG_START_TRACE_CAPTURE(...)
+#define DEBUG_START_PERFETTO_CAPTURE(...)
+#define DEBUG_STOP_TRACE_CAPTURE(...)
+#define DEBUG_CAPTURE(...)
+#define DEBUG_SET_CAPTURE_TRIGGERS(...)
+#define DEBUG_INSTALL_CRASH_HANDLERS(...)
+
+#define DEBUG_SAVE_BASELINE(...)
+#define DEBUG_COMPARE_TO_BASELINE(...) (0)
+#define DEBUG_SET_BASELINE_THRESHOLDS(...)
+
+#define DEBUG_EXPORT_CHROME_TRACE(...)
+#define DEBUG_EXPORT_FLAME_GRAPH(...)
+#define DEBUG_OPEN_CAPTURE(...) (0)
+
 #define DEBUG_VALUE(...)
 
 #define TIMED_MUTEX_WAITING(...)
@@ -175,7 +175,7 @@ ETWBufferCallback( EVENT_TRACE_LOGFILEA *Logfile )
     debug_scope_tree *ReadTree = ThreadState->ScopeTrees + SharedState->ReadScopeIndex;
     if (MainThreadReadTree->FrameRecorded == ReadTree->FrameRecorded)
     {
-      debug_timed_function BlockTimer2("Push Scope Bars");
+      TIMED_NAMED_BLOCK("Push Scope Bars");
       PushScopeBarsRecursive(Group, ReadTree->Root, &FrameCycles, TotalGraphWidth, &Entropy);
     }
     PushNewRow(Group);
@@ -205,6 +205,7 @@ PushContextSwitch(debug_context_switch_event_buffer_stream *Stream, debug_contex
   if (BufferHasRoomFor(&CurrentBlock->Buffer, 1))
   {
     CurrentBlock->Buffer.Events[CurrentBlock->Buffer.At++] = *Evt;
+    Stream->Ingested++;
   }
   else
   {
@@ -314,6 +315,7 @@ ETWEventCallback(EVENT_RECORD *Event)
             /* if (LastCSwitchEvt) { Assert(LastCSwitchEvt->CycleCount < CSwitch.CycleCount); } */
             /* if (LastCSwitchEvt) { Assert(LastCSwitchEvt->Type != CSwitch.Type); } */
             PushContextSwitch(TS->ContextSwitches, &CSwitch);
+            PushTraceContextSwitch(DebugState, ThreadIndex, &CSwitch);
           }
         }
       }